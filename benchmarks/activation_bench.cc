@@ -0,0 +1,52 @@
+// Activation throughput: libm through apply() against the vectorized math
+// kernels, in millions of elements per second.
+//
+//   bazel run -c opt //benchmarks:activation_bench [elements]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "tensor.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double melems_per_second(F&& f, size_t n) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{0};
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed.count() < 0.5);
+  return static_cast<double>(n) * reps / elapsed.count() / 1e6;
+}
+
+int main(int argc, char** argv) {
+  const uint32_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+  Tensor<float> x(TensorType::Matrix, {1, n});
+  std::vector<float> values(n);
+  for (uint32_t i = 0; i < n; i++) {
+    values[i] = -8.0f + 16.0f * i / n;
+  }
+  x.fill(values);
+
+  std::printf("%10s %14s %14s %8s   (%u elements, %s)\n", "function", "libm Melem/s", "vector Melem/s", "speedup", n,
+              kernels::isa_name(kernels::active_isa()));
+
+  auto row = [&](const char* name, auto libm, auto vectorized) {
+    const double a = melems_per_second([&] { Tensor<float> y = x.apply(libm); }, n);
+    const double b = melems_per_second([&] { Tensor<float> y = vectorized(); }, n);
+    std::printf("%10s %14.1f %14.1f %7.1fx\n", name, a, b, b / a);
+  };
+
+  row("exp", [](float v) { return std::exp(v); }, [&] { return x.exp(); });
+  row("log", [](float v) { return std::log(v + 9.0f); }, [&] { return Tensor<float>(expr::log(x.lazy() + 9.0f)); });
+  row("tanh", [](float v) { return std::tanh(v); }, [&] { return x.tanh(); });
+  row("sigmoid", [](float v) { return 1.0f / (1.0f + std::exp(-v)); }, [&] { return x.sigmoid(); });
+  row("relu", [](float v) { return std::max(v, 0.0f); }, [&] { return Tensor<float>(max(x.lazy(), 0.0f)); });
+  return 0;
+}
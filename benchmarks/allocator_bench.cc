@@ -0,0 +1,59 @@
+// Cost of creating and dropping a tensor per allocator, for a few buffer
+// sizes. Buffers are zero-filled on allocation, so large sizes converge.
+//
+//   bazel run -c opt //benchmarks:allocator_bench
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "allocator.hh"
+#include "tensor.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double ns_per_call(F&& f) {
+  const size_t reps = 20000;
+  f();
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t r = 0; r < reps; r++) {
+    f();
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / reps;
+}
+
+int main() {
+  const std::vector<uint32_t> sizes = {16, 256, 4096, 65536, 1 << 20};
+  auto system = std::make_shared<SystemAllocator>();
+  auto caching = std::shared_ptr<Allocator>(&CachingAllocator::instance(), [](Allocator*) {});
+  auto arena = std::make_shared<Arena>(size_t(64) << 20);
+
+  std::printf("%10s %12s %12s %12s\n", "elements", "system ns", "caching ns", "arena ns");
+  for (uint32_t n : sizes) {
+    const auto make = [n] { Tensor<float> t(TensorType::Matrix, {1, n}); };
+    double system_ns, caching_ns, arena_ns;
+    {
+      AllocatorScope scope(system);
+      system_ns = ns_per_call(make);
+    }
+    {
+      AllocatorScope scope(caching);
+      caching_ns = ns_per_call(make);
+    }
+    {
+      AllocatorScope scope(arena);
+      arena_ns = ns_per_call([&] {
+        make();
+        arena->reset();
+      });
+    }
+    std::printf("%10u %12.1f %12.1f %12.1f\n", n, system_ns, caching_ns, arena_ns);
+  }
+
+  const AllocatorStats stats = CachingAllocator::instance().stats();
+  std::printf("caching allocator: %llu allocations, %llu cache hits, peak %llu bytes\n",
+              static_cast<unsigned long long>(stats.allocations), static_cast<unsigned long long>(stats.cache_hits),
+              static_cast<unsigned long long>(stats.peak_bytes));
+  return 0;
+}
@@ -0,0 +1,67 @@
+// Batched matmul of (C, R, K) x (C, K, N) against the chip-and-loop idiom
+// it replaces (one a.chip(c, 0).matmul(b.chip(c, 0)) per channel), and of
+// (C, R, K) x (K, N) with a weight shared by every channel.
+//
+//   bazel run -c opt //benchmarks:batched_matmul_bench
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "tensor.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5 || reps < 3);
+  return elapsed / reps;
+}
+
+static Tensor<float> filled(const std::vector<uint32_t>& shape, float value) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  t.fill(value);
+  return t;
+}
+
+struct Case {
+  uint32_t c, r, k, n;
+  bool shared;
+};
+
+int main() {
+  const std::vector<Case> cases = {
+      {256, 16, 16, 16, false}, {64, 64, 64, 64, false},    {8, 256, 256, 256, false},
+      {256, 16, 16, 16, true},  {64, 64, 64, 64, true},     {8, 256, 256, 256, true},
+  };
+
+  std::printf("%-28s %12s %12s %10s %10s\n", "shape", "loop ms", "batched ms", "GFLOP/s", "speedup");
+  for (const Case& s : cases) {
+    const Tensor<float> a = filled({s.c, s.r, s.k}, 0.5f);
+    const Tensor<float> b = s.shared ? filled({s.k, s.n}, 0.25f) : filled({s.c, s.k, s.n}, 0.25f);
+    Tensor<float> out(0.0f);
+
+    const double loop = seconds_per_call([&] {
+      std::vector<Tensor<float>> results;
+      results.reserve(s.c);
+      for (uint32_t c = 0; c < s.c; c++) {
+        results.push_back(a.chip(c, 0).matmul(s.shared ? b : b.chip(c, 0)));
+      }
+    });
+    const double batched = seconds_per_call([&] { a.matmul(b, out); });
+
+    char shape[64];
+    std::snprintf(shape, sizeof(shape), "%ux%ux%u x %s%ux%u", s.c, s.r, s.k, s.shared ? "" : "C x ", s.k, s.n);
+    const double flops = 2.0 * s.c * s.r * s.k * s.n;
+    std::printf("%-28s %12.3f %12.3f %10.1f %9.2fx\n", shape, loop * 1e3, batched * 1e3, flops / batched * 1e-9,
+                loop / batched);
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+// Peak activation memory and step time of deep MLPs (MatMul, then Tanh or
+// Sigmoid, per layer) trained with every activation kept and with
+// checkpoints chosen by Executor::checkpoint_by_budget().
+//
+//   bazel run -c opt //benchmarks:checkpoint_bench
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "graph.hh"
+
+using namespace upsilon;
+
+static Tensor<float> pattern(const std::vector<uint32_t>& shape, float scale) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> v(t.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    v[i] = scale * (0.01f * static_cast<float>((i * 37) % 201) - 1.0f);
+  }
+  t.fill(v);
+  return t;
+}
+
+static std::shared_ptr<Op> mlp(uint32_t batch, uint32_t width, int layers) {
+  std::shared_ptr<Op> h = std::make_shared<Variable>(pattern({batch, width}, 1.0f));
+  for (int l = 0; l < layers; l++) {
+    auto w = std::make_shared<Variable>(pattern({width, width}, 1.0f / width));
+    const auto z = std::make_shared<MatMul>(h, w);
+    h = l % 2 == 0 ? std::shared_ptr<Op>(std::make_shared<Tanh>(z)) : std::make_shared<Sigmoid>(z);
+  }
+  return std::make_shared<Mean>(std::make_shared<Mean>(h, 1), 0);
+}
+
+static double seconds_per_call(const std::function<void()>& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5 || reps < 3);
+  return elapsed / reps;
+}
+
+int main() {
+  const uint32_t batch = 512, width = 256;
+  auto& allocator = CachingAllocator::instance();
+  std::printf("%-16s %12s %8s %10s %10s %10s\n", "mlp 512x256", "mode", "ckpts", "act MB", "step ms", "compute");
+  for (int layers : {16, 64, 256}) {
+    double base = 0;
+    for (bool checkpointing : {false, true}) {
+      std::shared_ptr<Op> loss = mlp(batch, width, layers);
+      const uint64_t weights = allocator.stats().bytes_in_use;
+      Executor executor(loss);
+      const size_t checkpoints = checkpointing ? executor.checkpoint_by_budget().size() : 0;
+      const double t = seconds_per_call([&] { executor.step(); });
+      // What the executor holds at the peak of a step besides the parameter
+      // gradients: kept outputs, their gradients and the segment being
+      // recomputed.
+      allocator.reset_stats();
+      executor.step();
+      uint64_t params = 0;
+      for (const auto& op : executor.graph().order()) {
+        if (dynamic_cast<const Variable*>(op.get()) != nullptr) {
+          params += op->grad.size() * sizeof(float);
+        }
+      }
+      const double peak = static_cast<double>(allocator.stats().peak_bytes - weights - params) / (1 << 20);
+      base = checkpointing ? base : t;
+      std::printf("%-16d %12s %8zu %10.1f %10.2f %9.2fx\n", layers, checkpointing ? "checkpoint" : "keep all",
+                  checkpoints, peak, t * 1e3, t / base);
+    }
+  }
+  return 0;
+}
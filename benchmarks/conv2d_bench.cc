@@ -0,0 +1,101 @@
+// Conv2D (im2col + packed GEMM, padding applied while unrolling) on ResNet
+// layer shapes at batch 1, against the pad-then-loop convolution it replaces:
+// Tensor::padding() into a new buffer followed by a direct loop nest.
+//
+//   bazel run -c opt //benchmarks:conv2d_bench
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "graph.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5 || reps < 3);
+  return elapsed / reps;
+}
+
+static Tensor<float> filled(const std::vector<uint32_t>& shape, float value) {
+  Tensor<float> t(TensorType::Tensor, shape);
+  t.fill(value);
+  return t;
+}
+
+// The old way: pad a copy of the image, then loop over every tap.
+static Tensor<float> pad_and_loop(const Tensor<float>& image, const Tensor<float>& weights, uint32_t stride,
+                                  uint32_t pad) {
+  Tensor<float> padded = image;
+  padded.padding({pad, pad, pad, pad}, 0.0f);
+  const std::vector<uint32_t> xs = padded.shape(), ws = weights.shape();
+  const uint32_t oh = (xs[1] - ws[2]) / stride + 1, ow = (xs[2] - ws[3]) / stride + 1;
+  Tensor<float> out(TensorType::Tensor, {ws[0], oh, ow});
+  const float* in = padded.data().data();
+  const float* w = weights.data().data();
+  float* y = out.mutable_data().data();
+  for (uint32_t o = 0; o < ws[0]; o++) {
+    for (uint32_t i = 0; i < oh; i++) {
+      for (uint32_t j = 0; j < ow; j++) {
+        float sum = 0.0f;
+        for (uint32_t c = 0; c < ws[1]; c++) {
+          for (uint32_t ki = 0; ki < ws[2]; ki++) {
+            const float* row = in + (size_t(c) * xs[1] + i * stride + ki) * xs[2] + j * stride;
+            const float* taps = w + ((size_t(o) * ws[1] + c) * ws[2] + ki) * ws[3];
+            for (uint32_t kj = 0; kj < ws[3]; kj++) {
+              sum += row[kj] * taps[kj];
+            }
+          }
+        }
+        y[(size_t(o) * oh + i) * ow + j] = sum;
+      }
+    }
+  }
+  return out;
+}
+
+struct Layer {
+  const char* name;
+  uint32_t channels, size, out_channels, kernel, stride, pad;
+};
+
+int main() {
+  const std::vector<Layer> layers = {
+      {"conv1 7x7/2", 3, 224, 64, 7, 2, 3},     {"conv2_x 3x3", 64, 56, 64, 3, 1, 1},
+      {"conv3_1 3x3/2", 64, 56, 128, 3, 2, 1},  {"conv3_x 3x3", 128, 28, 128, 3, 1, 1},
+      {"conv4_x 3x3", 256, 14, 256, 3, 1, 1},   {"conv5_x 3x3", 512, 7, 512, 3, 1, 1},
+      {"bottleneck 1x1", 256, 56, 64, 1, 1, 0}, {"expand 1x1", 64, 56, 256, 1, 1, 0},
+  };
+
+  std::printf("%-16s %10s %10s %10s %10s %10s\n", "layer", "loop ms", "fwd ms", "fwd GF/s", "bwd ms", "speedup");
+  for (const Layer& l : layers) {
+    auto x = std::make_shared<Variable>(filled({l.channels, l.size, l.size}, 0.5f));
+    auto w = std::make_shared<Variable>(filled({l.out_channels, l.channels, l.kernel, l.kernel}, 0.01f));
+    Conv2DOptions options;
+    options.stride_h = options.stride_w = l.stride;
+    options.pad_h = options.pad_w = l.pad;
+    auto y = std::make_shared<Conv2D>(x, w, options);
+    y->forward();
+    y->grad = Tensor<float>::zeros_like(y->output).fill_(1.0f);
+    x->grad = Tensor<float>::zeros_like(x->output);
+    w->grad = Tensor<float>::zeros_like(w->output);
+
+    const double loop = seconds_per_call([&] { pad_and_loop(x->output, w->output, l.stride, l.pad); });
+    const double forward = seconds_per_call([&] { y->forward(); });
+    const double backward = seconds_per_call([&] { y->backward(); });
+    const std::vector<uint32_t> out = y->output.shape();
+    const double flops = 2.0 * out[0] * out[1] * out[2] * l.channels * l.kernel * l.kernel;
+    std::printf("%-16s %10.3f %10.3f %10.1f %10.3f %9.1fx\n", l.name, loop * 1e3, forward * 1e3,
+                flops / forward * 1e-9, backward * 1e3, loop / forward);
+  }
+  return 0;
+}
@@ -0,0 +1,100 @@
+// Forward time of every Conv2D kernel that fits a layer shape:
+// im2col + GEMM, Winograd F(2x2, 3x3) and F(4x4, 3x3), and the direct
+// depthwise kernel. "best" is the fastest, "auto" is what conv::select()
+// picks when the algorithm is left to Conv2D.
+//
+//   bazel run -c opt //benchmarks:conv_kernels_bench
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "graph.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.3 || reps < 3);
+  return elapsed / reps;
+}
+
+static Tensor<float> filled(const std::vector<uint32_t>& shape, float value) {
+  Tensor<float> t(TensorType::Tensor, shape);
+  t.fill(value);
+  return t;
+}
+
+struct Layer {
+  const char* name;
+  uint32_t batch, channels, size, out_channels, kernel, stride, groups;
+};
+
+int main() {
+  const std::vector<Layer> layers = {
+      {"resnet 64@56", 1, 64, 56, 64, 3, 1, 1},
+      {"resnet 128@28", 1, 128, 28, 128, 3, 1, 1},
+      {"resnet 256@14", 1, 256, 14, 256, 3, 1, 1},
+      {"resnet 512@7", 1, 512, 7, 512, 3, 1, 1},
+      {"resnet 256@14 x8", 8, 256, 14, 256, 3, 1, 1},
+      {"resnet 512@7 x8", 8, 512, 7, 512, 3, 1, 1},
+      {"vgg 64@224", 1, 64, 224, 64, 3, 1, 1},
+      {"rgb 3@224", 1, 3, 224, 32, 3, 1, 1},
+      {"narrow 16@112", 1, 16, 112, 16, 3, 1, 1},
+      {"narrow 8@112", 1, 8, 112, 8, 3, 1, 1},
+      {"strided 64@56/2", 1, 64, 56, 128, 3, 2, 1},
+      {"mobilenet dw 32@112", 1, 32, 112, 32, 3, 1, 32},
+      {"mobilenet dw 144@56", 1, 144, 56, 144, 3, 1, 144},
+      {"mobilenet dw 144@56/2", 1, 144, 56, 144, 3, 2, 144},
+      {"mobilenet dw 576@14", 1, 576, 14, 576, 3, 1, 576},
+      {"mobilenet dw 960@7", 1, 960, 7, 960, 3, 1, 960},
+  };
+  const std::vector<ConvAlgorithm> algorithms = {ConvAlgorithm::Im2col, ConvAlgorithm::Winograd2x2,
+                                                 ConvAlgorithm::Winograd4x4, ConvAlgorithm::Direct};
+
+  std::printf("%-24s", "layer (ms)");
+  for (ConvAlgorithm a : algorithms) {
+    std::printf(" %12s", algorithm_name(a));
+  }
+  std::printf(" %12s %12s\n", "best", "auto");
+  for (const Layer& l : layers) {
+    auto x = std::make_shared<Variable>(filled({l.batch, l.channels, l.size, l.size}, 0.5f));
+    auto w = std::make_shared<Variable>(filled({l.out_channels, l.channels / l.groups, l.kernel, l.kernel}, 0.01f));
+    Conv2DOptions options;
+    options.stride_h = options.stride_w = l.stride;
+    options.pad_h = options.pad_w = l.kernel / 2;
+    options.groups = l.groups;
+
+    std::printf("%-24s", l.name);
+    double best = 0;
+    ConvAlgorithm winner = ConvAlgorithm::Auto;
+    for (ConvAlgorithm a : algorithms) {
+      options.algorithm = a;
+      auto y = std::make_shared<Conv2D>(x, w, options);
+      try {
+        y->forward();
+      } catch (const std::invalid_argument&) {
+        std::printf(" %12s", "-");
+        continue;
+      }
+      const double t = seconds_per_call([&] { y->forward(); });
+      std::printf(" %12.3f", t * 1e3);
+      if (winner == ConvAlgorithm::Auto || t < best) {
+        best = t;
+        winner = a;
+      }
+    }
+    options.algorithm = ConvAlgorithm::Auto;
+    const conv::Geometry g = conv::geometry(l.channels, l.size, l.size, w->output.shape(), options, l.batch);
+    std::printf(" %12s %12s\n", algorithm_name(winner), algorithm_name(g.algorithm));
+  }
+  return 0;
+}
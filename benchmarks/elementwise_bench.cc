@@ -0,0 +1,70 @@
+// Elementwise add throughput per instruction set, in GB/s of memory traffic
+// (two reads and one write per element), next to memcpy as a stand-in for
+// the machine's memory bandwidth.
+//
+//   bazel run -c opt //benchmarks:elementwise_bench [max_elements]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "kernels.hh"
+#include "tensor.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f, size_t bytes) {
+  // Enough repetitions to touch ~2 GB, but at least 3.
+  const size_t reps = std::max<size_t>(3, (size_t(2) << 30) / std::max<size_t>(bytes, 1));
+  f();
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t r = 0; r < reps; r++) {
+    f();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / reps;
+}
+
+int main(int argc, char** argv) {
+  const size_t max_n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+  const kernels::Isa isas[] = {kernels::Isa::Scalar, kernels::Isa::SSE, kernels::Isa::AVX2, kernels::Isa::AVX512};
+
+  std::printf("%12s %10s", "elements", "memcpy");
+  for (auto isa : isas) {
+    if (static_cast<int>(isa) <= static_cast<int>(kernels::supported_isa())) {
+      std::printf(" %10s", kernels::isa_name(isa));
+    }
+  }
+  std::printf(" %12s %8s\n", "Tensor::add", "% bw");
+
+  for (size_t n = 1000; n <= max_n; n *= 10) {
+    std::vector<float> a(n, 1.f), b(n, 2.f), out(n);
+    const double traffic = 3.0 * n * sizeof(float);
+
+    const double copy = seconds_per_call([&] { std::memcpy(out.data(), a.data(), n * sizeof(float)); }, 2 * n * sizeof(float));
+    const double bandwidth = 2.0 * n * sizeof(float) / copy / 1e9;
+    std::printf("%12zu %10.2f", n, bandwidth);
+
+    for (auto isa : isas) {
+      if (static_cast<int>(isa) > static_cast<int>(kernels::supported_isa())) {
+        continue;
+      }
+      kernels::set_isa(isa);
+      const double t = seconds_per_call([&] { kernels::binary(kernels::BinaryOp::Add, a.data(), b.data(), out.data(), n); },
+                                        3 * n * sizeof(float));
+      std::printf(" %10.2f", traffic / t / 1e9);
+    }
+    kernels::set_isa(kernels::supported_isa());
+
+    Tensor<float> x(TensorType::Matrix, {1, static_cast<uint32_t>(n)});
+    Tensor<float> y(TensorType::Matrix, {1, static_cast<uint32_t>(n)});
+    x.fill(1.f);
+    y.fill(2.f);
+    const double t = seconds_per_call([&] { Tensor<float> z = x.add(y); }, 3 * n * sizeof(float));
+    const double gbps = traffic / t / 1e9;
+    std::printf(" %12.2f %7.0f%%\n", gbps, 100.0 * gbps / bandwidth);
+  }
+
+  return 0;
+}
@@ -0,0 +1,35 @@
+// Per-op overhead of Executor::forward() and backward() on a long chain of
+// scalar Adds, where the arithmetic is negligible next to the bookkeeping.
+//
+//   bazel run -c opt //benchmarks:executor_bench
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include "graph.hh"
+
+using namespace upsilon;
+
+int main() {
+  std::printf("%-10s %14s %14s\n", "depth", "forward ns/op", "backward ns/op");
+  for (size_t depth : {1000, 10000, 100000}) {
+    auto x = std::make_shared<Variable>(Tensor<float>(1.0f));
+    std::shared_ptr<Op> y = x;
+    for (size_t i = 0; i < depth; ++i) {
+      y = std::make_shared<Add>(y, x);
+    }
+    Executor executor(y);
+    executor.step();
+
+    // Best of several steps, so that one slow step does not skew the result.
+    double forward = 0, backward = 0;
+    for (int rep = 0; rep < 5; rep++) {
+      const double f = executor.forward().ns_per_op();
+      const double b = executor.backward().ns_per_op();
+      forward = rep == 0 ? f : std::min(forward, f);
+      backward = rep == 0 ? b : std::min(backward, b);
+    }
+    std::printf("%-10zu %14.1f %14.1f\n", depth, forward, backward);
+  }
+  return 0;
+}
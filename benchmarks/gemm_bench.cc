@@ -0,0 +1,78 @@
+// In-tree GEMM (gemm.hh) against Eigen's product on the shapes the framework
+// produces: square products, MLP layers and their transposed backward
+// products, and the small or skinny ones (batched heads, matrix-vector) that
+// skip packing. Prints the tuned config first.
+//
+//   bazel run -c opt //benchmarks:gemm_bench
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <Eigen/Dense>
+#include "gemm.hh"
+
+using namespace upsilon;
+
+using RowMatrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5 || reps < 3);
+  return elapsed / reps;
+}
+
+struct Shape {
+  const char* name;
+  size_t m, n, k;
+  bool ta, tb;
+};
+
+int main() {
+  const gemm::Config config = gemm::config();
+  std::printf("isa %s, tile %ux%u, mc %u kc %u nc %u, %zu threads\n", kernels::isa_name(kernels::active_isa()),
+              config.mr, config.nr, config.mc, config.kc, config.nc, num_threads());
+
+  const std::vector<Shape> shapes = {
+      {"square 128", 128, 128, 128, false, false},   {"square 512", 512, 512, 512, false, false},
+      {"square 1024", 1024, 1024, 1024, false, false}, {"mlp fwd 64x784x256", 64, 256, 784, false, false},
+      {"mlp dW  A^T*B", 784, 256, 64, true, false},   {"mlp dX  A*B^T", 64, 784, 256, false, true},
+      {"tall 4096x64x64", 4096, 64, 64, false, false}, {"conv 64x3136x576", 64, 3136, 576, false, false},
+      {"square 16", 16, 16, 16, false, false},         {"square 32", 32, 32, 32, false, false},
+      {"square 64", 64, 64, 64, false, false},         {"batch 8x256x256", 8, 256, 256, false, false},
+      {"batch 4x512x128 B^T", 4, 512, 128, false, true}, {"gemv 1x1024x1024", 1, 1024, 1024, false, false},
+      {"col 256x1x256", 256, 1, 256, false, false},    {"narrow 512x4x512", 512, 4, 512, false, false},
+      {"small dW 32x16x8 A^T", 32, 16, 8, true, false},
+  };
+
+  std::printf("%-22s %12s %12s %10s\n", "shape", "Eigen GF/s", "gemm GF/s", "speedup");
+  for (const Shape& s : shapes) {
+    const RowMatrix a = RowMatrix::Random(s.ta ? s.k : s.m, s.ta ? s.m : s.k);
+    const RowMatrix b = RowMatrix::Random(s.tb ? s.n : s.k, s.tb ? s.k : s.n);
+    RowMatrix c(s.m, s.n);
+
+    const double eigen = seconds_per_call([&] {
+      if (s.ta) {
+        c.noalias() = a.transpose() * b;
+      } else if (s.tb) {
+        c.noalias() = a * b.transpose();
+      } else {
+        c.noalias() = a * b;
+      }
+    });
+    const double ours = seconds_per_call([&] {
+      gemm::sgemm(s.ta ? gemm::Trans::Yes : gemm::Trans::No, s.tb ? gemm::Trans::Yes : gemm::Trans::No, s.m, s.n,
+                  s.k, 1.0f, a.data(), a.cols(), b.data(), b.cols(), 0.0f, c.data(), s.n);
+    });
+    const double flops = 2.0 * s.m * s.n * s.k;
+    std::printf("%-22s %12.1f %12.1f %9.2fx\n", s.name, flops / eigen * 1e-9, flops / ours * 1e-9, eigen / ours);
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+// Peak memory and time of a forward pass of an MLP and a conv net run as in
+// training (every activation kept) and inside a NoGradScope.
+//
+//   bazel run -c opt //benchmarks:inference_bench
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "graph.hh"
+
+using namespace upsilon;
+
+static Tensor<float> pattern(const std::vector<uint32_t>& shape, float scale) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> v(t.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    v[i] = scale * (0.01f * static_cast<float>((i * 37) % 201) - 1.0f);
+  }
+  t.fill(v);
+  return t;
+}
+
+static std::shared_ptr<Op> mlp(uint32_t batch, uint32_t width, int layers) {
+  std::shared_ptr<Op> h = std::make_shared<Variable>(pattern({batch, width}, 1.0f));
+  for (int l = 0; l < layers; l++) {
+    auto w = std::make_shared<Variable>(pattern({width, width}, 1.0f / width));
+    const auto z = std::make_shared<MatMul>(h, w);
+    h = l % 2 == 0 ? std::shared_ptr<Op>(std::make_shared<ReLU>(z)) : std::make_shared<Sigmoid>(z);
+  }
+  return std::make_shared<Softmax>(h);
+}
+
+static std::shared_ptr<Op> convnet(uint32_t batch) {
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  std::shared_ptr<Op> h = std::make_shared<Variable>(pattern({batch, 16, 32, 32}, 1.0f));
+  for (int l = 0; l < 8; l++) {
+    auto w = std::make_shared<Variable>(pattern({16, 16, 3, 3}, 0.05f));
+    h = std::make_shared<ReLU>(std::make_shared<Conv2D>(h, w, same));
+  }
+  return std::make_shared<GlobalAvgPool>(h);
+}
+
+static double seconds_per_call(const std::function<void()>& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.3 || reps < 3);
+  return elapsed / reps;
+}
+
+int main() {
+  const std::vector<std::pair<const char*, std::function<std::shared_ptr<Op>()>>> nets = {
+      {"mlp 256x1024 x16", [] { return mlp(256, 1024, 16); }},
+      {"conv 8x16x32x32 x8", [] { return convnet(8); }},
+  };
+  auto& allocator = CachingAllocator::instance();
+
+  std::printf("%-20s %8s %10s %10s %10s\n", "net", "mode", "peak MB", "fwd ms", "speedup");
+  for (const auto& [name, build] : nets) {
+    double base = 0;
+    for (bool inference : {false, true}) {
+      std::unique_ptr<NoGradScope> no_grad;
+      if (inference) {
+        no_grad = std::make_unique<NoGradScope>();
+      }
+      Executor executor(build());
+      const uint64_t weights = allocator.stats().bytes_in_use;
+      const double t = seconds_per_call([&] { executor.forward(); });
+      // Outputs the executor holds at the peak of a pass (all of them when
+      // training), plus whatever the ops allocate while running.
+      allocator.reset_stats();
+      executor.forward();
+      const double peak = static_cast<double>(allocator.stats().peak_bytes - weights) / (1 << 20);
+      base = inference ? base : t;
+      std::printf("%-20s %8s %10.1f %10.2f %9.2fx\n", name, inference ? "no-grad" : "train", peak, t * 1e3,
+                  base / t);
+    }
+  }
+  return 0;
+}
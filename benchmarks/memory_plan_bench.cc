@@ -0,0 +1,92 @@
+// Planned peak of the intermediate outputs and gradients against one buffer
+// each, for training and inference plans of an MLP and a conv net, with the
+// step time before and after planning.
+//
+//   bazel run -c opt //benchmarks:memory_plan_bench
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "graph.hh"
+
+using namespace upsilon;
+
+static Tensor<float> pattern(const std::vector<uint32_t>& shape, float scale) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> v(t.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    v[i] = scale * (0.01f * static_cast<float>((i * 37) % 201) - 1.0f);
+  }
+  t.fill(v);
+  return t;
+}
+
+static std::shared_ptr<Op> mlp(uint32_t batch, uint32_t width, int layers) {
+  std::shared_ptr<Op> h = std::make_shared<Variable>(pattern({batch, width}, 1.0f));
+  for (int l = 0; l < layers; l++) {
+    auto w = std::make_shared<Variable>(pattern({width, width}, 1.0f / width));
+    h = std::make_shared<ReLU>(std::make_shared<MatMul>(h, w));
+  }
+  std::vector<uint32_t> labels(batch);
+  for (uint32_t r = 0; r < batch; r++) {
+    labels[r] = r % width;
+  }
+  return std::make_shared<SoftmaxCrossEntropy>(h, std::make_shared<Variable>(Tensor<float>(labels)));
+}
+
+static std::shared_ptr<Op> convnet(uint32_t batch) {
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  std::shared_ptr<Op> h = std::make_shared<Variable>(pattern({batch, 16, 32, 32}, 1.0f));
+  for (int l = 0; l < 4; l++) {
+    auto w = std::make_shared<Variable>(pattern({16, 16, 3, 3}, 0.05f));
+    h = std::make_shared<ReLU>(std::make_shared<Conv2D>(h, w, same));
+  }
+  return std::make_shared<Mean>(std::make_shared<Mean>(h, 0), 0);
+}
+
+static double seconds_per_call(const std::function<void()>& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.3 || reps < 3);
+  return elapsed / reps;
+}
+
+int main() {
+  const std::vector<std::pair<const char*, std::function<std::shared_ptr<Op>()>>> nets = {
+      {"mlp 256x1024 x8", [] { return mlp(256, 1024, 8); }},
+      {"conv 8x16x32x32 x4", [] { return convnet(8); }},
+  };
+
+  std::printf("%-20s %6s %10s %10s %8s %10s %10s\n", "net", "plan", "naive MB", "peak MB", "saved", "before ms",
+              "after ms");
+  for (const auto& [name, build] : nets) {
+    for (bool training : {true, false}) {
+      Executor executor(build());
+      auto run = [&] {
+        if (training) {
+          executor.step();
+        } else {
+          executor.forward();
+        }
+      };
+      const double before = seconds_per_call(run);
+      const MemoryPlan& plan = executor.plan_memory(training);
+      const double after = seconds_per_call(run);
+      const double naive = static_cast<double>(plan.naive_bytes()) / (1 << 20);
+      const double peak = static_cast<double>(plan.peak_bytes()) / (1 << 20);
+      std::printf("%-20s %6s %10.1f %10.1f %7.0f%% %10.2f %10.2f\n", name, training ? "train" : "infer", naive, peak,
+                  100.0 * (1.0 - peak / naive), before * 1e3, after * 1e3);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+// Activation memory held between forward and backward, and step time, for
+// an MLP and a small conv net trained in fp32 and with 16-bit activations
+// (MixedPrecision, bf16 and fp16).
+//
+//   bazel run -c opt //benchmarks:mixed_precision_bench
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "mixed_precision.hh"
+
+using namespace upsilon;
+
+static Tensor<float> pattern(const std::vector<uint32_t>& shape, float scale) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> v(t.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    v[i] = scale * (0.01f * static_cast<float>((i * 37) % 201) - 1.0f);
+  }
+  t.fill(v);
+  return t;
+}
+
+struct Net {
+  std::shared_ptr<Op> loss;
+  std::vector<std::shared_ptr<Variable>> params;
+};
+
+static Net mlp(uint32_t batch, uint32_t width, int layers) {
+  Net net;
+  std::shared_ptr<Op> h = std::make_shared<Variable>(pattern({batch, width}, 1.0f));
+  for (int l = 0; l < layers; l++) {
+    net.params.push_back(std::make_shared<Variable>(pattern({width, width}, 1.0f / width)));
+    h = std::make_shared<ReLU>(std::make_shared<MatMul>(h, net.params.back()));
+  }
+  std::vector<uint32_t> labels(batch);
+  for (uint32_t r = 0; r < batch; r++) {
+    labels[r] = r % width;
+  }
+  net.loss = std::make_shared<SoftmaxCrossEntropy>(h, std::make_shared<Variable>(Tensor<float>(labels)));
+  return net;
+}
+
+static Net convnet(uint32_t batch) {
+  Net net;
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  std::shared_ptr<Op> h = std::make_shared<Variable>(pattern({batch, 16, 32, 32}, 1.0f));
+  for (int l = 0; l < 4; l++) {
+    net.params.push_back(std::make_shared<Variable>(pattern({16, 16, 3, 3}, 0.05f)));
+    h = std::make_shared<ReLU>(std::make_shared<Conv2D>(h, net.params.back(), same));
+  }
+  net.loss = std::make_shared<Mean>(std::make_shared<Mean>(h, 0), 0);
+  return net;
+}
+
+// Megabytes of activations (float outputs plus the executor's 16-bit copies)
+// and of gradients held by the non-Variable ops.
+static std::pair<double, double> held_mb(const Executor& executor) {
+  size_t activations = executor.saved_bytes(), grads = 0;
+  for (const auto& op : executor.graph().order()) {
+    if (dynamic_cast<const Variable*>(op.get()) == nullptr) {
+      activations += op->output.size() * sizeof(float);
+      grads += op->grad.size() * sizeof(float);
+    }
+  }
+  return {static_cast<double>(activations) / (1 << 20), static_cast<double>(grads) / (1 << 20)};
+}
+
+static double seconds_per_call(const std::function<void()>& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.3 || reps < 3);
+  return elapsed / reps;
+}
+
+int main() {
+  const std::vector<std::pair<const char*, std::function<Net()>>> nets = {
+      {"mlp 256x1024 x8", [] { return mlp(256, 1024, 8); }},
+      {"conv 8x16x32x32 x4", [] { return convnet(8); }},
+  };
+  const std::vector<std::pair<const char*, Precision>> modes = {
+      {"fp32", Precision::FP32}, {"bf16", Precision::BF16}, {"fp16", Precision::FP16}};
+
+  std::printf("%-20s %6s %10s %10s %10s %10s\n", "net", "mode", "act MB", "grad MB", "step ms", "vs fp32");
+  for (const auto& [name, build] : nets) {
+    double base = 0;
+    for (const auto& [mode, precision] : modes) {
+      Net net = build();
+      Executor executor(net.loss);
+      std::unique_ptr<MixedPrecision> trainer;
+      if (precision != Precision::FP32) {
+        trainer = std::make_unique<MixedPrecision>(executor, net.params, precision);
+      }
+      // Memory is read between forward and backward of the second step; the
+      // fp32 executor keeps every gradient buffer from the first.
+      executor.step();
+      executor.forward();
+      const auto [activations, grads] = held_mb(executor);
+      executor.backward();
+      const double t = seconds_per_call([&] {
+        if (trainer) {
+          trainer->step(1e-3f);
+        } else {
+          executor.step();
+        }
+      });
+      base = precision == Precision::FP32 ? t : base;
+      std::printf("%-20s %6s %10.1f %10.1f %10.2f %9.2fx\n", name, mode, activations, grads, t * 1e3, base / t);
+    }
+  }
+  return 0;
+}
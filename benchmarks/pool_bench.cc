@@ -0,0 +1,109 @@
+// MaxPool2D, AvgPool2D and GlobalAvgPool forward and backward on ResNet
+// layer shapes, against pooling written with bounds-checked Tensor::at().
+//
+//   bazel run -c opt //benchmarks:pool_bench
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "graph.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.3 || reps < 3);
+  return elapsed / reps;
+}
+
+static Tensor<float> ramp(const std::vector<uint32_t>& shape) {
+  Tensor<float> t(TensorType::Tensor, shape);
+  std::vector<float> values(t.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<float>((i * 7) % 31) * 0.1f;
+  }
+  t.fill(values);
+  return t;
+}
+
+// The old way: one at(c, r, col) per tap.
+static void at_loop(const Tensor<float>& x, Tensor<float>& y, uint32_t kernel, uint32_t stride, uint32_t pad,
+                    bool max) {
+  const std::vector<uint32_t> xs = x.shape(), ys = y.shape();
+  for (uint32_t c = 0; c < ys[0]; c++) {
+    for (uint32_t i = 0; i < ys[1]; i++) {
+      for (uint32_t j = 0; j < ys[2]; j++) {
+        float acc = max ? -std::numeric_limits<float>::infinity() : 0.0f;
+        int count = 0;
+        for (uint32_t ki = 0; ki < kernel; ki++) {
+          for (uint32_t kj = 0; kj < kernel; kj++) {
+            const int64_t r = int64_t(i) * stride + ki - pad, col = int64_t(j) * stride + kj - pad;
+            if (r < 0 || col < 0 || r >= xs[1] || col >= xs[2]) {
+              continue;
+            }
+            const float v = x.at(c, uint32_t(r), uint32_t(col));
+            acc = max ? std::max(acc, v) : acc + v;
+            count++;
+          }
+        }
+        y.at(c, i, j) = max ? acc : acc / count;
+      }
+    }
+  }
+}
+
+struct Layer {
+  const char* name;
+  uint32_t channels, size, kernel, stride, pad;
+  bool max, global;
+};
+
+int main() {
+  const std::vector<Layer> layers = {
+      {"max 3x3/2 64@112", 64, 112, 3, 2, 1, true, false},
+      {"max 2x2/2 64@112", 64, 112, 2, 2, 0, true, false},
+      {"max 3x3/1 256@28", 256, 28, 3, 1, 1, true, false},
+      {"avg 2x2/2 256@56", 256, 56, 2, 2, 0, false, false},
+      {"avg 3x3/1 256@28", 256, 28, 3, 1, 1, false, false},
+      {"global 2048@7", 2048, 7, 7, 1, 0, false, true},
+  };
+
+  std::printf("%-20s %10s %10s %10s %10s\n", "layer", "at() ms", "fwd ms", "bwd ms", "speedup");
+  for (const Layer& l : layers) {
+    auto x = std::make_shared<Variable>(ramp({l.channels, l.size, l.size}));
+    Pool2DOptions options;
+    options.kernel_h = options.kernel_w = l.kernel;
+    options.stride_h = options.stride_w = l.stride;
+    options.pad_h = options.pad_w = l.pad;
+    std::shared_ptr<Op> y;
+    if (l.global) {
+      y = std::make_shared<GlobalAvgPool>(x);
+    } else if (l.max) {
+      y = std::make_shared<MaxPool2D>(x, options);
+    } else {
+      y = std::make_shared<AvgPool2D>(x, options);
+    }
+    y->forward();
+    y->grad = Tensor<float>::zeros_like(y->output).fill_(1.0f);
+    x->grad = Tensor<float>::zeros_like(x->output);
+
+    Tensor<float> expected(TensorType::Tensor, y->output.shape());
+    const double loop = seconds_per_call([&] { at_loop(x->output, expected, l.kernel, l.stride, l.pad, l.max); });
+    const double forward = seconds_per_call([&] { y->forward(); });
+    const double backward = seconds_per_call([&] { y->backward(); });
+    std::printf("%-20s %10.3f %10.3f %10.3f %9.1fx\n", l.name, loop * 1e3, forward * 1e3, backward * 1e3,
+                loop / forward);
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+// Float MatMul and Conv2D against their post-training quantized int8 forms
+// on inference shapes: time per forward pass and weight bytes.
+//
+//   bazel run -c opt //benchmarks:quant_bench
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "ptq.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.3 || reps < 3);
+  return elapsed / reps;
+}
+
+static Tensor<float> ramp(const std::vector<uint32_t>& shape, uint32_t seed) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> values(t.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<float>((i * 7 + seed) % 31) * 0.0625f - 0.9f;
+  }
+  t.fill(values);
+  return t;
+}
+
+struct Layer {
+  const char* name;
+  std::vector<uint32_t> input, weight;
+  uint32_t pad;
+};
+
+int main() {
+  std::printf("int8 kernel %s, %zu threads\n", quant::kernel_name(quant::active_kernel()), num_threads());
+  const std::vector<Layer> layers = {
+      {"linear 128x768x768", {128, 768}, {768, 768}, 0},
+      {"linear 128x768x3072", {128, 768}, {768, 3072}, 0},
+      {"linear 16x4096x4096", {16, 4096}, {4096, 4096}, 0},
+      {"conv 3x3 64@56", {1, 64, 56, 56}, {64, 64, 3, 3}, 1},
+      {"conv 1x1 256->64@56", {1, 256, 56, 56}, {64, 256, 1, 1}, 0},
+      {"conv 3x3 256@14", {1, 256, 14, 14}, {256, 256, 3, 3}, 1},
+  };
+
+  std::printf("%-22s %10s %10s %9s %12s %12s\n", "layer", "fp32 ms", "int8 ms", "speedup", "fp32 weights",
+              "int8 weights");
+  for (const Layer& l : layers) {
+    auto x = std::make_shared<Variable>(ramp(l.input, 1));
+    auto w = std::make_shared<Variable>(ramp(l.weight, 2));
+    std::shared_ptr<Op> y;
+    if (l.weight.size() == 2) {
+      y = std::make_shared<MatMul>(x, w);
+    } else {
+      Conv2DOptions options;
+      options.pad_h = options.pad_w = l.pad;
+      y = std::make_shared<Conv2D>(x, w, options);
+    }
+    Executor executor(y);
+    const double fp32 = seconds_per_call([&] { executor.forward(); });
+
+    Quantizer quantizer(executor.graph());
+    quantizer.observe();
+    quantizer.apply();
+    const double int8 = seconds_per_call([&] { executor.forward(); });
+
+    size_t packed = 0;
+    const Op* q = executor.graph().outputs()[0].get();
+    if (auto* m = dynamic_cast<const QuantizedMatMul*>(q)) {
+      packed = m->weight().bytes();
+    } else if (auto* c = dynamic_cast<const QuantizedConv2D*>(q)) {
+      packed = c->weight_bytes();
+    }
+    std::printf("%-22s %10.3f %10.3f %8.1fx %10.1f KB %10.1f KB\n", l.name, fp32 * 1e3, int8 * 1e3, fp32 / int8,
+                w->output.size() * sizeof(float) / 1024.0, packed / 1024.0);
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+// Read bandwidth of Tensor::reduce() for every reduction along the inner,
+// middle and outer axis, next to a plain single-threaded loop summing the
+// same elements. Inputs are 128 MB, well past the last-level cache.
+//
+//   bazel run -c opt //benchmarks:reduce_bench
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "tensor.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5 || reps < 3);
+  return elapsed / reps;
+}
+
+struct Case {
+  const char* name;
+  std::vector<uint32_t> shape;
+  uint32_t axis;
+};
+
+int main() {
+  const std::vector<Case> cases = {
+      {"(4096, 8192) axis 1", {4096, 8192}, 1},
+      {"(4096, 8192) axis 0", {4096, 8192}, 0},
+      {"(64, 512, 1024) axis 1", {64, 512, 1024}, 1},
+      {"(8, 4194304) axis 1", {8, 4194304}, 1},
+  };
+  const std::vector<std::pair<const char*, Reduction>> reductions = {
+      {"sum", Reduction::Sum},       {"mean", Reduction::Mean},     {"max", Reduction::Max},
+      {"min", Reduction::Min},       {"argmax", Reduction::ArgMax}, {"l2norm", Reduction::L2Norm},
+  };
+
+  std::printf("%-24s %8s", "GB/s", "loop");
+  for (const auto& r : reductions) {
+    std::printf(" %8s", r.first);
+  }
+  std::printf("\n");
+  for (const Case& c : cases) {
+    Tensor<float> x(c.shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, c.shape);
+    x.fill(0.5f);
+    const double bytes = static_cast<double>(x.size()) * sizeof(float);
+
+    const float* in = x.data().data();
+    volatile float sink = 0;
+    const double loop = seconds_per_call([&] {
+      float total = 0;
+      for (size_t i = 0; i < x.size(); i++) {
+        total += in[i];
+      }
+      sink = total;
+    });
+    std::printf("%-24s %8.1f", c.name, bytes / loop * 1e-9);
+
+    Tensor<float> out(0.0f);
+    for (const auto& r : reductions) {
+      const double t = seconds_per_call([&] { x.reduce(r.second, c.axis, false, out); });
+      std::printf(" %8.1f", bytes / t * 1e-9);
+    }
+    std::printf("\n");
+  }
+  return 0;
+}
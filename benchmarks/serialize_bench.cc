@@ -0,0 +1,88 @@
+// Load time of a multi-GB checkpoint of 64 MB float matrices: reading each
+// tensor into a std::vector and fill()ing a Tensor (two copies), against
+// mapping the file with TensorFile (no copy), with and without a first pass
+// over every value. The file was just written, so the page cache is warm.
+//
+//   bazel run -c opt //benchmarks:serialize_bench -- [GB, default 2] [path]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "serialize.hh"
+
+using namespace upsilon;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  const double gb = argc > 1 ? std::atof(argv[1]) : 2.0;
+  const std::string path = argc > 2 ? argv[2] : "/tmp/upsilon_serialize_bench.ups";
+  const uint32_t rows = 4096, cols = 4096;
+  const size_t tensor_bytes = size_t(rows) * cols * sizeof(float);
+  const size_t count = std::max<size_t>(1, static_cast<size_t>(gb * (1 << 30) / tensor_bytes));
+  const double total_gb = static_cast<double>(count * tensor_bytes) / (1 << 30);
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    TensorWriter writer;
+    for (size_t i = 0; i < count; i++) {
+      Tensor<float> t(TensorType::Matrix, {rows, cols});
+      t.fill_(static_cast<float>(i));
+      writer.add("layer" + std::to_string(i) + ".weight", t);
+    }
+    writer.write(path);
+  }
+  std::printf("%zu tensors, %.2f GB, written in %.2f s\n\n", count, total_gb, seconds_since(start));
+  std::printf("%-28s %10s %10s\n", "load", "ms", "GB/s");
+  auto report = [&](const char* name, double seconds) {
+    std::printf("%-28s %10.1f %10.2f\n", name, seconds * 1e3, total_gb / seconds);
+  };
+
+  // What loading looked like before: read the bytes, then fill() a tensor.
+  start = std::chrono::steady_clock::now();
+  {
+    const TensorFile index(path);
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    std::vector<Tensor<float>> tensors;
+    std::vector<float> values(size_t(rows) * cols);
+    for (size_t i = 0; i < count; i++) {
+      std::fseek(file, static_cast<long>(index.offset("layer" + std::to_string(i) + ".weight")), SEEK_SET);
+      if (std::fread(values.data(), sizeof(float), values.size(), file) != values.size()) {
+        std::fprintf(stderr, "short read\n");
+        return 1;
+      }
+      tensors.emplace_back(TensorType::Matrix, std::vector<uint32_t>{rows, cols});
+      tensors.back().fill(values);
+    }
+    std::fclose(file);
+    report("fread + fill", seconds_since(start));
+  }
+
+  start = std::chrono::steady_clock::now();
+  {
+    const TensorFile file(path);
+    std::vector<Tensor<float>> tensors;
+    for (size_t i = 0; i < count; i++) {
+      tensors.push_back(file.get("layer" + std::to_string(i) + ".weight"));
+    }
+    report("TensorFile (mapped)", seconds_since(start));
+  }
+
+  volatile float sink = 0;
+  start = std::chrono::steady_clock::now();
+  {
+    const TensorFile file(path);
+    for (size_t i = 0; i < count; i++) {
+      const Tensor<float> t = file.get("layer" + std::to_string(i) + ".weight");
+      sink = sink + kernels::sum(t.data().data(), t.size());
+    }
+    report("TensorFile + read all", seconds_since(start));
+  }
+
+  std::remove(path.c_str());
+  return 0;
+}
@@ -0,0 +1,72 @@
+// SoftmaxCrossEntropy forward and backward against the same loss composed
+// from tensor pieces: exp(), a row sum, div() and log(), each a full pass
+// with its own temporary (and overflowing for logits above ~88).
+//
+//   bazel run -c opt //benchmarks:softmax_bench
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "graph.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.3 || reps < 3);
+  return elapsed / reps;
+}
+
+static float composed(const Tensor<float>& x, const std::vector<uint32_t>& labels) {
+  const Tensor<float> e = x.exp();
+  const Tensor<float> p = e.div(e.sum(1, true));
+  const Tensor<float> lp = p.log();
+  float total = 0.0f;
+  for (uint32_t r = 0; r < labels.size(); r++) {
+    total -= lp.at(r, labels[r]);
+  }
+  return total / static_cast<float>(labels.size());
+}
+
+int main() {
+  const std::vector<std::pair<uint32_t, uint32_t>> shapes = {{256, 10}, {256, 1000}, {64, 32000}, {4096, 1000}};
+
+  std::printf("%-14s %12s %12s %12s %10s\n", "batch x class", "composed ms", "fused fwd ms", "fused bwd ms", "speedup");
+  for (const auto& [rows, classes] : shapes) {
+    Tensor<float> x(TensorType::Matrix, {rows, classes});
+    std::vector<float> v(x.size());
+    for (size_t i = 0; i < v.size(); i++) {
+      v[i] = 0.01f * static_cast<float>((i * 37) % 501) - 2.5f;
+    }
+    x.fill(v);
+    std::vector<uint32_t> labels(rows);
+    for (uint32_t r = 0; r < rows; r++) {
+      labels[r] = (r * 7) % classes;
+    }
+
+    auto logits = std::make_shared<Variable>(Tensor<float>(x));
+    auto loss = std::make_shared<SoftmaxCrossEntropy>(logits, std::make_shared<Variable>(Tensor<float>(labels)));
+    loss->forward();
+    loss->grad = Tensor<float>(1.0f);
+    logits->grad = Tensor<float>::zeros_like(logits->output);
+
+    volatile float sink = 0;
+    const double base = seconds_per_call([&] { sink = composed(x, labels); });
+    const double forward = seconds_per_call([&] { loss->forward(); });
+    const double backward = seconds_per_call([&] { loss->backward(); });
+    char name[32];
+    std::snprintf(name, sizeof(name), "%u x %u", rows, classes);
+    std::printf("%-14s %12.3f %12.3f %12.3f %9.1fx\n", name, base * 1e3, forward * 1e3, backward * 1e3,
+                base / forward);
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+// Speedup of the threaded tensor operations from 1 to N threads, relative to
+// a single thread. N defaults to the number of hardware threads.
+//
+//   bazel run -c opt //benchmarks:thread_scaling_bench [max_threads]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "tensor.hh"
+#include "thread_pool.hh"
+
+using namespace upsilon;
+
+template <typename F>
+static double seconds_per_call(F&& f) {
+  f();
+  size_t reps = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    f();
+    reps++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5 || reps < 3);
+  return elapsed / reps;
+}
+
+int main(int argc, char** argv) {
+  const size_t max_threads = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                      : std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+
+  Tensor<float> a(TensorType::Tensor, {16, 1024, 1024});
+  Tensor<float> b(TensorType::Tensor, {16, 1024, 1024});
+  a.fill(0.5f);
+  b.fill(2.0f);
+  Tensor<float> m(TensorType::Matrix, {1024, 1024});
+  m.fill(0.01f);
+
+  struct Case {
+    const char* name;
+    std::function<void()> run;
+  };
+  const std::vector<Case> cases = {
+      {"add 16M", [&] { Tensor<float> c = a.add(b); }},
+      {"add strided 16M", [&] { Tensor<float> c = a.transposed().add(b.transposed()); }},
+      {"tanh 16M", [&] { Tensor<float> c = a.tanh(); }},
+      {"apply 16M", [&] { Tensor<float> c = a.apply([](float x) { return x * x + 1.0f; }); }},
+      {"padding 16M", [&] { Tensor<float> c = a; c.padding({1, 1, 1, 1}, 0.0f); }},
+      {"sum 16M", [&] { volatile float s = a.sum(); (void)s; }},
+      {"matmul 1024", [&] { Tensor<float> c = m.matmul(m); }},
+  };
+
+  std::vector<size_t> counts;
+  for (size_t t = 1; t < max_threads; t *= 2) {
+    counts.push_back(t);
+  }
+  counts.push_back(max_threads);
+
+  std::printf("%-16s %12s", "op", "1 thread ms");
+  for (size_t i = 1; i < counts.size(); i++) {
+    std::printf(" %8zux", counts[i]);
+  }
+  std::printf("\n");
+
+  for (const auto& c : cases) {
+    set_num_threads(1);
+    const double base = seconds_per_call(c.run);
+    std::printf("%-16s %12.2f", c.name, base * 1e3);
+    for (size_t i = 1; i < counts.size(); i++) {
+      set_num_threads(counts[i]);
+      std::printf(" %9.2f", base / seconds_per_call(c.run));
+    }
+    std::printf("\n");
+  }
+  return 0;
+}
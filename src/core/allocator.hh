@@ -0,0 +1,442 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Memory for tensor storage. Every Storage gets its buffer from the calling
+// thread's current Allocator: the process-wide CachingAllocator unless an
+// AllocatorScope (for example around an Arena) says otherwise.
+
+namespace upsilon {
+
+// Alignment of every tensor buffer: one cache line, and enough for any SIMD
+// load the kernels issue.
+constexpr size_t kBufferAlignment = 64;
+
+class Allocator {
+public:
+  virtual ~Allocator() = default;
+
+  // Returns at least bytes bytes aligned to kBufferAlignment; never nullptr.
+  virtual void* allocate(size_t bytes) = 0;
+
+  // Releases a block from allocate(bytes) on this allocator. May be called
+  // from any thread.
+  virtual void deallocate(void* p, size_t bytes) = 0;
+};
+
+struct AllocatorStats {
+  uint64_t allocations = 0;  // allocate() calls
+  uint64_t cache_hits = 0;   // allocations served from a free list
+  uint64_t bytes_in_use = 0;  // bytes handed out and not yet released
+  uint64_t peak_bytes = 0;   // high-water mark of bytes_in_use
+  uint64_t bytes_cached = 0;  // bytes held in free lists
+};
+
+namespace detail {
+
+// Blocks at least this large come straight from mmap, and are backed by
+// transparent huge pages when those are enabled.
+constexpr size_t kHugePageSize = size_t(2) << 20;
+
+inline std::atomic<bool>& huge_pages_enabled() {
+  static std::atomic<bool> enabled{[] {
+    const char* env = std::getenv("UPSILON_HUGE_PAGES");
+    return env != nullptr && env[0] == '1';
+  }()};
+  return enabled;
+}
+
+inline void* system_allocate(size_t bytes) {
+#if defined(__linux__)
+  if (bytes >= kHugePageSize) {
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+#if defined(MADV_HUGEPAGE)
+    if (huge_pages_enabled().load(std::memory_order_relaxed)) {
+      madvise(p, bytes, MADV_HUGEPAGE);
+    }
+#endif
+    return p;
+  }
+#endif
+  void* p = nullptr;
+  if (posix_memalign(&p, kBufferAlignment, std::max<size_t>(bytes, 1)) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+inline void system_deallocate(void* p, size_t bytes) {
+#if defined(__linux__)
+  if (bytes >= kHugePageSize) {
+    munmap(p, bytes);
+    return;
+  }
+#endif
+  std::free(p);
+}
+
+}  // namespace detail
+
+// Back large buffers (2 MiB and up) with transparent huge pages. Off unless
+// UPSILON_HUGE_PAGES=1; affects blocks allocated from now on.
+inline void set_huge_pages(bool enabled) {
+  detail::huge_pages_enabled().store(enabled, std::memory_order_relaxed);
+}
+
+// Allocates and frees every block directly from the system.
+class SystemAllocator : public Allocator {
+public:
+  void* allocate(size_t bytes) override {
+    return detail::system_allocate(bytes);
+  }
+
+  void deallocate(void* p, size_t bytes) override {
+    detail::system_deallocate(p, bytes);
+  }
+};
+
+// Size-class caching allocator. Requests are rounded up to a size class (64
+// byte steps up to 256 bytes, then four classes per power of two, so at most
+// 25% is wasted) and freed blocks go onto the freeing thread's free list for
+// that class instead of back to the system. A training loop that allocates
+// the same shapes every step is then served entirely from the free lists.
+//
+// There is one instance per process (instance()); its free lists are
+// thread-local, so the hot path takes no lock. A thread's cached blocks are
+// returned to the system when it exits, or by release_cached().
+class CachingAllocator : public Allocator {
+public:
+  static CachingAllocator& instance() {
+    // Never destroyed: tensors in static storage may outlive any destructor.
+    static CachingAllocator* allocator = new CachingAllocator();
+    return *allocator;
+  }
+
+  void* allocate(size_t bytes) override {
+    const size_t index = size_class(bytes);
+    const size_t rounded = class_size(index);
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    add_in_use(rounded);
+
+    if (cache_destroyed()) {
+      return detail::system_allocate(rounded);
+    }
+    ThreadCache& local = cache();
+    auto& list = local.lists[index];
+    if (!list.empty()) {
+      void* p = list.back();
+      list.pop_back();
+      local.bytes -= rounded;
+      bytes_cached_.fetch_sub(rounded, std::memory_order_relaxed);
+      cache_hits_.fetch_add(1, std::memory_order_relaxed);
+      return p;
+    }
+    return detail::system_allocate(rounded);
+  }
+
+  void deallocate(void* p, size_t bytes) override {
+    const size_t index = size_class(bytes);
+    const size_t rounded = class_size(index);
+    bytes_in_use_.fetch_sub(rounded, std::memory_order_relaxed);
+
+    if (cache_destroyed()) {
+      detail::system_deallocate(p, rounded);
+      return;
+    }
+    ThreadCache& local = cache();
+    if (local.bytes + rounded > cache_limit_.load(std::memory_order_relaxed)) {
+      detail::system_deallocate(p, rounded);
+      return;
+    }
+    local.lists[index].push_back(p);
+    local.bytes += rounded;
+    bytes_cached_.fetch_add(rounded, std::memory_order_relaxed);
+  }
+
+  // Frees every block cached by the calling thread.
+  void release_cached() {
+    if (!cache_destroyed()) {
+      cache().release();
+    }
+  }
+
+  // Upper bound on the bytes one thread keeps in its free lists; blocks freed
+  // beyond it go back to the system. Defaults to 1 GiB.
+  void set_cache_limit(size_t bytes) {
+    cache_limit_.store(bytes, std::memory_order_relaxed);
+  }
+
+  AllocatorStats stats() const {
+    AllocatorStats s;
+    s.allocations = allocations_.load(std::memory_order_relaxed);
+    s.cache_hits = cache_hits_.load(std::memory_order_relaxed);
+    s.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+    s.peak_bytes = peak_bytes_.load(std::memory_order_relaxed);
+    s.bytes_cached = bytes_cached_.load(std::memory_order_relaxed);
+    return s;
+  }
+
+  // Zeroes the counters and restarts the peak from the bytes now in use.
+  void reset_stats() {
+    allocations_.store(0, std::memory_order_relaxed);
+    cache_hits_.store(0, std::memory_order_relaxed);
+    peak_bytes_.store(bytes_in_use_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  // Size-class index for a request and the block size it stands for.
+  static size_t size_class(size_t bytes) {
+    if (bytes <= 256) {
+      return bytes == 0 ? 0 : (bytes - 1) / 64;
+    }
+    const size_t k = 63 - __builtin_clzll(bytes - 1);  // bytes in (2^k, 2^(k+1)]
+    const size_t step = size_t(1) << (k - 2);
+    const size_t j = (bytes - (size_t(1) << k) + step - 1) / step;  // 1..4
+    return 4 + (k - 8) * 4 + (j - 1);
+  }
+
+  static size_t class_size(size_t index) {
+    if (index < 4) {
+      return (index + 1) * 64;
+    }
+    const size_t k = (index - 4) / 4 + 8;
+    const size_t j = (index - 4) % 4 + 1;
+    return (size_t(1) << k) + j * (size_t(1) << (k - 2));
+  }
+
+private:
+  static constexpr size_t kClasses = 4 + (64 - 8) * 4;
+
+  struct ThreadCache {
+    std::array<std::vector<void*>, kClasses> lists;
+    size_t bytes = 0;
+
+    void release() {
+      auto& owner = instance();
+      for (size_t i = 0; i < kClasses; i++) {
+        for (void* p : lists[i]) {
+          detail::system_deallocate(p, class_size(i));
+        }
+        lists[i].clear();
+        lists[i].shrink_to_fit();
+      }
+      owner.bytes_cached_.fetch_sub(bytes, std::memory_order_relaxed);
+      bytes = 0;
+    }
+
+    ~ThreadCache() {
+      release();
+      cache_destroyed() = true;
+    }
+  };
+
+  CachingAllocator() = default;
+
+  // Set once the thread's cache is gone, so buffers freed later during
+  // thread or process teardown bypass it.
+  static bool& cache_destroyed() {
+    thread_local bool destroyed = false;
+    return destroyed;
+  }
+
+  static ThreadCache& cache() {
+    thread_local ThreadCache local;
+    return local;
+  }
+
+  void add_in_use(size_t bytes) {
+    const uint64_t now = bytes_in_use_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    uint64_t peak = peak_bytes_.load(std::memory_order_relaxed);
+    while (now > peak && !peak_bytes_.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+  }
+
+  std::atomic<uint64_t> allocations_{0};
+  std::atomic<uint64_t> cache_hits_{0};
+  std::atomic<uint64_t> bytes_in_use_{0};
+  std::atomic<uint64_t> peak_bytes_{0};
+  std::atomic<uint64_t> bytes_cached_{0};
+  std::atomic<size_t> cache_limit_{size_t(1) << 30};
+};
+
+// Bump allocator for short-lived buffers. Memory comes in chunks from the
+// system; deallocate() only drops a chunk's reference count and reset()
+// rewinds to the start of the chunks no buffer lives in any more. A chunk
+// that still holds live buffers at reset() is handed over to them and freed
+// when the last one goes, so resetting is always safe, merely wasteful if
+// buffers are kept across steps. Use it through a shared_ptr (see
+// AllocatorScope); buffers keep the arena alive.
+class Arena : public Allocator {
+public:
+  explicit Arena(size_t chunk_bytes = size_t(4) << 20) : chunk_bytes_(chunk_bytes) {}
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  ~Arena() override {
+    for (Chunk* chunk : chunks_) {
+      Chunk::release(chunk);
+    }
+  }
+
+  void* allocate(size_t bytes) override {
+    const size_t need = kHeader + (bytes + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (current_ < chunks_.size() && chunks_[current_]->used + need > chunks_[current_]->capacity) {
+      current_++;
+    }
+    if (current_ == chunks_.size()) {
+      add_chunk(need);
+    }
+    Chunk* chunk = chunks_[current_];
+    char* block = reinterpret_cast<char*>(chunk) + chunk->used;
+    chunk->used += need;
+    chunk->refs.fetch_add(1, std::memory_order_relaxed);
+    *reinterpret_cast<Chunk**>(block) = chunk;
+
+    bytes_in_use_ += need;
+    peak_bytes_ = std::max(peak_bytes_, bytes_in_use_);
+    return block + kHeader;
+  }
+
+  void deallocate(void* p, size_t) override {
+    Chunk* chunk = *reinterpret_cast<Chunk**>(static_cast<char*>(p) - kHeader);
+    Chunk::release(chunk);
+  }
+
+  // Starts over from the first chunk. Chunks that still hold live buffers are
+  // dropped from the arena rather than reused.
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Chunk*> kept;
+    for (Chunk* chunk : chunks_) {
+      if (chunk->refs.load(std::memory_order_acquire) == 1) {
+        chunk->used = sizeof(Chunk);
+        kept.push_back(chunk);
+      } else {
+        Chunk::release(chunk);
+      }
+    }
+    chunks_ = std::move(kept);
+    current_ = 0;
+    bytes_in_use_ = 0;
+  }
+
+  // Bytes handed out since the last reset(), including per-block headers.
+  size_t bytes_in_use() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_in_use_;
+  }
+
+  // Largest bytes_in_use() seen between two resets.
+  size_t peak_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_bytes_;
+  }
+
+  size_t chunk_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunks_.size();
+  }
+
+private:
+  // Lives at the start of its own memory; refs counts the arena plus every
+  // live block.
+  struct alignas(kBufferAlignment) Chunk {
+    std::atomic<size_t> refs{1};
+    size_t used = 0;
+    size_t capacity = 0;
+
+    static void release(Chunk* chunk) {
+      if (chunk->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        const size_t capacity = chunk->capacity;
+        chunk->~Chunk();
+        detail::system_deallocate(chunk, capacity);
+      }
+    }
+  };
+
+  // Space in front of every block for a pointer back to its chunk, padded so
+  // the block stays aligned.
+  static constexpr size_t kHeader = kBufferAlignment;
+
+  void add_chunk(size_t need) {
+    const size_t capacity = std::max(chunk_bytes_, sizeof(Chunk) + need);
+    Chunk* chunk = new (detail::system_allocate(capacity)) Chunk();
+    chunk->used = sizeof(Chunk);
+    chunk->capacity = capacity;
+    chunks_.push_back(chunk);
+  }
+
+  const size_t chunk_bytes_;
+  mutable std::mutex mutex_;
+  std::vector<Chunk*> chunks_;
+  size_t current_ = 0;
+  size_t bytes_in_use_ = 0;
+  size_t peak_bytes_ = 0;
+};
+
+namespace detail {
+
+inline std::shared_ptr<Allocator>& default_allocator() {
+  // The singleton is not owned: tensors may be released after static
+  // destructors have run.
+  static std::shared_ptr<Allocator> allocator(&CachingAllocator::instance(), [](Allocator*) {});
+  return allocator;
+}
+
+inline std::shared_ptr<Allocator>& scoped_allocator() {
+  thread_local std::shared_ptr<Allocator> allocator;
+  return allocator;
+}
+
+}  // namespace detail
+
+// Allocator new tensor storage comes from on the calling thread. Every
+// buffer keeps a reference to its allocator, so an allocator is destroyed
+// only after the last tensor allocated from it.
+inline std::shared_ptr<Allocator> current_allocator() {
+  const std::shared_ptr<Allocator>& scoped = detail::scoped_allocator();
+  return scoped ? scoped : std::atomic_load(&detail::default_allocator());
+}
+
+// Replaces the process-wide default (initially CachingAllocator::instance()).
+inline void set_default_allocator(std::shared_ptr<Allocator> allocator) {
+  if (!allocator) {
+    throw std::invalid_argument("Allocator must not be null");
+  }
+  std::atomic_store(&detail::default_allocator(), std::move(allocator));
+}
+
+// Routes storage allocated on this thread to allocator until the scope ends.
+class AllocatorScope {
+public:
+  explicit AllocatorScope(std::shared_ptr<Allocator> allocator) : previous_(std::move(detail::scoped_allocator())) {
+    detail::scoped_allocator() = std::move(allocator);
+  }
+
+  AllocatorScope(const AllocatorScope&) = delete;
+  AllocatorScope& operator=(const AllocatorScope&) = delete;
+
+  ~AllocatorScope() { detail::scoped_allocator() = std::move(previous_); }
+
+private:
+  std::shared_ptr<Allocator> previous_;
+};
+
+}  // namespace upsilon
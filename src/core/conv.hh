@@ -0,0 +1,597 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "gemm.hh"
+#include "thread_pool.hh"
+
+// 2-D convolution lowered to GEMM. Images are (channels, rows, cols) in
+// row-major order; weights are (out_channels, channels / groups, kh, kw).
+//
+// im2col() unrolls the receptive fields of one group of channels into a
+// (channels * kh * kw) x (out_rows * out_cols) matrix, so the convolution is
+// weights * columns. Padding is applied while unrolling: taps that fall
+// outside the image read as zero and no padded copy of the input exists.
+// col2im() is the adjoint, scattering column gradients back onto the image.
+//
+// Two kernels avoid the column matrix where it hurts most. 3x3 stride-1
+// layers use Winograd F(2x2, 3x3) or F(4x4, 3x3): tiles of the input and the
+// filters are transformed so that each tile needs (M + 2)^2 / M^2 as many
+// multiplies per output instead of 9, and the products are GEMMs over the
+// channels. Depthwise layers (one input channel per group) are computed
+// directly. select() picks a kernel from the layer shape; Conv2DOptions can
+// force one. The backward pass of a Winograd layer goes through im2col.
+
+namespace upsilon {
+
+enum class ConvAlgorithm { Auto, Im2col, Winograd2x2, Winograd4x4, Direct };
+
+struct Conv2DOptions {
+  uint32_t stride_h = 1, stride_w = 1;
+  uint32_t pad_h = 0, pad_w = 0;
+  uint32_t dilation_h = 1, dilation_w = 1;
+  uint32_t groups = 1;
+  ConvAlgorithm algorithm = ConvAlgorithm::Auto;
+};
+
+inline const char* algorithm_name(ConvAlgorithm algorithm) {
+  switch (algorithm) {
+    case ConvAlgorithm::Im2col:
+      return "im2col";
+    case ConvAlgorithm::Winograd2x2:
+      return "winograd2x2";
+    case ConvAlgorithm::Winograd4x4:
+      return "winograd4x4";
+    case ConvAlgorithm::Direct:
+      return "direct";
+    default:
+      return "auto";
+  }
+}
+
+namespace conv {
+
+// Sizes of one convolution over a batch of images.
+struct Geometry {
+  uint32_t channels, rows, cols;          // input, per image
+  uint32_t out_channels, out_rows, out_cols;
+  uint32_t kernel_rows, kernel_cols;
+  Conv2DOptions options;
+  uint32_t batch = 1;
+  ConvAlgorithm algorithm = ConvAlgorithm::Im2col;  // never Auto
+
+  uint32_t group_channels() const { return channels / options.groups; }
+  uint32_t group_out_channels() const { return out_channels / options.groups; }
+  // Rows of the column matrix for one group, i.e. the GEMM depth.
+  size_t patch() const { return size_t(group_channels()) * kernel_rows * kernel_cols; }
+  size_t out_pixels() const { return size_t(out_rows) * out_cols; }
+  size_t image_size() const { return size_t(channels) * rows * cols; }
+  size_t out_size() const { return size_t(out_channels) * out_pixels(); }
+  // Winograd tiles of one output channel of one image, for M x M tiles.
+  size_t tiles(size_t m) const { return (out_rows + m - 1) / m * ((out_cols + m - 1) / m); }
+
+  // A 1x1 kernel with unit stride and no padding reads the image itself as
+  // its column matrix.
+  bool pointwise() const {
+    return kernel_rows == 1 && kernel_cols == 1 && options.stride_h == 1 && options.stride_w == 1 &&
+           options.pad_h == 0 && options.pad_w == 0;
+  }
+
+  bool winograd_fits() const {
+    return kernel_rows == 3 && kernel_cols == 3 && options.stride_h == 1 && options.stride_w == 1 &&
+           options.dilation_h == 1 && options.dilation_w == 1;
+  }
+
+  bool depthwise() const { return group_channels() == 1; }
+};
+
+// Tiles across the batch below which a Winograd GEMM is too narrow to beat
+// im2col: its kAlpha^2 transformed filter matrices are then read for too
+// little work (see benchmarks/conv_kernels_bench.cc).
+constexpr size_t kWinogradMinTiles = 128;
+
+// The kernel for a layer shape. Depthwise layers are memory-bound and a
+// one-row GEMM per channel is the worst way to run them, so they always go
+// direct. Winograd needs enough channels for the GEMMs to outweigh the tile
+// transforms and enough tiles for the GEMMs to be wide; F(4x4) does fewer
+// multiplies than F(2x2) but has a quarter as many tiles.
+inline ConvAlgorithm select(const Geometry& g) {
+  if (g.depthwise()) {
+    return ConvAlgorithm::Direct;
+  }
+  if (g.winograd_fits() && g.group_channels() >= 8 && g.group_out_channels() >= 8) {
+    if (g.batch * g.tiles(4) >= kWinogradMinTiles) {
+      return ConvAlgorithm::Winograd4x4;
+    }
+    if (g.batch * g.tiles(2) >= kWinogradMinTiles) {
+      return ConvAlgorithm::Winograd2x2;
+    }
+  }
+  return ConvAlgorithm::Im2col;
+}
+
+inline Geometry geometry(uint32_t channels, uint32_t rows, uint32_t cols, const std::vector<uint32_t>& weight_shape,
+                         const Conv2DOptions& options, uint32_t batch = 1) {
+  if (weight_shape.size() != 4) {
+    throw std::invalid_argument("Conv2D weights must be (out_channels, channels / groups, kh, kw)");
+  }
+  if (options.groups == 0 || options.stride_h == 0 || options.stride_w == 0 || options.dilation_h == 0 ||
+      options.dilation_w == 0) {
+    throw std::invalid_argument("Conv2D stride, dilation and groups must be positive");
+  }
+  if (channels % options.groups != 0 || weight_shape[0] % options.groups != 0 ||
+      weight_shape[1] * options.groups != channels) {
+    throw std::invalid_argument("Conv2D channels do not match the weights and groups");
+  }
+
+  Geometry g{channels, rows, cols, weight_shape[0], 0, 0, weight_shape[2], weight_shape[3], options, batch};
+  const int64_t span_h = int64_t(options.dilation_h) * (g.kernel_rows - 1) + 1;
+  const int64_t span_w = int64_t(options.dilation_w) * (g.kernel_cols - 1) + 1;
+  const int64_t padded_h = int64_t(rows) + 2 * options.pad_h;
+  const int64_t padded_w = int64_t(cols) + 2 * options.pad_w;
+  if (g.kernel_rows == 0 || g.kernel_cols == 0 || span_h > padded_h || span_w > padded_w) {
+    throw std::invalid_argument("Conv2D kernel is larger than the padded input");
+  }
+  g.out_rows = static_cast<uint32_t>((padded_h - span_h) / options.stride_h + 1);
+  g.out_cols = static_cast<uint32_t>((padded_w - span_w) / options.stride_w + 1);
+
+  switch (options.algorithm) {
+    case ConvAlgorithm::Auto:
+      g.algorithm = select(g);
+      break;
+    case ConvAlgorithm::Winograd2x2:
+    case ConvAlgorithm::Winograd4x4:
+      if (!g.winograd_fits()) {
+        throw std::invalid_argument("Winograd convolution needs a 3x3 kernel with unit stride and dilation");
+      }
+      g.algorithm = options.algorithm;
+      break;
+    case ConvAlgorithm::Direct:
+      if (!g.depthwise()) {
+        throw std::invalid_argument("Direct convolution needs one input channel per group");
+      }
+      g.algorithm = options.algorithm;
+      break;
+    default:
+      g.algorithm = options.algorithm;
+  }
+  return g;
+}
+
+// Output columns [begin, end) whose tap at kernel offset `offset` lands inside
+// [0, size) of the input.
+inline void valid_range(uint32_t out_size, uint32_t size, uint32_t stride, int64_t offset, uint32_t& begin,
+                        uint32_t& end) {
+  // in = out * stride + offset must satisfy 0 <= in < size.
+  const int64_t lo = offset >= 0 ? 0 : (-offset + stride - 1) / stride;
+  const int64_t hi = int64_t(size) - offset <= 0 ? 0 : (int64_t(size) - offset + stride - 1) / stride;
+  begin = static_cast<uint32_t>(std::min<int64_t>(lo, out_size));
+  end = static_cast<uint32_t>(std::max<int64_t>(begin, std::min<int64_t>(hi, out_size)));
+}
+
+// columns = im2col(image) for g.group_channels() channels starting at image.
+inline void im2col(const Geometry& g, const float* image, float* columns) {
+  const Conv2DOptions& o = g.options;
+  const size_t kernel = size_t(g.kernel_rows) * g.kernel_cols;
+  const size_t pixels = g.out_pixels();
+  parallel_for(g.patch(), std::max<size_t>(1, (size_t(1) << 15) / std::max<size_t>(pixels, 1)),
+               [&](size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++) {
+      const uint32_t c = static_cast<uint32_t>(r / kernel);
+      const uint32_t ki = static_cast<uint32_t>(r % kernel / g.kernel_cols);
+      const uint32_t kj = static_cast<uint32_t>(r % g.kernel_cols);
+      const int64_t offset_h = int64_t(ki) * o.dilation_h - o.pad_h;
+      const int64_t offset_w = int64_t(kj) * o.dilation_w - o.pad_w;
+      uint32_t oi_begin, oi_end, oj_begin, oj_end;
+      valid_range(g.out_rows, g.rows, o.stride_h, offset_h, oi_begin, oi_end);
+      valid_range(g.out_cols, g.cols, o.stride_w, offset_w, oj_begin, oj_end);
+
+      const float* channel = image + size_t(c) * g.rows * g.cols;
+      float* out = columns + r * pixels;
+      std::fill(out, out + size_t(oi_begin) * g.out_cols, 0.0f);
+      for (uint32_t oi = oi_begin; oi < oi_end; oi++) {
+        float* dst = out + size_t(oi) * g.out_cols;
+        const float* src = channel + (int64_t(oi) * o.stride_h + offset_h) * g.cols + offset_w;
+        std::fill(dst, dst + oj_begin, 0.0f);
+        if (o.stride_w == 1) {
+          std::memcpy(dst + oj_begin, src + oj_begin, (oj_end - oj_begin) * sizeof(float));
+        } else {
+          for (uint32_t oj = oj_begin; oj < oj_end; oj++) {
+            dst[oj] = src[int64_t(oj) * o.stride_w];
+          }
+        }
+        std::fill(dst + oj_end, dst + g.out_cols, 0.0f);
+      }
+      std::fill(out + size_t(oi_end) * g.out_cols, out + pixels, 0.0f);
+    }
+  });
+}
+
+// image += col2im(columns), the adjoint of im2col(). Channels are independent,
+// so they are split across threads.
+inline void col2im(const Geometry& g, const float* columns, float* image) {
+  const Conv2DOptions& o = g.options;
+  const size_t kernel = size_t(g.kernel_rows) * g.kernel_cols;
+  const size_t pixels = g.out_pixels();
+  parallel_for(g.group_channels(), std::max<size_t>(1, (size_t(1) << 15) / std::max<size_t>(kernel * pixels, 1)),
+               [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      float* channel = image + c * g.rows * g.cols;
+      for (size_t k = 0; k < kernel; k++) {
+        const int64_t offset_h = int64_t(k / g.kernel_cols) * o.dilation_h - o.pad_h;
+        const int64_t offset_w = int64_t(k % g.kernel_cols) * o.dilation_w - o.pad_w;
+        uint32_t oi_begin, oi_end, oj_begin, oj_end;
+        valid_range(g.out_rows, g.rows, o.stride_h, offset_h, oi_begin, oi_end);
+        valid_range(g.out_cols, g.cols, o.stride_w, offset_w, oj_begin, oj_end);
+
+        const float* in = columns + (c * kernel + k) * pixels;
+        for (uint32_t oi = oi_begin; oi < oi_end; oi++) {
+          const float* src = in + size_t(oi) * g.out_cols;
+          float* dst = channel + (int64_t(oi) * o.stride_h + offset_h) * g.cols + offset_w;
+          for (uint32_t oj = oj_begin; oj < oj_end; oj++) {
+            dst[int64_t(oj) * o.stride_w] += src[oj];
+          }
+        }
+      }
+    }
+  });
+}
+
+template <size_t M>
+struct Winograd;
+
+// F(2x2, 3x3) and F(4x4, 3x3) (Lavin and Gray, "Fast Algorithms for
+// Convolutional Neural Networks"): with kAlpha = M + 2, one M x M output tile
+// is A^T [(G g G^T) . (B^T d B)] A for the kAlpha x kAlpha input tile d.
+template <>
+struct Winograd<2> {
+  static constexpr size_t kAlpha = 4;
+  static constexpr float BT[4][4] = {{1, 0, -1, 0}, {0, 1, 1, 0}, {0, -1, 1, 0}, {0, 1, 0, -1}};
+  static constexpr float G[4][3] = {{1, 0, 0}, {0.5f, 0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0, 0, 1}};
+  static constexpr float AT[2][4] = {{1, 1, 1, 0}, {0, 1, -1, -1}};
+};
+
+template <>
+struct Winograd<4> {
+  static constexpr size_t kAlpha = 6;
+  static constexpr float BT[6][6] = {{4, 0, -5, 0, 1, 0},  {0, -4, -4, 1, 1, 0}, {0, 4, -4, -1, 1, 0},
+                                     {0, -2, -1, 2, 1, 0}, {0, 2, -1, -2, 1, 0}, {0, 4, 0, -5, 0, 1}};
+  static constexpr float G[6][3] = {{1.0f / 4, 0, 0},
+                                    {-1.0f / 6, -1.0f / 6, -1.0f / 6},
+                                    {-1.0f / 6, 1.0f / 6, -1.0f / 6},
+                                    {1.0f / 24, 1.0f / 12, 1.0f / 6},
+                                    {1.0f / 24, -1.0f / 12, 1.0f / 6},
+                                    {0, 0, 1}};
+  static constexpr float AT[4][6] = {{1, 1, 1, 1, 1, 0}, {0, 1, -1, 2, -2, 0}, {0, 1, 1, 4, 4, 0}, {0, 1, -1, 8, -8, 1}};
+};
+
+namespace scalar {
+#define UPSILON_SIMD_WIDTH 1
+#include "conv_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace scalar
+
+#if UPSILON_X86_SIMD
+UPSILON_TARGET_REGION("sse4.1")
+namespace sse {
+#define UPSILON_SIMD_WIDTH 4
+#include "conv_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace sse
+UPSILON_UNTARGET_REGION
+
+UPSILON_TARGET_REGION("avx2,fma")
+namespace avx2 {
+#define UPSILON_SIMD_WIDTH 8
+#include "conv_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace avx2
+UPSILON_UNTARGET_REGION
+
+UPSILON_TARGET_REGION("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma")
+namespace avx512 {
+#define UPSILON_SIMD_WIDTH 16
+#include "conv_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace avx512
+UPSILON_UNTARGET_REGION
+#endif
+
+using kernels::Isa;
+using kernels::active_isa;
+
+template <size_t M>
+inline void winograd_filter(const float* g, size_t filters, float* u, size_t xi_stride) {
+  UPSILON_DISPATCH(winograd_filter<M>, g, filters, u, xi_stride)
+}
+
+template <size_t M>
+inline void winograd_input(const float* plane, size_t stride, size_t tiles_w, size_t tiles, float* v,
+                           size_t xi_stride) {
+  UPSILON_DISPATCH(winograd_input<M>, plane, stride, tiles_w, tiles, v, xi_stride)
+}
+
+template <size_t M>
+inline void winograd_output(const float* m, size_t xi_stride, size_t tiles_w, size_t tiles, float* plane,
+                            size_t stride) {
+  UPSILON_DISPATCH(winograd_output<M>, m, xi_stride, tiles_w, tiles, plane, stride)
+}
+
+inline void depthwise_channel(const Geometry& g, const float* image, const float* kernel, float* out) {
+  UPSILON_DISPATCH(depthwise_channel, g, image, kernel, out)
+}
+
+inline void axpy(size_t n, float alpha, const float* x, float* y) {
+  UPSILON_DISPATCH(axpy, n, alpha, x, y)
+}
+
+inline float dot(size_t n, const float* x, const float* y) {
+  UPSILON_DISPATCH(dot, n, x, y)
+}
+
+namespace detail {
+
+// Per-thread scratch for the tiles of one channel.
+inline float* plane_buffer(size_t n) {
+  thread_local std::vector<float> buffer;
+  if (buffer.size() < n) {
+    buffer.resize(n);
+  }
+  return buffer.data();
+}
+
+}  // namespace detail
+
+inline size_t winograd_tile(ConvAlgorithm algorithm) {
+  return algorithm == ConvAlgorithm::Winograd4x4 ? 4 : 2;
+}
+
+// Images per Winograd GEMM: enough that the GEMMs are kWinogradGemmTiles
+// wide, if the batch has them, without the workspace growing with the batch.
+constexpr size_t kWinogradGemmTiles = 256;
+
+inline size_t winograd_chunk(const Geometry& g, size_t tiles) {
+  return std::min<size_t>(g.batch, (kWinogradGemmTiles + tiles - 1) / tiles);
+}
+
+// Winograd forward pass. The filters are transformed once into kAlpha^2
+// matrices U (out x in channels of a group). Then, for a chunk of images and
+// a group at a time, every input tile is transformed into kAlpha^2 matrices V
+// (in channels x tiles of the chunk), the kAlpha^2 products U * V are GEMMs,
+// and the output transform turns them back into tiles. Padding is applied
+// one channel at a time in a per-thread buffer, never to the whole input.
+template <size_t M>
+void winograd_forward(const Geometry& g, const float* images, const float* weights, float* out, float* workspace) {
+  constexpr size_t A = Winograd<M>::kAlpha;
+  const Conv2DOptions& o = g.options;
+  const size_t cg = g.group_channels(), og = g.group_out_channels();
+  const size_t filters = size_t(g.out_channels) * cg;
+  const size_t tiles_h = (g.out_rows + M - 1) / M, tiles_w = (g.out_cols + M - 1) / M, tiles = tiles_h * tiles_w;
+  const size_t plane_rows = tiles_h * M + 2, plane_cols = tiles_w * M + 2;
+  const size_t chunk = winograd_chunk(g, tiles), width = chunk * tiles;
+  float* u = workspace;               // [A * A][out_channels][cg]
+  float* v = u + A * A * filters;     // [A * A][cg][width]
+  float* m = v + A * A * cg * width;  // [A * A][og][width]
+
+  parallel_for((filters + 15) / 16, row_grain(16 * A * A), [&](size_t begin, size_t end) {
+    const size_t f = begin * 16;
+    winograd_filter<M>(weights + f * 9, std::min(end * 16, filters) - f, u + f, filters);
+  });
+
+  uint32_t col_begin, col_end;
+  valid_range(static_cast<uint32_t>(plane_cols), g.cols, 1, -int64_t(o.pad_w), col_begin, col_end);
+  for (size_t n0 = 0; n0 < g.batch; n0 += chunk) {
+    const size_t images_in_chunk = std::min<size_t>(chunk, g.batch - n0);
+    for (uint32_t group = 0; group < o.groups; group++) {
+      // Task i is channel i % cg of image n0 + i / cg.
+      parallel_for(images_in_chunk * cg, row_grain(tiles * A * A), [&](size_t begin, size_t end) {
+        float* plane = detail::plane_buffer(plane_rows * plane_cols);
+        for (size_t task = begin; task < end; task++) {
+          const size_t n = task / cg, c = task % cg;
+          const float* channel = images + (n0 + n) * g.image_size() + (group * cg + c) * g.rows * g.cols;
+          for (size_t r = 0; r < plane_rows; r++) {
+            float* dst = plane + r * plane_cols;
+            const int64_t i = int64_t(r) - o.pad_h;
+            if (i < 0 || i >= g.rows) {
+              std::fill(dst, dst + plane_cols, 0.0f);
+              continue;
+            }
+            std::fill(dst, dst + col_begin, 0.0f);
+            std::memcpy(dst + col_begin, channel + i * g.cols + col_begin - o.pad_w,
+                        (col_end - col_begin) * sizeof(float));
+            std::fill(dst + col_end, dst + plane_cols, 0.0f);
+          }
+          winograd_input<M>(plane, plane_cols, tiles_w, tiles, v + c * width + n * tiles, cg * width);
+        }
+      });
+
+      for (size_t xi = 0; xi < A * A; xi++) {
+        gemm::gemm_strided(og, images_in_chunk * tiles, cg, 1.0f, u + xi * filters + group * og * cg, cg, 1,
+                           v + xi * cg * width, width, 1, 0.0f, m + xi * og * width, width, 1);
+      }
+
+      parallel_for(images_in_chunk * og, row_grain(tiles * A * A), [&](size_t begin, size_t end) {
+        float* plane = detail::plane_buffer(tiles_h * M * tiles_w * M);
+        for (size_t task = begin; task < end; task++) {
+          const size_t n = task / og, oc = task % og;
+          winograd_output<M>(m + oc * width + n * tiles, og * width, tiles_w, tiles, plane, tiles_w * M);
+          float* y = out + (n0 + n) * g.out_size() + (group * og + oc) * g.out_pixels();
+          for (size_t i = 0; i < g.out_rows; i++) {
+            std::memcpy(y + i * g.out_cols, plane + i * tiles_w * M, g.out_cols * sizeof(float));
+          }
+        }
+      });
+    }
+  }
+}
+
+// Depthwise forward pass of one image: out channel oc reads input channel
+// oc / multiplier.
+inline void depthwise_forward(const Geometry& g, const float* image, const float* weights, float* out) {
+  const size_t taps = size_t(g.kernel_rows) * g.kernel_cols, multiplier = g.group_out_channels();
+  parallel_for(g.out_channels, row_grain(g.out_pixels() * taps), [&](size_t begin, size_t end) {
+    for (size_t oc = begin; oc < end; oc++) {
+      depthwise_channel(g, image + oc / multiplier * g.rows * g.cols, weights + oc * taps, out + oc * g.out_pixels());
+    }
+  });
+}
+
+// Depthwise backward pass of one image, tap by tap: each tap adds a scaled
+// row of dY onto a row of dX and takes the dot product of the same rows for
+// its weight. Split by input channel so no two tasks write the same dX.
+inline void depthwise_backward(const Geometry& g, const float* image, const float* weights, const float* out_grad,
+                               float* image_grad, float* weight_grad) {
+  const Conv2DOptions& o = g.options;
+  const size_t taps = size_t(g.kernel_rows) * g.kernel_cols, multiplier = g.group_out_channels();
+  const size_t plane = size_t(g.rows) * g.cols;
+  parallel_for(g.channels, row_grain(multiplier * g.out_pixels() * taps), [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      for (size_t oc = c * multiplier; oc < (c + 1) * multiplier; oc++) {
+        const float* w = weights + oc * taps;
+        const float* dy = out_grad + oc * g.out_pixels();
+        for (uint32_t kj = 0; kj < g.kernel_cols; kj++) {
+          const int64_t offset_w = int64_t(kj) * o.dilation_w - o.pad_w;
+          uint32_t oj_begin, oj_end;
+          valid_range(g.out_cols, g.cols, o.stride_w, offset_w, oj_begin, oj_end);
+          const size_t n = oj_end - oj_begin;
+          if (n == 0) {
+            continue;
+          }
+          for (uint32_t ki = 0; ki < g.kernel_rows; ki++) {
+            const int64_t offset_h = int64_t(ki) * o.dilation_h - o.pad_h;
+            uint32_t oi_begin, oi_end;
+            valid_range(g.out_rows, g.rows, o.stride_h, offset_h, oi_begin, oi_end);
+            const size_t tap = ki * g.kernel_cols + kj;
+            float wg = 0.0f;
+            for (uint32_t oi = oi_begin; oi < oi_end; oi++) {
+              const float* dy_row = dy + size_t(oi) * g.out_cols + oj_begin;
+              const int64_t at = c * plane + (int64_t(oi) * o.stride_h + offset_h) * g.cols +
+                                 int64_t(oj_begin) * o.stride_w + offset_w;
+              if (o.stride_w == 1) {
+                if (image_grad != nullptr) {
+                  axpy(n, w[tap], dy_row, image_grad + at);
+                }
+                if (weight_grad != nullptr) {
+                  wg += dot(n, dy_row, image + at);
+                }
+                continue;
+              }
+              for (size_t j = 0; j < n; j++) {
+                if (image_grad != nullptr) {
+                  image_grad[at + int64_t(j) * o.stride_w] += w[tap] * dy_row[j];
+                }
+                wg += dy_row[j] * image[at + int64_t(j) * o.stride_w];
+              }
+            }
+            if (weight_grad != nullptr) {
+              weight_grad[oc * taps + tap] += wg;
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+// Floats of workspace that forward() (or backward()) needs for g.
+inline size_t workspace_size(const Geometry& g, bool backward) {
+  if (g.algorithm == ConvAlgorithm::Direct) {
+    return 0;
+  }
+  if (!backward && (g.algorithm == ConvAlgorithm::Winograd2x2 || g.algorithm == ConvAlgorithm::Winograd4x4)) {
+    const size_t m = winograd_tile(g.algorithm), alpha = m + 2;
+    const size_t width = winograd_chunk(g, g.tiles(m)) * g.tiles(m);
+    const size_t cg = g.group_channels(), og = g.group_out_channels();
+    return alpha * alpha * (g.out_channels * cg + cg * width + og * width);
+  }
+  return g.pointwise() ? 0 : g.patch() * g.out_pixels();
+}
+
+// out = W * im2col(image), one GEMM per group. columns is unused when the
+// convolution is pointwise.
+inline void im2col_forward(const Geometry& g, const float* image, const float* weights, float* out, float* columns) {
+  const size_t patch = g.patch(), pixels = g.out_pixels();
+  const size_t og = g.group_out_channels();
+  for (uint32_t group = 0; group < g.options.groups; group++) {
+    const float* in = image + size_t(group) * g.group_channels() * g.rows * g.cols;
+    const float* cols = in;
+    if (!g.pointwise()) {
+      im2col(g, in, columns);
+      cols = columns;
+    }
+    gemm::gemm_strided(og, pixels, patch, 1.0f, weights + group * og * patch, patch, 1, cols, pixels, 1, 0.0f,
+                       out + group * og * pixels, pixels, 1);
+  }
+}
+
+// weight_grad += dY * columns^T and image_grad += col2im(W^T * dY).
+inline void im2col_backward(const Geometry& g, const float* image, const float* weights, const float* out_grad,
+                     float* image_grad, float* weight_grad, float* columns) {
+  const size_t patch = g.patch(), pixels = g.out_pixels();
+  const size_t og = g.group_out_channels();
+  for (uint32_t group = 0; group < g.options.groups; group++) {
+    const size_t in_offset = size_t(group) * g.group_channels() * g.rows * g.cols;
+    const float* dy = out_grad + group * og * pixels;
+    const float* w = weights + group * og * patch;
+    if (weight_grad != nullptr) {
+      const float* cols = image + in_offset;
+      if (!g.pointwise()) {
+        im2col(g, image + in_offset, columns);
+        cols = columns;
+      }
+      gemm::gemm_strided(og, patch, pixels, 1.0f, dy, pixels, 1, cols, 1, pixels, 1.0f, weight_grad + group * og * patch,
+                         patch, 1);
+    }
+    if (image_grad != nullptr) {
+      if (g.pointwise()) {
+        gemm::gemm_strided(patch, pixels, og, 1.0f, w, 1, patch, dy, pixels, 1, 1.0f, image_grad + in_offset, pixels,
+                           1);
+      } else {
+        gemm::gemm_strided(patch, pixels, og, 1.0f, w, 1, patch, dy, pixels, 1, 0.0f, columns, pixels, 1);
+        col2im(g, columns, image_grad + in_offset);
+      }
+    }
+  }
+}
+
+// out = conv(images, weights) for the g.batch images with g.algorithm.
+// workspace must hold workspace_size(g, false) floats.
+inline void forward(const Geometry& g, const float* images, const float* weights, float* out, float* workspace) {
+  switch (g.algorithm) {
+    case ConvAlgorithm::Winograd2x2:
+      return winograd_forward<2>(g, images, weights, out, workspace);
+    case ConvAlgorithm::Winograd4x4:
+      return winograd_forward<4>(g, images, weights, out, workspace);
+    case ConvAlgorithm::Direct:
+      for (uint32_t n = 0; n < g.batch; n++) {
+        depthwise_forward(g, images + n * g.image_size(), weights, out + n * g.out_size());
+      }
+      return;
+    default:
+      for (uint32_t n = 0; n < g.batch; n++) {
+        im2col_forward(g, images + n * g.image_size(), weights, out + n * g.out_size(), workspace);
+      }
+  }
+}
+
+// Accumulates the gradients of the g.batch images into image_grad and
+// weight_grad; either may be null. workspace must hold
+// workspace_size(g, true) floats.
+inline void backward(const Geometry& g, const float* images, const float* weights, const float* out_grad,
+                     float* image_grad, float* weight_grad, float* workspace) {
+  for (uint32_t n = 0; n < g.batch; n++) {
+    const float* x = images + n * g.image_size();
+    const float* dy = out_grad + n * g.out_size();
+    float* dx = image_grad == nullptr ? nullptr : image_grad + n * g.image_size();
+    if (g.algorithm == ConvAlgorithm::Direct) {
+      depthwise_backward(g, x, weights, dy, dx, weight_grad);
+    } else {
+      im2col_backward(g, x, weights, dy, dx, weight_grad, workspace);
+    }
+  }
+}
+
+}  // namespace conv
+}  // namespace upsilon
@@ -0,0 +1,291 @@
+// Convolution kernels shared by every instruction set. Deliberately has no
+// include guard: conv.hh includes it once per ISA, inside namespace
+// upsilon::conv::<isa>, with UPSILON_SIMD_WIDTH set to the number of float
+// lanes (1 for the scalar fallback). Do not include it directly.
+
+#if UPSILON_SIMD_WIDTH > 1
+typedef float vfloat __attribute__((vector_size(UPSILON_SIMD_WIDTH * sizeof(float))));
+#else
+typedef float vfloat;
+#endif
+
+constexpr size_t kWidth = UPSILON_SIMD_WIDTH;
+
+inline vfloat load(const float* p) {
+  vfloat v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void store(float* p, vfloat v) {
+  std::memcpy(p, &v, sizeof(v));
+}
+
+// sum_k coeffs[k] * x[k * step] for a constant coefficient row. Once the loop
+// is unrolled the zero terms vanish and +-1 needs no multiply.
+template <size_t N>
+inline vfloat combine(const float* coeffs, const vfloat* x, size_t step) {
+  vfloat acc{};
+  bool first = true;
+#pragma GCC unroll 8
+  for (size_t k = 0; k < N; k++) {
+    const float a = coeffs[k];
+    if (a == 0.0f) {
+      continue;
+    }
+    const vfloat term = a == 1.0f ? x[k * step] : a == -1.0f ? -x[k * step] : a * x[k * step];
+    acc = first ? term : acc + term;
+    first = false;
+  }
+  return acc;
+}
+
+// Winograd filter transform G g G^T of consecutive 3x3 filters, one filter
+// per lane: element xi of filter f goes to u[xi * xi_stride + f].
+template <size_t M>
+void winograd_filter(const float* g, size_t filters, float* u, size_t xi_stride) {
+  typedef Winograd<M> W;
+  constexpr size_t A = W::kAlpha;
+  for (size_t f0 = 0; f0 < filters; f0 += kWidth) {
+    const size_t lanes = std::min(kWidth, filters - f0);
+    alignas(64) float gathered[9][kWidth];
+    for (size_t l = 0; l < kWidth; l++) {
+      const float* filter = g + (f0 + std::min(l, lanes - 1)) * 9;
+      for (size_t k = 0; k < 9; k++) {
+        gathered[k][l] = filter[k];
+      }
+    }
+    vfloat x[9], t[A * 3];
+#pragma GCC unroll 9
+    for (size_t k = 0; k < 9; k++) {
+      x[k] = load(gathered[k]);
+    }
+#pragma GCC unroll 6
+    for (size_t i = 0; i < A; i++) {
+#pragma GCC unroll 3
+      for (size_t c = 0; c < 3; c++) {
+        t[i * 3 + c] = combine<3>(W::G[i], x + c, 3);
+      }
+    }
+#pragma GCC unroll 6
+    for (size_t i = 0; i < A; i++) {
+#pragma GCC unroll 6
+      for (size_t j = 0; j < A; j++) {
+        const vfloat y = combine<3>(W::G[j], t + i * 3, 1);
+        float* dst = u + (i * A + j) * xi_stride + f0;
+        if (lanes == kWidth) {
+          store(dst, y);
+        } else {
+          alignas(64) float tmp[kWidth];
+          store(tmp, y);
+          std::memcpy(dst, tmp, lanes * sizeof(float));
+        }
+      }
+    }
+  }
+}
+
+// Offsets in a plane with row stride `stride` of tiles [t0, t0 + kWidth)
+// in a grid tiles_w wide, clamped to the last tile so every lane is valid.
+template <size_t M>
+inline void tile_offsets(size_t t0, size_t tiles, size_t tiles_w, size_t stride, size_t* offsets) {
+  for (size_t l = 0; l < kWidth; l++) {
+    const size_t t = std::min(t0 + l, tiles - 1);
+    offsets[l] = t / tiles_w * M * stride + t % tiles_w * M;
+  }
+}
+
+// Winograd input transform B^T d B of one channel, one tile per lane. plane
+// is the channel already padded, with tile t of the tiles_w-wide grid
+// starting at row t / tiles_w * M and column t % tiles_w * M; element xi of
+// tile t goes to v[xi * xi_stride + t].
+template <size_t M>
+void winograd_input(const float* plane, size_t stride, size_t tiles_w, size_t tiles, float* v, size_t xi_stride) {
+  typedef Winograd<M> W;
+  constexpr size_t A = W::kAlpha;
+  for (size_t t0 = 0; t0 < tiles; t0 += kWidth) {
+    const size_t lanes = std::min(kWidth, tiles - t0);
+    size_t offsets[kWidth];
+    tile_offsets<M>(t0, tiles, tiles_w, stride, offsets);
+    alignas(64) float gathered[A * A][kWidth];
+    for (size_t r = 0; r < A; r++) {
+#pragma GCC unroll 6
+      for (size_t c = 0; c < A; c++) {
+        const float* src = plane + r * stride + c;
+#pragma GCC unroll 16
+        for (size_t l = 0; l < kWidth; l++) {
+          gathered[r * A + c][l] = src[offsets[l]];
+        }
+      }
+    }
+    vfloat d[A * A], t[A * A];
+#pragma GCC unroll 36
+    for (size_t i = 0; i < A * A; i++) {
+      d[i] = load(gathered[i]);
+    }
+#pragma GCC unroll 6
+    for (size_t i = 0; i < A; i++) {
+#pragma GCC unroll 6
+      for (size_t c = 0; c < A; c++) {
+        t[i * A + c] = combine<A>(W::BT[i], d + c, A);
+      }
+    }
+#pragma GCC unroll 6
+    for (size_t i = 0; i < A; i++) {
+#pragma GCC unroll 6
+      for (size_t j = 0; j < A; j++) {
+        const vfloat y = combine<A>(W::BT[j], t + i * A, 1);
+        float* dst = v + (i * A + j) * xi_stride + t0;
+        if (lanes == kWidth) {
+          store(dst, y);
+        } else {
+          alignas(64) float tmp[kWidth];
+          store(tmp, y);
+          std::memcpy(dst, tmp, lanes * sizeof(float));
+        }
+      }
+    }
+  }
+}
+
+// Winograd output transform A^T m A, the inverse of winograd_input() for the
+// products of one channel: reads element xi of tile t from
+// m[xi * xi_stride + t] and writes the M x M outputs of the tile to plane.
+template <size_t M>
+void winograd_output(const float* m, size_t xi_stride, size_t tiles_w, size_t tiles, float* plane, size_t stride) {
+  typedef Winograd<M> W;
+  constexpr size_t A = W::kAlpha;
+  for (size_t t0 = 0; t0 < tiles; t0 += kWidth) {
+    const size_t lanes = std::min(kWidth, tiles - t0);
+    vfloat x[A * A], t[M * A];
+#pragma GCC unroll 36
+    for (size_t xi = 0; xi < A * A; xi++) {
+      const float* src = m + xi * xi_stride + t0;
+      if (lanes == kWidth) {
+        x[xi] = load(src);
+      } else {
+        alignas(64) float tmp[kWidth] = {};
+        std::memcpy(tmp, src, lanes * sizeof(float));
+        x[xi] = load(tmp);
+      }
+    }
+#pragma GCC unroll 4
+    for (size_t i = 0; i < M; i++) {
+#pragma GCC unroll 6
+      for (size_t c = 0; c < A; c++) {
+        t[i * A + c] = combine<A>(W::AT[i], x + c, A);
+      }
+    }
+    alignas(64) float y[M * M][kWidth];
+#pragma GCC unroll 4
+    for (size_t i = 0; i < M; i++) {
+#pragma GCC unroll 4
+      for (size_t j = 0; j < M; j++) {
+        store(y[i * M + j], combine<A>(W::AT[j], t + i * A, 1));
+      }
+    }
+    size_t offsets[kWidth];
+    tile_offsets<M>(t0, tiles, tiles_w, stride, offsets);
+    for (size_t i = 0; i < M; i++) {
+#pragma GCC unroll 4
+      for (size_t j = 0; j < M; j++) {
+        float* dst = plane + i * stride + j;
+        for (size_t l = 0; l < lanes; l++) {
+          dst[offsets[l]] = y[i * M + j][l];
+        }
+      }
+    }
+  }
+}
+
+// out = one channel of image convolved with one kernel_rows x kernel_cols
+// filter, straight from the definition. Columns whose taps all land inside
+// the row are computed a vector at a time when the stride is 1; the borders
+// check every tap.
+inline void depthwise_channel(const Geometry& g, const float* image, const float* kernel, float* out) {
+  const Conv2DOptions& o = g.options;
+  uint32_t first_begin, first_end, last_begin, last_end;
+  valid_range(g.out_cols, g.cols, o.stride_w, -int64_t(o.pad_w), first_begin, first_end);
+  valid_range(g.out_cols, g.cols, o.stride_w, int64_t(g.kernel_cols - 1) * o.dilation_w - o.pad_w, last_begin,
+              last_end);
+  const uint32_t inner_begin = first_begin, inner_end = std::max(first_begin, last_end);
+
+  for (uint32_t oi = 0; oi < g.out_rows; oi++) {
+    float* dst = out + size_t(oi) * g.out_cols;
+    const int64_t top = int64_t(oi) * o.stride_h - o.pad_h;
+    uint32_t ki_begin, ki_end;  // kernel rows inside the image
+    valid_range(g.kernel_rows, g.rows, o.dilation_h, top, ki_begin, ki_end);
+    // Sum of the valid taps for output column oj; checked says whether the
+    // columns can fall outside the row.
+    auto at = [&](uint32_t oj, bool checked) {
+      const int64_t left = int64_t(oj) * o.stride_w - o.pad_w;
+      float sum = 0.0f;
+      for (uint32_t ki = ki_begin; ki < ki_end; ki++) {
+        const float* src = image + (top + int64_t(ki) * o.dilation_h) * g.cols + left;
+        const float* taps = kernel + ki * g.kernel_cols;
+        for (uint32_t kj = 0; kj < g.kernel_cols; kj++) {
+          const int64_t j = int64_t(kj) * o.dilation_w;
+          if (!checked || (left + j >= 0 && left + j < g.cols)) {
+            sum += taps[kj] * src[j];
+          }
+        }
+      }
+      dst[oj] = sum;
+    };
+
+    uint32_t oj = 0;
+    for (; oj < inner_begin; oj++) {
+      at(oj, true);
+    }
+    if (o.stride_w == 1) {
+      for (; oj + kWidth <= inner_end; oj += kWidth) {
+        vfloat acc{};
+        for (uint32_t ki = ki_begin; ki < ki_end; ki++) {
+          const float* src = image + (top + int64_t(ki) * o.dilation_h) * g.cols + oj - o.pad_w;
+          const float* taps = kernel + ki * g.kernel_cols;
+          for (uint32_t kj = 0; kj < g.kernel_cols; kj++) {
+            acc += (taps[kj] - vfloat{}) * load(src + size_t(kj) * o.dilation_w);
+          }
+        }
+        store(dst + oj, acc);
+      }
+    }
+    for (; oj < inner_end; oj++) {
+      at(oj, false);
+    }
+    for (; oj < g.out_cols; oj++) {
+      at(oj, true);
+    }
+  }
+}
+
+// y[0, n) += alpha * x[0, n).
+inline void axpy(size_t n, float alpha, const float* x, float* y) {
+  const vfloat a = alpha - vfloat{};
+  size_t i = 0;
+  for (; i + kWidth <= n; i += kWidth) {
+    store(y + i, load(y + i) + a * load(x + i));
+  }
+  for (; i < n; i++) {
+    y[i] += alpha * x[i];
+  }
+}
+
+// sum of x[i] * y[i] over [0, n).
+inline float dot(size_t n, const float* x, const float* y) {
+  vfloat acc{};
+  size_t i = 0;
+  for (; i + kWidth <= n; i += kWidth) {
+    acc += load(x + i) * load(y + i);
+  }
+  alignas(64) float lanes[kWidth];
+  store(lanes, acc);
+  float sum = 0.0f;
+  for (size_t l = 0; l < kWidth; l++) {
+    sum += lanes[l];
+  }
+  for (; i < n; i++) {
+    sum += x[i] * y[i];
+  }
+  return sum;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Lazy elementwise expressions. Arithmetic on Tensor::lazy() handles builds a
+// small expression tree instead of computing anything; constructing a Tensor
+// from the tree evaluates it in one fused, vectorized pass (see
+// kernels::evaluate), so a chain like a + b * (1 - c * c) reads each operand
+// once and allocates only the result.
+//
+// Nodes hold plain pointers into the operands, so an expression must be
+// evaluated before the tensors it refers to go away, normally within the same
+// statement.
+
+namespace upsilon {
+namespace expr {
+
+template <typename E>
+struct Expr {
+  const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// A contiguous tensor operand.
+struct Ref : Expr<Ref> {
+  const float* data;
+  const std::vector<uint32_t>* shape;
+
+  Ref(const float* data, const std::vector<uint32_t>* shape) : data(data), shape(shape) {}
+};
+
+// A scalar broadcast to every element.
+struct Const : Expr<Const> {
+  float value;
+
+  explicit Const(float value) : value(value) {}
+};
+
+struct Add {};
+struct Sub {};
+struct Mul {};
+struct Div {};
+struct Max {};
+struct Min {};
+struct Greater {};  // 1 where lhs > rhs, otherwise 0
+struct Neg {};
+struct Exp {};
+struct Log {};
+struct Tanh {};
+struct Sigmoid {};
+
+template <typename Op, typename A>
+struct Unary : Expr<Unary<Op, A>> {
+  A arg;
+
+  explicit Unary(const A& arg) : arg(arg) {}
+};
+
+template <typename Op, typename L, typename R>
+struct Binary : Expr<Binary<Op, L, R>> {
+  L lhs;
+  R rhs;
+
+  Binary(const L& lhs, const R& rhs) : lhs(lhs), rhs(rhs) {}
+};
+
+#define UPSILON_EXPR_BINARY(name, Op)                                                   \
+  template <typename L, typename R>                                                     \
+  Binary<Op, L, R> name(const Expr<L>& l, const Expr<R>& r) {                           \
+    return Binary<Op, L, R>(l.self(), r.self());                                        \
+  }                                                                                     \
+  template <typename L>                                                                 \
+  Binary<Op, L, Const> name(const Expr<L>& l, float r) {                                \
+    return Binary<Op, L, Const>(l.self(), Const(r));                                    \
+  }                                                                                     \
+  template <typename R>                                                                 \
+  Binary<Op, Const, R> name(float l, const Expr<R>& r) {                                \
+    return Binary<Op, Const, R>(Const(l), r.self());                                    \
+  }
+
+UPSILON_EXPR_BINARY(operator+, Add)
+UPSILON_EXPR_BINARY(operator-, Sub)
+UPSILON_EXPR_BINARY(operator*, Mul)
+UPSILON_EXPR_BINARY(operator/, Div)
+UPSILON_EXPR_BINARY(max, Max)
+UPSILON_EXPR_BINARY(min, Min)
+UPSILON_EXPR_BINARY(greater, Greater)
+
+#undef UPSILON_EXPR_BINARY
+
+#define UPSILON_EXPR_UNARY(name, Op)     \
+  template <typename A>                  \
+  Unary<Op, A> name(const Expr<A>& a) {  \
+    return Unary<Op, A>(a.self());       \
+  }
+
+UPSILON_EXPR_UNARY(operator-, Neg)
+UPSILON_EXPR_UNARY(exp, Exp)
+UPSILON_EXPR_UNARY(log, Log)
+UPSILON_EXPR_UNARY(tanh, Tanh)
+UPSILON_EXPR_UNARY(sigmoid, Sigmoid)
+
+#undef UPSILON_EXPR_UNARY
+
+// Shape shared by every tensor operand, or nullptr if there are none.
+inline const std::vector<uint32_t>* shape_of(const Ref& e) {
+  return e.shape;
+}
+
+inline const std::vector<uint32_t>* shape_of(const Const&) {
+  return nullptr;
+}
+
+template <typename Op, typename A>
+const std::vector<uint32_t>* shape_of(const Unary<Op, A>& e) {
+  return shape_of(e.arg);
+}
+
+template <typename Op, typename L, typename R>
+const std::vector<uint32_t>* shape_of(const Binary<Op, L, R>& e) {
+  const std::vector<uint32_t>* l = shape_of(e.lhs);
+  const std::vector<uint32_t>* r = shape_of(e.rhs);
+  if (l && r && *l != *r) {
+    throw std::invalid_argument("Expression operands require same shape");
+  }
+  return l ? l : r;
+}
+
+}  // namespace expr
+}  // namespace upsilon
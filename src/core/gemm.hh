@@ -0,0 +1,381 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "kernels.hh"
+#include "thread_pool.hh"
+
+// Single-precision GEMM on packed operands.
+//
+// gemm_impl.hh holds the packing routines, the register-blocked microkernel
+// and the cache-blocked loop nest, written once against vector extensions and
+// included once per instruction set like kernels_impl.hh. Operands are read
+// through arbitrary (row, column) strides while they are packed, so transposed
+// views cost nothing extra.
+//
+// The register tile and the cache blocks are picked per instruction set by a
+// short autotuning run the first time a product is computed, and the choice
+// is cached in a file (see cache_path()) so later processes skip the run.
+
+namespace upsilon {
+namespace gemm {
+
+using kernels::Isa;
+using kernels::active_isa;
+
+enum class Trans {
+  No,
+  Yes
+};
+
+// An MR x NR register tile, MC x KC blocks of packed A (kept in L2) and
+// KC x NC panels of packed B (kept in L3). mr/nr select the microkernel.
+struct Config {
+  uint32_t mr = 0;
+  uint32_t nr = 0;
+  uint32_t mc = 0;
+  uint32_t kc = 0;
+  uint32_t nc = 0;
+
+  bool operator==(const Config& other) const {
+    return mr == other.mr && nr == other.nr && mc == other.mc && kc == other.kc && nc == other.nc;
+  }
+};
+
+inline Config default_config(uint32_t mr, uint32_t nr) {
+  return Config{mr, nr, std::max<uint32_t>(mr, 192 / mr * mr), 256, std::max<uint32_t>(nr, 2048 / nr * nr)};
+}
+
+namespace detail {
+
+// Growable 64-byte aligned scratch buffers, one set per thread, so packing
+// allocates nothing once the largest product has been seen.
+inline float* pack_buffer(size_t slot, size_t n) {
+  struct Buffer {
+    std::unique_ptr<float, decltype(&std::free)> data{nullptr, &std::free};
+    size_t size = 0;
+  };
+  thread_local std::array<Buffer, 2> buffers;
+  Buffer& buffer = buffers[slot];
+  if (buffer.size < n) {
+    const size_t bytes = (n * sizeof(float) + 63) / 64 * 64;
+    buffer.data.reset(static_cast<float*>(std::aligned_alloc(64, bytes)));
+    if (!buffer.data) {
+      throw std::bad_alloc();
+    }
+    buffer.size = n;
+  }
+  return buffer.data.get();
+}
+
+}  // namespace detail
+
+// Multiply-adds per compute task; smaller pieces are not worth handing to
+// another thread. Packing splits by row_grain().
+constexpr size_t kGrainMultiplyAdds = size_t(1) << 18;
+
+// Products up to this many multiply-adds skip packing, which costs more than
+// it saves on them; so do those narrower than a register tile.
+constexpr size_t kDirectMultiplyAdds = size_t(1) << 20;
+
+namespace scalar {
+#define UPSILON_SIMD_WIDTH 1
+#include "gemm_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace scalar
+
+#if UPSILON_X86_SIMD
+UPSILON_TARGET_REGION("sse4.1")
+namespace sse {
+#define UPSILON_SIMD_WIDTH 4
+#include "gemm_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace sse
+UPSILON_UNTARGET_REGION
+
+UPSILON_TARGET_REGION("avx2,fma")
+namespace avx2 {
+#define UPSILON_SIMD_WIDTH 8
+#include "gemm_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace avx2
+UPSILON_UNTARGET_REGION
+
+UPSILON_TARGET_REGION("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma")
+namespace avx512 {
+#define UPSILON_SIMD_WIDTH 16
+#include "gemm_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace avx512
+UPSILON_UNTARGET_REGION
+#endif
+
+// Register tiles available for the active instruction set, each with the
+// default cache blocking.
+inline std::vector<Config> tiles() {
+  UPSILON_DISPATCH(tiles)
+}
+
+namespace detail {
+
+inline void run(const Config& config, size_t m, size_t n, size_t k, float alpha, const float* a, int64_t a_rs,
+                int64_t a_cs, const float* b, int64_t b_rs, int64_t b_cs, float beta, float* c, int64_t ldc) {
+  UPSILON_DISPATCH(gemm, config, m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, ldc)
+}
+
+inline void run_direct(size_t m, size_t n, size_t k, float alpha, const float* a, int64_t a_rs, int64_t a_cs,
+                       const float* b, int64_t b_rs, int64_t b_cs, float beta, float* c, int64_t ldc) {
+  UPSILON_DISPATCH(direct, m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, ldc)
+}
+
+struct ConfigTable {
+  std::mutex mutex;
+  std::array<Config, 4> configs{};  // indexed by Isa; mr == 0 until chosen
+};
+
+inline ConfigTable& config_table() {
+  static ConfigTable table;
+  return table;
+}
+
+inline bool is_tile(const Config& config) {
+  for (const Config& tile : tiles()) {
+    if (tile.mr == config.mr && tile.nr == config.nr) {
+      return config.mc > 0 && config.kc > 0 && config.nc > 0;
+    }
+  }
+  return false;
+}
+
+}  // namespace detail
+
+// File holding tuned configs, one "<isa> mr nr mc kc nc" line per instruction
+// set: $UPSILON_GEMM_CACHE, else $XDG_CACHE_HOME/upsilon/gemm_tiles, else
+// $HOME/.cache/upsilon/gemm_tiles. Empty if none of these is set.
+inline std::string cache_path() {
+  if (const char* path = std::getenv("UPSILON_GEMM_CACHE")) {
+    return path;
+  }
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+    return std::string(xdg) + "/upsilon/gemm_tiles";
+  }
+  if (const char* home = std::getenv("HOME")) {
+    return std::string(home) + "/.cache/upsilon/gemm_tiles";
+  }
+  return "";
+}
+
+// The cached config for isa, if the cache file has a usable one.
+inline bool load_config(Isa isa, Config& config) {
+  const std::string path = cache_path();
+  std::FILE* file = path.empty() ? nullptr : std::fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char name[32];
+  Config entry;
+  bool found = false;
+  while (std::fscanf(file, "%31s %u %u %u %u %u", name, &entry.mr, &entry.nr, &entry.mc, &entry.kc, &entry.nc) == 6) {
+    if (std::strcmp(name, kernels::isa_name(isa)) == 0) {
+      config = entry;
+      found = true;
+    }
+  }
+  std::fclose(file);
+  return found;
+}
+
+// Rewrites isa's line of the cache file, keeping the others. Failures (e.g.
+// a read-only home directory) are ignored: the config then lasts for this
+// process only.
+inline void save_config(Isa isa, const Config& config) {
+  const std::string path = cache_path();
+  if (path.empty()) {
+    return;
+  }
+  for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+
+  std::vector<std::string> lines;
+  if (std::FILE* file = std::fopen(path.c_str(), "r")) {
+    char line[256];
+    const std::string prefix = std::string(kernels::isa_name(isa)) + " ";
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+      if (std::strncmp(line, prefix.c_str(), prefix.size()) != 0) {
+        lines.emplace_back(line);
+      }
+    }
+    std::fclose(file);
+  }
+  const std::string tmp = path + ".tmp";
+  std::FILE* file = std::fopen(tmp.c_str(), "w");
+  if (file == nullptr) {
+    return;
+  }
+  for (const std::string& line : lines) {
+    std::fputs(line.c_str(), file);
+  }
+  std::fprintf(file, "%s %u %u %u %u %u\n", kernels::isa_name(isa), config.mr, config.nr, config.mc, config.kc,
+               config.nc);
+  std::fclose(file);
+  std::rename(tmp.c_str(), path.c_str());
+}
+
+// Times each register tile on a representative product, then sweeps KC, MC
+// and NC in turn around the best one. Takes a fraction of a second.
+inline Config autotune() {
+  const size_t m = 384, n = 1536, k = 384;
+  std::vector<float> a(m * k), b(k * n), c(m * n);
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<float>(i % 17) * 0.125f - 1.0f;
+  }
+  for (size_t i = 0; i < b.size(); i++) {
+    b[i] = static_cast<float>(i % 13) * 0.0625f - 0.5f;
+  }
+  const auto seconds = [&](const Config& config) {
+    double best = 1e30;
+    for (int rep = 0; rep < 3; rep++) {
+      const auto start = std::chrono::steady_clock::now();
+      detail::run(config, m, n, k, 1.0f, a.data(), k, 1, b.data(), n, 1, 0.0f, c.data(), n);
+      best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+  };
+
+  Config best;
+  double best_time = 1e30;
+  const auto consider = [&](const Config& config) {
+    const double t = seconds(config);
+    if (t < best_time) {
+      best_time = t;
+      best = config;
+    }
+  };
+  for (const Config& tile : tiles()) {
+    consider(tile);
+  }
+  const Config tile = best;
+  for (uint32_t kc : {128u, 192u, 384u, 512u}) {
+    Config config = tile;
+    config.kc = kc;
+    consider(config);
+  }
+  const Config blocked = best;
+  for (uint32_t rows : {48u, 96u, 384u}) {
+    Config config = blocked;
+    config.mc = std::max(config.mr, rows / config.mr * config.mr);
+    consider(config);
+  }
+  const Config sized = best;
+  for (uint32_t cols : {512u, 1024u, 4096u}) {
+    Config config = sized;
+    config.nc = std::max(config.nr, cols / config.nr * config.nr);
+    consider(config);
+  }
+  return best;
+}
+
+// Config used for the active instruction set: set_config()'s, else the cached
+// one, else the result of autotune() (saved to the cache). Setting
+// UPSILON_GEMM_AUTOTUNE=0 skips the tuning run and uses the defaults.
+inline Config config() {
+  const Isa isa = active_isa();
+  detail::ConfigTable& table = detail::config_table();
+  std::lock_guard<std::mutex> lock(table.mutex);
+  Config& config = table.configs[static_cast<size_t>(isa)];
+  if (config.mr == 0) {
+    Config loaded;
+    const char* env = std::getenv("UPSILON_GEMM_AUTOTUNE");
+    if (load_config(isa, loaded) && detail::is_tile(loaded)) {
+      config = loaded;
+    } else if (env != nullptr && std::strcmp(env, "0") == 0) {
+      config = tiles().front();
+    } else {
+      config = autotune();
+      save_config(isa, config);
+    }
+  }
+  return config;
+}
+
+// Overrides the config for the active instruction set in this process.
+inline void set_config(const Config& config) {
+  if (!detail::is_tile(config)) {
+    throw std::invalid_argument("GEMM config has no matching microkernel");
+  }
+  detail::ConfigTable& table = detail::config_table();
+  std::lock_guard<std::mutex> lock(table.mutex);
+  table.configs[static_cast<size_t>(active_isa())] = config;
+}
+
+// c = alpha * a * b + beta * c, where a is m x k, b is k x n and c is m x n,
+// each addressed as x[i * row_stride + j * col_stride]. c must not overlap a
+// or b; with beta = 0 its old contents are ignored.
+inline void gemm_strided(size_t m, size_t n, size_t k, float alpha, const float* a, int64_t a_rs, int64_t a_cs,
+                         const float* b, int64_t b_rs, int64_t b_cs, float beta, float* c, int64_t c_rs,
+                         int64_t c_cs) {
+  if (m == 0 || n == 0) {
+    return;
+  }
+  if (n == 1) {
+    c_cs = 1;
+  }
+  if (c_cs != 1) {
+    if (c_rs == 1) {
+      // c^T = b^T a^T has unit column stride.
+      return gemm_strided(n, m, k, alpha, b, b_cs, b_rs, a, a_cs, a_rs, beta, c, c_cs, 1);
+    }
+    std::vector<float> packed(m * n);
+    for (size_t i = 0; i < m; i++) {
+      for (size_t j = 0; j < n; j++) {
+        packed[i * n + j] = c[i * c_rs + j * c_cs];
+      }
+    }
+    gemm_strided(m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, packed.data(), n, 1);
+    for (size_t i = 0; i < m; i++) {
+      for (size_t j = 0; j < n; j++) {
+        c[i * c_rs + j * c_cs] = packed[i * n + j];
+      }
+    }
+    return;
+  }
+  if (k == 0 || alpha == 0.0f) {
+    for (size_t i = 0; i < m; i++) {
+      for (size_t j = 0; j < n; j++) {
+        float& x = c[i * c_rs + j];
+        x = beta == 0.0f ? 0.0f : beta * x;
+      }
+    }
+    return;
+  }
+  if (m * n * k <= kDirectMultiplyAdds) {
+    return detail::run_direct(m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, c_rs);
+  }
+  const Config tuned = config();
+  if (m < tuned.mr || n < tuned.nr) {
+    return detail::run_direct(m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, c_rs);
+  }
+  detail::run(tuned, m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, c_rs);
+}
+
+// BLAS-style product on row-major matrices: c = alpha * op(a) * op(b) +
+// beta * c, where op(x) is x or its transpose, op(a) is m x k, op(b) is
+// k x n, and lda, ldb, ldc are the row strides of a, b and c as stored.
+inline void sgemm(Trans trans_a, Trans trans_b, size_t m, size_t n, size_t k, float alpha, const float* a,
+                  int64_t lda, const float* b, int64_t ldb, float beta, float* c, int64_t ldc) {
+  const bool ta = trans_a == Trans::Yes, tb = trans_b == Trans::Yes;
+  gemm_strided(m, n, k, alpha, a, ta ? 1 : lda, ta ? lda : 1, b, tb ? 1 : ldb, tb ? ldb : 1, beta, c, ldc, 1);
+}
+
+}  // namespace gemm
+}  // namespace upsilon
@@ -0,0 +1,538 @@
+// GEMM bodies shared by every instruction set. Deliberately has no include
+// guard: gemm.hh includes it once per ISA, inside namespace
+// upsilon::gemm::<isa>, with UPSILON_SIMD_WIDTH set to the number of float
+// lanes (1 for the scalar fallback). Do not include it directly.
+
+#if UPSILON_SIMD_WIDTH > 1
+typedef float vfloat __attribute__((vector_size(UPSILON_SIMD_WIDTH * sizeof(float))));
+#else
+typedef float vfloat;
+#endif
+
+constexpr size_t kWidth = UPSILON_SIMD_WIDTH;
+
+inline vfloat load(const float* p) {
+  vfloat v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void store(float* p, vfloat v) {
+  std::memcpy(p, &v, sizeof(v));
+}
+
+// Register tiles (MR x NR) compiled for this instruction set, narrowest
+// first. Each keeps MR * NR / kWidth accumulators plus one row of B and a
+// broadcast of A in registers.
+#if UPSILON_SIMD_WIDTH == 16
+#define UPSILON_GEMM_TILES(X) X(6, 32) X(8, 48) X(14, 32)
+#elif UPSILON_SIMD_WIDTH == 8
+#define UPSILON_GEMM_TILES(X) X(6, 16) X(4, 24)
+#elif UPSILON_SIMD_WIDTH == 4
+#define UPSILON_GEMM_TILES(X) X(4, 8) X(6, 8)
+#else
+#define UPSILON_GEMM_TILES(X) X(4, 4)
+#endif
+
+// Packs rows [0, rows) of an A block, scaled by alpha, into MR-row slivers:
+// element (i, p) of sliver s lands at dst[s * MR * kc + p * MR + i]. Rows past
+// the end are zero so the microkernel never needs a row count.
+template <size_t MR>
+void pack_a(size_t rows, size_t kc, const float* a, int64_t rs, int64_t cs, float alpha, float* dst) {
+  for (size_t i0 = 0; i0 < rows; i0 += MR) {
+    const size_t mr = std::min(MR, rows - i0);
+    float* out = dst + i0 * kc;
+    if (cs == 1) {
+      // Row-major A: read each row contiguously.
+      for (size_t i = 0; i < MR; i++) {
+        const float* row = a + (i0 + i) * rs;
+        for (size_t p = 0; p < kc; p++) {
+          out[p * MR + i] = i < mr ? alpha * row[p] : 0.0f;
+        }
+      }
+      continue;
+    }
+    for (size_t p = 0; p < kc; p++) {
+      const float* col = a + i0 * rs + p * cs;
+      for (size_t i = 0; i < mr; i++) {
+        out[p * MR + i] = alpha * col[i * rs];
+      }
+      for (size_t i = mr; i < MR; i++) {
+        out[p * MR + i] = 0.0f;
+      }
+    }
+  }
+}
+
+// Packs columns [0, cols) of a B panel into NR-column slivers: element (p, j)
+// of sliver s lands at dst[s * NR * kc + p * NR + j], zero-padded likewise.
+template <size_t NR>
+void pack_b(size_t cols, size_t kc, const float* b, int64_t rs, int64_t cs, float* dst) {
+  for (size_t j0 = 0; j0 < cols; j0 += NR) {
+    const size_t nr = std::min(NR, cols - j0);
+    float* out = dst + j0 * kc;
+    if (rs == 1 && cs != 1) {
+      // Transposed B: read each column contiguously.
+      for (size_t j = 0; j < NR; j++) {
+        const float* col = b + (j0 + j) * cs;
+        for (size_t p = 0; p < kc; p++) {
+          out[p * NR + j] = j < nr ? col[p] : 0.0f;
+        }
+      }
+      continue;
+    }
+    for (size_t p = 0; p < kc; p++) {
+      const float* row = b + p * rs + j0 * cs;
+      if (cs == 1 && nr == NR) {
+        std::memcpy(out + p * NR, row, NR * sizeof(float));
+        continue;
+      }
+      for (size_t j = 0; j < nr; j++) {
+        out[p * NR + j] = row[j * cs];
+      }
+      for (size_t j = nr; j < NR; j++) {
+        out[p * NR + j] = 0.0f;
+      }
+    }
+  }
+}
+
+// c[0, mr) x [0, nr) = beta * c + a * b over kc packed steps. Full tiles are
+// written straight from the accumulators; edge tiles go through a buffer.
+template <size_t MR, size_t NR>
+void micro_kernel(size_t kc, const float* a, const float* b, float* c, int64_t ldc, float beta, size_t mr,
+                  size_t nr) {
+  constexpr size_t NV = NR / kWidth;
+  vfloat acc[MR][NV];
+#pragma GCC unroll 16
+  for (size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 8
+    for (size_t j = 0; j < NV; j++) {
+      acc[i][j] = vfloat{};
+    }
+  }
+
+  for (size_t p = 0; p < kc; p++) {
+    vfloat row[NV];
+#pragma GCC unroll 8
+    for (size_t j = 0; j < NV; j++) {
+      row[j] = load(b + p * NR + j * kWidth);
+    }
+#pragma GCC unroll 16
+    for (size_t i = 0; i < MR; i++) {
+      const vfloat x = a[p * MR + i] - vfloat{};  // broadcast; x - 0 folds away, x + 0 does not
+#pragma GCC unroll 8
+      for (size_t j = 0; j < NV; j++) {
+        acc[i][j] += x * row[j];
+      }
+    }
+  }
+
+  if (mr == MR && nr == NR) {
+#pragma GCC unroll 16
+    for (size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 8
+      for (size_t j = 0; j < NV; j++) {
+        float* dst = c + i * ldc + j * kWidth;
+        vfloat v = acc[i][j];
+        if (beta == 1.0f) {
+          v += load(dst);
+        } else if (beta != 0.0f) {
+          v += beta * load(dst);
+        }
+        store(dst, v);
+      }
+    }
+    return;
+  }
+
+  alignas(64) float tile[MR * NR];
+  for (size_t i = 0; i < MR; i++) {
+    for (size_t j = 0; j < NV; j++) {
+      store(tile + i * NR + j * kWidth, acc[i][j]);
+    }
+  }
+  for (size_t i = 0; i < mr; i++) {
+    for (size_t j = 0; j < nr; j++) {
+      float& dst = c[i * ldc + j];
+      dst = beta == 0.0f ? tile[i * NR + j] : beta * dst + tile[i * NR + j];
+    }
+  }
+}
+
+// Unpacked kernels for products too small or too skinny to repay packing
+// (see gemm.hh). Both read the operands in place.
+
+// c[0, R) x [0, V * kWidth) = beta * c + alpha * a * b, with a read through
+// its strides and b by unit-stride rows.
+template <size_t R, size_t V>
+void row_tile(size_t k, const float* a, int64_t a_rs, int64_t a_cs, const float* b, int64_t b_rs, float alpha,
+              float beta, float* c, int64_t ldc) {
+  vfloat acc[R][V];
+#pragma GCC unroll 8
+  for (size_t i = 0; i < R; i++) {
+#pragma GCC unroll 4
+    for (size_t j = 0; j < V; j++) {
+      acc[i][j] = vfloat{};
+    }
+  }
+  for (size_t p = 0; p < k; p++) {
+    vfloat row[V];
+#pragma GCC unroll 4
+    for (size_t j = 0; j < V; j++) {
+      row[j] = load(b + p * b_rs + j * kWidth);
+    }
+#pragma GCC unroll 8
+    for (size_t i = 0; i < R; i++) {
+      const vfloat x = a[i * a_rs + p * a_cs] - vfloat{};
+#pragma GCC unroll 4
+      for (size_t j = 0; j < V; j++) {
+        acc[i][j] += x * row[j];
+      }
+    }
+  }
+#pragma GCC unroll 8
+  for (size_t i = 0; i < R; i++) {
+#pragma GCC unroll 4
+    for (size_t j = 0; j < V; j++) {
+      float* dst = c + i * ldc + j * kWidth;
+      vfloat v = alpha * acc[i][j];
+      if (beta != 0.0f) {
+        v += beta * load(dst);
+      }
+      store(dst, v);
+    }
+  }
+}
+
+// The last cols < kWidth columns of rows [0, R) of the row-form product,
+// starting at column 0 of b and c. The first safe rows of b are read as
+// whole vectors, whose extra lanes hold memory inside b past the row and are
+// discarded; the remaining rows come from tail, a zero-padded copy.
+template <size_t R>
+void tail_tile(size_t k, size_t safe, const float* a, int64_t a_rs, int64_t a_cs, const float* b, int64_t b_rs,
+               const float* tail, float alpha, float beta, float* c, int64_t ldc, size_t cols) {
+  vfloat acc[R];
+  for (size_t i = 0; i < R; i++) {
+    acc[i] = vfloat{};
+  }
+  size_t p = 0;
+  if (R == 1) {
+    // A single row is one dependency chain; split it over four.
+    vfloat part[3] = {};
+    for (; p + 4 <= safe; p += 4) {
+      acc[0] += (a[p * a_cs] - vfloat{}) * load(b + p * b_rs);
+      part[0] += (a[(p + 1) * a_cs] - vfloat{}) * load(b + (p + 1) * b_rs);
+      part[1] += (a[(p + 2) * a_cs] - vfloat{}) * load(b + (p + 2) * b_rs);
+      part[2] += (a[(p + 3) * a_cs] - vfloat{}) * load(b + (p + 3) * b_rs);
+    }
+    acc[0] += (part[0] + part[1]) + part[2];
+  }
+  for (; p < safe; p++) {
+    const vfloat row = load(b + p * b_rs);
+#pragma GCC unroll 8
+    for (size_t i = 0; i < R; i++) {
+      acc[i] += (a[i * a_rs + p * a_cs] - vfloat{}) * row;
+    }
+  }
+  for (; p < k; p++) {
+    const vfloat row = load(tail + (p - safe) * kWidth);
+#pragma GCC unroll 8
+    for (size_t i = 0; i < R; i++) {
+      acc[i] += (a[i * a_rs + p * a_cs] - vfloat{}) * row;
+    }
+  }
+  alignas(64) float tile[R * kWidth];
+  for (size_t i = 0; i < R; i++) {
+    store(tile + i * kWidth, alpha * acc[i]);
+  }
+  for (size_t i = 0; i < R; i++) {
+    for (size_t j = 0; j < cols; j++) {
+      float& dst = c[i * ldc + j];
+      dst = beta == 0.0f ? tile[i * kWidth + j] : beta * dst + tile[i * kWidth + j];
+    }
+  }
+}
+
+// Columns [0, cols) of rows [0, R) of the row-form product, cols <= V *
+// kWidth. Fewer than kWidth trailing columns are the last of the product
+// and go through tail_tile().
+template <size_t R, size_t V>
+void row_block(size_t k, const float* a, int64_t a_rs, int64_t a_cs, const float* b, int64_t b_rs, size_t safe,
+               const float* tail, float alpha, float beta, float* c, int64_t ldc, size_t cols) {
+  if (cols == V * kWidth) {
+    return row_tile<R, V>(k, a, a_rs, a_cs, b, b_rs, alpha, beta, c, ldc);
+  }
+  for (; cols >= kWidth; cols -= kWidth, b += kWidth, c += kWidth) {
+    row_tile<R, 1>(k, a, a_rs, a_cs, b, b_rs, alpha, beta, c, ldc);
+  }
+  if (cols > 0) {
+    tail_tile<R>(k, safe, a, a_rs, a_cs, b, b_rs, tail, alpha, beta, c, ldc, cols);
+  }
+}
+
+// A vector of N floats; a plain float for N == 1.
+template <size_t N>
+struct Lanes {
+  typedef float type __attribute__((vector_size(N * sizeof(float))));
+};
+
+template <>
+struct Lanes<1> {
+  typedef float type;
+};
+
+inline float lane_sum(float v) { return v; }
+
+// Sum of the lanes of v, adding its halves: log2(lanes) vector adds.
+template <typename V>
+inline float lane_sum(V v) {
+  typename Lanes<sizeof(V) / sizeof(float) / 2>::type lo, hi;
+  std::memcpy(&lo, &v, sizeof(lo));
+  std::memcpy(&hi, reinterpret_cast<const char*>(&v) + sizeof(lo), sizeof(hi));
+  return lane_sum(lo + hi);
+}
+
+// c[0, R) x [0, J) = beta * c + alpha * a * b as dot products along k, for
+// a with unit column stride and b with unit row stride (e.g. b transposed).
+template <size_t R, size_t J>
+void dot_tile(size_t k, const float* a, int64_t a_rs, const float* b, int64_t b_cs, float alpha, float beta,
+              float* c, int64_t ldc) {
+  vfloat acc[R][J];
+#pragma GCC unroll 8
+  for (size_t i = 0; i < R; i++) {
+#pragma GCC unroll 8
+    for (size_t j = 0; j < J; j++) {
+      acc[i][j] = vfloat{};
+    }
+  }
+  size_t p = 0;
+  for (; p + kWidth <= k; p += kWidth) {
+    vfloat x[R];
+#pragma GCC unroll 8
+    for (size_t i = 0; i < R; i++) {
+      x[i] = load(a + i * a_rs + p);
+    }
+#pragma GCC unroll 8
+    for (size_t j = 0; j < J; j++) {
+      const vfloat y = load(b + j * b_cs + p);
+#pragma GCC unroll 8
+      for (size_t i = 0; i < R; i++) {
+        acc[i][j] += x[i] * y;
+      }
+    }
+  }
+  for (size_t i = 0; i < R; i++) {
+    for (size_t j = 0; j < J; j++) {
+      float sum = lane_sum(acc[i][j]);
+      for (size_t q = p; q < k; q++) {
+        sum += a[i * a_rs + q] * b[j * b_cs + q];
+      }
+      float& dst = c[i * ldc + j];
+      dst = beta == 0.0f ? alpha * sum : beta * dst + alpha * sum;
+    }
+  }
+}
+
+template <size_t R, size_t J>
+void dot_block(size_t k, const float* a, int64_t a_rs, const float* b, int64_t b_cs, float alpha, float beta,
+               float* c, int64_t ldc, size_t rows, size_t cols) {
+  if (rows == R && cols == J) {
+    return dot_tile<R, J>(k, a, a_rs, b, b_cs, alpha, beta, c, ldc);
+  }
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 0; j < cols; j++) {
+      dot_tile<1, 1>(k, a + i * a_rs, a_rs, b + j * b_cs, b_cs, alpha, beta, c + i * ldc + j, ldc);
+    }
+  }
+}
+
+// Splits the m x n product into rows x cols blocks, one task each, and calls
+// block(i0, j0, rows, cols) for them.
+template <typename F>
+void for_each_block(size_t m, size_t n, size_t k, size_t rows, size_t cols, F&& block) {
+  const size_t row_blocks = (m + rows - 1) / rows, col_blocks = (n + cols - 1) / cols;
+  parallel_for(row_blocks * col_blocks, std::max<size_t>(1, kGrainMultiplyAdds / (rows * cols * k)),
+               [&](size_t begin, size_t end) {
+    for (size_t task = begin; task < end; task++) {
+      const size_t i0 = task / col_blocks * rows, j0 = task % col_blocks * cols;
+      block(i0, j0, std::min(rows, m - i0), std::min(cols, n - j0));
+    }
+  });
+}
+
+// c = beta * c + alpha * a * b without packing, for c with unit column
+// stride. Products whose a and b both run contiguously along k are dot
+// products; the others broadcast elements of a against unit-stride rows of
+// b, copying b first if its rows are strided (so b should be small).
+inline void direct(size_t m, size_t n, size_t k, float alpha, const float* a, int64_t a_rs, int64_t a_cs,
+                   const float* b, int64_t b_rs, int64_t b_cs, float beta, float* c, int64_t ldc) {
+  if (n == 1 && m > 1 && a_rs == 1 && a_cs != 1 && ldc == 1) {
+    // a^T times a vector: c^T = b^T a^T reads a by unit-stride rows.
+    return direct(1, m, k, alpha, b, b_cs, b_rs, a, a_cs, a_rs, beta, c, ldc);
+  }
+  // Dot products for a vector b, and for a transposed b unless it is wide
+  // enough for the row form, a has enough rows to repay copying it, and the
+  // copy is small.
+  const bool copy_b = n >= kWidth && m * kWidth > k && k * n <= kDirectMultiplyAdds;
+  if (a_cs == 1 && b_rs == 1 && k >= kWidth && (n == 1 || (b_cs != 1 && !copy_b))) {
+    // Enough independent sums per tile to hide the latency of each.
+    const size_t R = n == 1 ? 8 : m == 1 ? 1 : 2, J = n == 1 ? 1 : 4;
+    return for_each_block(m, n, k, R, J, [&](size_t i0, size_t j0, size_t rows, size_t cols) {
+      const float* a_block = a + i0 * a_rs;
+      const float* b_block = b + j0 * b_cs;
+      float* c_block = c + i0 * ldc + j0;
+      if (R == 8) {
+        dot_block<8, 1>(k, a_block, a_rs, b_block, b_cs, alpha, beta, c_block, ldc, rows, cols);
+      } else if (R == 1) {
+        dot_block<1, 4>(k, a_block, a_rs, b_block, b_cs, alpha, beta, c_block, ldc, rows, cols);
+      } else {
+        dot_block<2, 4>(k, a_block, a_rs, b_block, b_cs, alpha, beta, c_block, ldc, rows, cols);
+      }
+    });
+  }
+
+  if (b_cs != 1) {
+    // Sixteen rows at a time, so a transposed b is read in runs along k.
+    float* rows = detail::pack_buffer(0, k * n);
+    for (size_t p0 = 0; p0 < k; p0 += 16) {
+      const size_t p1 = std::min(k, p0 + 16);
+      for (size_t j = 0; j < n; j++) {
+        for (size_t p = p0; p < p1; p++) {
+          rows[p * n + j] = b[p * b_rs + j * b_cs];
+        }
+      }
+    }
+    b = rows;
+    b_rs = n;
+  }
+  const size_t full = n / kWidth * kWidth;
+  size_t safe = k;
+  float* tail = nullptr;
+  if (full < n) {
+    // Rows whose vector at column full ends inside b; see tail_tile().
+    const size_t end = (k - 1) * b_rs + n;
+    safe = end >= full + kWidth && b_rs > 0 ? std::min(k, (end - full - kWidth) / b_rs + 1) : 0;
+    tail = detail::pack_buffer(1, (k - safe) * kWidth);
+    for (size_t p = safe; p < k; p++) {
+      for (size_t j = 0; j < kWidth; j++) {
+        tail[(p - safe) * kWidth + j] = full + j < n ? b[p * b_rs + full + j] : 0.0f;
+      }
+    }
+  }
+  if (n < kWidth) {
+    // All tail: eight rows keep eight sums in flight on the one vector.
+    return for_each_block(m, n, k, 8, n, [&](size_t i0, size_t, size_t rows, size_t cols) {
+      const float* a_block = a + i0 * a_rs;
+      float* c_block = c + i0 * ldc;
+      if (rows == 8) {
+        return tail_tile<8>(k, safe, a_block, a_rs, a_cs, b, b_rs, tail, alpha, beta, c_block, ldc, cols);
+      }
+      for (size_t i = 0; i < rows; i++) {
+        tail_tile<1>(k, safe, a_block + i * a_rs, a_rs, a_cs, b, b_rs, tail, alpha, beta, c_block + i * ldc, ldc, cols);
+      }
+    });
+  }
+  // Four rows share each row of b; a single row takes wider blocks instead
+  // so it still has several sums in flight.
+  const size_t V = m < 4 ? 4 : 2;
+  for_each_block(m, n, k, 4, V * kWidth, [&](size_t i0, size_t j0, size_t rows, size_t cols) {
+    const float* a_block = a + i0 * a_rs;
+    float* c_block = c + i0 * ldc + j0;
+    if (rows == 4) {
+      row_block<4, 2>(k, a_block, a_rs, a_cs, b + j0, b_rs, safe, tail, alpha, beta, c_block, ldc, cols);
+      return;
+    }
+    for (size_t i = 0; i < rows; i++) {
+      row_block<1, 4>(k, a_block + i * a_rs, a_rs, a_cs, b + j0, b_rs, safe, tail, alpha, beta, c_block + i * ldc,
+                      ldc, cols);
+    }
+  });
+}
+
+// c = beta * c + alpha * a * b for an m x k matrix a and a k x n matrix b
+// with arbitrary strides, and c with unit column stride.
+//
+// Goto-style loop nest: for each KC-deep slice of k, A is packed once (in
+// MR slivers, parallel across slivers); for each NC-wide panel of B, the
+// panel is packed once and shared by every task. Tasks own an MC-row block of
+// c (which keeps its packed A in L2) and a range of NR-column slivers, and
+// walk the slivers outermost so each KC x NR sliver of B stays in L1 while
+// the A slivers stream past it.
+template <size_t MR, size_t NR>
+void run(const Config& config, size_t m, size_t n, size_t k, float alpha, const float* a, int64_t a_rs,
+         int64_t a_cs, const float* b, int64_t b_rs, int64_t b_cs, float beta, float* c, int64_t ldc) {
+  const size_t kc = std::min<size_t>(config.kc, k);
+  const size_t mc = std::max<size_t>(config.mc / MR, 1) * MR;
+  const size_t nc = std::min(std::max<size_t>(config.nc / NR, 1) * NR, (n + NR - 1) / NR * NR);
+  const size_t m_slivers = (m + MR - 1) / MR;
+  float* packed_a = detail::pack_buffer(0, m_slivers * MR * kc);
+  float* packed_b = detail::pack_buffer(1, nc * kc);
+  const size_t threads = num_threads();
+
+  for (size_t pc = 0; pc < k; pc += kc) {
+    const size_t kb = std::min(kc, k - pc);
+    const float* a_slice = a + pc * a_cs;
+    parallel_for(m_slivers, row_grain(MR * kb), [&](size_t begin, size_t end) {
+      const size_t rows = std::min(end * MR, m) - begin * MR;
+      pack_a<MR>(rows, kb, a_slice + begin * MR * a_rs, a_rs, a_cs, alpha, packed_a + begin * MR * kb);
+    });
+    const float step_beta = pc == 0 ? beta : 1.0f;
+
+    for (size_t jc = 0; jc < n; jc += nc) {
+      const size_t nb = std::min(nc, n - jc);
+      const size_t n_slivers = (nb + NR - 1) / NR;
+      const float* b_panel = b + pc * b_rs + jc * b_cs;
+      parallel_for(n_slivers, row_grain(NR * kb), [&](size_t begin, size_t end) {
+        const size_t cols = std::min(end * NR, nb) - begin * NR;
+        pack_b<NR>(cols, kb, b_panel + begin * NR * b_cs, b_rs, b_cs, packed_b + begin * NR * kb);
+      });
+
+      // Enough column splits that every thread gets about two tasks.
+      const size_t m_blocks = (m + mc - 1) / mc;
+      const size_t splits = std::min(n_slivers, std::max<size_t>(1, (2 * threads + m_blocks - 1) / m_blocks));
+      const size_t task_work = std::min(mc, m) * (nb / splits + 1) * kb;
+      parallel_for(m_blocks * splits, std::max<size_t>(1, kGrainMultiplyAdds / task_work),
+                   [&](size_t begin, size_t end) {
+        for (size_t task = begin; task < end; task++) {
+          const size_t ic = (task / splits) * mc;
+          const size_t split = task % splits;
+          const size_t rows = std::min(mc, m - ic);
+          for (size_t s = split * n_slivers / splits; s < (split + 1) * n_slivers / splits; s++) {
+            const size_t jr = s * NR;
+            const float* b_sliver = packed_b + jr * kb;
+            for (size_t ir = 0; ir < rows; ir += MR) {
+              micro_kernel<MR, NR>(kb, packed_a + (ic + ir) * kb, b_sliver, c + (ic + ir) * ldc + jc + jr, ldc,
+                                   step_beta, std::min(MR, rows - ir), std::min(NR, nb - jr));
+            }
+          }
+        }
+      });
+    }
+  }
+}
+
+// The register tiles above, as configs with default cache blocking.
+inline std::vector<Config> tiles() {
+  std::vector<Config> result;
+#define UPSILON_GEMM_TILE_CONFIG(MR, NR) result.push_back(default_config(MR, NR));
+  UPSILON_GEMM_TILES(UPSILON_GEMM_TILE_CONFIG)
+#undef UPSILON_GEMM_TILE_CONFIG
+  return result;
+}
+
+// Runs with config's register tile, or the first one if this instruction set
+// was not compiled with it.
+inline void gemm(const Config& config, size_t m, size_t n, size_t k, float alpha, const float* a, int64_t a_rs,
+                 int64_t a_cs, const float* b, int64_t b_rs, int64_t b_cs, float beta, float* c, int64_t ldc) {
+#define UPSILON_GEMM_TILE_CASE(MR, NR)                                           \
+  if (config.mr == MR && config.nr == NR) {                                      \
+    return run<MR, NR>(config, m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, ldc); \
+  }
+  UPSILON_GEMM_TILES(UPSILON_GEMM_TILE_CASE)
+#undef UPSILON_GEMM_TILE_CASE
+  const Config fallback = tiles().front();
+  gemm(fallback, m, n, k, alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, ldc);
+}
+
+#undef UPSILON_GEMM_TILES
@@ -0,0 +1,571 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "memory_plan.hh"
+#include "op.hh"
+
+namespace upsilon {
+
+// Wall time spent in one executor call, plus the number of ops it visited so
+// the per-node overhead of deep graphs can be read off directly.
+struct Timing {
+  std::chrono::nanoseconds elapsed{0};
+  size_t ops = 0;
+
+  double ms() const {
+    return std::chrono::duration<double, std::milli>(elapsed).count();
+  }
+
+  double ns_per_op() const {
+    return ops == 0 ? 0.0 : static_cast<double>(elapsed.count()) / ops;
+  }
+};
+
+// Element type the executor keeps activations in between forward and
+// backward (see Executor::set_activation_precision).
+enum class Precision { FP32, BF16, FP16 };
+
+// A computation graph reachable from one or more output ops. The topological
+// order (every op after all of its inputs) is computed once and cached.
+class Graph {
+public:
+  explicit Graph(std::shared_ptr<Op> output) : Graph(std::vector<std::shared_ptr<Op>>{std::move(output)}) {}
+
+  explicit Graph(std::vector<std::shared_ptr<Op>> outputs) : outputs_(std::move(outputs)) {
+    rebuild();
+  }
+
+  // A graph whose topological order is already known, such as one read back
+  // by load_graph(): order must hold every op reachable from outputs, each
+  // after its inputs.
+  Graph(std::vector<std::shared_ptr<Op>> outputs, std::vector<std::shared_ptr<Op>> order)
+      : outputs_(std::move(outputs)), order_(std::move(order)) {}
+
+  const std::vector<std::shared_ptr<Op>>& outputs() const { return outputs_; }
+
+  const std::vector<std::shared_ptr<Op>>& order() const { return order_; }
+
+  size_t size() const { return order_.size(); }
+
+  // Rewires every use of op (as an input or an output) to replacement and
+  // recomputes the order.
+  void replace(const std::shared_ptr<Op>& op, std::shared_ptr<Op> replacement) {
+    if (!replacement) {
+      throw std::invalid_argument("Replacement op must not be null");
+    }
+    const std::shared_ptr<Op> old = op;  // op may be one of the slots below
+    for (const auto& node : order_) {
+      for (auto& input : node->inputs) {
+        if (input == old) {
+          input = replacement;
+        }
+      }
+    }
+    for (auto& output : outputs_) {
+      if (output == old) {
+        output = replacement;
+      }
+    }
+    rebuild();
+  }
+
+  // Recomputes the cached order; only needed if Op::inputs was rewired.
+  void rebuild() {
+    order_.clear();
+
+    // Iterative post-order DFS, so graphs with thousands of nodes in a chain
+    // don't overflow the call stack.
+    std::unordered_set<const Op*> visited;
+    std::vector<std::pair<std::shared_ptr<Op>, size_t>> stack;
+
+    for (const auto& output : outputs_) {
+      if (!output) {
+        throw std::invalid_argument("Graph output must not be null");
+      }
+      if (!visited.insert(output.get()).second) {
+        continue;
+      }
+      stack.emplace_back(output, 0);
+
+      while (!stack.empty()) {
+        auto& [op, next] = stack.back();
+        if (next < op->inputs.size()) {
+          const auto& input = op->inputs[next++];
+          if (!input) {
+            throw std::invalid_argument("Op input must not be null");
+          }
+          if (visited.insert(input.get()).second) {
+            stack.emplace_back(input, 0);
+          }
+        } else {
+          order_.push_back(std::move(op));
+          stack.pop_back();
+        }
+      }
+    }
+  }
+
+private:
+  std::vector<std::shared_ptr<Op>> outputs_;
+  std::vector<std::shared_ptr<Op>> order_;
+};
+
+// Runs a Graph: forward in topological order, backward in reverse order with
+// the output gradients seeded to one.
+class Executor {
+public:
+  explicit Executor(std::shared_ptr<Op> output) : graph_(std::move(output)) {}
+
+  explicit Executor(Graph graph) : graph_(std::move(graph)) {}
+
+  Graph& graph() { return graph_; }
+
+  const Graph& graph() const { return graph_; }
+
+  // Allocates the storage of each step from arena, which is reset at the
+  // start of every forward pass. Buffers that ops keep across steps (outputs
+  // and gradients are reused in place) stay valid; the arena just stops
+  // reusing the chunk they live in. nullptr goes back to the default allocator.
+  void set_arena(std::shared_ptr<Arena> arena) { arena_ = std::move(arena); }
+
+  const std::shared_ptr<Arena>& arena() const { return arena_; }
+
+  // With BF16 or FP16, forward() rounds each intermediate activation to 16
+  // bits and frees the float buffer as soon as its last consumer has run,
+  // roughly halving the memory held between forward and backward. backward()
+  // widens an activation again when it is first needed and frees it, with
+  // its gradient, once its own op has propagated. Variables, graph outputs
+  // and activations that share storage with another tensor (views, placed
+  // outputs) stay in fp32; the other intermediate outputs and gradients are
+  // not readable after forward(). Buffers taken from an arena are only
+  // returned when it is reset, so the saving needs the default allocator.
+  void set_activation_precision(Precision precision) {
+    if (precision != Precision::FP32 && !plan_.blocks.empty()) {
+      throw std::logic_error("16-bit activations cannot be combined with a memory plan");
+    }
+    precision_ = precision;
+  }
+
+  Precision activation_precision() const { return precision_; }
+
+  // Bytes of 16-bit activations currently held for backward().
+  size_t saved_bytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < stash_.size(); i++) {
+      if (stash_[i] == Stash::Half) {
+        bytes += precision_ == Precision::BF16 ? bf16_[i].bytes() : fp16_[i].bytes();
+      }
+    }
+    return bytes;
+  }
+
+  // Gives the outputs and gradients of the intermediate ops offsets in one
+  // shared slab, so tensors whose lifetimes do not overlap reuse the same
+  // memory (see memory_plan.hh). A step (a forward pass if !training) runs
+  // first to learn the shapes. From then on an interior output or gradient
+  // only holds its value during its lifetime; graph outputs and Variables
+  // are not planned. A tensor whose shape changes later moves back to a
+  // buffer of its own. A forward-only plan is for inference: backward()
+  // throws after it.
+  const MemoryPlan& plan_memory(bool training = true) {
+    if (precision_ != Precision::FP32) {
+      throw std::logic_error("A memory plan cannot be combined with 16-bit activations");
+    }
+    if (!checkpoint_.empty()) {
+      throw std::logic_error("A memory plan cannot be combined with checkpoints");
+    }
+    if (training) {
+      step();
+    } else {
+      forward();
+    }
+    const auto& order = graph_.order();
+    plan_ = upsilon::plan_memory(order, graph_.outputs(), training);
+    index_order();
+    const uint32_t floats = static_cast<uint32_t>(plan_.slab_floats);
+    slab_ = std::make_shared<Storage<float>>(floats);
+    const Tensor<float> slab = Tensor<float>::wrap(slab_, {floats});
+    planned_grad_.assign(order.size(), false);
+    for (const MemoryPlan::Block& block : plan_.blocks) {
+      Op& op = *order[block.op];
+      Tensor<float>& t = block.grad ? op.grad : op.output;
+      const uint32_t begin = static_cast<uint32_t>(block.offset);
+      t.place_(slab.slice(0, begin, begin + static_cast<uint32_t>(block.size)).view(op.output.shape()));
+      planned_grad_[block.op] = planned_grad_[block.op] || block.grad;
+    }
+    return plan_;
+  }
+
+  const MemoryPlan& memory_plan() const { return plan_; }
+
+  // Gradient checkpointing: forward() keeps the outputs of the given ops and
+  // drops every other intermediate output once its consumers have run, as
+  // with 16-bit activations (Variables, graph outputs and tensors sharing
+  // storage are always kept). backward() recomputes a dropped output, and
+  // its dropped inputs back to the nearest kept ones, when first needed and
+  // frees it again after its own op has propagated. Checkpoints that cut
+  // the graph (no dropped output is read past them) split it into segments;
+  // memory holds them plus one segment at a time, for about one extra
+  // forward pass of compute. With 16-bit activations the checkpoints are
+  // kept in 16 bits. An empty list turns checkpointing off.
+  void set_checkpoints(const std::vector<std::shared_ptr<Op>>& ops) {
+    if (!ops.empty() && !plan_.blocks.empty()) {
+      throw std::logic_error("Checkpoints cannot be combined with a memory plan");
+    }
+    const auto& order = graph_.order();
+    std::vector<bool> checkpoint(ops.empty() ? 0 : order.size(), false);
+    for (const auto& op : ops) {
+      const auto it = std::find(order.begin(), order.end(), op);
+      if (it == order.end()) {
+        throw std::invalid_argument("Checkpoint is not an op of the graph");
+      }
+      checkpoint[it - order.begin()] = true;
+    }
+    checkpoint_ = std::move(checkpoint);
+  }
+
+  // Chooses checkpoints from the output sizes of a forward pass run first:
+  // walking the graph order, the first op that cuts the graph once the
+  // outputs that would be dropped since the previous checkpoint exceed
+  // budget_bytes becomes the next one. The default, total / sqrt(count) of
+  // those outputs, gives about sqrt(N) segments of sqrt(N) ops when the
+  // sizes are similar. A budget no segment exceeds still cuts the graph
+  // about every sqrt(N) droppable outputs. Returns the checkpoints chosen.
+  std::vector<std::shared_ptr<Op>> checkpoint_by_budget(size_t budget_bytes = 0) {
+    const auto& order = graph_.order();
+    checkpoint_.clear();
+    const Precision precision = precision_;
+    precision_ = Precision::FP32;
+    forward();
+    precision_ = precision;
+    index_order();
+
+    std::vector<bool> droppable(order.size(), false);
+    size_t total = 0, count = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+      const Op& op = *order[i];
+      droppable[i] = dynamic_cast<const Variable*>(&op) == nullptr && op.output.sole_owner();
+      if (droppable[i]) {
+        total += op.output.size() * sizeof(float);
+        count++;
+      }
+    }
+    for (const auto& output : graph_.outputs()) {
+      const size_t i = index_.at(output.get());
+      if (droppable[i]) {
+        droppable[i] = false;
+        total -= output->output.size() * sizeof(float);
+        count--;
+      }
+    }
+    // An op cuts the graph if no droppable output skips over it to a later
+    // consumer; a checkpoint elsewhere would let recomputation run past it.
+    std::vector<int> skips(order.size() + 1, 0);
+    for (size_t k = 0; k < order.size(); k++) {
+      for (const auto& input : order[k]->inputs) {
+        const size_t j = index_.at(input.get());
+        if (droppable[j] && j + 1 < k) {
+          skips[j + 1]++;
+          skips[k]--;
+        }
+      }
+    }
+    if (budget_bytes == 0 && count > 0) {
+      budget_bytes = static_cast<size_t>(static_cast<double>(total) / std::sqrt(static_cast<double>(count)));
+    }
+
+    // Also ends a segment once it holds max_ops droppable outputs.
+    auto choose = [&](size_t budget, size_t max_ops) {
+      std::vector<std::shared_ptr<Op>> chosen;
+      size_t segment = 0, ops = 0;
+      int skipping = 0;
+      for (size_t i = 0; i < order.size(); i++) {
+        skipping += skips[i];
+        if (!droppable[i]) {
+          continue;
+        }
+        segment += order[i]->output.size() * sizeof(float);
+        ops++;
+        if ((segment > budget || ops >= max_ops) && skipping == 0) {
+          chosen.push_back(order[i]);
+          segment = ops = 0;
+        }
+      }
+      return chosen;
+    };
+    std::vector<std::shared_ptr<Op>> checkpoints = choose(budget_bytes, SIZE_MAX);
+    // A budget that covers everything would leave a single segment, all of
+    // it recomputed and held at once; cut it about every sqrt(N) ops instead.
+    if (checkpoints.empty() && count > 0) {
+      checkpoints = choose(SIZE_MAX, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count)))));
+    }
+    // An empty list would turn checkpointing off instead of dropping
+    // everything; keep the output, which is never dropped anyway.
+    set_checkpoints(checkpoints.empty() ? graph_.outputs() : checkpoints);
+    return checkpoints;
+  }
+
+  std::vector<std::shared_ptr<Op>> checkpoints() const {
+    std::vector<std::shared_ptr<Op>> ops;
+    for (size_t i = 0; i < checkpoint_.size(); i++) {
+      if (checkpoint_[i]) {
+        ops.push_back(graph_.order()[i]);
+      }
+    }
+    return ops;
+  }
+
+  // Ops whose forward the last backward() ran again.
+  size_t recomputed() const { return recomputed_; }
+
+  Timing forward() {
+    const auto start = std::chrono::steady_clock::now();
+    if (arena_) {
+      arena_->reset();
+    }
+    AllocatorScope scope(step_allocator());
+    if (!grad_enabled()) {
+      forward_inference();
+    } else if (precision_ != Precision::FP32 || !checkpoint_.empty()) {
+      forward_stashing();
+    } else {
+      for (const auto& op : graph_.order()) {
+        op->forward();
+      }
+    }
+    last_forward_ = {std::chrono::steady_clock::now() - start, graph_.size()};
+    return last_forward_;
+  }
+
+  // Clears every gradient, seeds d(output)/d(output) = seed (1 unless the
+  // loss is being scaled) and propagates. Gradient buffers are allocated on
+  // the first call and reused afterwards; ops accumulate into them in place.
+  Timing backward(float seed = 1.0f) {
+    if (!plan_.blocks.empty() && !plan_.training) {
+      throw std::logic_error("backward() after a forward-only memory plan");
+    }
+    if (!grad_enabled()) {
+      throw std::logic_error("backward() inside a NoGradScope");
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const auto& order = graph_.order();
+    AllocatorScope scope(step_allocator());
+
+    // Stashed and planned gradients are zeroed when first reached instead: a
+    // planned one may share memory with an activation still in use.
+    const bool lazy = stash_.size() == order.size() || !planned_grad_.empty();
+    reached_.assign(lazy ? order.size() : 0, false);
+    live_.assign(stash_.size(), false);
+    recomputed_ = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+      if (!lazy_grad(i)) {
+        order[i]->grad.resize_as_(order[i]->output).fill_(0.0f);
+      }
+    }
+    for (const auto& output : graph_.outputs()) {
+      output->grad.fill(seed);
+    }
+
+    for (size_t i = order.size(); i-- > 0;) {
+      Op& op = *order[i];
+      if (lazy) {
+        reach(i);
+        for (const auto& input : op.inputs) {
+          reach(index_.at(input.get()));
+        }
+      }
+      op.backward();
+      if (is_stashed(i)) {
+        op.output.release_();
+        op.grad.release_();
+        stash_[i] = Stash::None;
+      }
+    }
+
+    last_backward_ = {std::chrono::steady_clock::now() - start, order.size()};
+    return last_backward_;
+  }
+
+  // One training step: forward followed by backward.
+  Timing step() {
+    const Timing f = forward();
+    const Timing b = backward();
+    return {f.elapsed + b.elapsed, f.ops + b.ops};
+  }
+
+  const Timing& last_forward() const { return last_forward_; }
+
+  const Timing& last_backward() const { return last_backward_; }
+
+private:
+  std::shared_ptr<Allocator> step_allocator() const {
+    return arena_ ? arena_ : current_allocator();
+  }
+
+  // forward() inside a NoGradScope: nothing is kept for backward, so an
+  // intermediate output is freed once every op reading it has run, and an
+  // op that is the last reader of its input may overwrite it.
+  void forward_inference() {
+    const auto& order = graph_.order();
+    count_consumers();
+    for (const auto& op : order) {
+      bool done = false;
+      if (!op->inputs.empty()) {
+        const size_t i = index_.at(op->inputs[0].get());
+        done = pending_[i] == 1 && releasable(i) && op->forward_in_place();
+      }
+      if (!done) {
+        op->forward();
+      }
+      for (const auto& input : op->inputs) {
+        const size_t i = index_.at(input.get());
+        if (--pending_[i] == 0 && releasable(i)) {
+          input->output.release_();
+        }
+      }
+    }
+  }
+
+  // Readers of each output in a forward pass; graph outputs count one more
+  // so they are never freed.
+  void count_consumers() {
+    const auto& order = graph_.order();
+    index_order();
+    pending_.assign(order.size(), 0);
+    for (const auto& op : order) {
+      for (const auto& input : op->inputs) {
+        pending_[index_.at(input.get())]++;
+      }
+    }
+    for (const auto& output : graph_.outputs()) {
+      pending_[index_.at(output.get())]++;
+    }
+  }
+
+  // An output that may be freed once read: not a Variable, and not sharing
+  // its buffer with another tensor.
+  bool releasable(size_t i) const {
+    const Op& op = *graph_.order()[i];
+    return dynamic_cast<const Variable*>(&op) == nullptr && op.output.sole_owner();
+  }
+
+  // forward() for 16-bit activations or checkpoints: once every op reading
+  // an output has run, it is dropped if it lies between checkpoints and
+  // otherwise saved in 16 bits.
+  void forward_stashing() {
+    const auto& order = graph_.order();
+    count_consumers();
+    stash_.assign(order.size(), Stash::None);
+    bf16_.resize(order.size());
+    fp16_.resize(order.size());
+
+    for (const auto& op : order) {
+      op->forward();
+      for (const auto& input : op->inputs) {
+        const size_t i = index_.at(input.get());
+        if (--pending_[i] != 0 || !releasable(i)) {
+          continue;
+        }
+        if (!checkpoint_.empty() && !checkpoint_[i]) {
+          stash_[i] = Stash::Dropped;
+        } else if (precision_ == Precision::BF16) {
+          bf16_[i].encode_(input->output);
+          stash_[i] = Stash::Half;
+        } else if (precision_ == Precision::FP16) {
+          fp16_[i].encode_(input->output);
+          stash_[i] = Stash::Half;
+        } else {
+          continue;
+        }
+        input->output.release_();
+      }
+    }
+  }
+
+  void index_order() {
+    const auto& order = graph_.order();
+    index_.clear();
+    for (size_t i = 0; i < order.size(); i++) {
+      index_[order[i].get()] = i;
+    }
+  }
+
+  bool is_stashed(size_t i) const { return i < stash_.size() && stash_[i] != Stash::None; }
+
+  bool lazy_grad(size_t i) const { return is_stashed(i) || (i < planned_grad_.size() && planned_grad_[i]); }
+
+  // Brings a stashed output back for backward(): widens its 16-bit copy, or
+  // recomputes it after restoring its inputs. Walks an explicit stack, as a
+  // dropped segment can be as long as the graph.
+  void restore(size_t i) {
+    // An op, and whether its inputs are restored and it can run.
+    std::vector<std::pair<size_t, bool>> stack = {{i, false}};
+    while (!stack.empty()) {
+      const auto [k, ready] = stack.back();
+      stack.pop_back();
+      Op& op = *graph_.order()[k];
+      if (ready) {
+        op.forward();
+        recomputed_++;
+        continue;
+      }
+      if (!is_stashed(k) || live_[k]) {
+        continue;
+      }
+      live_[k] = true;
+      if (stash_[k] == Stash::Dropped) {
+        stack.emplace_back(k, true);
+        for (auto input = op.inputs.rbegin(); input != op.inputs.rend(); ++input) {
+          stack.emplace_back(index_.at(input->get()), false);
+        }
+      } else if (precision_ == Precision::BF16) {
+        bf16_[k].decode_into(op.output);
+      } else {
+        fp16_[k].decode_into(op.output);
+      }
+    }
+  }
+
+  // First time backward reaches op i: restores its output and zeroes a
+  // lazily cleared gradient.
+  void reach(size_t i) {
+    if (reached_[i]) {
+      return;
+    }
+    reached_[i] = true;
+    Op& op = *graph_.order()[i];
+    restore(i);
+    if (lazy_grad(i)) {
+      op.grad.resize_as_(op.output).fill_(0.0f);
+    }
+  }
+
+  Graph graph_;
+  std::shared_ptr<Arena> arena_;
+  Timing last_forward_;
+  Timing last_backward_;
+  Precision precision_ = Precision::FP32;
+  std::unordered_map<const Op*, size_t> index_;  // position in graph order
+  std::vector<uint32_t> pending_;                // consumers yet to run
+  // Where an intermediate output is between forward() and its backward.
+  enum class Stash : uint8_t { None, Half, Dropped };
+  std::vector<Stash> stash_;
+  std::vector<bool> live_;     // stashed, but restored by this backward()
+  std::vector<bool> reached_;  // by this backward()
+  std::vector<bool> checkpoint_;  // empty unless checkpointing
+  size_t recomputed_ = 0;
+  std::vector<Tensor<bf16>> bf16_;
+  std::vector<Tensor<fp16>> fp16_;
+  MemoryPlan plan_;
+  std::shared_ptr<Storage<float>> slab_;
+  std::vector<bool> planned_grad_;
+};
+
+} // namespace upsilon
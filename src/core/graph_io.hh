@@ -0,0 +1,406 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "graph.hh"
+#include "serialize.hh"
+
+// On-disk form of a Graph, so a serving process can rebuild a model without
+// running the code that built it:
+//
+//   save_graph(graph, "model.graph", "model.ups", {{"x", x}});
+//   LoadedGraph model = load_graph("model.graph");
+//   model.inputs.at("x")->output = batch;
+//   Executor(model.graph).forward();
+//
+// The graph file lists the ops in topological order, so the loader builds
+// every op once, in one pass, after all of its inputs. Weights (every
+// Variable not named as an input) go to a tensor file (serialize.hh) that is
+// memory-mapped on load, so no weight is copied. Layout, integers
+// little-endian:
+//
+//   header   char magic[8] = "UPSGRAPH", u32 version = 1, u32 op_count,
+//            u32 output_count, u32 path_bytes, weights path
+//   op       u32 type (OpType), u32 name_bytes, name, u32 input_count,
+//            u32 inputs[] (indices of earlier ops), u32 attr_count,
+//            u32 attrs[]
+//   outputs  u32 indices[output_count]
+//
+// A Variable's name is its tensor in the weights file, or the input name;
+// an input's attrs are its shape. A relative weights path is relative to the
+// graph file's directory. Quantized ops are not supported.
+
+namespace upsilon {
+
+enum class OpType : uint32_t {
+  Variable, Input, Add, Mul, Sub, Div, MatMul, Conv2D, MaxPool2D, AvgPool2D, GlobalAvgPool, Tanh, ReLU,
+  Sigmoid, Concat, Slice, Sum, Mean, L2Norm, Max, Min, ArgMax, Softmax, LogSoftmax, SoftmaxCrossEntropy
+};
+
+// Variables fed at run time, by name. Their values are not saved.
+using GraphInputs = std::vector<std::pair<std::string, std::shared_ptr<Variable>>>;
+
+struct LoadedGraph {
+  Graph graph;
+  std::unordered_map<std::string, std::shared_ptr<Variable>> inputs;
+};
+
+namespace io {
+
+constexpr char kGraphMagic[8] = {'U', 'P', 'S', 'G', 'R', 'A', 'P', 'H'};
+constexpr uint32_t kGraphVersion = 1;
+
+inline std::string resolve(const std::string& graph_path, const std::string& path) {
+  if (path.empty() || path[0] == '/') {
+    return path;
+  }
+  const size_t slash = graph_path.rfind('/');
+  return slash == std::string::npos ? path : graph_path.substr(0, slash + 1) + path;
+}
+
+inline void put_string(std::string& out, const std::string& s) {
+  put<uint32_t>(out, s.size());
+  out += s;
+}
+
+// A u32 count of items at least item_bytes each, checked against the bytes
+// left so that a corrupt count cannot size an allocation.
+inline uint32_t get_count(Cursor& in, size_t item_bytes) {
+  const uint32_t n = in.get<uint32_t>();
+  if (n > in.remaining() / item_bytes) {
+    throw std::runtime_error("Graph file is truncated");
+  }
+  return n;
+}
+
+inline std::string get_string(Cursor& in) {
+  const uint32_t n = in.get<uint32_t>();
+  return std::string(reinterpret_cast<const char*>(in.take(n)), n);
+}
+
+inline std::vector<uint32_t> conv_attrs(const Conv2DOptions& o) {
+  return {o.stride_h, o.stride_w, o.pad_h, o.pad_w, o.dilation_h, o.dilation_w, o.groups,
+          static_cast<uint32_t>(o.algorithm)};
+}
+
+inline std::vector<uint32_t> pool_attrs(const Pool2DOptions& o) {
+  return {o.kernel_h, o.kernel_w, o.stride_h, o.stride_w, o.pad_h, o.pad_w};
+}
+
+// Type and attributes of op.
+inline OpType describe(const Op& op, std::vector<uint32_t>& attrs) {
+  static const std::unordered_map<std::type_index, OpType> types = {
+      {typeid(Variable), OpType::Variable}, {typeid(Add), OpType::Add}, {typeid(Mul), OpType::Mul},
+      {typeid(Sub), OpType::Sub}, {typeid(Div), OpType::Div}, {typeid(MatMul), OpType::MatMul},
+      {typeid(Conv2D), OpType::Conv2D}, {typeid(MaxPool2D), OpType::MaxPool2D},
+      {typeid(AvgPool2D), OpType::AvgPool2D}, {typeid(GlobalAvgPool), OpType::GlobalAvgPool},
+      {typeid(Tanh), OpType::Tanh}, {typeid(ReLU), OpType::ReLU}, {typeid(Sigmoid), OpType::Sigmoid},
+      {typeid(Concat), OpType::Concat}, {typeid(Slice), OpType::Slice}, {typeid(Sum), OpType::Sum},
+      {typeid(Mean), OpType::Mean}, {typeid(L2Norm), OpType::L2Norm}, {typeid(Max), OpType::Max},
+      {typeid(Min), OpType::Min}, {typeid(ArgMax), OpType::ArgMax}, {typeid(Softmax), OpType::Softmax},
+      {typeid(LogSoftmax), OpType::LogSoftmax}, {typeid(SoftmaxCrossEntropy), OpType::SoftmaxCrossEntropy},
+  };
+  const auto it = types.find(typeid(op));
+  if (it == types.end()) {
+    throw std::invalid_argument(std::string("save_graph does not support op type ") + typeid(op).name());
+  }
+  switch (it->second) {
+    case OpType::Conv2D:
+      attrs = conv_attrs(static_cast<const Conv2D&>(op).options());
+      break;
+    case OpType::MaxPool2D:
+      attrs = pool_attrs(static_cast<const MaxPool2D&>(op).options());
+      break;
+    case OpType::AvgPool2D:
+      attrs = pool_attrs(static_cast<const AvgPool2D&>(op).options());
+      break;
+    case OpType::Concat:
+      attrs = {static_cast<const Concat&>(op).axis()};
+      break;
+    case OpType::Slice: {
+      const auto& slice = static_cast<const Slice&>(op);
+      attrs = {slice.dim(), slice.start(), slice.end()};
+      break;
+    }
+    case OpType::Sum:
+    case OpType::Mean:
+    case OpType::L2Norm:
+    case OpType::Max:
+    case OpType::Min:
+    case OpType::ArgMax: {
+      const auto& reduce = static_cast<const Reduce&>(op);
+      attrs = {reduce.axis(), reduce.keepdim()};
+      break;
+    }
+    default:
+      attrs.clear();
+  }
+  return it->second;
+}
+
+// Builds one op from its record; inputs and attrs were read from the file
+// and are checked here.
+inline std::shared_ptr<Op> make(OpType type, std::vector<std::shared_ptr<Op>> in, const std::vector<uint32_t>& a) {
+  size_t inputs = 1, attrs = 0;
+  switch (type) {
+    case OpType::Add:
+    case OpType::Mul:
+    case OpType::Sub:
+    case OpType::Div:
+    case OpType::MatMul:
+    case OpType::SoftmaxCrossEntropy:
+      inputs = 2;
+      break;
+    case OpType::Conv2D:
+      inputs = 2, attrs = 8;
+      break;
+    case OpType::MaxPool2D:
+    case OpType::AvgPool2D:
+      attrs = 6;
+      break;
+    case OpType::Concat:
+      inputs = std::max<size_t>(in.size(), 1), attrs = 1;
+      break;
+    case OpType::Slice:
+      attrs = 3;
+      break;
+    case OpType::Sum:
+    case OpType::Mean:
+    case OpType::L2Norm:
+    case OpType::Max:
+    case OpType::Min:
+    case OpType::ArgMax:
+      attrs = 2;
+      break;
+    default:
+      break;
+  }
+  if (in.size() != inputs || a.size() != attrs) {
+    throw std::runtime_error("Graph file has an op with the wrong number of inputs or attributes");
+  }
+
+  switch (type) {
+    case OpType::Add:
+      return std::make_shared<Add>(in[0], in[1]);
+    case OpType::Mul:
+      return std::make_shared<Mul>(in[0], in[1]);
+    case OpType::Sub:
+      return std::make_shared<Sub>(in[0], in[1]);
+    case OpType::Div:
+      return std::make_shared<Div>(in[0], in[1]);
+    case OpType::MatMul:
+      return std::make_shared<MatMul>(in[0], in[1]);
+    case OpType::Conv2D: {
+      Conv2DOptions o;
+      o.stride_h = a[0], o.stride_w = a[1], o.pad_h = a[2], o.pad_w = a[3];
+      o.dilation_h = a[4], o.dilation_w = a[5], o.groups = a[6];
+      if (a[7] > static_cast<uint32_t>(ConvAlgorithm::Direct)) {
+        throw std::runtime_error("Graph file has an unknown convolution algorithm");
+      }
+      o.algorithm = static_cast<ConvAlgorithm>(a[7]);
+      return std::make_shared<Conv2D>(in[0], in[1], o);
+    }
+    case OpType::MaxPool2D:
+    case OpType::AvgPool2D: {
+      Pool2DOptions o;
+      o.kernel_h = a[0], o.kernel_w = a[1], o.stride_h = a[2], o.stride_w = a[3], o.pad_h = a[4], o.pad_w = a[5];
+      if (type == OpType::MaxPool2D) {
+        return std::make_shared<MaxPool2D>(in[0], o);
+      }
+      return std::make_shared<AvgPool2D>(in[0], o);
+    }
+    case OpType::GlobalAvgPool:
+      return std::make_shared<GlobalAvgPool>(in[0]);
+    case OpType::Tanh:
+      return std::make_shared<Tanh>(in[0]);
+    case OpType::ReLU:
+      return std::make_shared<ReLU>(in[0]);
+    case OpType::Sigmoid:
+      return std::make_shared<Sigmoid>(in[0]);
+    case OpType::Concat:
+      return std::make_shared<Concat>(std::move(in), a[0]);
+    case OpType::Slice:
+      return std::make_shared<Slice>(in[0], a[0], a[1], a[2]);
+    case OpType::Sum:
+      return std::make_shared<Sum>(in[0], a[0], a[1] != 0);
+    case OpType::Mean:
+      return std::make_shared<Mean>(in[0], a[0], a[1] != 0);
+    case OpType::L2Norm:
+      return std::make_shared<L2Norm>(in[0], a[0], a[1] != 0);
+    case OpType::Max:
+      return std::make_shared<Max>(in[0], a[0], a[1] != 0);
+    case OpType::Min:
+      return std::make_shared<Min>(in[0], a[0], a[1] != 0);
+    case OpType::ArgMax:
+      return std::make_shared<ArgMax>(in[0], a[0], a[1] != 0);
+    case OpType::Softmax:
+      return std::make_shared<Softmax>(in[0]);
+    case OpType::LogSoftmax:
+      return std::make_shared<LogSoftmax>(in[0]);
+    case OpType::SoftmaxCrossEntropy:
+      return std::make_shared<SoftmaxCrossEntropy>(in[0], in[1]);
+    default:
+      throw std::runtime_error("Graph file has an unknown op type " + std::to_string(static_cast<uint32_t>(type)));
+  }
+}
+
+}  // namespace io
+
+// Writes graph to path and the values of its weights (every Variable not in
+// inputs) to weights_path, resolved against path's directory if relative.
+inline void save_graph(const Graph& graph, const std::string& path, const std::string& weights_path,
+                       const GraphInputs& inputs = {}) {
+  const auto& order = graph.order();
+  std::unordered_map<const Op*, uint32_t> index;
+  for (size_t i = 0; i < order.size(); i++) {
+    index[order[i].get()] = static_cast<uint32_t>(i);
+  }
+  std::unordered_map<const Op*, std::string> input_names;
+  for (const auto& [name, variable] : inputs) {
+    if (index.count(variable.get()) == 0) {
+      throw std::invalid_argument("Graph input " + name + " is not part of the graph");
+    }
+    input_names[variable.get()] = name;
+  }
+
+  std::string out(io::kGraphMagic, sizeof(io::kGraphMagic));
+  io::put<uint32_t>(out, io::kGraphVersion);
+  io::put<uint32_t>(out, order.size());
+  io::put<uint32_t>(out, graph.outputs().size());
+  io::put_string(out, weights_path);
+
+  TensorWriter weights;
+  std::vector<uint32_t> attrs;
+  for (size_t i = 0; i < order.size(); i++) {
+    const Op& op = *order[i];
+    OpType type = io::describe(op, attrs);
+    std::string name;
+    if (type == OpType::Variable) {
+      const auto it = input_names.find(&op);
+      if (it != input_names.end()) {
+        type = OpType::Input;
+        name = it->second;
+        attrs = op.output.shape();
+      } else {
+        name = "op" + std::to_string(i);
+        weights.add(name, op.output);
+      }
+    }
+    io::put<uint32_t>(out, static_cast<uint32_t>(type));
+    io::put_string(out, name);
+    io::put<uint32_t>(out, op.inputs.size());
+    for (const auto& input : op.inputs) {
+      io::put<uint32_t>(out, index.at(input.get()));
+    }
+    io::put<uint32_t>(out, attrs.size());
+    for (uint32_t v : attrs) {
+      io::put<uint32_t>(out, v);
+    }
+  }
+  for (const auto& output : graph.outputs()) {
+    io::put<uint32_t>(out, index.at(output.get()));
+  }
+
+  weights.write(io::resolve(path, weights_path));
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    throw std::runtime_error("Cannot create " + path);
+  }
+  const bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  if (std::fclose(file) != 0 || !ok) {
+    throw std::runtime_error("Cannot write " + path);
+  }
+}
+
+// Rebuilds a graph written by save_graph(). Weights alias the mapped weights
+// file; inputs start as zeros of their saved shape.
+inline LoadedGraph load_graph(const std::string& path) {
+  std::string bytes;
+  {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    char buffer[1 << 16];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      bytes.append(buffer, n);
+    }
+    std::fclose(file);
+  }
+  io::Cursor in(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+  if (bytes.size() < sizeof(io::kGraphMagic) ||
+      std::memcmp(in.take(sizeof(io::kGraphMagic)), io::kGraphMagic, sizeof(io::kGraphMagic)) != 0) {
+    throw std::runtime_error(path + " is not a graph file");
+  }
+  const uint32_t version = in.get<uint32_t>();
+  if (version != io::kGraphVersion) {
+    throw std::runtime_error(path + " has unsupported graph file version " + std::to_string(version));
+  }
+  // An op record takes at least 16 bytes, an output index 4.
+  const uint32_t count = io::get_count(in, 16);
+  const uint32_t output_count = io::get_count(in, 4);
+  const TensorFile weights(io::resolve(path, io::get_string(in)));
+
+  std::vector<std::shared_ptr<Op>> order;
+  std::unordered_map<std::string, std::shared_ptr<Variable>> inputs;
+  std::vector<std::shared_ptr<Op>> op_inputs;
+  std::vector<uint32_t> attrs;
+  order.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    const auto type = static_cast<OpType>(in.get<uint32_t>());
+    const std::string name = io::get_string(in);
+    op_inputs.resize(io::get_count(in, 4));
+    for (auto& input : op_inputs) {
+      const uint32_t j = in.get<uint32_t>();
+      if (j >= i) {
+        throw std::runtime_error("Graph file is not in topological order");
+      }
+      input = order[j];
+    }
+    attrs.resize(io::get_count(in, 4));
+    for (uint32_t& v : attrs) {
+      v = in.get<uint32_t>();
+    }
+
+    if ((type == OpType::Variable || type == OpType::Input) && !op_inputs.empty()) {
+      throw std::runtime_error("Graph file has a variable with inputs");
+    }
+    if (type == OpType::Variable) {
+      order.push_back(std::make_shared<Variable>(weights.get(name)));
+    } else if (type == OpType::Input) {
+      // Element counts are indexed with u32 throughout Tensor.
+      size_t bytes = 0;
+      if (!io::checked_bytes(attrs, sizeof(float), bytes) || bytes / sizeof(float) > UINT32_MAX) {
+        throw std::runtime_error("Graph file has an input of impossible size");
+      }
+      auto variable = std::make_shared<Variable>(
+          Tensor<float>::wrap(std::make_shared<Storage<float>>(bytes / sizeof(float)), attrs));
+      if (!inputs.emplace(name, variable).second) {
+        throw std::runtime_error("Graph file has two inputs named " + name);
+      }
+      order.push_back(std::move(variable));
+    } else {
+      order.push_back(io::make(type, op_inputs, attrs));
+    }
+  }
+
+  std::vector<std::shared_ptr<Op>> outputs(output_count);
+  for (auto& output : outputs) {
+    const uint32_t j = in.get<uint32_t>();
+    if (j >= count) {
+      throw std::runtime_error("Graph file has an output out of range");
+    }
+    output = order[j];
+  }
+  return {Graph(std::move(outputs), std::move(order)), std::move(inputs)};
+}
+
+}  // namespace upsilon
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include "kernels.hh"
+
+namespace upsilon {
+
+// 16-bit floating point storage formats. Neither type does arithmetic: values
+// are converted to float by the SIMD kernels in kernels.hh (rounding to
+// nearest even) and all math happens in fp32.
+//
+// bf16 keeps the 8-bit exponent of float and 7 mantissa bits, so anything a
+// float can hold keeps its magnitude. fp16 (IEEE half) has 10 mantissa bits
+// but tops out at 65504 and flushes below 2^-24, which is why fp16 training
+// needs loss scaling.
+struct bf16 {
+  uint16_t bits = 0;
+
+  static void encode(const float* a, uint16_t* out, size_t n) { kernels::encode_bf16(a, out, n); }
+
+  static void decode(const uint16_t* a, float* out, size_t n) { kernels::decode_bf16(a, out, n); }
+};
+
+struct fp16 {
+  uint16_t bits = 0;
+
+  static void encode(const float* a, uint16_t* out, size_t n) { kernels::encode_fp16(a, out, n); }
+
+  static void decode(const uint16_t* a, float* out, size_t n) { kernels::decode_fp16(a, out, n); }
+};
+
+static_assert(sizeof(bf16) == 2 && sizeof(fp16) == 2, "half types must be two bytes");
+
+template <typename T>
+inline T to_half(float x) {
+  T h;
+  T::encode(&x, &h.bits, 1);
+  return h;
+}
+
+template <typename T>
+inline float to_float(T h) {
+  float x;
+  T::decode(&h.bits, &x, 1);
+  return x;
+}
+
+}  // namespace upsilon
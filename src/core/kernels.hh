@@ -0,0 +1,315 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "expr.hh"
+
+// Elementwise kernels over raw contiguous float pointers.
+//
+// kernels_impl.hh holds the kernel bodies written once against GCC/Clang
+// vector extensions. It is included below once per instruction set, each
+// time inside its own namespace and with that instruction set enabled as the
+// compile target, so every copy is vectorized for its ISA without global
+// -m flags. The public entry points pick a copy at runtime from CPUID.
+
+#define UPSILON_STRINGIFY_IMPL(x) #x
+#define UPSILON_STRINGIFY(x) UPSILON_STRINGIFY_IMPL(x)
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UPSILON_X86_SIMD 1
+#if defined(__clang__)
+#define UPSILON_TARGET_REGION(T) \
+  _Pragma(UPSILON_STRINGIFY(clang attribute push(__attribute__((target(T))), apply_to = function)))
+#define UPSILON_UNTARGET_REGION _Pragma("clang attribute pop")
+#else
+#define UPSILON_TARGET_REGION(T) _Pragma("GCC push_options") _Pragma(UPSILON_STRINGIFY(GCC target(T)))
+#define UPSILON_UNTARGET_REGION _Pragma("GCC pop_options")
+#endif
+#else
+#define UPSILON_X86_SIMD 0
+#endif
+
+namespace upsilon {
+namespace kernels {
+
+enum class Isa {
+  Scalar,
+  SSE,
+  AVX2,
+  AVX512
+};
+
+enum class BinaryOp {
+  Add,
+  Sub,
+  Mul,
+  Div,
+  Max,
+  Min
+};
+
+inline const char* isa_name(Isa isa) {
+  switch (isa) {
+    case Isa::SSE:
+      return "sse4.1";
+    case Isa::AVX2:
+      return "avx2";
+    case Isa::AVX512:
+      return "avx512";
+    default:
+      return "scalar";
+  }
+}
+
+// Widest instruction set the running CPU (and OS) supports.
+inline Isa supported_isa() {
+#if UPSILON_X86_SIMD
+  static const Isa isa = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")) {
+      return Isa::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return Isa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+      return Isa::SSE;
+    }
+    return Isa::Scalar;
+  }();
+  return isa;
+#else
+  return Isa::Scalar;
+#endif
+}
+
+namespace detail {
+
+inline std::atomic<Isa>& active_isa() {
+  static std::atomic<Isa> isa{supported_isa()};
+  return isa;
+}
+
+}  // namespace detail
+
+inline Isa active_isa() {
+  return detail::active_isa().load(std::memory_order_relaxed);
+}
+
+// Restricts dispatch to isa or narrower, e.g. to compare paths in a
+// benchmark. Returns the instruction set actually selected.
+inline Isa set_isa(Isa isa) {
+  if (static_cast<int>(isa) > static_cast<int>(supported_isa())) {
+    isa = supported_isa();
+  }
+  detail::active_isa().store(isa, std::memory_order_relaxed);
+  return isa;
+}
+
+namespace scalar {
+#define UPSILON_SIMD_WIDTH 1
+#include "kernels_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace scalar
+
+#if UPSILON_X86_SIMD
+UPSILON_TARGET_REGION("sse4.1")
+namespace sse {
+#define UPSILON_SIMD_WIDTH 4
+#include "kernels_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace sse
+UPSILON_UNTARGET_REGION
+
+UPSILON_TARGET_REGION("avx2,fma")
+namespace avx2 {
+#define UPSILON_SIMD_WIDTH 8
+#include "kernels_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace avx2
+UPSILON_UNTARGET_REGION
+
+UPSILON_TARGET_REGION("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma")
+namespace avx512 {
+#define UPSILON_SIMD_WIDTH 16
+#include "kernels_impl.hh"
+#undef UPSILON_SIMD_WIDTH
+}  // namespace avx512
+UPSILON_UNTARGET_REGION
+#endif
+
+#if UPSILON_X86_SIMD
+#define UPSILON_DISPATCH(fn, ...)              \
+  switch (active_isa()) {                      \
+    case Isa::AVX512:                          \
+      return avx512::fn(__VA_ARGS__);          \
+    case Isa::AVX2:                            \
+      return avx2::fn(__VA_ARGS__);            \
+    case Isa::SSE:                             \
+      return sse::fn(__VA_ARGS__);             \
+    default:                                   \
+      return scalar::fn(__VA_ARGS__);          \
+  }
+#else
+#define UPSILON_DISPATCH(fn, ...) return scalar::fn(__VA_ARGS__);
+#endif
+
+// out[i] = a[i] op b[i] for contiguous a, b and out. out may alias a or b.
+inline void binary(BinaryOp op, const float* a, const float* b, float* out, size_t n) {
+  UPSILON_DISPATCH(binary, op, a, b, out, n)
+}
+
+// out[i] = a[i] op b, or b op a[i] if scalar_lhs, for contiguous a and out:
+// the inner loop of a broadcast operand.
+inline void binary_scalar(BinaryOp op, const float* a, float b, float* out, size_t n, bool scalar_lhs) {
+  UPSILON_DISPATCH(binary_scalar, op, a, b, out, n, scalar_lhs)
+}
+
+// out[0, n) = e for an expression tree from expr.hh, in one fused pass.
+template <typename E>
+inline void evaluate(const E& e, float* out, size_t n) {
+  UPSILON_DISPATCH(evaluate, e, out, 0, n)
+}
+
+// Same, restricted to elements [begin, end); out still points at element 0.
+template <typename E>
+inline void evaluate(const E& e, float* out, size_t begin, size_t end) {
+  UPSILON_DISPATCH(evaluate, e, out, begin, end)
+}
+
+// Sum of a[0, n).
+inline float sum(const float* a, size_t n) {
+  UPSILON_DISPATCH(sum, a, n)
+}
+
+// Max, min and sum of squares of a[0, n); n > 0 for max and min.
+inline float reduce_max(const float* a, size_t n) {
+  UPSILON_DISPATCH(reduce_max, a, n)
+}
+
+inline float reduce_min(const float* a, size_t n) {
+  UPSILON_DISPATCH(reduce_min, a, n)
+}
+
+inline float sum_squares(const float* a, size_t n) {
+  UPSILON_DISPATCH(sum_squares, a, n)
+}
+
+// Index of the first maximum (minimum) of a[0, n), n > 0.
+inline size_t argmax(const float* a, size_t n) {
+  UPSILON_DISPATCH(argmax, a, n)
+}
+
+inline size_t argmin(const float* a, size_t n) {
+  UPSILON_DISPATCH(argmin, a, n)
+}
+
+// Running arg-reduction over rows: where row[j] beats best[j] (greater, or
+// less if !greater), best[j] = row[j] and index[j] = k.
+inline void arg_update(bool greater, float* best, float* index, const float* row, float k, size_t n) {
+  UPSILON_DISPATCH(arg_update, greater, best, index, row, k, n)
+}
+
+// acc[j] += row[j]^2 over [0, n).
+inline void add_squares(float* acc, const float* row, size_t n) {
+  UPSILON_DISPATCH(add_squares, acc, row, n)
+}
+
+// log(sum(exp(a[i]))) over a[0, n), n > 0, computed in one pass without
+// overflow.
+inline float logsumexp(const float* a, size_t n) {
+  UPSILON_DISPATCH(logsumexp, a, n)
+}
+
+// out[i] = exp(a[i] - shift); out may alias a.
+inline void exp_shifted(const float* a, float shift, float* out, size_t n) {
+  UPSILON_DISPATCH(exp_shifted, a, shift, out, n)
+}
+
+// out[i] += scale * exp(a[i] - shift).
+inline void add_exp_shifted(const float* a, float shift, float scale, float* out, size_t n) {
+  UPSILON_DISPATCH(add_exp_shifted, a, shift, scale, out, n)
+}
+
+// Sum of a[i] * b[i] over [0, n).
+inline float dot(const float* a, const float* b, size_t n) {
+  UPSILON_DISPATCH(dot, a, b, n)
+}
+
+// dx[i] += y[i] * (dy[i] - c): the softmax gradient with c = dot(y, dy).
+inline void softmax_grad(const float* y, const float* dy, float c, float* dx, size_t n) {
+  UPSILON_DISPATCH(softmax_grad, y, dy, c, dx, n)
+}
+
+// out[i] = clamp(round(a[i] * inv_scale + zero_point), 0, 255), the affine
+// uint8 quantization of a; ties round to even.
+inline void quantize(const float* a, float inv_scale, int32_t zero_point, uint8_t* out, size_t n) {
+  UPSILON_DISPATCH(quantize, a, inv_scale, zero_point, out, n)
+}
+
+// out[i] = (a[i] - zero_point) * scale.
+inline void dequantize(const uint8_t* a, float scale, int32_t zero_point, float* out, size_t n) {
+  UPSILON_DISPATCH(dequantize, a, scale, zero_point, out, n)
+}
+
+// Conversions between float and the bits of IEEE half precision (fp16) or
+// bfloat16, rounding to nearest even. Values beyond the fp16 range become
+// infinity.
+inline void encode_fp16(const float* a, uint16_t* out, size_t n) {
+  UPSILON_DISPATCH(encode_fp16, a, out, n)
+}
+
+inline void decode_fp16(const uint16_t* a, float* out, size_t n) {
+  UPSILON_DISPATCH(decode_fp16, a, out, n)
+}
+
+inline void encode_bf16(const float* a, uint16_t* out, size_t n) {
+  UPSILON_DISPATCH(encode_bf16, a, out, n)
+}
+
+inline void decode_bf16(const uint16_t* a, float* out, size_t n) {
+  UPSILON_DISPATCH(decode_bf16, a, out, n)
+}
+
+// True if a[0, n) holds no infinity or NaN.
+inline bool all_finite(const float* a, size_t n) {
+  UPSILON_DISPATCH(all_finite, a, n)
+}
+
+// Same as binary() for operands with arbitrary element strides.
+inline void binary_strided(BinaryOp op, const float* a, int64_t a_stride, const float* b, int64_t b_stride,
+                           float* out, int64_t out_stride, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const float x = a[i * a_stride];
+    const float y = b[i * b_stride];
+    float r;
+    switch (op) {
+      case BinaryOp::Add:
+        r = x + y;
+        break;
+      case BinaryOp::Sub:
+        r = x - y;
+        break;
+      case BinaryOp::Mul:
+        r = x * y;
+        break;
+      case BinaryOp::Max:
+        r = x > y ? x : y;
+        break;
+      case BinaryOp::Min:
+        r = x < y ? x : y;
+        break;
+      default:
+        r = x / y;
+        break;
+    }
+    out[i * out_stride] = r;
+  }
+}
+
+}  // namespace kernels
+}  // namespace upsilon
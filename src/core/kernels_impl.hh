@@ -0,0 +1,730 @@
+// Kernel bodies shared by every instruction set. Deliberately has no include
+// guard: kernels.hh includes it once per ISA, inside namespace
+// upsilon::kernels::<isa>, with UPSILON_SIMD_WIDTH set to the number of float
+// lanes (1 for the scalar fallback). Do not include it directly.
+
+#if UPSILON_SIMD_WIDTH > 1
+typedef float vfloat __attribute__((vector_size(UPSILON_SIMD_WIDTH * sizeof(float))));
+typedef int32_t vint __attribute__((vector_size(UPSILON_SIMD_WIDTH * sizeof(int32_t))));
+
+inline vfloat load(const float* p) {
+  vfloat v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void store(float* p, vfloat v) {
+  std::memcpy(p, &v, sizeof(v));
+}
+#endif
+
+constexpr size_t kWidth = UPSILON_SIMD_WIDTH;
+
+template <typename V>
+inline V broadcast(float x) {
+  return V{} + x;
+}
+
+template <typename V>
+inline V load_as(const float* p) {
+  V v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+template <typename To, typename From>
+inline To bit_cast(From x) {
+  static_assert(sizeof(To) == sizeof(From), "bit_cast requires equal sizes");
+  To y;
+  std::memcpy(&y, &x, sizeof(y));
+  return y;
+}
+
+// Integer lanes matching V, and exact conversions between the two.
+inline int32_t lanes_to_int(float x) { return static_cast<int32_t>(x); }
+inline float lanes_to_float(int32_t x) { return static_cast<float>(x); }
+inline int32_t int_lanes(float) { return 0; }
+#if UPSILON_SIMD_WIDTH > 1
+inline vint lanes_to_int(vfloat x) { return __builtin_convertvector(x, vint); }
+inline vfloat lanes_to_float(vint x) { return __builtin_convertvector(x, vfloat); }
+inline vint int_lanes(vfloat) { return vint{}; }
+#endif
+
+template <typename V>
+using IntLanes = decltype(int_lanes(V{}));
+
+// Vectorized elementary functions (Cephes-style range reduction plus a
+// minimax polynomial). Maximum error against the correctly rounded result,
+// measured over every float in the stated range, identical for all ISAs
+// (tests/vmath_test.cc rechecks a sample of each range):
+//   vexp      x in [-87.3, 88.7]     1 ulp
+//   vlog      x in (0, FLT_MAX]      1 ulp
+//   vtanh     x in [-9, 9]           1 ulp
+//   vsigmoid  x in [-87, 87]         2 ulp
+// Outside those ranges the results saturate: exp gives 0 / +inf, tanh +-1,
+// sigmoid 0 / 1, log(0) = -inf and log(x < 0) = NaN. NaN inputs propagate.
+
+template <typename V>
+inline V vexp(V x) {
+  using I = IntLanes<V>;
+  const V input = x;
+  x = x > broadcast<V>(88.7228391f) ? broadcast<V>(88.7228391f) : x;
+  x = x < broadcast<V>(-87.3365479f) ? broadcast<V>(-87.3365479f) : x;
+
+  // x = n ln2 + r with |r| <= ln2 / 2; rounding through 1.5 * 2^23.
+  const V shifter = broadcast<V>(12582912.0f);
+  const V n = (x * 1.44269504088896341f + shifter) - shifter;
+  V r = x - n * 0.693359375f;
+  r = r + n * 2.12194440e-4f;
+
+  V p = broadcast<V>(1.9875691500E-4f);
+  p = p * r + 1.3981999507E-3f;
+  p = p * r + 8.3334519073E-3f;
+  p = p * r + 4.1665795894E-2f;
+  p = p * r + 1.6666665459E-1f;
+  p = p * r + 5.0000001201E-1f;
+  p = p * (r * r) + r + 1.0f;
+
+  // 2^n in two halves, since n = 128 has no float exponent of its own.
+  const I ni = lanes_to_int(n);
+  const I half = ni >> 1;
+  V result = p * bit_cast<V>((half + 127) << 23) * bit_cast<V>((ni - half + 127) << 23);
+  result = input > broadcast<V>(88.7228391f) ? broadcast<V>(__builtin_inff()) : result;
+  result = input < broadcast<V>(-87.3365479f) ? broadcast<V>(0.0f) : result;
+  return input != input ? input : result;
+}
+
+template <typename V>
+inline V vlog(V x) {
+  using I = IntLanes<V>;
+  const V input = x;
+
+  // Scale denormals into the normal range first.
+  const V min_normal = broadcast<V>(1.17549435e-38f);
+  const V scaled = x < min_normal ? x * 8388608.0f : x;
+  I bits = bit_cast<I>(scaled);
+  V e = lanes_to_float(((bits >> 23) & 0xff) - 126);
+  e = x < min_normal ? e - 23.0f : e;
+
+  // Mantissa in [0.5, 1), then shifted to [sqrt(1/2), sqrt(2)) - 1.
+  V m = bit_cast<V>((bits & 0x007fffff) | 0x3f000000);
+  const auto small = m < broadcast<V>(0.707106781186547524f);
+  e = small ? e - 1.0f : e;
+  m = small ? m + m - 1.0f : m - 1.0f;
+
+  const V z = m * m;
+  V y = broadcast<V>(7.0376836292E-2f);
+  y = y * m - 1.1514610310E-1f;
+  y = y * m + 1.1676998740E-1f;
+  y = y * m - 1.2420140846E-1f;
+  y = y * m + 1.4249322787E-1f;
+  y = y * m - 1.6668057665E-1f;
+  y = y * m + 2.0000714765E-1f;
+  y = y * m - 2.4999993993E-1f;
+  y = y * m + 3.3333331174E-1f;
+  y = y * m * z;
+  y = y + e * -2.12194440e-4f;
+  y = y - z * 0.5f;
+  V result = m + y + e * 0.693359375f;
+
+  result = input == broadcast<V>(__builtin_inff()) ? input : result;
+  result = input == broadcast<V>(0.0f) ? broadcast<V>(-__builtin_inff()) : result;
+  result = input < broadcast<V>(0.0f) ? broadcast<V>(__builtin_nanf("")) : result;
+  return input != input ? input : result;
+}
+
+template <typename V>
+inline V vtanh(V x) {
+  using I = IntLanes<V>;
+  const I sign = bit_cast<I>(x) & INT32_MIN;
+  const V ax = bit_cast<V>(bit_cast<I>(x) & 0x7fffffff);
+
+  // Small |x|: odd polynomial, avoids cancellation in 1 - 2 / (e^2x + 1).
+  const V z = x * x;
+  V p = broadcast<V>(-5.70498872745E-3f);
+  p = p * z + 2.06390887954E-2f;
+  p = p * z - 5.37397155531E-2f;
+  p = p * z + 1.33314422036E-1f;
+  p = p * z - 3.33332819422E-1f;
+  const V small = p * z * ax + ax;
+  const V large = 1.0f - 2.0f / (vexp(ax + ax) + 1.0f);
+
+  V result = ax < broadcast<V>(0.625f) ? small : large;
+  result = ax > broadcast<V>(9.0f) ? broadcast<V>(1.0f) : result;
+  result = bit_cast<V>(bit_cast<I>(result) | sign);
+  return x != x ? x : result;
+}
+
+template <typename V>
+inline V vsigmoid(V x) {
+  return 1.0f / (1.0f + vexp(-x));
+}
+
+// Operations on one lane (V = float) or one vector of lanes (V = vfloat).
+template <typename V>
+inline V apply(expr::Add, V a, V b) { return a + b; }
+
+template <typename V>
+inline V apply(expr::Sub, V a, V b) { return a - b; }
+
+template <typename V>
+inline V apply(expr::Mul, V a, V b) { return a * b; }
+
+template <typename V>
+inline V apply(expr::Div, V a, V b) { return a / b; }
+
+template <typename V>
+inline V apply(expr::Max, V a, V b) { return a > b ? a : b; }
+
+template <typename V>
+inline V apply(expr::Min, V a, V b) { return a < b ? a : b; }
+
+template <typename V>
+inline V apply(expr::Greater, V a, V b) { return a > b ? broadcast<V>(1.0f) : broadcast<V>(0.0f); }
+
+template <typename V>
+inline V apply(expr::Neg, V a) { return -a; }
+
+template <typename V>
+inline V apply(expr::Exp, V a) { return vexp(a); }
+
+template <typename V>
+inline V apply(expr::Log, V a) { return vlog(a); }
+
+template <typename V>
+inline V apply(expr::Tanh, V a) { return vtanh(a); }
+
+template <typename V>
+inline V apply(expr::Sigmoid, V a) { return vsigmoid(a); }
+
+// Element(s) i of an expression tree.
+template <typename V>
+inline V packet(const expr::Ref& e, size_t i) {
+  return load_as<V>(e.data + i);
+}
+
+template <typename V>
+inline V packet(const expr::Const& e, size_t) {
+  return broadcast<V>(e.value);
+}
+
+template <typename V, typename Op, typename A>
+inline V packet(const expr::Unary<Op, A>& e, size_t i);
+
+template <typename V, typename Op, typename L, typename R>
+inline V packet(const expr::Binary<Op, L, R>& e, size_t i);
+
+template <typename V, typename Op, typename A>
+inline V packet(const expr::Unary<Op, A>& e, size_t i) {
+  return apply(Op{}, packet<V>(e.arg, i));
+}
+
+template <typename V, typename Op, typename L, typename R>
+inline V packet(const expr::Binary<Op, L, R>& e, size_t i) {
+  return apply(Op{}, packet<V>(e.lhs, i), packet<V>(e.rhs, i));
+}
+
+// out[begin, end) = e[begin, end), in a single pass. out may alias an operand
+// of e.
+template <typename E>
+inline void evaluate(const E& e, float* out, size_t begin, size_t end) {
+  size_t i = begin;
+#if UPSILON_SIMD_WIDTH > 1
+  for (; i + 2 * kWidth <= end; i += 2 * kWidth) {
+    const vfloat r0 = packet<vfloat>(e, i);
+    const vfloat r1 = packet<vfloat>(e, i + kWidth);
+    store(out + i, r0);
+    store(out + i + kWidth, r1);
+  }
+  for (; i + kWidth <= end; i += kWidth) {
+    store(out + i, packet<vfloat>(e, i));
+  }
+#endif
+  for (; i < end; i++) {
+    out[i] = packet<float>(e, i);
+  }
+}
+
+template <typename Op>
+inline void binary_loop(const float* a, const float* b, float* out, size_t n, Op op) {
+  size_t i = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  // Four independent vectors per iteration to hide load latency.
+  for (; i + 4 * kWidth <= n; i += 4 * kWidth) {
+    const vfloat r0 = apply(op, load(a + i), load(b + i));
+    const vfloat r1 = apply(op, load(a + i + kWidth), load(b + i + kWidth));
+    const vfloat r2 = apply(op, load(a + i + 2 * kWidth), load(b + i + 2 * kWidth));
+    const vfloat r3 = apply(op, load(a + i + 3 * kWidth), load(b + i + 3 * kWidth));
+    store(out + i, r0);
+    store(out + i + kWidth, r1);
+    store(out + i + 2 * kWidth, r2);
+    store(out + i + 3 * kWidth, r3);
+  }
+  for (; i + kWidth <= n; i += kWidth) {
+    store(out + i, apply(op, load(a + i), load(b + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = apply(op, a[i], b[i]);
+  }
+}
+
+inline void binary(BinaryOp op, const float* a, const float* b, float* out, size_t n) {
+  switch (op) {
+    case BinaryOp::Add:
+      return binary_loop(a, b, out, n, expr::Add{});
+    case BinaryOp::Sub:
+      return binary_loop(a, b, out, n, expr::Sub{});
+    case BinaryOp::Mul:
+      return binary_loop(a, b, out, n, expr::Mul{});
+    case BinaryOp::Div:
+      return binary_loop(a, b, out, n, expr::Div{});
+    case BinaryOp::Max:
+      return binary_loop(a, b, out, n, expr::Max{});
+    case BinaryOp::Min:
+      return binary_loop(a, b, out, n, expr::Min{});
+  }
+}
+
+template <typename Op>
+inline void binary_scalar_loop(const float* a, float b, float* out, size_t n, bool scalar_lhs, Op op) {
+  size_t i = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  const vfloat vb = broadcast<vfloat>(b);
+  for (; i + kWidth <= n; i += kWidth) {
+    store(out + i, scalar_lhs ? apply(op, vb, load(a + i)) : apply(op, load(a + i), vb));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = scalar_lhs ? apply(op, b, a[i]) : apply(op, a[i], b);
+  }
+}
+
+inline void binary_scalar(BinaryOp op, const float* a, float b, float* out, size_t n, bool scalar_lhs) {
+  switch (op) {
+    case BinaryOp::Add:
+      return binary_scalar_loop(a, b, out, n, scalar_lhs, expr::Add{});
+    case BinaryOp::Sub:
+      return binary_scalar_loop(a, b, out, n, scalar_lhs, expr::Sub{});
+    case BinaryOp::Mul:
+      return binary_scalar_loop(a, b, out, n, scalar_lhs, expr::Mul{});
+    case BinaryOp::Div:
+      return binary_scalar_loop(a, b, out, n, scalar_lhs, expr::Div{});
+    case BinaryOp::Max:
+      return binary_scalar_loop(a, b, out, n, scalar_lhs, expr::Max{});
+    case BinaryOp::Min:
+      return binary_scalar_loop(a, b, out, n, scalar_lhs, expr::Min{});
+  }
+}
+
+inline float sum(const float* a, size_t n) {
+  size_t i = 0;
+  float total = 0.0f;
+#if UPSILON_SIMD_WIDTH > 1
+  vfloat s0 = broadcast<vfloat>(0.0f), s1 = s0, s2 = s0, s3 = s0;
+  for (; i + 4 * kWidth <= n; i += 4 * kWidth) {
+    s0 += load(a + i);
+    s1 += load(a + i + kWidth);
+    s2 += load(a + i + 2 * kWidth);
+    s3 += load(a + i + 3 * kWidth);
+  }
+  for (; i + kWidth <= n; i += kWidth) {
+    s0 += load(a + i);
+  }
+  s0 = (s0 + s1) + (s2 + s3);
+  for (size_t k = 0; k < kWidth; k++) {
+    total += s0[k];
+  }
+#endif
+  for (; i < n; i++) {
+    total += a[i];
+  }
+  return total;
+}
+
+// Fold of a[0, n) with op (Add, Max or Min) over four accumulators per lane,
+// combined pairwise at the end. Every accumulator starts at init, so init
+// must be op's identity or an element of a.
+template <typename Op>
+inline float fold(const float* a, size_t n, float init, Op op) {
+  size_t i = 0;
+  float total = init;
+#if UPSILON_SIMD_WIDTH > 1
+  vfloat s0 = broadcast<vfloat>(init), s1 = s0, s2 = s0, s3 = s0;
+  for (; i + 4 * kWidth <= n; i += 4 * kWidth) {
+    s0 = apply(op, s0, load(a + i));
+    s1 = apply(op, s1, load(a + i + kWidth));
+    s2 = apply(op, s2, load(a + i + 2 * kWidth));
+    s3 = apply(op, s3, load(a + i + 3 * kWidth));
+  }
+  for (; i + kWidth <= n; i += kWidth) {
+    s0 = apply(op, s0, load(a + i));
+  }
+  s0 = apply(op, apply(op, s0, s1), apply(op, s2, s3));
+  for (size_t k = 0; k < kWidth; k++) {
+    total = apply(op, total, s0[k]);
+  }
+#endif
+  for (; i < n; i++) {
+    total = apply(op, total, a[i]);
+  }
+  return total;
+}
+
+inline float reduce_max(const float* a, size_t n) {
+  return fold(a, n, a[0], expr::Max{});
+}
+
+inline float reduce_min(const float* a, size_t n) {
+  return fold(a, n, a[0], expr::Min{});
+}
+
+inline float sum_squares(const float* a, size_t n) {
+  size_t i = 0;
+  float total = 0.0f;
+#if UPSILON_SIMD_WIDTH > 1
+  vfloat s0 = broadcast<vfloat>(0.0f), s1 = s0, s2 = s0, s3 = s0;
+  for (; i + 4 * kWidth <= n; i += 4 * kWidth) {
+    const vfloat x0 = load(a + i), x1 = load(a + i + kWidth);
+    const vfloat x2 = load(a + i + 2 * kWidth), x3 = load(a + i + 3 * kWidth);
+    s0 += x0 * x0;
+    s1 += x1 * x1;
+    s2 += x2 * x2;
+    s3 += x3 * x3;
+  }
+  for (; i + kWidth <= n; i += kWidth) {
+    const vfloat x = load(a + i);
+    s0 += x * x;
+  }
+  s0 = (s0 + s1) + (s2 + s3);
+  for (size_t k = 0; k < kWidth; k++) {
+    total += s0[k];
+  }
+#endif
+  for (; i < n; i++) {
+    total += a[i] * a[i];
+  }
+  return total;
+}
+
+// Index of the first maximum (minimum) of a[0, n): the extreme value with a
+// vectorized fold, then the first element equal to it.
+inline size_t argmax(const float* a, size_t n) {
+  const float m = reduce_max(a, n);
+  return std::min<size_t>(std::find(a, a + n, m) - a, n - 1);
+}
+
+inline size_t argmin(const float* a, size_t n) {
+  const float m = reduce_min(a, n);
+  return std::min<size_t>(std::find(a, a + n, m) - a, n - 1);
+}
+
+// Where row[j] is strictly greater (or, if !greater, less) than best[j]:
+// best[j] = row[j] and index[j] = k. Visiting rows in order keeps the first
+// extreme.
+inline void arg_update(bool greater, float* best, float* index, const float* row, float k, size_t n) {
+  size_t j = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  const vfloat vk = broadcast<vfloat>(k);
+  for (; j + kWidth <= n; j += kWidth) {
+    const vfloat b = load(best + j), x = load(row + j);
+    const auto better = greater ? x > b : x < b;
+    store(best + j, better ? x : b);
+    store(index + j, better ? vk : load(index + j));
+  }
+#endif
+  for (; j < n; j++) {
+    if (greater ? row[j] > best[j] : row[j] < best[j]) {
+      best[j] = row[j];
+      index[j] = k;
+    }
+  }
+}
+
+// acc[j] += row[j] * row[j].
+inline void add_squares(float* acc, const float* row, size_t n) {
+  size_t j = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  for (; j + kWidth <= n; j += kWidth) {
+    const vfloat x = load(row + j);
+    store(acc + j, load(acc + j) + x * x);
+  }
+#endif
+  for (; j < n; j++) {
+    acc[j] += row[j] * row[j];
+  }
+}
+
+// log(sum(exp(a[i]))) over a[0, n), n > 0, in one pass: every lane keeps a
+// running max m and a sum s of exp(x - m), rescaled by exp(m_old - m_new)
+// once per block of four vectors rather than per element. The lanes are
+// merged at the end the same way. A partial last vector is padded with
+// -inf, whose exp is 0.
+inline float logsumexp(const float* a, size_t n) {
+#if UPSILON_SIMD_WIDTH > 1
+  vfloat vm = broadcast<vfloat>(a[0]), vs = broadcast<vfloat>(0.0f);
+  auto update = [&](vfloat top) {
+    const vfloat next = apply(expr::Max{}, vm, top);
+    vs = vs * vexp(vm - next);
+    vm = next;
+  };
+  size_t i = 0;
+  for (; i + 4 * kWidth <= n; i += 4 * kWidth) {
+    const vfloat x0 = load(a + i), x1 = load(a + i + kWidth);
+    const vfloat x2 = load(a + i + 2 * kWidth), x3 = load(a + i + 3 * kWidth);
+    update(apply(expr::Max{}, apply(expr::Max{}, x0, x1), apply(expr::Max{}, x2, x3)));
+    vs += (vexp(x0 - vm) + vexp(x1 - vm)) + (vexp(x2 - vm) + vexp(x3 - vm));
+  }
+  for (; i + kWidth <= n; i += kWidth) {
+    const vfloat x = load(a + i);
+    update(x);
+    vs += vexp(x - vm);
+  }
+  if (i < n) {
+    // Pad with a real element and mask its terms out; padding with -inf
+    // would make vexp() return through denormals, which is very slow.
+    alignas(64) float tail[kWidth], keep[kWidth];
+    for (size_t k = 0; k < kWidth; k++) {
+      tail[k] = a[i + k < n ? i + k : i];
+      keep[k] = i + k < n ? 1.0f : 0.0f;
+    }
+    const vfloat x = load(tail);
+    update(x);
+    vs += vexp(x - vm) * load(keep);
+  }
+  float m = vm[0];
+  for (size_t k = 1; k < kWidth; k++) {
+    m = m > vm[k] ? m : vm[k];
+  }
+  const vfloat scaled = vs * vexp(vm - m);
+  float s = 0.0f;
+  for (size_t k = 0; k < kWidth; k++) {
+    s += scaled[k];
+  }
+#else
+  float m = a[0], s = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    if (a[i] > m) {
+      s *= vexp(m - a[i]);
+      m = a[i];
+    }
+    s += vexp(a[i] - m);
+  }
+#endif
+  return m + vlog(s);
+}
+
+// out[i] = exp(a[i] - shift).
+inline void exp_shifted(const float* a, float shift, float* out, size_t n) {
+  size_t i = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  const vfloat vshift = broadcast<vfloat>(shift);
+  for (; i + kWidth <= n; i += kWidth) {
+    store(out + i, vexp(load(a + i) - vshift));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = vexp(a[i] - shift);
+  }
+}
+
+// out[i] += scale * exp(a[i] - shift).
+inline void add_exp_shifted(const float* a, float shift, float scale, float* out, size_t n) {
+  size_t i = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  const vfloat vshift = broadcast<vfloat>(shift), vscale = broadcast<vfloat>(scale);
+  for (; i + kWidth <= n; i += kWidth) {
+    store(out + i, load(out + i) + vscale * vexp(load(a + i) - vshift));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] += scale * vexp(a[i] - shift);
+  }
+}
+
+// Sum of a[i] * b[i] over [0, n).
+inline float dot(const float* a, const float* b, size_t n) {
+  size_t i = 0;
+  float total = 0.0f;
+#if UPSILON_SIMD_WIDTH > 1
+  vfloat s0 = broadcast<vfloat>(0.0f), s1 = s0;
+  for (; i + 2 * kWidth <= n; i += 2 * kWidth) {
+    s0 += load(a + i) * load(b + i);
+    s1 += load(a + i + kWidth) * load(b + i + kWidth);
+  }
+  for (; i + kWidth <= n; i += kWidth) {
+    s0 += load(a + i) * load(b + i);
+  }
+  s0 += s1;
+  for (size_t k = 0; k < kWidth; k++) {
+    total += s0[k];
+  }
+#endif
+  for (; i < n; i++) {
+    total += a[i] * b[i];
+  }
+  return total;
+}
+
+// dx[i] += y[i] * (dy[i] - c).
+inline void softmax_grad(const float* y, const float* dy, float c, float* dx, size_t n) {
+  size_t i = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  const vfloat vc = broadcast<vfloat>(c);
+  for (; i + kWidth <= n; i += kWidth) {
+    store(dx + i, load(dx + i) + load(y + i) * (load(dy + i) - vc));
+  }
+#endif
+  for (; i < n; i++) {
+    dx[i] += y[i] * (dy[i] - c);
+  }
+}
+
+// out[i] = clamp(round(a[i] * inv_scale + zero_point), 0, 255), rounding
+// half to even.
+inline void quantize(const float* a, float inv_scale, int32_t zero_point, uint8_t* out, size_t n) {
+  const float zp = static_cast<float>(zero_point);
+  size_t i = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  typedef uint8_t vbyte __attribute__((vector_size(UPSILON_SIMD_WIDTH)));
+  const vfloat shifter = broadcast<vfloat>(12582912.0f), lo = broadcast<vfloat>(0.0f), hi = broadcast<vfloat>(255.0f);
+  for (; i + kWidth <= n; i += kWidth) {
+    vfloat v = load(a + i) * inv_scale + zp;
+    v = v < lo ? lo : v;
+    v = v > hi ? hi : v;
+    const vbyte q = __builtin_convertvector(lanes_to_int((v + shifter) - shifter), vbyte);
+    std::memcpy(out + i, &q, sizeof(q));
+  }
+#endif
+  for (; i < n; i++) {
+    const float v = std::nearbyint(a[i] * inv_scale + zp);
+    out[i] = static_cast<uint8_t>(v < 0.0f ? 0.0f : v > 255.0f ? 255.0f : v);
+  }
+}
+
+// out[i] = (a[i] - zero_point) * scale.
+inline void dequantize(const uint8_t* a, float scale, int32_t zero_point, float* out, size_t n) {
+  size_t i = 0;
+#if UPSILON_SIMD_WIDTH > 1
+  typedef uint8_t vbyte __attribute__((vector_size(UPSILON_SIMD_WIDTH)));
+  const vint zp = vint{} + zero_point;
+  for (; i + kWidth <= n; i += kWidth) {
+    vbyte q;
+    std::memcpy(&q, a + i, sizeof(q));
+    store(out + i, lanes_to_float(__builtin_convertvector(q, vint) - zp) * scale);
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = static_cast<float>(static_cast<int32_t>(a[i]) - zero_point) * scale;
+  }
+}
+
+// IEEE half-precision bits of x, rounding to nearest even; overflow gives
+// infinity, NaN stays NaN.
+template <typename V>
+inline IntLanes<V> float_to_fp16_bits(V x) {
+  using I = IntLanes<V>;
+  I f = bit_cast<I>(x);
+  const I sign = f & static_cast<int32_t>(0x80000000u);
+  f ^= sign;
+  // Results that are subnormal or zero: adding 0.5 puts the half mantissa in
+  // the low bits, rounded by the float addition itself.
+  const I small = bit_cast<I>(bit_cast<V>(f) + 0.5f) - 0x3f000000;
+  const I odd = (f >> 13) & 1;
+  const I normal = (f - ((127 - 15) << 23) + 0xfff + odd) >> 13;
+  const I special = f > 0x7f800000 ? I{} + 0x7e00 : I{} + 0x7c00;
+  I h = f >= 0x47800000 ? special : f < 0x38800000 ? small : normal;
+  return h | ((sign >> 16) & 0x8000);
+}
+
+template <typename V>
+inline V fp16_bits_to_float(IntLanes<V> h) {
+  using I = IntLanes<V>;
+  const I shifted_exp = I{} + (0x7c00 << 13);
+  I o = (h & 0x7fff) << 13;
+  const I exp = o & shifted_exp;
+  o += (127 - 15) << 23;
+  const I inf_nan = o + ((128 - 16) << 23);
+  const I subnormal = bit_cast<I>(bit_cast<V>(o + (1 << 23)) - bit_cast<V>(I{} + (113 << 23)));
+  o = exp == shifted_exp ? inf_nan : exp == 0 ? subnormal : o;
+  return bit_cast<V>(o | ((h & 0x8000) << 16));
+}
+
+// bfloat16 bits of x (the top half of the float), rounding to nearest even.
+template <typename V>
+inline IntLanes<V> float_to_bf16_bits(V x) {
+  using I = IntLanes<V>;
+  const I f = bit_cast<I>(x);
+  const I rounded = (f + 0x7fff + ((f >> 16) & 1)) >> 16;
+  return (x != x ? (f >> 16) | 0x40 : rounded) & 0xffff;
+}
+
+template <typename V>
+inline V bf16_bits_to_float(IntLanes<V> h) {
+  return bit_cast<V>(h << 16);
+}
+
+#if UPSILON_SIMD_WIDTH > 1
+typedef uint16_t vhalf __attribute__((vector_size(UPSILON_SIMD_WIDTH * sizeof(uint16_t))));
+#endif
+
+#define UPSILON_HALF_KERNELS(name, to_bits, from_bits)                                   \
+  inline void encode_##name(const float* a, uint16_t* out, size_t n) {                  \
+    size_t i = 0;                                                                        \
+    UPSILON_HALF_VECTOR_ENCODE(to_bits)                                                  \
+    for (; i < n; i++) {                                                                 \
+      out[i] = static_cast<uint16_t>(to_bits<float>(a[i]));                              \
+    }                                                                                    \
+  }                                                                                      \
+  inline void decode_##name(const uint16_t* a, float* out, size_t n) {                  \
+    size_t i = 0;                                                                        \
+    UPSILON_HALF_VECTOR_DECODE(from_bits)                                                \
+    for (; i < n; i++) {                                                                 \
+      out[i] = from_bits<float>(a[i]);                                                   \
+    }                                                                                    \
+  }
+
+#if UPSILON_SIMD_WIDTH > 1
+#define UPSILON_HALF_VECTOR_ENCODE(to_bits)                                              \
+  for (; i + kWidth <= n; i += kWidth) {                                                 \
+    const vhalf h = __builtin_convertvector(to_bits<vfloat>(load(a + i)), vhalf);        \
+    std::memcpy(out + i, &h, sizeof(h));                                                 \
+  }
+#define UPSILON_HALF_VECTOR_DECODE(from_bits)                                            \
+  for (; i + kWidth <= n; i += kWidth) {                                                 \
+    vhalf h;                                                                             \
+    std::memcpy(&h, a + i, sizeof(h));                                                   \
+    store(out + i, from_bits<vfloat>(__builtin_convertvector(h, vint)));                 \
+  }
+#else
+#define UPSILON_HALF_VECTOR_ENCODE(to_bits)
+#define UPSILON_HALF_VECTOR_DECODE(from_bits)
+#endif
+
+UPSILON_HALF_KERNELS(fp16, float_to_fp16_bits, fp16_bits_to_float)
+UPSILON_HALF_KERNELS(bf16, float_to_bf16_bits, bf16_bits_to_float)
+
+#undef UPSILON_HALF_KERNELS
+#undef UPSILON_HALF_VECTOR_ENCODE
+#undef UPSILON_HALF_VECTOR_DECODE
+
+// True if no element of a[0, n) is infinite or NaN: x - x is 0 exactly for
+// finite x and NaN otherwise.
+inline bool all_finite(const float* a, size_t n) {
+  size_t i = 0;
+  float total = 0.0f;
+#if UPSILON_SIMD_WIDTH > 1
+  vfloat acc = broadcast<vfloat>(0.0f);
+  for (; i + kWidth <= n; i += kWidth) {
+    const vfloat x = load(a + i);
+    acc += x - x;
+  }
+  for (size_t k = 0; k < kWidth; k++) {
+    total += acc[k];
+  }
+#endif
+  for (; i < n; i++) {
+    total += a[i] - a[i];
+  }
+  return total == 0.0f;
+}
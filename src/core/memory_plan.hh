@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "op.hh"
+
+// Static memory planning for a graph whose tensor shapes are known (from a
+// step that has already run). Every op's output and gradient gets a
+// lifetime on a timeline of op executions: forward runs op i at time i and
+// backward runs it at time 2n - 1 - i. An output lives from its op's
+// forward until the last read, which in training is the op's own backward
+// (ops read their output and inputs there); a gradient lives from the
+// backward of the last consumer, which is the first to accumulate into it,
+// until the op's own backward. Tensors whose lifetimes do not overlap may
+// share memory, so each one gets an offset in a single slab, placed greedily
+// from the largest down at the lowest offset free for its whole lifetime.
+
+namespace upsilon {
+
+struct MemoryPlan {
+  struct Block {
+    size_t op = 0;         // position in the graph order
+    bool grad = false;     // the op's gradient rather than its output
+    size_t offset = 0;     // in floats from the start of the slab
+    size_t size = 0;       // in floats
+    uint32_t first = 0, last = 0;  // lifetime, inclusive
+  };
+
+  std::vector<Block> blocks;
+  size_t slab_floats = 0;
+  size_t naive_floats = 0;  // sum of every planned block
+  bool training = true;
+
+  // Bytes of the shared slab, which is the planned peak.
+  size_t peak_bytes() const { return slab_floats * sizeof(float); }
+
+  // Bytes the same tensors take with a buffer each.
+  size_t naive_bytes() const { return naive_floats * sizeof(float); }
+};
+
+namespace plan {
+
+// Block offsets are multiples of this many floats (kBufferAlignment bytes).
+constexpr size_t kAlignFloats = kBufferAlignment / sizeof(float);
+
+// Assigns offsets: largest blocks first, each at the lowest aligned offset
+// that no block with an overlapping lifetime already covers.
+inline void assign_offsets(MemoryPlan& plan) {
+  std::vector<size_t> by_size(plan.blocks.size());
+  for (size_t i = 0; i < by_size.size(); i++) {
+    by_size[i] = i;
+  }
+  std::stable_sort(by_size.begin(), by_size.end(),
+                   [&](size_t a, size_t b) { return plan.blocks[a].size > plan.blocks[b].size; });
+
+  std::vector<const MemoryPlan::Block*> placed;
+  std::vector<std::pair<size_t, size_t>> taken;  // [begin, end) of live neighbours
+  for (size_t i : by_size) {
+    MemoryPlan::Block& block = plan.blocks[i];
+    taken.clear();
+    for (const MemoryPlan::Block* other : placed) {
+      if (other->first <= block.last && block.first <= other->last) {
+        taken.emplace_back(other->offset, other->offset + other->size);
+      }
+    }
+    std::sort(taken.begin(), taken.end());
+    size_t offset = 0;
+    for (const auto& [begin, end] : taken) {
+      if (offset + block.size <= begin) {
+        break;
+      }
+      offset = std::max(offset, (end + kAlignFloats - 1) / kAlignFloats * kAlignFloats);
+    }
+    block.offset = offset;
+    plan.slab_floats = std::max(plan.slab_floats, offset + block.size);
+    placed.push_back(&block);
+  }
+}
+
+}  // namespace plan
+
+// Plans the outputs and (when training) gradients of the ops in order, a
+// topological order of the graph with the given outputs. Variables, graph
+// outputs and tensors that share their buffer with another tensor (views,
+// outputs placed into a Concat) keep their own buffers. Shapes are read
+// from the ops as they are now.
+inline MemoryPlan plan_memory(const std::vector<std::shared_ptr<Op>>& order,
+                              const std::vector<std::shared_ptr<Op>>& outputs, bool training = true) {
+  const uint32_t n = static_cast<uint32_t>(order.size());
+  std::unordered_map<const Op*, uint32_t> index;
+  for (uint32_t i = 0; i < n; i++) {
+    index[order[i].get()] = i;
+  }
+  // Last forward reader and last backward reader (the consumer that runs
+  // first in backward) of each output.
+  std::vector<uint32_t> last_forward(n), last_consumer(n);
+  for (uint32_t i = 0; i < n; i++) {
+    last_forward[i] = last_consumer[i] = i;
+    for (const auto& input : order[i]->inputs) {
+      const uint32_t j = index.at(input.get());
+      last_forward[j] = std::max(last_forward[j], i);
+      last_consumer[j] = std::max(last_consumer[j], i);
+    }
+  }
+  std::vector<bool> excluded(n, false);
+  for (const auto& output : outputs) {
+    excluded[index.at(output.get())] = true;
+  }
+
+  MemoryPlan plan;
+  plan.training = training;
+  auto backward_time = [&](uint32_t i) { return 2 * n - 1 - i; };
+  for (uint32_t i = 0; i < n; i++) {
+    const Op& op = *order[i];
+    if (excluded[i] || dynamic_cast<const Variable*>(&op) != nullptr || !op.output.sole_owner()) {
+      continue;
+    }
+    MemoryPlan::Block block;
+    block.op = i;
+    block.size = op.output.size();
+    block.first = i;
+    block.last = training ? backward_time(i) : last_forward[i];
+    plan.blocks.push_back(block);
+    if (training) {
+      block.grad = true;
+      block.first = backward_time(last_consumer[i]);
+      plan.blocks.push_back(block);
+    }
+  }
+  for (const MemoryPlan::Block& block : plan.blocks) {
+    plan.naive_floats += block.size;
+  }
+  plan::assign_offsets(plan);
+  return plan;
+}
+
+}  // namespace upsilon
@@ -0,0 +1,115 @@
+#pragma once
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "graph.hh"
+
+namespace upsilon {
+
+// Dynamic loss scaling: the loss gradient is multiplied by scale so that
+// small gradients survive the 16-bit formats. A step whose gradients
+// overflowed is skipped and the scale multiplied by backoff; after interval
+// steps in a row without overflow it is multiplied by growth.
+struct LossScaling {
+  float initial = 65536.0f;
+  float growth = 2.0f;
+  float backoff = 0.5f;
+  uint32_t interval = 2000;
+};
+
+// Mixed-precision SGD over an executor's graph. The trainable Variables hold
+// a working copy of the weights rounded to bf16 or fp16, which the forward
+// pass uses, while the updates go to fp32 master weights kept here. The
+// executor keeps activations in the same format (see
+// Executor::set_activation_precision) and weight gradients are rounded
+// through it before the overflow check, so an fp16 gradient beyond 65504
+// shows up as infinity:
+//
+//   MixedPrecision trainer(executor, {w1, w2}, Precision::FP16);
+//   for (const Tensor<float>& batch : data) {
+//     x->output = batch;
+//     trainer.step(0.1f);
+//   }
+class MixedPrecision {
+public:
+  MixedPrecision(Executor& executor, std::vector<std::shared_ptr<Variable>> params, Precision precision,
+                 LossScaling scaling = LossScaling())
+      : executor_(executor), params_(std::move(params)), precision_(precision), scaling_(scaling),
+        scale_(scaling.initial) {
+    if (precision == Precision::FP32) {
+      throw std::invalid_argument("MixedPrecision needs BF16 or FP16");
+    }
+    if (!(scaling.initial > 0.0f) || !(scaling.growth >= 1.0f) || !(scaling.backoff > 0.0f && scaling.backoff < 1.0f)) {
+      throw std::invalid_argument("Loss scaling needs initial > 0, growth >= 1 and backoff in (0, 1)");
+    }
+    executor_.set_activation_precision(precision);
+    grads_.assign(params_.size(), Tensor<float>(0.0f));
+    bf16_.resize(params_.size());
+    fp16_.resize(params_.size());
+    for (size_t i = 0; i < params_.size(); i++) {
+      masters_.push_back(params_[i]->output);
+      round(i, masters_[i], params_[i]->output);
+    }
+  }
+
+  // Forward, backward with the loss scaled, then w -= learning_rate * grad
+  // on the master weights and a fresh rounded working copy. Returns false if
+  // a gradient overflowed, in which case nothing was updated.
+  bool step(float learning_rate) {
+    executor_.forward();
+    executor_.backward(scale_);
+
+    bool finite = true;
+    for (size_t i = 0; i < params_.size() && finite; i++) {
+      round(i, params_[i]->grad, grads_[i]);
+      finite = kernels::all_finite(grads_[i].data().data(), grads_[i].size());
+    }
+    if (!finite) {
+      scale_ *= scaling_.backoff;
+      good_steps_ = 0;
+      skipped_++;
+      return false;
+    }
+
+    for (size_t i = 0; i < params_.size(); i++) {
+      masters_[i].axpy_(-learning_rate / scale_, grads_[i]);
+      round(i, masters_[i], params_[i]->output);
+    }
+    if (++good_steps_ == scaling_.interval) {
+      scale_ *= scaling_.growth;
+      good_steps_ = 0;
+    }
+    return true;
+  }
+
+  float loss_scale() const { return scale_; }
+
+  // Steps skipped because of overflow.
+  uint64_t skipped() const { return skipped_; }
+
+  const Tensor<float>& master(size_t i) const { return masters_.at(i); }
+
+private:
+  // out = x rounded to the working format.
+  void round(size_t i, const Tensor<float>& x, Tensor<float>& out) {
+    if (precision_ == Precision::BF16) {
+      bf16_[i].encode_(x).decode_into(out);
+    } else {
+      fp16_[i].encode_(x).decode_into(out);
+    }
+  }
+
+  Executor& executor_;
+  std::vector<std::shared_ptr<Variable>> params_;
+  Precision precision_;
+  LossScaling scaling_;
+  float scale_;
+  uint32_t good_steps_ = 0;
+  uint64_t skipped_ = 0;
+  std::vector<Tensor<float>> masters_;
+  std::vector<Tensor<float>> grads_;
+  std::vector<Tensor<bf16>> bf16_;
+  std::vector<Tensor<fp16>> fp16_;
+};
+
+}  // namespace upsilon
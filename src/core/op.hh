@@ -1,26 +1,118 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include "conv.hh"
+#include "pool.hh"
+#include "quant.hh"
+#include "softmax.hh"
 #include "tensor.hh"
 
 namespace upsilon {
 
+namespace detail {
+
+inline bool& grad_enabled_flag() {
+  thread_local bool enabled = true;
+  return enabled;
+}
+
+}  // namespace detail
+
+// False while a NoGradScope is active on the calling thread.
+inline bool grad_enabled() {
+  return detail::grad_enabled_flag();
+}
+
+// Inference on this thread until the scope ends: ops built inside it start
+// with empty output and grad tensors instead of allocated scalars, ops keep
+// no scratch between passes, and Executor::forward() frees intermediate
+// outputs as soon as their last consumer has run, letting elementwise ops
+// overwrite their input (Op::forward_in_place()). Executor::backward()
+// throws.
+class NoGradScope {
+public:
+  NoGradScope() : previous_(detail::grad_enabled_flag()) { detail::grad_enabled_flag() = false; }
+
+  NoGradScope(const NoGradScope&) = delete;
+  NoGradScope& operator=(const NoGradScope&) = delete;
+
+  ~NoGradScope() { detail::grad_enabled_flag() = previous_; }
+
+private:
+  bool previous_;
+};
+
 class Op {
 public:
   std::vector<std::shared_ptr<Op>> inputs;
   Tensor<float> output;
   Tensor<float> grad;
 
-  Op() : output(0), grad(0) {}
+  Op() : output(initial()), grad(initial()) {}
+  Op(Op&&) = default;
+  Op& operator=(Op&&) = default;
+  // Releases the inputs only this op holds one at a time, so that dropping
+  // the end of a long chain does not recurse once per op.
+  virtual ~Op() {
+    std::vector<std::shared_ptr<Op>> pending = std::move(inputs);
+    while (!pending.empty()) {
+      std::shared_ptr<Op> op = std::move(pending.back());
+      pending.pop_back();
+      if (op.use_count() == 1) {
+        std::move(op->inputs.begin(), op->inputs.end(), std::back_inserter(pending));
+        op->inputs.clear();
+      }
+    }
+  }
 
   virtual void forward() = 0;
   virtual void backward() = 0;
+
+  // forward() computed over the buffer of inputs[0], which the caller must
+  // no longer need; the input is left empty. Ops that cannot do that return
+  // false without doing anything.
+  virtual bool forward_in_place() { return false; }
+
+protected:
+  // Gradient buffers for kernels that write through raw pointers. The
+  // Executor sizes every grad like its op's output; a backward() called by
+  // hand has to do the same first, or these throw.
+  const float* output_grad() const {
+    check_grad(*this);
+    return grad.data().data();
+  }
+
+  float* input_grad(size_t i) {
+    check_grad(*inputs[i]);
+    return inputs[i]->grad.mutable_data().data();
+  }
+
+private:
+  static void check_grad(const Op& op) {
+    if (!op.grad.same_shape(op.output)) {
+      throw std::invalid_argument("Gradient must have the shape of the op's output");
+    }
+  }
+
+  static Tensor<float> initial() {
+    return grad_enabled() ? Tensor<float>(0.0f) : Tensor<float>(TensorType::Matrix, {0, 0});
+  }
 };
 
 
 class Variable : public Op {
 public:
+  // Backward formulas read operands through Tensor::lazy(), which needs a
+  // contiguous layout, so strided views are packed once here.
   Variable(Tensor<float>&& tensor) {
-    this->output = tensor;
+    if (tensor.is_contiguous()) {
+      this->output = std::move(tensor);
+    } else {
+      this->output = tensor.contiguous();
+    }
   }
 
   void forward() override {
@@ -33,201 +125,818 @@ public:
 class Add : public Op {
 public:
   Add(std::shared_ptr<Op> a, std::shared_ptr<Op> b) {
-  inputs.push_back(a);
-  inputs.push_back(b);
+  inputs.push_back(std::move(a));
+  inputs.push_back(std::move(b));
   }
 
   void forward() override {
-  output = inputs[0]->output.add(inputs[1]->output);
+  inputs[0]->output.add(inputs[1]->output, output);
   }
 
+  // A broadcast input receives the gradient summed over the broadcast axes.
   void backward() override {
-  inputs[0]->grad = inputs[0]->grad.add(grad);
-  inputs[1]->grad = inputs[1]->grad.add(grad);
+  inputs[0]->grad.add_reduced_(grad);
+  inputs[1]->grad.add_reduced_(grad);
   }
 };
 
 class Mul : public Op {
 public:
   Mul(std::shared_ptr<Op> a, std::shared_ptr<Op> b) {
-  inputs.push_back(a);
-  inputs.push_back(b);
+  inputs.push_back(std::move(a));
+  inputs.push_back(std::move(b));
   }
 
   void forward() override {
-  output = inputs[0]->output.mul(inputs[1]->output);
+  inputs[0]->output.mul(inputs[1]->output, output);
   }
 
   void backward() override {
-  inputs[0]->grad = inputs[0]->grad.add(inputs[1]->output.mul(grad));
-  inputs[1]->grad = inputs[1]->grad.add(inputs[0]->output.mul(grad));
+  const Tensor<float> a = inputs[0]->output.contiguous();
+  const Tensor<float> b = inputs[1]->output.contiguous();
+  if (a.same_shape(b)) {
+    inputs[0]->grad.add_(b.lazy() * grad.lazy());
+    inputs[1]->grad.add_(a.lazy() * grad.lazy());
+    return;
+  }
+  inputs[0]->grad.add_reduced_(grad.mul(b));
+  inputs[1]->grad.add_reduced_(grad.mul(a));
   }
 };
 
 class Sub : public Op {
 public:
   Sub(std::shared_ptr<Op> a, std::shared_ptr<Op> b) {
-  inputs.push_back(a);
-  inputs.push_back(b);
+  inputs.push_back(std::move(a));
+  inputs.push_back(std::move(b));
   }
 
   void forward() override {
-  output = inputs[0]->output.sub(inputs[1]->output);
+  inputs[0]->output.sub(inputs[1]->output, output);
   }
 
   void backward() override {
-  inputs[0]->grad = inputs[0]->grad.add(grad);
-  inputs[1]->grad = inputs[1]->grad.sub(grad); // 注意减法的梯度传播
+  inputs[0]->grad.add_reduced_(grad);
+  inputs[1]->grad.add_reduced_(grad, -1.0f); // 注意减法的梯度传播
   }
 };
 
 class Div : public Op {
 public:
   Div(std::shared_ptr<Op> a, std::shared_ptr<Op> b) {
-  inputs.push_back(a);
-  inputs.push_back(b);
+  inputs.push_back(std::move(a));
+  inputs.push_back(std::move(b));
   }
 
   void forward() override {
-  output = inputs[0]->output.div(inputs[1]->output);
+  inputs[0]->output.div(inputs[1]->output, output);
   }
 
   void backward() override {
-  inputs[0]->grad = inputs[0]->grad.add(grad.mul(inputs[1]->output.inv()));
-  inputs[1]->grad = inputs[1]->grad.sub(grad.mul(inputs[0]->output).div(inputs[1]->output.square()));
+  const Tensor<float> a = inputs[0]->output.contiguous();
+  const Tensor<float> b = inputs[1]->output.contiguous();
+  if (a.same_shape(b)) {
+    inputs[0]->grad.add_(grad.lazy() / b.lazy());
+    inputs[1]->grad.sub_(grad.lazy() * a.lazy() / (b.lazy() * b.lazy()));
+    return;
+  }
+  // d(a/b)/db = -a/b^2 = -y/b
+  const Tensor<float> grad_a = grad.div(b);
+  inputs[0]->grad.add_reduced_(grad_a);
+  inputs[1]->grad.add_reduced_(grad_a.mul(output), -1.0f);
   }
 };
 
 class MatMul : public Op {
 public:
   MatMul(std::shared_ptr<Op> a, std::shared_ptr<Op> b) {
-    inputs.push_back(a);
-    inputs.push_back(b);
+    inputs.push_back(std::move(a));
+    inputs.push_back(std::move(b));
   }
 
   void forward() override {
-    output = inputs[0]->output.matmul(inputs[1]->output);
+    inputs[0]->output.matmul(inputs[1]->output, output);
   }
 
   void backward() override {
-    // 简化的梯度计算，真实实现需要考虑维度匹配和转置
-    inputs[0]->grad = grad.matmul(inputs[1]->output.transposed());
-    inputs[1]->grad = inputs[0]->output.transposed().matmul(grad);
+    // dA += dY * B^T, dB += A^T * dY, per matrix of a batch; addmm_ sums
+    // the products for an operand that is shared across the batch.
+    inputs[0]->grad.addmm_(grad, inputs[1]->output.transposed());
+    inputs[1]->grad.addmm_(inputs[0]->output.transposed(), grad);
   }
 };
 
-class Tanh : public Op {
+// 2-D convolution of a (C, H, W) image or an (N, C, H, W) batch with
+// (O, C / groups, KH, KW) weights, giving (O, OH, OW) or (N, O, OH, OW).
+// The kernel (im2col + GEMM, Winograd or direct) is chosen per layer shape
+// unless options.algorithm forces one (see conv.hh); its workspace is kept
+// between steps and reused, and padding never materializes.
+class Conv2D : public Op {
 public:
-  Tanh(std::shared_ptr<Op> a) {
-    inputs.push_back(a);
+  Conv2D(std::shared_ptr<Op> input, std::shared_ptr<Op> weight, Conv2DOptions options = Conv2DOptions())
+      : options_(options) {
+    inputs.push_back(std::move(input));
+    inputs.push_back(std::move(weight));
   }
 
   void forward() override {
-    output = inputs[0]->output.apply([](float x) { return std::tanh(x); });
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const Tensor<float> w = inputs[1]->output.contiguous();
+    const conv::Geometry g = geometry(x, w);
+    std::vector<uint32_t> shape = x.shape();
+    shape[shape.size() - 3] = g.out_channels;
+    shape[shape.size() - 2] = g.out_rows;
+    shape[shape.size() - 1] = g.out_cols;
+    output.resize_(shape);
+
+    float* scratch = workspace(g, false);
+    const float* in = x.data().data();
+    float* out = output.mutable_data().data();
+    conv::forward(g, in, w.data().data(), out, scratch);
+    if (!grad_enabled()) {
+      scratch_.release_();  // serving: one workspace at a time, not one per layer
+    }
   }
 
   void backward() override {
-    inputs[0]->grad = inputs[0]->grad.add(grad.mul(output.apply([](float y) { return 1 - y * y; })));
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const Tensor<float> w = inputs[1]->output.contiguous();
+    const conv::Geometry g = geometry(x, w);
+    float* scratch = workspace(g, true);
+    const float* in = x.data().data();
+    const float* dy = output_grad();
+    float* dx = input_grad(0);
+    float* dw = input_grad(1);
+    conv::backward(g, in, w.data().data(), dy, dx, dw, scratch);
+  }
+
+  const Conv2DOptions& options() const { return options_; }
+
+private:
+  Conv2DOptions options_;
+  Tensor<float> scratch_{0.0f};
+
+  conv::Geometry geometry(const Tensor<float>& x, const Tensor<float>& w) const {
+    if (x.ndim() != 3 && x.ndim() != 4) {
+      throw std::invalid_argument("Conv2D input must be (C, H, W) or (N, C, H, W)");
+    }
+    const std::vector<uint32_t> shape = x.shape();
+    const size_t d = shape.size() - 3;
+    return conv::geometry(shape[d], shape[d + 1], shape[d + 2], w.shape(), options_, d == 1 ? shape[0] : 1);
+  }
+
+  // Scratch for the kernel. It only ever grows, so a step that
+  // runs forward and backward settles on the larger of the two sizes.
+  float* workspace(const conv::Geometry& g, bool backward) {
+    const size_t n = conv::workspace_size(g, backward);
+    if (n == 0) {
+      return nullptr;
+    }
+    if (scratch_.size() < n) {
+      scratch_.resize_({static_cast<uint32_t>(n)});
+    }
+    return scratch_.mutable_data().data();
   }
 };
 
-class Mul : public Op {
+// Max pooling of every (H, W) plane of a (C, H, W) or (N, C, H, W) input.
+// Backward finds each maximum again instead of keeping an argmax tensor.
+class MaxPool2D : public Op {
 public:
-  Mul(std::shared_ptr<Op> a, std::shared_ptr<Op> b) {
-    inputs.push_back(a);
-    inputs.push_back(b);
+  MaxPool2D(std::shared_ptr<Op> input, Pool2DOptions options = Pool2DOptions()) : options_(options) {
+    inputs.push_back(std::move(input));
+  }
+
+  void forward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const pool::Geometry g = pool::geometry(x.shape(), options_);
+    output.resize_(pool::with_plane(x.shape(), g.out_rows, g.out_cols));
+    pool::max_forward(g, x.data().data(), output.mutable_data().data());
+  }
+
+  void backward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const pool::Geometry g = pool::geometry(x.shape(), options_);
+    pool::max_backward(g, x.data().data(), output.data().data(), output_grad(), input_grad(0));
+  }
+
+  const Pool2DOptions& options() const { return options_; }
+
+private:
+  Pool2DOptions options_;
+};
+
+// Average pooling of every (H, W) plane; padding is left out of the average.
+class AvgPool2D : public Op {
+public:
+  AvgPool2D(std::shared_ptr<Op> input, Pool2DOptions options = Pool2DOptions()) : options_(options) {
+    inputs.push_back(std::move(input));
   }
 
   void forward() override {
-    output = inputs[0]->output.mul(inputs[1]->output);
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const pool::Geometry g = pool::geometry(x.shape(), options_);
+    output.resize_(pool::with_plane(x.shape(), g.out_rows, g.out_cols));
+    pool::avg_forward(g, x.data().data(), output.mutable_data().data());
   }
 
   void backward() override {
-    inputs[0]->grad = inputs[0]->grad.add(inputs[1]->output.mul(grad));
-    inputs[1]->grad = inputs[1]->grad.add(inputs[0]->output.mul(grad));
+    const pool::Geometry g = pool::geometry(inputs[0]->output.shape(), options_);
+    pool::avg_backward(g, output_grad(), input_grad(0));
+  }
+
+  const Pool2DOptions& options() const { return options_; }
+
+private:
+  Pool2DOptions options_;
+};
+
+// Mean of every (H, W) plane: (C, H, W) -> (C, 1, 1), (N, C, H, W) ->
+// (N, C, 1, 1).
+class GlobalAvgPool : public Op {
+public:
+  GlobalAvgPool(std::shared_ptr<Op> input) {
+    inputs.push_back(std::move(input));
+  }
+
+  void forward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    if (x.ndim() != 3 && x.ndim() != 4) {
+      throw std::invalid_argument("GlobalAvgPool input must be (C, H, W) or (N, C, H, W)");
+    }
+    output.resize_(pool::with_plane(x.shape(), 1, 1));
+    pool::global_avg_forward(output.size(), plane_size(x), x.data().data(), output.mutable_data().data());
+  }
+
+  void backward() override {
+    pool::global_avg_backward(output.size(), plane_size(inputs[0]->output), output_grad(), input_grad(0));
+  }
+
+private:
+  static size_t plane_size(const Tensor<float>& x) {
+    const std::vector<uint32_t> shape = x.shape();
+    return size_t(shape[shape.size() - 2]) * shape[shape.size() - 1];
+  }
+};
+
+class Tanh : public Op {
+public:
+  Tanh(std::shared_ptr<Op> a) {
+    inputs.push_back(std::move(a));
+  }
+
+  void forward() override {
+    output = tanh(inputs[0]->output.contiguous().lazy());
+  }
+
+  bool forward_in_place() override {
+    output = std::move(inputs[0]->output);
+    inputs[0]->output.release_();
+    output = tanh(output.lazy());
+    return true;
+  }
+
+  void backward() override {
+    const auto y = output.lazy();
+    inputs[0]->grad.add_(grad.lazy() * (1.0f - y * y));
   }
 };
 
 class ReLU : public Op {
 public:
   ReLU(std::shared_ptr<Op> a) {
-  inputs.push_back(a);
+  inputs.push_back(std::move(a));
   }
 
   void forward() override {
-  output = inputs[0]->output.apply([](float x) { return std::max(0.0f, x); });
+  output = max(inputs[0]->output.contiguous().lazy(), 0.0f);
+  }
+
+  bool forward_in_place() override {
+  output = std::move(inputs[0]->output);
+  inputs[0]->output.release_();
+  output = max(output.lazy(), 0.0f);
+  return true;
   }
 
   void backward() override {
-  inputs[0]->grad = inputs[0]->grad.add(grad.apply([](float x) { return x > 0 ? 1.0f : 0.0f; }));
+  inputs[0]->grad.add_(grad.lazy() * greater(output.lazy(), 0.0f));
   }
 };
 
 class Sigmoid : public Op {
 public:
   Sigmoid(std::shared_ptr<Op> a) {
-  inputs.push_back(a);
+  inputs.push_back(std::move(a));
   }
 
   void forward() override {
-  output = inputs[0]->output.apply([](float x) { return 1.0f / (1.0f + std::exp(-x)); });
+  output = sigmoid(inputs[0]->output.contiguous().lazy());
+  }
+
+  bool forward_in_place() override {
+  output = std::move(inputs[0]->output);
+  inputs[0]->output.release_();
+  output = sigmoid(output.lazy());
+  return true;
   }
 
   void backward() override {
-  auto sigmoid_grad = output.apply([](float y) { return y * (1 - y); });
-  inputs[0]->grad = inputs[0]->grad.add(grad.mul(sigmoid_grad));
+  const auto y = output.lazy();
+  inputs[0]->grad.add_(grad.lazy() * y * (1.0f - y));
   }
 };
-/*
+
+// Concatenation along axis; every other dimension must match. Where a
+// part is a contiguous range of the output (every dimension in front of axis
+// has size 1, e.g. channels of a (C, H, W) map), its producer is placed
+// there (Tensor::place_) after the first step and from then on writes its
+// result straight into the output, so the concat itself moves no data.
+// Other parts are copied in each step.
 class Concat : public Op {
 public:
-  // axis是拼接的维度
-  Concat(std::vector<std::shared_ptr<Op>> ops, int axis) {
-    this->inputs = std::move(ops);
-    this->axis = axis;
+  Concat(std::vector<std::shared_ptr<Op>> ops, uint32_t axis) : axis_(axis) {
+    if (ops.empty()) {
+      throw std::invalid_argument("Concat requires at least one input");
+    }
+    inputs = std::move(ops);
   }
 
   void forward() override {
-    output = Tensor<float>::concat(inputs, axis);
+    std::vector<uint32_t> shape = inputs[0]->output.shape();
+    if (axis_ >= shape.size()) {
+      throw std::invalid_argument("Concat axis out of range");
+    }
+    shape[axis_] = 0;
+    for (const auto& input : inputs) {
+      std::vector<uint32_t> part = input->output.shape();
+      if (part.size() != shape.size()) {
+        throw std::invalid_argument("Concat inputs must have the same number of dimensions");
+      }
+      shape[axis_] += part[axis_];
+      part[axis_] = shape[axis_];
+      if (part != shape) {
+        throw std::invalid_argument("Concat inputs must match outside the concat axis");
+      }
+    }
+    // Keep the buffer the placed producers write into while the shape holds.
+    if (output.shape() != shape) {
+      output.resize_(shape);
+    }
+
+    uint32_t start = 0;
+    for (const auto& input : inputs) {
+      const uint32_t n = input->output.shape()[axis_];
+      Tensor<float> region = output.slice(axis_, start, start + n);
+      start += n;
+      if (input->output.aliases(region)) {
+        continue;
+      }
+      region.copy_(input->output);
+      if (region.is_contiguous()) {
+        input->output.place_(region);
+      }
+    }
   }
 
+  // Each part's gradient is read in place from its range of grad.
   void backward() override {
-    // 反向传播时需要将梯度分配回各个输入
-    std::vector<upsilon::Tensor<float>> grads = grad.split(inputs.size(), axis);
-    for (size_t i = 0; i < inputs.size(); ++i) {
-      inputs[i]->grad = inputs[i]->grad.add(grads[i]);
+    uint32_t start = 0;
+    for (const auto& input : inputs) {
+      const uint32_t n = input->output.shape()[axis_];
+      input->grad.add_(grad.slice(axis_, start, start + n));
+      start += n;
     }
   }
 
+  uint32_t axis() const { return axis_; }
+
 private:
-  int axis;
+  uint32_t axis_;
 };
 
+// [start, end) of the input along dim, as a view of the input's output: no
+// data moves. Slices along an inner dimension are strided; ops that need a
+// contiguous operand pack it themselves.
 class Slice : public Op {
 public:
-  // start和end是切片的起始和结束索引，这里简化为一维切片
-  Slice(std::shared_ptr<Op> a, int start, int end) {
-    inputs.push_back(a);
-    this->start = start;
-    this->end = end;
+  Slice(std::shared_ptr<Op> input, uint32_t dim, uint32_t start, uint32_t end)
+      : dim_(dim), start_(start), end_(end) {
+    inputs.push_back(std::move(input));
+  }
+
+  void forward() override {
+    output = inputs[0]->output.slice(dim_, start_, end_);
+  }
+
+  // Adds grad into the matching range of the input's gradient.
+  void backward() override {
+    inputs[0]->grad.slice(dim_, start_, end_).add_(grad);
+  }
+
+  uint32_t dim() const { return dim_; }
+
+  uint32_t start() const { return start_; }
+
+  uint32_t end() const { return end_; }
+
+private:
+  uint32_t dim_, start_, end_;
+};
+
+// Reduction of one axis of the input (see Tensor::reduce); the axis is
+// dropped from the output unless keepdim.
+class Reduce : public Op {
+public:
+  Reduce(std::shared_ptr<Op> input, Reduction reduction, uint32_t axis, bool keepdim)
+      : reduction_(reduction), axis_(axis), keepdim_(keepdim) {
+    inputs.push_back(std::move(input));
+  }
+
+  void forward() override {
+    inputs[0]->output.reduce(reduction_, axis_, keepdim_, output);
+  }
+
+  uint32_t axis() const { return axis_; }
+
+  bool keepdim() const { return keepdim_; }
+
+protected:
+  // t, shaped like the output, as a view with the reduced axis kept at size
+  // 1, which broadcasts against the input.
+  Tensor<float> kept(const Tensor<float>& t) const {
+    return t.view(inputs[0]->output.reduced_shape(axis_, true));
+  }
+
+  // Elements before, along and after the axis in the input.
+  void layout(size_t& outer, size_t& len, size_t& inner) const {
+    const std::vector<uint32_t> shape = inputs[0]->output.shape();
+    outer = inner = 1;
+    len = shape[axis_];
+    for (size_t d = 0; d < shape.size(); d++) {
+      (d < axis_ ? outer : inner) *= d == axis_ ? 1 : shape[d];
+    }
+  }
+
+  Reduction reduction_;
+  uint32_t axis_;
+  bool keepdim_;
+};
+
+class Sum : public Reduce {
+public:
+  Sum(std::shared_ptr<Op> input, uint32_t axis, bool keepdim = false)
+      : Reduce(std::move(input), Reduction::Sum, axis, keepdim) {}
+
+  void backward() override {
+    inputs[0]->grad.add_(kept(grad));
+  }
+};
+
+class Mean : public Reduce {
+public:
+  Mean(std::shared_ptr<Op> input, uint32_t axis, bool keepdim = false)
+      : Reduce(std::move(input), Reduction::Mean, axis, keepdim) {}
+
+  void backward() override {
+    scaled_ = grad.lazy() * (1.0f / static_cast<float>(inputs[0]->output.shape()[axis_]));
+    inputs[0]->grad.add_(kept(scaled_));
+  }
+
+private:
+  Tensor<float> scaled_{0.0f};
+};
+
+// d|x| / dx = x / |x|, taken as 0 where the norm is 0.
+class L2Norm : public Reduce {
+public:
+  L2Norm(std::shared_ptr<Op> input, uint32_t axis, bool keepdim = false)
+      : Reduce(std::move(input), Reduction::L2Norm, axis, keepdim) {}
+
+  void backward() override {
+    const auto y = output.lazy();
+    scale_ = grad.lazy() * greater(y, 0.0f) / max(y, std::numeric_limits<float>::min());
+    inputs[0]->output.mul(kept(scale_), product_);
+    inputs[0]->grad.add_(product_);
+  }
+
+private:
+  Tensor<float> scale_{0.0f};
+  Tensor<float> product_{0.0f};
+};
+
+// Max or min along the axis. The position of each extreme is kept (one index
+// per output) so backward routes the gradient to it; ties go to the first.
+class Extremum : public Reduce {
+public:
+  Extremum(std::shared_ptr<Op> input, bool maximum, uint32_t axis, bool keepdim)
+      : Reduce(std::move(input), maximum ? Reduction::ArgMax : Reduction::ArgMin, axis, keepdim) {}
+
+  void forward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    x.reduce(reduction_, axis_, keepdim_, index_);
+    output.resize_(index_.shape());
+    size_t outer, len, inner;
+    layout(outer, len, inner);
+    const float* in = x.data().data();
+    const float* index = index_.data().data();
+    float* out = output.mutable_data().data();
+    each_output(outer, inner, [&](size_t o, size_t j) {
+      out[o * inner + j] = in[(o * len + static_cast<size_t>(index[o * inner + j])) * inner + j];
+    });
+  }
+
+  void backward() override {
+    size_t outer, len, inner;
+    layout(outer, len, inner);
+    const float* index = index_.data().data();
+    const float* dy = output_grad();
+    float* dx = input_grad(0);
+    each_output(outer, inner, [&](size_t o, size_t j) {
+      dx[(o * len + static_cast<size_t>(index[o * inner + j])) * inner + j] += dy[o * inner + j];
+    });
+  }
+
+private:
+  template <typename F>
+  static void each_output(size_t outer, size_t inner, F&& f) {
+    parallel_for(outer, std::max<size_t>(1, (size_t(1) << 15) / inner), [&](size_t begin, size_t end) {
+      for (size_t o = begin; o < end; o++) {
+        for (size_t j = 0; j < inner; j++) {
+          f(o, j);
+        }
+      }
+    });
+  }
+
+  Tensor<float> index_{0.0f};
+};
+
+class Max : public Extremum {
+public:
+  Max(std::shared_ptr<Op> input, uint32_t axis, bool keepdim = false)
+      : Extremum(std::move(input), true, axis, keepdim) {}
+};
+
+class Min : public Extremum {
+public:
+  Min(std::shared_ptr<Op> input, uint32_t axis, bool keepdim = false)
+      : Extremum(std::move(input), false, axis, keepdim) {}
+};
+
+// Index of the first maximum along the axis, as floats. Not differentiable:
+// no gradient flows back.
+class ArgMax : public Reduce {
+public:
+  ArgMax(std::shared_ptr<Op> input, uint32_t axis, bool keepdim = false)
+      : Reduce(std::move(input), Reduction::ArgMax, axis, keepdim) {}
+
+  void backward() override {
+  }
+};
+
+// Softmax over the last dimension: rows = size / last dimension.
+class Softmax : public Op {
+public:
+  Softmax(std::shared_ptr<Op> input) {
+    inputs.push_back(std::move(input));
+  }
+
+  void forward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    output.resize_(x.shape());
+    softmax::forward(x.size() / x.shape().back(), x.shape().back(), x.data().data(), output.mutable_data().data());
+  }
+
+  void backward() override {
+    const size_t n = output.shape().back();
+    softmax::backward(output.size() / n, n, output.data().data(), output_grad(), input_grad(0));
+  }
+};
+
+class LogSoftmax : public Op {
+public:
+  LogSoftmax(std::shared_ptr<Op> input) {
+    inputs.push_back(std::move(input));
   }
 
   void forward() override {
-    output = inputs[0]->output.slice(start, end);
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    output.resize_(x.shape());
+    softmax::log_forward(x.size() / x.shape().back(), x.shape().back(), x.data().data(),
+                         output.mutable_data().data());
   }
 
   void backward() override {
-    // 反向传播时需要将梯度恢复到原始大小，并只在切片部分更新梯度
-    // 创建一个与输入相同形状的全零张量
-    upsilon::Tensor<float> grad_input = upsilon::Tensor<float>::zeros_like(inputs[0]->output);
-    // 将梯度放置在正确的位置
-    grad_input.slice(start, end).fill(grad);
-    // 更新输入的梯度
-    inputs[0]->grad = inputs[0]->grad.add(grad_input);
+    const size_t n = output.shape().back();
+    softmax::log_backward(output.size() / n, n, output.data().data(), output_grad(), input_grad(0));
+  }
+};
+
+// Mean over rows of -log(softmax(logits)[label]): logits hold one row of
+// class scores per sample in the last dimension, labels one class index
+// (as a float) per row, in any shape. The output is a scalar. No softmax
+// is materialized; backward adds softmax - onehot to the logits' gradient
+// in place. Labels get no gradient.
+class SoftmaxCrossEntropy : public Op {
+public:
+  SoftmaxCrossEntropy(std::shared_ptr<Op> logits, std::shared_ptr<Op> labels) {
+    inputs.push_back(std::move(logits));
+    inputs.push_back(std::move(labels));
+  }
+
+  void forward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const Tensor<float> labels = inputs[1]->output.contiguous();
+    const size_t n = x.shape().back(), rows = x.size() / n;
+    if (labels.size() != rows) {
+      throw std::invalid_argument("SoftmaxCrossEntropy needs one label per row of logits");
+    }
+    lse_.resize(rows);
+    loss_.resize(rows);
+    softmax::cross_entropy(rows, n, x.data().data(), labels.data().data(), lse_.data(), loss_.data());
+    float total = 0.0f;
+    for (float l : loss_) {
+      total += l;
+    }
+    output.resize_({});
+    output.mutable_data()[0] = total / static_cast<float>(rows);
+  }
+
+  void backward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const Tensor<float> labels = inputs[1]->output.contiguous();
+    const size_t n = x.shape().back(), rows = x.size() / n;
+    softmax::cross_entropy_backward(rows, n, x.data().data(), labels.data().data(), lse_.data(),
+                                    output_grad()[0] / static_cast<float>(rows), input_grad(0));
+  }
+
+private:
+  std::vector<float> lse_, loss_;
+};
+
+// Base of the inference-only int8 ops. Float activations are quantized on
+// entry with the params fixed by set_input_params() (from calibration, see
+// ptq.hh), or else with the range of each input; constant weights are held
+// packed as int8 (see quant.hh), and outputs come back as float.
+class QuantizedOp : public Op {
+public:
+  void set_input_params(quant::Params params) {
+    input_params_ = params;
+    calibrated_ = true;
+  }
+
+  void backward() override {
+    throw std::logic_error("Quantized ops are inference-only");
+  }
+
+protected:
+  quant::Params input_params(const Tensor<float>& x) const {
+    return calibrated_ || x.size() == 0 ? input_params_ : quant::affine(x.data().data(), x.size());
+  }
+
+  static quant::PackedMatrix pack(const Tensor<uint8_t>& w, size_t offset, int64_t rs, int64_t cs, size_t k,
+                                  size_t n) {
+    return quant::pack(w.data().data() + offset, rs, cs, k, n, w.params());
+  }
+
+  static Tensor<uint8_t> symmetric(const Tensor<float>& w) {
+    const Tensor<float> c = w.contiguous();
+    return Tensor<uint8_t>::quantize(c, quant::symmetric(c.data().data(), c.size()));
+  }
+
+private:
+  quant::Params input_params_;
+  bool calibrated_ = false;
+};
+
+// a (..., m, k) times constant weights (k, n), in int8.
+class QuantizedMatMul : public QuantizedOp {
+public:
+  QuantizedMatMul(std::shared_ptr<Op> a, const Tensor<float>& weight) {
+    if (weight.ndim() != 2) {
+      throw std::invalid_argument("QuantizedMatMul weights must be (k, n)");
+    }
+    inputs.push_back(std::move(a));
+    const std::vector<uint32_t> shape = weight.shape();
+    weight_ = pack(symmetric(weight), 0, shape[1], 1, shape[0], shape[1]);
+  }
+
+  const quant::PackedMatrix& weight() const { return weight_; }
+
+  void forward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    const size_t k = weight_.rows(), n = weight_.cols();
+    std::vector<uint32_t> shape = x.shape();
+    if (x.ndim() < 2 || shape.back() != k) {
+      throw std::invalid_argument("QuantizedMatMul input must be (..., m, k)");
+    }
+    const size_t rows = x.size() / k, depth = quant::padded_depth(k);
+    const quant::Params params = input_params(x);
+    input_.resize_({static_cast<uint32_t>(rows), static_cast<uint32_t>(depth)}, params);
+    quant::quantize_rows(x.data().data(), rows, k, k, params, input_.mutable_data().data(), depth);
+
+    shape.back() = static_cast<uint32_t>(n);
+    output.resize_(shape);
+    quant::Output out;
+    out.c = output.mutable_data().data();
+    out.rs = static_cast<int64_t>(n);
+    quant::qgemm(rows, input_.data().data(), depth, params, weight_, out);
+  }
+
+private:
+  quant::PackedMatrix weight_;
+  Tensor<uint8_t> input_{{}, quant::Params()};
+};
+
+// Conv2D with constant weights in int8. The input is quantized to
+// channels-last order, so gathering the taps of an output pixel
+// (quant::im2row) copies whole runs of channels, and a 1x1 layer multiplies
+// the image directly; each group is one product with its weights.
+class QuantizedConv2D : public QuantizedOp {
+public:
+  QuantizedConv2D(std::shared_ptr<Op> input, const Tensor<float>& weight, Conv2DOptions options = Conv2DOptions())
+      : options_(options), weight_shape_(weight.shape()) {
+    if (weight.ndim() != 4) {
+      throw std::invalid_argument("Conv2D weights must be (O, C / groups, KH, KW)");
+    }
+    if (options.groups == 0 || weight_shape_[0] % options.groups != 0) {
+      throw std::invalid_argument("Conv2D output channels must be divisible by groups");
+    }
+    inputs.push_back(std::move(input));
+    const Tensor<uint8_t> w = symmetric(weight);
+    const uint8_t* q = w.data().data();
+    const size_t og = weight_shape_[0] / options.groups, channels = weight_shape_[1];
+    const size_t taps = size_t(weight_shape_[2]) * weight_shape_[3], patch = channels * taps;
+    // Reorder each group's (O, C, KH, KW) weights to (KH, KW, C) x O.
+    std::vector<uint8_t> reordered(patch * og);
+    for (uint32_t group = 0; group < options.groups; group++) {
+      for (size_t o = 0; o < og; o++) {
+        for (size_t c = 0; c < channels; c++) {
+          for (size_t t = 0; t < taps; t++) {
+            reordered[(t * channels + c) * og + o] = q[(group * og + o) * patch + c * taps + t];
+          }
+        }
+      }
+      weights_.push_back(quant::pack(reordered.data(), static_cast<int64_t>(og), 1, patch, og, w.params()));
+    }
+  }
+
+  size_t weight_bytes() const {
+    size_t bytes = 0;
+    for (const quant::PackedMatrix& w : weights_) {
+      bytes += w.bytes();
+    }
+    return bytes;
+  }
+
+  void forward() override {
+    const Tensor<float> x = inputs[0]->output.contiguous();
+    if (x.ndim() != 3 && x.ndim() != 4) {
+      throw std::invalid_argument("Conv2D input must be (C, H, W) or (N, C, H, W)");
+    }
+    std::vector<uint32_t> shape = x.shape();
+    const size_t d = shape.size() - 3;
+    const conv::Geometry g =
+        conv::geometry(shape[d], shape[d + 1], shape[d + 2], weight_shape_, options_, d == 1 ? shape[0] : 1);
+    const quant::Params params = input_params(x);
+    const size_t in_pixels = size_t(g.rows) * g.cols, ld = quant::padded_depth(g.channels);
+    image_.resize_({g.batch * static_cast<uint32_t>(in_pixels), static_cast<uint32_t>(ld)}, params);
+    for (uint32_t b = 0; b < g.batch; b++) {
+      quant::quantize_channels_last(x.data().data() + b * g.image_size(), g.channels, in_pixels, params,
+                                    image_.mutable_data().data() + b * in_pixels * ld, ld);
+    }
+
+    shape[d] = g.out_channels;
+    shape[d + 1] = g.out_rows;
+    shape[d + 2] = g.out_cols;
+    output.resize_(shape);
+    const size_t pixels = g.out_pixels(), depth = quant::padded_depth(g.patch());
+    const size_t og = g.group_out_channels();
+    const bool direct = g.pointwise() && options_.groups == 1;
+    if (!direct) {
+      rows_.resize_({static_cast<uint32_t>(pixels), static_cast<uint32_t>(depth)}, params);
+    }
+    for (uint32_t b = 0; b < g.batch; b++) {
+      for (uint32_t group = 0; group < options_.groups; group++) {
+        const uint8_t* in = image_.data().data() + b * in_pixels * ld + size_t(group) * g.group_channels();
+        if (!direct) {
+          quant::im2row(g, in, ld, static_cast<uint8_t>(params.zero_point), rows_.mutable_data().data(), depth);
+        }
+        quant::Output out;
+        out.c = output.mutable_data().data() + b * g.out_size() + group * og * pixels;
+        out.rs = 1;
+        out.cs = static_cast<int64_t>(pixels);
+        quant::qgemm(pixels, direct ? in : rows_.data().data(), direct ? ld : depth, params, weights_[group], out);
+      }
+    }
   }
 
 private:
-  int start, end;
+  Conv2DOptions options_;
+  std::vector<uint32_t> weight_shape_;
+  std::vector<quant::PackedMatrix> weights_;
+  Tensor<uint8_t> image_{{}, quant::Params()};  // channels-last
+  Tensor<uint8_t> rows_{{}, quant::Params()};
 };
-*/
 } // namespace upsilon
@@ -0,0 +1,251 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "kernels.hh"
+#include "thread_pool.hh"
+
+// 2-D max and average pooling over every (rows, cols) plane of a (C, H, W)
+// or (N, C, H, W) tensor.
+//
+// A pooling window is separable: the max (or sum) over a kh x kw window is
+// the max over kw columns of the max over kh rows. Each output row therefore
+// first combines the kh input rows under it into one row with the vectorized
+// kernels::binary(), then reduces along the row, vectorized too when the
+// stride is 1. Planes are independent and split across threads.
+//
+// Max-pool backward keeps no argmax: each window is scanned again for the
+// first input equal to the pooled output, which is where the gradient goes.
+
+namespace upsilon {
+
+struct Pool2DOptions {
+  uint32_t kernel_h = 2, kernel_w = 2;
+  uint32_t stride_h = 0, stride_w = 0;  // 0: the kernel size
+  uint32_t pad_h = 0, pad_w = 0;
+};
+
+namespace pool {
+
+struct Geometry {
+  size_t planes;  // images * channels
+  uint32_t rows, cols, out_rows, out_cols;
+  uint32_t kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w;
+
+  size_t plane() const { return size_t(rows) * cols; }
+  size_t out_plane() const { return size_t(out_rows) * out_cols; }
+};
+
+inline Geometry geometry(const std::vector<uint32_t>& shape, const Pool2DOptions& options) {
+  if (shape.size() != 3 && shape.size() != 4) {
+    throw std::invalid_argument("Pooling input must be (C, H, W) or (N, C, H, W)");
+  }
+  Geometry g{1, shape[shape.size() - 2], shape[shape.size() - 1], 0, 0, options.kernel_h, options.kernel_w,
+             options.stride_h == 0 ? options.kernel_h : options.stride_h,
+             options.stride_w == 0 ? options.kernel_w : options.stride_w, options.pad_h, options.pad_w};
+  for (size_t d = 0; d + 2 < shape.size(); d++) {
+    g.planes *= shape[d];
+  }
+  // Padding smaller than the window keeps every window over real inputs.
+  if (g.kernel_h == 0 || g.kernel_w == 0 || g.pad_h >= g.kernel_h || g.pad_w >= g.kernel_w) {
+    throw std::invalid_argument("Pooling kernel must be positive and larger than the padding");
+  }
+  if (g.kernel_h > g.rows + 2 * g.pad_h || g.kernel_w > g.cols + 2 * g.pad_w) {
+    throw std::invalid_argument("Pooling kernel is larger than the padded input");
+  }
+  g.out_rows = (g.rows + 2 * g.pad_h - g.kernel_h) / g.stride_h + 1;
+  g.out_cols = (g.cols + 2 * g.pad_w - g.kernel_w) / g.stride_w + 1;
+  return g;
+}
+
+// shape with its last two dimensions replaced by (rows, cols).
+inline std::vector<uint32_t> with_plane(std::vector<uint32_t> shape, uint32_t rows, uint32_t cols) {
+  shape[shape.size() - 2] = rows;
+  shape[shape.size() - 1] = cols;
+  return shape;
+}
+
+namespace detail {
+
+// Per-thread scratch of one row.
+inline float* row_buffer(size_t n) {
+  thread_local std::vector<float> buffer;
+  if (buffer.size() < n) {
+    buffer.resize(n);
+  }
+  return buffer.data();
+}
+
+inline float combine(kernels::BinaryOp op, float a, float b) {
+  return op == kernels::BinaryOp::Max ? std::max(a, b) : a + b;
+}
+
+// Input rows [begin, end) under output row oi (or columns, for a column).
+inline void window(uint32_t o, uint32_t stride, uint32_t pad, uint32_t kernel, uint32_t size, uint32_t& begin,
+                   uint32_t& end) {
+  const int64_t start = int64_t(o) * stride - pad;
+  begin = static_cast<uint32_t>(std::max<int64_t>(start, 0));
+  end = static_cast<uint32_t>(std::min<int64_t>(start + kernel, size));
+}
+
+}  // namespace detail
+
+// out = max (op Max) or sum (op Add) over each window of every plane.
+inline void reduce_windows(const Geometry& g, kernels::BinaryOp op, const float* in, float* out) {
+  // Output columns whose window lies inside the row: stride 1 reduces them
+  // as shifted rows.
+  const uint32_t inner_begin = std::min(g.pad_w, g.out_cols);
+  const uint32_t inner_end =
+      g.cols + g.pad_w < g.kernel_w ? inner_begin
+                                    : std::max(inner_begin, std::min(g.out_cols, g.cols + g.pad_w - g.kernel_w + 1));
+  parallel_for(g.planes, row_grain(g.plane()), [&](size_t begin, size_t end) {
+    float* row = detail::row_buffer(g.cols);
+    for (size_t p = begin; p < end; p++) {
+      const float* plane = in + p * g.plane();
+      for (uint32_t oi = 0; oi < g.out_rows; oi++) {
+        uint32_t r0, r1;
+        detail::window(oi, g.stride_h, g.pad_h, g.kernel_h, g.rows, r0, r1);
+        std::memcpy(row, plane + size_t(r0) * g.cols, g.cols * sizeof(float));
+        for (uint32_t r = r0 + 1; r < r1; r++) {
+          kernels::binary(op, row, plane + size_t(r) * g.cols, row, g.cols);
+        }
+
+        float* dst = out + p * g.out_plane() + size_t(oi) * g.out_cols;
+        auto at = [&](uint32_t oj) {
+          uint32_t c0, c1;
+          detail::window(oj, g.stride_w, g.pad_w, g.kernel_w, g.cols, c0, c1);
+          float acc = row[c0];
+          for (uint32_t c = c0 + 1; c < c1; c++) {
+            acc = detail::combine(op, acc, row[c]);
+          }
+          dst[oj] = acc;
+        };
+        if (g.stride_w != 1) {
+          for (uint32_t oj = 0; oj < g.out_cols; oj++) {
+            at(oj);
+          }
+          continue;
+        }
+        for (uint32_t oj = 0; oj < inner_begin; oj++) {
+          at(oj);
+        }
+        const size_t n = inner_end - inner_begin;
+        if (n > 0) {
+          const float* src = row + inner_begin - g.pad_w;
+          std::memcpy(dst + inner_begin, src, n * sizeof(float));
+          for (uint32_t kj = 1; kj < g.kernel_w; kj++) {
+            kernels::binary(op, dst + inner_begin, src + kj, dst + inner_begin, n);
+          }
+        }
+        for (uint32_t oj = inner_end; oj < g.out_cols; oj++) {
+          at(oj);
+        }
+      }
+    }
+  });
+}
+
+inline void max_forward(const Geometry& g, const float* in, float* out) {
+  reduce_windows(g, kernels::BinaryOp::Max, in, out);
+}
+
+// Averages count only the inputs under a window, not its padding.
+inline void avg_forward(const Geometry& g, const float* in, float* out) {
+  reduce_windows(g, kernels::BinaryOp::Add, in, out);
+  parallel_for(g.planes, row_grain(g.out_plane()), [&](size_t begin, size_t end) {
+    for (size_t p = begin; p < end; p++) {
+      for (uint32_t oi = 0; oi < g.out_rows; oi++) {
+        uint32_t r0, r1;
+        detail::window(oi, g.stride_h, g.pad_h, g.kernel_h, g.rows, r0, r1);
+        float* dst = out + p * g.out_plane() + size_t(oi) * g.out_cols;
+        for (uint32_t oj = 0; oj < g.out_cols; oj++) {
+          uint32_t c0, c1;
+          detail::window(oj, g.stride_w, g.pad_w, g.kernel_w, g.cols, c0, c1);
+          dst[oj] /= static_cast<float>((r1 - r0) * (c1 - c0));
+        }
+      }
+    }
+  });
+}
+
+// in_grad += d max / d in: each output's gradient goes to the first input
+// of its window, in row-major order, that equals the output.
+inline void max_backward(const Geometry& g, const float* in, const float* out, const float* out_grad,
+                         float* in_grad) {
+  parallel_for(g.planes, row_grain(g.plane()), [&](size_t begin, size_t end) {
+    for (size_t p = begin; p < end; p++) {
+      const float* plane = in + p * g.plane();
+      float* grad = in_grad + p * g.plane();
+      for (uint32_t oi = 0; oi < g.out_rows; oi++) {
+        uint32_t r0, r1;
+        detail::window(oi, g.stride_h, g.pad_h, g.kernel_h, g.rows, r0, r1);
+        for (uint32_t oj = 0; oj < g.out_cols; oj++) {
+          uint32_t c0, c1;
+          detail::window(oj, g.stride_w, g.pad_w, g.kernel_w, g.cols, c0, c1);
+          const size_t o = p * g.out_plane() + size_t(oi) * g.out_cols + oj;
+          const float target = out[o];
+          for (uint32_t r = r0; r < r1; r++) {
+            const float* src = plane + size_t(r) * g.cols;
+            const float* hit = std::find(src + c0, src + c1, target);
+            if (hit != src + c1) {
+              grad[hit - plane] += out_grad[o];
+              break;
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+// in_grad += d avg / d in. The gradient of a window spreads evenly over its
+// inputs, which is again separable: each output row spreads along the row
+// into one row of contributions, added to every input row under it.
+inline void avg_backward(const Geometry& g, const float* out_grad, float* in_grad) {
+  parallel_for(g.planes, row_grain(g.plane()), [&](size_t begin, size_t end) {
+    float* row = detail::row_buffer(g.cols);
+    for (size_t p = begin; p < end; p++) {
+      float* grad = in_grad + p * g.plane();
+      for (uint32_t oi = 0; oi < g.out_rows; oi++) {
+        uint32_t r0, r1;
+        detail::window(oi, g.stride_h, g.pad_h, g.kernel_h, g.rows, r0, r1);
+        const float* dy = out_grad + p * g.out_plane() + size_t(oi) * g.out_cols;
+        std::fill(row, row + g.cols, 0.0f);
+        for (uint32_t oj = 0; oj < g.out_cols; oj++) {
+          uint32_t c0, c1;
+          detail::window(oj, g.stride_w, g.pad_w, g.kernel_w, g.cols, c0, c1);
+          const float share = dy[oj] / static_cast<float>((r1 - r0) * (c1 - c0));
+          for (uint32_t c = c0; c < c1; c++) {
+            row[c] += share;
+          }
+        }
+        for (uint32_t r = r0; r < r1; r++) {
+          kernels::binary(kernels::BinaryOp::Add, grad + size_t(r) * g.cols, row, grad + size_t(r) * g.cols, g.cols);
+        }
+      }
+    }
+  });
+}
+
+// out[p] = mean of plane p, for planes of n elements.
+inline void global_avg_forward(size_t planes, size_t n, const float* in, float* out) {
+  parallel_for(planes, row_grain(n), [&](size_t begin, size_t end) {
+    for (size_t p = begin; p < end; p++) {
+      out[p] = kernels::sum(in + p * n, n) / static_cast<float>(n);
+    }
+  });
+}
+
+inline void global_avg_backward(size_t planes, size_t n, const float* out_grad, float* in_grad) {
+  parallel_for(planes, row_grain(n), [&](size_t begin, size_t end) {
+    for (size_t p = begin; p < end; p++) {
+      float* grad = in_grad + p * n;
+      kernels::binary_scalar(kernels::BinaryOp::Add, grad, out_grad[p] / static_cast<float>(n), grad, n, false);
+    }
+  });
+}
+
+}  // namespace pool
+}  // namespace upsilon
@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "graph.hh"
+
+namespace upsilon {
+
+// Post-training quantization of a float graph for inference. Every MatMul
+// and Conv2D whose second input is a Variable (taken as constant weights) is
+// replaced by its int8 counterpart (QuantizedMatMul, QuantizedConv2D).
+// Running representative inputs through the graph first fixes the
+// activation ranges:
+//
+//   Executor executor(y);
+//   Quantizer quantizer(executor.graph());
+//   for (const Tensor<float>& batch : calibration) {
+//     x->output = batch;
+//     executor.forward();
+//     quantizer.observe();
+//   }
+//   quantizer.apply();
+//
+// Without calibration the quantized ops take the range of each input as it
+// arrives. A replaced graph output is reached through graph.outputs(), and
+// the float weights are released once nothing else holds them.
+class Quantizer {
+public:
+  explicit Quantizer(Graph& graph) : graph_(graph) {
+    for (const auto& op : graph.order()) {
+      const bool constant = op->inputs.size() == 2 && dynamic_cast<Variable*>(op->inputs[1].get()) != nullptr;
+      const bool matmul = dynamic_cast<MatMul*>(op.get()) != nullptr && op->inputs[1]->output.ndim() == 2;
+      if (constant && (matmul || dynamic_cast<Conv2D*>(op.get()) != nullptr)) {
+        targets_.push_back({op});
+      }
+    }
+  }
+
+  // Ops apply() will replace.
+  size_t size() const { return targets_.size(); }
+
+  // Widens each target's activation range by the input it saw in the last
+  // forward pass.
+  void observe() {
+    for (Target& t : targets_) {
+      const Tensor<float> x = t.op->inputs[0]->output.contiguous();
+      if (x.size() == 0) {
+        continue;
+      }
+      t.min = std::min(t.min, kernels::reduce_min(x.data().data(), x.size()));
+      t.max = std::max(t.max, kernels::reduce_max(x.data().data(), x.size()));
+    }
+  }
+
+  // Swaps in the quantized ops and returns how many were replaced.
+  size_t apply() {
+    for (const Target& t : targets_) {
+      std::shared_ptr<QuantizedOp> q;
+      const Tensor<float>& weight = t.op->inputs[1]->output;
+      if (auto* conv = dynamic_cast<Conv2D*>(t.op.get())) {
+        q = std::make_shared<QuantizedConv2D>(t.op->inputs[0], weight, conv->options());
+      } else {
+        q = std::make_shared<QuantizedMatMul>(t.op->inputs[0], weight);
+      }
+      if (t.min <= t.max) {
+        q->set_input_params(quant::affine(t.min, t.max));
+      }
+      graph_.replace(t.op, q);
+    }
+    const size_t n = targets_.size();
+    targets_.clear();
+    return n;
+  }
+
+private:
+  struct Target {
+    std::shared_ptr<Op> op;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+  };
+
+  Graph& graph_;
+  std::vector<Target> targets_;
+};
+
+}  // namespace upsilon
@@ -0,0 +1,462 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "conv.hh"
+#include "kernels.hh"
+#include "thread_pool.hh"
+#if UPSILON_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Affine uint8 quantization and an int8 GEMM for inference.
+//
+// A real value x is stored as q = round(x / scale + zero_point), clamped to
+// [0, 255]. Activations use the whole range of their observed [min, max]
+// (affine()). Weights are symmetric around zero point 128 (symmetric()), so
+// q ^ 0x80 is the signed value q - 128 and they multiply as int8.
+//
+// qgemm() multiplies uint8 activations A (m x k) by packed weights B
+// (k x n) with int32 accumulation:
+//   sum_p (a[i,p] - za) * b[p,j] = sum_p a[i,p] * b[p,j] - za * colsum[j],
+// where colsum comes from pack(). The integer products are exact on every
+// path. AVX-512 VNNI uses vpdpbusd (u8 x s8, four at a time into int32).
+// AVX2 widens both sides to int16 and uses vpmaddwd, since vpmaddubsw would
+// saturate its int16 pair sums on full-range operands. The int32 sums are
+// scaled back to float, or requantized to uint8, as each tile is stored.
+
+namespace upsilon {
+namespace quant {
+
+struct Params {
+  float scale = 1.0f;
+  int32_t zero_point = 0;
+};
+
+// Params spanning [min, max], widened to include zero so that zero (padding,
+// ReLU outputs) is represented exactly.
+inline Params affine(float min, float max) {
+  if (!std::isfinite(min) || !std::isfinite(max)) {
+    throw std::invalid_argument("Cannot quantize non-finite values");
+  }
+  min = std::min(min, 0.0f);
+  max = std::max(max, 0.0f);
+  if (max == min) {
+    return Params{};
+  }
+  Params p;
+  p.scale = (max - min) / 255.0f;
+  p.zero_point = std::clamp(static_cast<int32_t>(std::nearbyint(-min / p.scale)), 0, 255);
+  return p;
+}
+
+// affine() over the values of x[0, n), n > 0.
+inline Params affine(const float* x, size_t n) {
+  return affine(kernels::reduce_min(x, n), kernels::reduce_max(x, n));
+}
+
+// Params for |x| <= absmax with zero point 128; values land in [1, 255].
+inline Params symmetric(float absmax) {
+  if (!std::isfinite(absmax)) {
+    throw std::invalid_argument("Cannot quantize non-finite values");
+  }
+  Params p;
+  p.scale = absmax > 0.0f ? absmax / 127.0f : 1.0f;
+  p.zero_point = 128;
+  return p;
+}
+
+// symmetric() over the largest magnitude in x[0, n), n > 0.
+inline Params symmetric(const float* x, size_t n) {
+  return symmetric(std::max(-kernels::reduce_min(x, n), kernels::reduce_max(x, n)));
+}
+
+// Columns per panel of packed weights; pack() pads n to a whole panel.
+constexpr size_t kPanel = 16;
+
+// k rounded up to the four-deep steps the kernels take.
+inline size_t padded_depth(size_t k) {
+  return (k + 3) / 4 * 4;
+}
+
+// Symmetric uint8 weights (k x n) as int8, in panels of kPanel columns:
+// element (p, j) is at panel j / kPanel, offset (p / 4) * 64 + (j % kPanel)
+// * 4 + p % 4, so four consecutive depths of a column are one int32 and a
+// step of four depths over a panel is one 64-byte vector. Depths past k and
+// columns past n are zero.
+class PackedMatrix {
+public:
+  size_t rows() const { return k_; }
+
+  size_t cols() const { return n_; }
+
+  float scale() const { return scale_; }
+
+  size_t panels() const { return (n_ + kPanel - 1) / kPanel; }
+
+  const int8_t* panel(size_t t) const { return data_.data() + t * padded_depth(k_) * kPanel; }
+
+  const int32_t* column_sums() const { return column_sums_.data(); }
+
+  size_t bytes() const { return data_.size() + column_sums_.size() * sizeof(int32_t); }
+
+private:
+  size_t k_ = 0, n_ = 0;
+  float scale_ = 1.0f;
+  std::vector<int8_t> data_;
+  std::vector<int32_t> column_sums_;
+
+  friend PackedMatrix pack(const uint8_t* b, int64_t rs, int64_t cs, size_t k, size_t n, Params params);
+};
+
+// Packs b[p * rs + j * cs] for p < k, j < n. The weights must be symmetric
+// (zero point 128, see symmetric()).
+inline PackedMatrix pack(const uint8_t* b, int64_t rs, int64_t cs, size_t k, size_t n, Params params) {
+  if (params.zero_point != 128) {
+    throw std::invalid_argument("Packed weights must be symmetric (zero point 128)");
+  }
+  PackedMatrix m;
+  m.k_ = k;
+  m.n_ = n;
+  m.scale_ = params.scale;
+  const size_t depth = padded_depth(k), cols = m.panels() * kPanel;
+  m.data_.assign(depth * cols, 0);
+  m.column_sums_.assign(cols, 0);
+  for (size_t j = 0; j < n; j++) {
+    int8_t* out = m.data_.data() + j / kPanel * depth * kPanel + j % kPanel * 4;
+    int32_t sum = 0;
+    for (size_t p = 0; p < k; p++) {
+      const int8_t w = static_cast<int8_t>(b[p * rs + j * cs] ^ 0x80);
+      out[p / 4 * kPanel * 4 + p % 4] = w;
+      sum += w;
+    }
+    m.column_sums_[j] = sum;
+  }
+  return m;
+}
+
+// Where qgemm() stores element (i, j): c[i * rs + j * cs] as float, or, when
+// q is set, q[i * rs + j * cs] requantized with requant.
+struct Output {
+  float* c = nullptr;
+  uint8_t* q = nullptr;
+  int64_t rs = 0, cs = 1;
+  Params requant;
+};
+
+namespace detail {
+
+// Row pointers of an MR-row tile; rows past the end repeat the first one
+// and their results are dropped, so A needs no padding rows.
+template <size_t MR>
+inline void tile_rows(const uint8_t* a, size_t lda, size_t rows, const uint8_t* (&out)[MR]) {
+  for (size_t i = 0; i < MR; i++) {
+    out[i] = a + (i < rows ? i : 0) * lda;
+  }
+}
+
+inline int32_t load4(const uint8_t* p) {
+  int32_t x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+// Scales (or requantizes) the rows x cols corner of an int32 tile with row
+// stride ld into element (i0, j0) of out.
+inline void store_tile(const int32_t* acc, size_t ld, size_t rows, size_t cols, size_t i0, size_t j0,
+                       float multiplier, int32_t za, const int32_t* column_sums, const Output& out) {
+  alignas(64) float row[64];
+  const float inv = out.q != nullptr ? 1.0f / out.requant.scale : 0.0f;
+  const float zp = static_cast<float>(out.requant.zero_point);
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 0; j < cols; j++) {
+      row[j] = multiplier * static_cast<float>(acc[i * ld + j] - za * column_sums[j0 + j]);
+    }
+    const int64_t o = int64_t(i0 + i) * out.rs + int64_t(j0) * out.cs;
+    if (out.q != nullptr) {
+      for (size_t j = 0; j < cols; j++) {
+        const float r = std::nearbyint(row[j] * inv + zp);
+        out.q[o + int64_t(j) * out.cs] = static_cast<uint8_t>(std::clamp(r, 0.0f, 255.0f));
+      }
+    } else if (out.cs == 1) {
+      std::memcpy(out.c + o, row, cols * sizeof(float));
+    } else {
+      for (size_t j = 0; j < cols; j++) {
+        out.c[o + int64_t(j) * out.cs] = row[j];
+      }
+    }
+  }
+}
+
+}  // namespace detail
+
+// Each kernel fills an MR x NR int32 tile (row stride NR) from MR rows of A
+// and the packed panels starting at column j0 (a multiple of NR).
+namespace scalar {
+
+constexpr size_t MR = 4, NR = kPanel;
+
+inline void tile(const uint8_t* a, size_t lda, size_t rows, const PackedMatrix& b, size_t j0, int32_t* acc) {
+  const uint8_t* row[MR];
+  detail::tile_rows(a, lda, rows, row);
+  const int8_t* w = b.panel(j0 / kPanel);
+  std::fill(acc, acc + MR * NR, 0);
+  for (size_t p = 0; p < padded_depth(b.rows()); p++) {
+    const int8_t* step = w + p / 4 * kPanel * 4 + p % 4;
+    for (size_t i = 0; i < MR; i++) {
+      const int32_t x = row[i][p];
+      for (size_t j = 0; j < NR; j++) {
+        acc[i * NR + j] += x * step[j * 4];
+      }
+    }
+  }
+}
+
+}  // namespace scalar
+
+#if UPSILON_X86_SIMD
+UPSILON_TARGET_REGION("avx2,fma")
+namespace avx2 {
+
+constexpr size_t MR = 4, NR = 8;
+
+// Half a panel: 8 columns x 4 depths of int8 are 32 bytes. Sign-extended to
+// int16 they hold (col, depth 0-1) and (col, depth 2-3) pairs per int32 lane,
+// which vpmaddwd multiplies with the broadcast pairs of a row of A. The two
+// partial sums of each column are added at the end.
+inline void tile(const uint8_t* a, size_t lda, size_t rows, const PackedMatrix& b, size_t j0, int32_t* acc) {
+  const uint8_t* row[MR];
+  detail::tile_rows(a, lda, rows, row);
+  const int8_t* w = b.panel(j0 / kPanel) + j0 % kPanel * 4;
+  __m256i lo[MR], hi[MR];
+  for (size_t i = 0; i < MR; i++) {
+    lo[i] = hi[i] = _mm256_setzero_si256();
+  }
+  const size_t depth = padded_depth(b.rows());
+  for (size_t p = 0; p < depth; p += 4) {
+    const __m256i step = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + p * kPanel));
+    const __m256i w_lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(step));
+    const __m256i w_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(step, 1));
+#pragma GCC unroll 4
+    for (size_t i = 0; i < MR; i++) {
+      const __m256i x = _mm256_broadcastq_epi64(_mm_cvtepu8_epi16(_mm_cvtsi32_si128(detail::load4(row[i] + p))));
+      lo[i] = _mm256_add_epi32(lo[i], _mm256_madd_epi16(w_lo, x));
+      hi[i] = _mm256_add_epi32(hi[i], _mm256_madd_epi16(w_hi, x));
+    }
+  }
+  for (size_t i = 0; i < MR; i++) {
+    const __m256i sums = _mm256_permute4x64_epi64(_mm256_hadd_epi32(lo[i], hi[i]), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i * NR), sums);
+  }
+}
+
+}  // namespace avx2
+UPSILON_UNTARGET_REGION
+
+UPSILON_TARGET_REGION("avx512f,avx512bw,avx512dq,avx512vl,avx512vnni,avx2,fma")
+namespace vnni {
+
+constexpr size_t MR = 8, NR = 2 * kPanel;
+
+inline void tile(const uint8_t* a, size_t lda, size_t rows, const PackedMatrix& b, size_t j0, int32_t* acc) {
+  const uint8_t* row[MR];
+  detail::tile_rows(a, lda, rows, row);
+  const int8_t* w0 = b.panel(j0 / kPanel);
+  // A lone last panel is read twice; the second copy's columns are dropped.
+  const int8_t* w1 = b.panel(std::min(j0 / kPanel + 1, b.panels() - 1));
+  __m512i c0[MR], c1[MR];
+  for (size_t i = 0; i < MR; i++) {
+    c0[i] = c1[i] = _mm512_setzero_si512();
+  }
+  const size_t depth = padded_depth(b.rows());
+  for (size_t p = 0; p < depth; p += 4) {
+    const __m512i s0 = _mm512_loadu_si512(w0 + p * kPanel);
+    const __m512i s1 = _mm512_loadu_si512(w1 + p * kPanel);
+#pragma GCC unroll 8
+    for (size_t i = 0; i < MR; i++) {
+      const __m512i x = _mm512_set1_epi32(detail::load4(row[i] + p));
+      c0[i] = _mm512_dpbusd_epi32(c0[i], x, s0);
+      c1[i] = _mm512_dpbusd_epi32(c1[i], x, s1);
+    }
+  }
+  for (size_t i = 0; i < MR; i++) {
+    _mm512_storeu_si512(acc + i * NR, c0[i]);
+    _mm512_storeu_si512(acc + i * NR + kPanel, c1[i]);
+  }
+}
+
+}  // namespace vnni
+UPSILON_UNTARGET_REGION
+#endif
+
+enum class Kernel {
+  Scalar,
+  AVX2,
+  VNNI
+};
+
+// Kernel qgemm() runs on the active instruction set: VNNI needs AVX-512
+// with the VNNI extension, and narrower sets than AVX2 use the scalar loop.
+inline Kernel active_kernel() {
+#if UPSILON_X86_SIMD
+  switch (kernels::active_isa()) {
+    case kernels::Isa::AVX512: {
+      static const bool vnni = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512vnni") != 0;
+      }();
+      return vnni ? Kernel::VNNI : Kernel::AVX2;
+    }
+    case kernels::Isa::AVX2:
+      return Kernel::AVX2;
+    default:
+      break;
+  }
+#endif
+  return Kernel::Scalar;
+}
+
+inline const char* kernel_name(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::VNNI:
+      return "avx512-vnni";
+    case Kernel::AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+namespace detail {
+
+// Multiply-adds per task; smaller pieces are not worth another thread.
+constexpr size_t kGrainMultiplyAdds = size_t(1) << 18;
+
+template <size_t MR, size_t NR, typename Tile>
+void run(Tile tile, size_t m, const uint8_t* a, size_t lda, Params a_params, const PackedMatrix& b,
+         const Output& out) {
+  const size_t n = b.cols();
+  const float multiplier = a_params.scale * b.scale();
+  // Blocks of 8 tiles down A by one NR-column strip of B, so a strip is
+  // reused from L1 while the rows stream past.
+  constexpr size_t kRowTiles = 8;
+  const size_t row_blocks = (m + MR * kRowTiles - 1) / (MR * kRowTiles);
+  const size_t col_tiles = (n + NR - 1) / NR;
+  const size_t task_work = MR * kRowTiles * NR * padded_depth(b.rows());
+  parallel_for(row_blocks * col_tiles, std::max<size_t>(1, kGrainMultiplyAdds / task_work),
+               [&](size_t begin, size_t end) {
+    alignas(64) int32_t acc[MR * NR];
+    for (size_t task = begin; task < end; task++) {
+      const size_t j0 = task % col_tiles * NR;
+      const size_t block = task / col_tiles * MR * kRowTiles;
+      for (size_t i0 = block; i0 < std::min(m, block + MR * kRowTiles); i0 += MR) {
+        const size_t rows = std::min(MR, m - i0);
+        tile(a + i0 * lda, lda, rows, b, j0, acc);
+        store_tile(acc, NR, rows, std::min(NR, n - j0), i0, j0, multiplier, a_params.zero_point, b.column_sums(),
+                   out);
+      }
+    }
+  });
+}
+
+}  // namespace detail
+
+// out = (A - za) * B for uint8 activations a (m x k, row stride lda) and
+// packed weights b (k x n), scaled by a_params.scale * b.scale(). Rows of A
+// are read in steps of four bytes, so lda >= padded_depth(k) and the bytes
+// between k and padded_depth(k) must be readable; their values do not
+// matter, since the matching weights are zero.
+inline void qgemm(size_t m, const uint8_t* a, size_t lda, Params a_params, const PackedMatrix& b,
+                  const Output& out) {
+  if (lda < padded_depth(b.rows())) {
+    throw std::invalid_argument("qgemm needs lda >= padded_depth(k)");
+  }
+  if (m == 0 || b.cols() == 0) {
+    return;
+  }
+  switch (active_kernel()) {
+#if UPSILON_X86_SIMD
+    case Kernel::VNNI:
+      return detail::run<vnni::MR, vnni::NR>(vnni::tile, m, a, lda, a_params, b, out);
+    case Kernel::AVX2:
+      return detail::run<avx2::MR, avx2::NR>(avx2::tile, m, a, lda, a_params, b, out);
+#endif
+    default:
+      return detail::run<scalar::MR, scalar::NR>(scalar::tile, m, a, lda, a_params, b, out);
+  }
+}
+
+// Quantizes rows x k floats (row stride ldx) into rows of ld bytes.
+inline void quantize_rows(const float* x, size_t rows, size_t k, size_t ldx, Params params, uint8_t* out,
+                          size_t ld) {
+  const float inv = 1.0f / params.scale;
+  parallel_for(rows, std::max<size_t>(1, (size_t(1) << 15) / std::max<size_t>(k, 1)), [&](size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++) {
+      kernels::quantize(x + r * ldx, inv, params.zero_point, out + r * ld, k);
+    }
+  });
+}
+
+// Quantizes a (channels, pixels) float image to channels-last order: pixel p
+// becomes out[p * ld, p * ld + channels), so the taps of one kernel position
+// are contiguous.
+inline void quantize_channels_last(const float* x, size_t channels, size_t pixels, Params params, uint8_t* out,
+                                   size_t ld) {
+  constexpr size_t kPixels = 256, kChannels = 16;
+  const float inv = 1.0f / params.scale;
+  parallel_for((pixels + kPixels - 1) / kPixels, std::max<size_t>(1, 512 / std::max<size_t>(channels, 1)),
+               [&](size_t begin, size_t end) {
+    uint8_t block[kChannels][kPixels];
+    for (size_t p0 = begin * kPixels; p0 < std::min(pixels, end * kPixels); p0 += kPixels) {
+      const size_t np = std::min(kPixels, pixels - p0);
+      for (size_t c0 = 0; c0 < channels; c0 += kChannels) {
+        const size_t nc = std::min(kChannels, channels - c0);
+        for (size_t c = 0; c < nc; c++) {
+          kernels::quantize(x + (c0 + c) * pixels + p0, inv, params.zero_point, block[c], np);
+        }
+        for (size_t p = 0; p < np; p++) {
+          uint8_t* dst = out + (p0 + p) * ld + c0;
+          for (size_t c = 0; c < nc; c++) {
+            dst[c] = block[c][p];
+          }
+        }
+      }
+    }
+  });
+}
+
+// The uint8 counterpart of conv::im2col, for a channels-last image (pixel
+// stride image_ld, starting at the group's first channel): row p of out
+// (stride ld) holds the taps of output pixel p as (ki, kj, channel), so a
+// convolution is out = rows * W^T with W's taps in that order. Taps outside
+// the image read as pad, the zero point.
+inline void im2row(const conv::Geometry& g, const uint8_t* image, size_t image_ld, uint8_t pad, uint8_t* out,
+                   size_t ld) {
+  const Conv2DOptions& o = g.options;
+  const size_t channels = g.group_channels();
+  parallel_for(g.out_rows, std::max<size_t>(1, (size_t(1) << 14) / std::max<size_t>(g.out_cols * ld, 1)),
+               [&](size_t begin, size_t end) {
+    for (size_t oi = begin; oi < end; oi++) {
+      for (uint32_t oj = 0; oj < g.out_cols; oj++) {
+        uint8_t* dst = out + (oi * g.out_cols + oj) * ld;
+        for (uint32_t ki = 0; ki < g.kernel_rows; ki++) {
+          const int64_t r = int64_t(oi) * o.stride_h + int64_t(ki) * o.dilation_h - o.pad_h;
+          for (uint32_t kj = 0; kj < g.kernel_cols; kj++, dst += channels) {
+            const int64_t col = int64_t(oj) * o.stride_w + int64_t(kj) * o.dilation_w - o.pad_w;
+            if (r >= 0 && col >= 0 && r < g.rows && col < g.cols) {
+              std::memcpy(dst, image + (r * g.cols + col) * image_ld, channels);
+            } else {
+              std::memset(dst, pad, channels);
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+}  // namespace quant
+}  // namespace upsilon
@@ -0,0 +1,417 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "tensor.hh"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define UPSILON_HAS_MMAP 1
+#endif
+
+// Binary container for named tensors, read back by memory-mapping the file.
+//
+// Layout, all integers little-endian:
+//
+//   header   char magic[8] = "UPSILON\0", u32 version = 1, u32 count,
+//            u64 index_bytes, u64 reserved = 0
+//   index    count entries of: u32 name_bytes, name, u32 dtype, u32 ndim,
+//            u32 shape[ndim], u64 offset, u64 bytes
+//   data     each tensor's elements, row-major, at an offset from the start
+//            of the file that is a multiple of kBufferAlignment
+//
+// Readers reject other versions.
+
+namespace upsilon {
+
+enum class DType : uint32_t { F32 = 0, BF16 = 1, FP16 = 2 };
+
+namespace io {
+
+constexpr char kMagic[8] = {'U', 'P', 'S', 'I', 'L', 'O', 'N', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 32;
+
+inline bool little_endian() {
+  const uint16_t one = 1;
+  uint8_t low;
+  std::memcpy(&low, &one, 1);
+  return low == 1;
+}
+
+inline size_t element_bytes(DType dtype) {
+  return dtype == DType::F32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+inline size_t align_up(size_t n) {
+  return (n + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+}
+
+// Bytes of a tensor of the given shape, or false if the count overflows.
+inline bool checked_bytes(const std::vector<uint32_t>& shape, size_t element, size_t& bytes) {
+  bytes = element;
+  for (uint32_t d : shape) {
+    if (__builtin_mul_overflow(bytes, static_cast<size_t>(d), &bytes)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+inline void put(std::string& out, T value) {
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+  }
+}
+
+// Bounds-checked little-endian reads from a file's bytes.
+class Cursor {
+public:
+  Cursor(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  template <typename T>
+  T get() {
+    const uint8_t* p = take(sizeof(T));
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      value |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return static_cast<T>(value);
+  }
+
+  const uint8_t* take(size_t n) {
+    if (n > size_ - pos_) {
+      throw std::runtime_error("File is truncated");
+    }
+    const uint8_t* p = data_ + pos_;
+    pos_ += n;
+    return p;
+  }
+
+  size_t remaining() const { return size_ - pos_; }
+
+private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+
+// A whole file, mapped copy-on-write (or read into memory where mmap is not
+// available). Writes through it never reach the file.
+class Mapping {
+public:
+  explicit Mapping(const std::string& path) {
+#if UPSILON_HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("Cannot stat " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void* p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("Cannot map " + path);
+      }
+      data_ = static_cast<uint8_t*>(p);
+      mapped_ = true;
+    }
+    ::close(fd);
+#else
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    std::fseek(file, 0, SEEK_END);
+    size_ = static_cast<size_t>(std::ftell(file));
+    std::fseek(file, 0, SEEK_SET);
+    data_ = static_cast<uint8_t*>(detail::system_allocate(size_));
+    const bool ok = std::fread(data_, 1, size_, file) == size_;
+    std::fclose(file);
+    if (!ok) {
+      detail::system_deallocate(data_, size_);
+      throw std::runtime_error("Cannot read " + path);
+    }
+#endif
+  }
+
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+
+  ~Mapping() {
+#if UPSILON_HAS_MMAP
+    if (mapped_) {
+      munmap(data_, size_);
+    }
+#else
+    detail::system_deallocate(data_, size_);
+#endif
+  }
+
+  uint8_t* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+private:
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+};
+
+}  // namespace io
+
+// Collects named tensors and writes them in one file:
+//
+//   TensorWriter writer;
+//   writer.add("fc1.weight", w1);
+//   writer.add("fc1.bias", b1);
+//   writer.write("model.ups");
+//
+// Adding a tensor is O(1): it shares the buffer until written.
+class TensorWriter {
+public:
+  void add(const std::string& name, const Tensor<float>& t) {
+    const Tensor<float> c = t.contiguous();
+    push(name, DType::F32, c.shape(), c.data().data(), c.size() * sizeof(float), std::make_shared<Tensor<float>>(c));
+  }
+
+  void add(const std::string& name, const Tensor<bf16>& t) {
+    push(name, DType::BF16, t.shape(), t.data().data(), t.bytes(), std::make_shared<Tensor<bf16>>(t));
+  }
+
+  void add(const std::string& name, const Tensor<fp16>& t) {
+    push(name, DType::FP16, t.shape(), t.data().data(), t.bytes(), std::make_shared<Tensor<fp16>>(t));
+  }
+
+  size_t size() const { return entries_.size(); }
+
+  void write(const std::string& path) const {
+    if (!io::little_endian()) {
+      throw std::runtime_error("Tensor files can only be written on little-endian hosts");
+    }
+    size_t index_bytes = 0;
+    for (const Entry& e : entries_) {
+      index_bytes += 4 + e.name.size() + 8 + 4 * e.shape.size() + 16;
+    }
+    std::string index;
+    size_t offset = io::align_up(io::kHeaderBytes + index_bytes);
+    for (const Entry& e : entries_) {
+      io::put<uint32_t>(index, e.name.size());
+      index += e.name;
+      io::put<uint32_t>(index, static_cast<uint32_t>(e.dtype));
+      io::put<uint32_t>(index, e.shape.size());
+      for (uint32_t d : e.shape) {
+        io::put<uint32_t>(index, d);
+      }
+      io::put<uint64_t>(index, offset);
+      io::put<uint64_t>(index, e.bytes);
+      offset = io::align_up(offset + e.bytes);
+    }
+
+    std::string header(io::kMagic, sizeof(io::kMagic));
+    io::put<uint32_t>(header, io::kVersion);
+    io::put<uint32_t>(header, entries_.size());
+    io::put<uint64_t>(header, index.size());
+    io::put<uint64_t>(header, 0);
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+      throw std::runtime_error("Cannot create " + path);
+    }
+    static const char zeros[kBufferAlignment] = {};
+    size_t written = 0;
+    bool ok = true;
+    auto emit = [&](const void* p, size_t n) {
+      ok = ok && std::fwrite(p, 1, n, file) == n;
+      written += n;
+    };
+    emit(header.data(), header.size());
+    emit(index.data(), index.size());
+    for (const Entry& e : entries_) {
+      emit(zeros, io::align_up(written) - written);
+      emit(e.data, e.bytes);
+    }
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+      throw std::runtime_error("Cannot write " + path);
+    }
+  }
+
+private:
+  struct Entry {
+    std::string name;
+    DType dtype;
+    std::vector<uint32_t> shape;
+    const void* data;
+    size_t bytes;
+    std::shared_ptr<const void> keep;  // the tensor data points into
+  };
+
+  void push(const std::string& name, DType dtype, const std::vector<uint32_t>& shape, const void* data, size_t bytes,
+            std::shared_ptr<const void> keep) {
+    for (const Entry& e : entries_) {
+      if (e.name == name) {
+        throw std::invalid_argument("Duplicate tensor name " + name);
+      }
+    }
+    entries_.push_back({name, dtype, shape, data, bytes, std::move(keep)});
+  }
+
+  std::vector<Entry> entries_;
+};
+
+// A tensor file mapped into memory. Opening it reads only the index; float
+// tensors come back as views of the mapped pages, so nothing is copied and
+// the OS pages data in on first touch. Tensors keep the mapping alive after
+// the TensorFile is gone, and writing to one gives it private pages (the
+// file itself is never modified).
+class TensorFile {
+public:
+  explicit TensorFile(const std::string& path) : mapping_(std::make_shared<io::Mapping>(path)) {
+    if (!io::little_endian()) {
+      throw std::runtime_error("Tensor files can only be read on little-endian hosts");
+    }
+    const size_t file_bytes = mapping_->size();
+    io::Cursor header(mapping_->data(), file_bytes);
+    if (file_bytes < io::kHeaderBytes || std::memcmp(header.take(sizeof(io::kMagic)), io::kMagic, sizeof(io::kMagic)) != 0) {
+      throw std::runtime_error(path + " is not a tensor file");
+    }
+    const uint32_t version = header.get<uint32_t>();
+    if (version != io::kVersion) {
+      throw std::runtime_error(path + " has unsupported tensor file version " + std::to_string(version));
+    }
+    const uint32_t count = header.get<uint32_t>();
+    const uint64_t index_bytes = header.get<uint64_t>();
+    if (index_bytes > file_bytes - io::kHeaderBytes) {
+      throw std::runtime_error("Tensor file index is truncated");
+    }
+
+    // Counts below size allocations, so they are checked against the bytes
+    // that could hold them first (an entry takes at least 28).
+    io::Cursor index(mapping_->data() + io::kHeaderBytes, index_bytes);
+    if (count > index.remaining() / 28) {
+      throw std::runtime_error("Tensor file index is truncated");
+    }
+    entries_.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+      Entry e;
+      const uint32_t name_bytes = index.get<uint32_t>();
+      e.name.assign(reinterpret_cast<const char*>(index.take(name_bytes)), name_bytes);
+      const uint32_t dtype = index.get<uint32_t>();
+      if (dtype > static_cast<uint32_t>(DType::FP16)) {
+        throw std::runtime_error("Tensor " + e.name + " has unknown dtype " + std::to_string(dtype));
+      }
+      e.dtype = static_cast<DType>(dtype);
+      const uint32_t ndim = index.get<uint32_t>();
+      if (ndim > index.remaining() / sizeof(uint32_t)) {
+        throw std::runtime_error("File is truncated");
+      }
+      e.shape.resize(ndim);
+      for (uint32_t& d : e.shape) {
+        d = index.get<uint32_t>();
+      }
+      e.offset = index.get<uint64_t>();
+      const uint64_t bytes = index.get<uint64_t>();
+      size_t expected = 0;
+      if (!io::checked_bytes(e.shape, io::element_bytes(e.dtype), expected) || bytes != expected ||
+          e.offset % kBufferAlignment != 0 ||
+          e.offset > file_bytes || bytes > file_bytes - e.offset) {
+        throw std::runtime_error("Tensor " + e.name + " lies outside the file or does not match its shape");
+      }
+      if (!lookup_.emplace(e.name, entries_.size()).second) {
+        throw std::runtime_error("Duplicate tensor name " + e.name);
+      }
+      entries_.push_back(std::move(e));
+    }
+  }
+
+  size_t size() const { return entries_.size(); }
+
+  // Names in file order.
+  std::vector<std::string> names() const {
+    std::vector<std::string> names;
+    for (const Entry& e : entries_) {
+      names.push_back(e.name);
+    }
+    return names;
+  }
+
+  bool contains(const std::string& name) const { return lookup_.count(name) != 0; }
+
+  DType dtype(const std::string& name) const { return entry(name).dtype; }
+
+  const std::vector<uint32_t>& shape(const std::string& name) const { return entry(name).shape; }
+
+  // Where the tensor's elements start, in bytes from the start of the file.
+  uint64_t offset(const std::string& name) const { return entry(name).offset; }
+
+  // The named tensor as float: a view of the mapped file for F32 entries,
+  // widened into a new buffer for 16-bit ones.
+  Tensor<float> get(const std::string& name) const {
+    const Entry& e = entry(name);
+    switch (e.dtype) {
+      case DType::BF16:
+        return get<bf16>(name).decode();
+      case DType::FP16:
+        return get<fp16>(name).decode();
+      default:
+        return Tensor<float>::wrap(storage<float>(e), e.shape);
+    }
+  }
+
+  // A 16-bit entry of exactly this type, as a view of the mapped file.
+  template <typename T>
+  Tensor<T> get(const std::string& name) const {
+    const Entry& e = entry(name);
+    if (e.dtype != (std::is_same<T, bf16>::value ? DType::BF16 : DType::FP16)) {
+      throw std::invalid_argument("Tensor " + name + " is stored with another dtype");
+    }
+    return Tensor<T>::wrap(storage<T>(e), e.shape);
+  }
+
+  // Bytes of the mapped file.
+  size_t bytes() const { return mapping_->size(); }
+
+private:
+  struct Entry {
+    std::string name;
+    DType dtype;
+    std::vector<uint32_t> shape;
+    uint64_t offset;
+  };
+
+  const Entry& entry(const std::string& name) const {
+    const auto it = lookup_.find(name);
+    if (it == lookup_.end()) {
+      throw std::invalid_argument("No tensor named " + name);
+    }
+    return entries_[it->second];
+  }
+
+  template <typename T>
+  std::shared_ptr<Storage<T>> storage(const Entry& e) const {
+    // Shares ownership of the mapping; no element is touched.
+    std::shared_ptr<T> buffer(mapping_, reinterpret_cast<T*>(mapping_->data() + e.offset));
+    return std::make_shared<Storage<T>>(std::move(buffer), detail::numel(e.shape));
+  }
+
+  std::shared_ptr<io::Mapping> mapping_;
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> lookup_;
+};
+
+}  // namespace upsilon
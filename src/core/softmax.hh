@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include "kernels.hh"
+#include "thread_pool.hh"
+
+// Softmax, log-softmax and softmax cross-entropy over rows of n contiguous
+// elements (the last dimension of a tensor).
+//
+// Every row starts with kernels::logsumexp(), a single streaming pass that
+// keeps a running max, so large logits never overflow. softmax is then
+// exp(x - lse) and log-softmax x - lse. Cross-entropy needs nothing but lse
+// and the logit of the label, and its gradient, softmax - onehot, is added
+// straight into the logits' gradient in one more pass.
+
+namespace upsilon {
+namespace softmax {
+
+template <typename F>
+inline void for_each_row(size_t rows, size_t n, F&& f) {
+  parallel_for(rows, row_grain(n), [&](size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++) {
+      f(r);
+    }
+  });
+}
+
+inline void forward(size_t rows, size_t n, const float* in, float* out) {
+  for_each_row(rows, n, [&](size_t r) {
+    const float* x = in + r * n;
+    kernels::exp_shifted(x, kernels::logsumexp(x, n), out + r * n, n);
+  });
+}
+
+inline void log_forward(size_t rows, size_t n, const float* in, float* out) {
+  for_each_row(rows, n, [&](size_t r) {
+    const float* x = in + r * n;
+    kernels::binary_scalar(kernels::BinaryOp::Sub, x, kernels::logsumexp(x, n), out + r * n, n, false);
+  });
+}
+
+// dx += y * (dy - dot(y, dy)) for softmax outputs y.
+inline void backward(size_t rows, size_t n, const float* y, const float* dy, float* dx) {
+  for_each_row(rows, n, [&](size_t r) {
+    const size_t o = r * n;
+    kernels::softmax_grad(y + o, dy + o, kernels::dot(y + o, dy + o, n), dx + o, n);
+  });
+}
+
+// dx += dy - exp(y) * sum(dy) for log-softmax outputs y.
+inline void log_backward(size_t rows, size_t n, const float* y, const float* dy, float* dx) {
+  for_each_row(rows, n, [&](size_t r) {
+    const size_t o = r * n;
+    kernels::binary(kernels::BinaryOp::Add, dx + o, dy + o, dx + o, n);
+    kernels::add_exp_shifted(y + o, 0.0f, -kernels::sum(dy + o, n), dx + o, n);
+  });
+}
+
+// Class index held by a label, checked against n classes.
+inline size_t label_index(float label, size_t n) {
+  if (!(label >= 0.0f && label < static_cast<float>(n)) || label != std::floor(label)) {
+    throw std::invalid_argument("Cross-entropy labels must be class indices in [0, classes)");
+  }
+  return static_cast<size_t>(label);
+}
+
+// loss[r] = lse(row r) - logits[r, labels[r]]; lse[r] keeps the log-sum-exp
+// for cross_entropy_backward().
+inline void cross_entropy(size_t rows, size_t n, const float* logits, const float* labels, float* lse,
+                          float* loss) {
+  for (size_t r = 0; r < rows; r++) {
+    label_index(labels[r], n);
+  }
+  for_each_row(rows, n, [&](size_t r) {
+    const float* x = logits + r * n;
+    lse[r] = kernels::logsumexp(x, n);
+    loss[r] = lse[r] - x[static_cast<size_t>(labels[r])];
+  });
+}
+
+// dx += scale * (softmax(row) - onehot(label)), with scale the gradient of
+// each row's loss.
+inline void cross_entropy_backward(size_t rows, size_t n, const float* logits, const float* labels,
+                                   const float* lse, float scale, float* dx) {
+  for_each_row(rows, n, [&](size_t r) {
+    const size_t o = r * n;
+    kernels::add_exp_shifted(logits + o, lse[r], scale, dx + o, n);
+    dx[o + static_cast<size_t>(labels[r])] -= scale;
+  });
+}
+
+}  // namespace softmax
+}  // namespace upsilon
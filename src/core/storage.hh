@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "allocator.hh"
+
+namespace upsilon {
+
+// Borrowed, non-owning view of a contiguous range of elements, in the
+// spirit of std::span.
+template <typename T>
+class Span {
+public:
+  Span() = default;
+
+  Span(T* data, size_t size) : data_(data), size_(size) {}
+
+  T* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  T& operator[](size_t i) const { return data_[i]; }
+
+  T* begin() const { return data_; }
+
+  T* end() const { return data_ + size_; }
+
+private:
+  T* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Counters for element buffers, so tests and benchmarks can check that a code
+// path does not allocate or copy more than it should.
+struct StorageStats {
+  uint64_t allocations = 0;  // buffers allocated
+  uint64_t copies = 0;       // buffers filled from another buffer
+};
+
+namespace detail {
+
+inline std::atomic<uint64_t> buffer_allocations{0};
+inline std::atomic<uint64_t> buffer_copies{0};
+
+inline void record_allocation() {
+  buffer_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void record_copy() {
+  buffer_copies.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace detail
+
+inline StorageStats storage_stats() {
+  return {detail::buffer_allocations.load(std::memory_order_relaxed),
+          detail::buffer_copies.load(std::memory_order_relaxed)};
+}
+
+inline void reset_storage_stats() {
+  detail::buffer_allocations.store(0, std::memory_order_relaxed);
+  detail::buffer_copies.store(0, std::memory_order_relaxed);
+}
+
+// Reference-counted, copy-on-write element buffer. A tensor and every view
+// taken from it hold the same Storage, so views never copy and always alias.
+// Copying a Storage shares the underlying buffer until one side writes
+// through mutable_data(), which then clones it.
+//
+// Buffers come zero-filled from the calling thread's current_allocator()
+// and go back to the allocator they came from. An empty storage holds no
+// buffer at all.
+template <typename T>
+class Storage {
+public:
+  explicit Storage(size_t n) : buffer_(n == 0 ? nullptr : allocate(n)), size_(n) {
+    std::fill_n(buffer_.get(), n, T());
+  }
+
+  // Adopts n elements that live elsewhere, e.g. in a memory-mapped file,
+  // without copying; buffer's deleter keeps that memory alive. Writes follow
+  // the usual copy-on-write rules.
+  Storage(std::shared_ptr<T> buffer, size_t n) : buffer_(std::move(buffer)), size_(n) {}
+
+  Storage(const Storage& other) : buffer_(other.buffer_), size_(other.size_) {}
+
+  Storage& operator=(const Storage&) = delete;
+
+  size_t size() const { return size_; }
+
+  const T* data() const { return buffer_.get(); }
+
+  T* mutable_data() {
+    if (buffer_.use_count() > 1) {
+      std::shared_ptr<T> copy = allocate(size_);
+      std::copy_n(buffer_.get(), size_, copy.get());
+      buffer_ = std::move(copy);
+      detail::record_copy();
+    }
+    return buffer_.get();
+  }
+
+  bool shares_buffer_with(const Storage& other) const {
+    return buffer_ != nullptr && buffer_ == other.buffer_;
+  }
+
+private:
+  static std::shared_ptr<T> allocate(size_t n) {
+    std::shared_ptr<Allocator> allocator = current_allocator();
+    const size_t bytes = n * sizeof(T);
+    T* p = static_cast<T*>(allocator->allocate(bytes));
+    detail::record_allocation();
+    return std::shared_ptr<T>(p, [allocator = std::move(allocator), bytes](T* q) { allocator->deallocate(q, bytes); });
+  }
+
+  std::shared_ptr<T> buffer_;
+  size_t size_;
+};
+
+namespace detail {
+
+inline size_t numel(const std::vector<uint32_t>& shape) {
+  size_t n = 1;
+  for (auto d : shape) {
+    n *= d;
+  }
+  return n;
+}
+
+// Row-major strides, in elements.
+inline std::vector<int64_t> contiguous_strides(const std::vector<uint32_t>& shape) {
+  std::vector<int64_t> strides(shape.size());
+  int64_t stride = 1;
+  for (size_t i = shape.size(); i-- > 0;) {
+    strides[i] = stride;
+    stride *= shape[i];
+  }
+  return strides;
+}
+
+inline bool is_contiguous(const std::vector<uint32_t>& shape, const std::vector<int64_t>& strides) {
+  int64_t stride = 1;
+  for (size_t i = shape.size(); i-- > 0;) {
+    if (shape[i] != 1 && strides[i] != stride) {
+      return false;
+    }
+    stride *= shape[i];
+  }
+  return true;
+}
+
+// NumPy broadcasting: shapes are aligned at their last dimension and each
+// pair of sizes must match or contain a 1.
+inline std::vector<uint32_t> broadcast_shape(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+  std::vector<uint32_t> shape(std::max(a.size(), b.size()));
+  for (size_t i = 0; i < shape.size(); i++) {
+    const uint32_t x = i < a.size() ? a[a.size() - 1 - i] : 1;
+    const uint32_t y = i < b.size() ? b[b.size() - 1 - i] : 1;
+    if (x != y && x != 1 && y != 1) {
+      throw std::invalid_argument("Shapes cannot be broadcast together");
+    }
+    shape[shape.size() - 1 - i] = x == 1 ? y : x;
+  }
+  return shape;
+}
+
+// Walks N operands that share a logical shape but have their own strides and
+// offsets, in row-major order. f(offsets, inner_strides, n) is called once per
+// innermost row, so the caller's loop over a row is a plain strided loop.
+template <size_t N, typename F>
+void for_each_row(const std::vector<uint32_t>& shape,
+                  const std::array<const std::vector<int64_t>*, N>& strides,
+                  std::array<int64_t, N> offsets, F&& f) {
+  const size_t ndim = shape.size();
+  std::array<int64_t, N> inner{};
+
+  if (ndim == 0) {
+    f(offsets, inner, 1u);
+    return;
+  }
+  if (numel(shape) == 0) {
+    return;
+  }
+
+  for (size_t k = 0; k < N; k++) {
+    inner[k] = (*strides[k])[ndim - 1];
+  }
+
+  std::vector<uint32_t> index(ndim - 1, 0);
+  for (;;) {
+    f(offsets, inner, shape[ndim - 1]);
+
+    size_t d = ndim - 1;
+    for (;;) {
+      if (d == 0) {
+        return;
+      }
+      --d;
+      if (++index[d] < shape[d]) {
+        for (size_t k = 0; k < N; k++) {
+          offsets[k] += (*strides[k])[d];
+        }
+        break;
+      }
+      for (size_t k = 0; k < N; k++) {
+        offsets[k] -= (*strides[k])[d] * (shape[d] - 1);
+      }
+      index[d] = 0;
+    }
+  }
+}
+
+}  // namespace detail
+
+}  // namespace upsilon
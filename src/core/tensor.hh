@@ -1,11 +1,21 @@
 #pragma once
 #include <unsupported/Eigen/CXX11/Tensor>
 #include <Eigen/Dense>
-#include <functional>
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include <numeric>
 #include <iostream>
+#include "gemm.hh"
+#include "half.hh"
+#include "kernels.hh"
+#include "quant.hh"
+#include "storage.hh"
+#include "thread_pool.hh"
 
 namespace upsilon {
 
@@ -15,6 +25,18 @@ enum class TensorType {
     Tensor
 };
 
+// Reductions along one dimension; see Tensor<float>::reduce(). ArgMax and
+// ArgMin give the index of the first extreme value.
+enum class Reduction {
+  Sum,
+  Mean,
+  Max,
+  Min,
+  ArgMax,
+  ArgMin,
+  L2Norm
+};
+
 template<typename T>
 using ScalarData = T;
 
@@ -24,81 +46,657 @@ using MatrixData = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMa
 template<typename T>
 using TensorData = Eigen::Tensor<T, 3, Eigen::RowMajor>;
 
-template<typename T>
-using UnifiedData = std::variant<ScalarData<T>, MatrixData<T>, TensorData<T>>;
-
+// Tensor<float> is the compute type. Tensor<bf16> and Tensor<fp16> (the
+// primary template below) store 16-bit floats, and Tensor<uint8_t> quantized
+// values; all three are defined after Tensor<float>.
 template <typename T = float>
-class Tensor {};
+class Tensor;
 
 template <>
-class Tensor<uint8_t> {
-};
+class Tensor<uint8_t>;
 
+// An N-d view (shape, strides, offset) over a shared contiguous Storage.
+// view(), slice(), chip(), permute() and transposed() return aliases of the
+// same storage. Copying a Tensor is O(1): the copy shares the buffer until
+// either side is written to, at which point the writer clones it.
 template <>
 class Tensor<float> {
 private:
-  std::vector<uint32_t> raw_shape_;
-  TensorType type_;
-  UnifiedData<float> raw_data_;
+  std::vector<uint32_t> shape_;
+  std::vector<int64_t> strides_;
+  int64_t offset_ = 0;
+  std::shared_ptr<Storage<float>> storage_;
+  bool placed_ = false;  // see place_()
+
+  template <typename T>
+  friend class Tensor;
+
+  using ConstStridedMap = Eigen::Map<const MatrixData<float>, Eigen::Unaligned, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+
+  explicit Tensor(const std::vector<uint32_t>& shape, std::vector<int64_t> strides, int64_t offset,
+                  std::shared_ptr<Storage<float>> storage)
+      : shape_(shape), strides_(std::move(strides)), offset_(offset), storage_(std::move(storage)) {}
+
+  static Tensor<float> empty(const std::vector<uint32_t>& shape) {
+    return Tensor<float>(shape, detail::contiguous_strides(shape), 0,
+                         std::make_shared<Storage<float>>(detail::numel(shape)));
+  }
+
+  const float* base() const { return storage_->data() + offset_; }
+
+  // Detaches from other copies of the buffer before handing out a pointer.
+  float* mutable_base() { return storage_->mutable_data() + offset_; }
+
+  // Reduction r of a[0, n) before the final scaling of Mean and L2Norm;
+  // index receives the position for ArgMax and ArgMin.
+  static float reduce_row(Reduction r, const float* a, size_t n, size_t& index) {
+    switch (r) {
+      case Reduction::Sum:
+      case Reduction::Mean:
+        return kernels::sum(a, n);
+      case Reduction::Max:
+        return kernels::reduce_max(a, n);
+      case Reduction::Min:
+        return kernels::reduce_min(a, n);
+      case Reduction::ArgMax:
+        index = kernels::argmax(a, n);
+        return a[index];
+      case Reduction::ArgMin:
+        index = kernels::argmin(a, n);
+        return a[index];
+      default:
+        return kernels::sum_squares(a, n);
+    }
+  }
+
+  // Combines the partial result b of a later block into a.
+  static void combine_partial(Reduction r, float& a, size_t& a_index, float b, size_t b_index) {
+    switch (r) {
+      case Reduction::Max:
+        a = std::max(a, b);
+        break;
+      case Reduction::Min:
+        a = std::min(a, b);
+        break;
+      case Reduction::ArgMax:
+      case Reduction::ArgMin:
+        if (r == Reduction::ArgMax ? b > a : b < a) {
+          a = b;
+          a_index = b_index;
+        }
+        break;
+      default:
+        a += b;
+        break;
+    }
+  }
+
+  // The output value of a row of n elements reduced to value.
+  static float finish_row(Reduction r, float value, size_t index, size_t n) {
+    switch (r) {
+      case Reduction::Mean:
+        return value / static_cast<float>(n);
+      case Reduction::ArgMax:
+      case Reduction::ArgMin:
+        return static_cast<float>(index);
+      case Reduction::L2Norm:
+        return std::sqrt(value);
+      default:
+        return value;
+    }
+  }
+
+  // reduce() into out, a contiguous tensor of the reduced size.
+  void reduce_into(Reduction r, uint32_t axis, Tensor<float>& out) const {
+    const size_t len = shape_[axis];
+    if (len == 0) {
+      throw std::invalid_argument("Cannot reduce an empty dimension");
+    }
+    size_t outer = 1, inner = 1;
+    for (size_t d = 0; d < axis; d++) {
+      outer *= shape_[d];
+    }
+    for (size_t d = axis + 1; d < shape_.size(); d++) {
+      inner *= shape_[d];
+    }
+    const Tensor<float> packed = contiguous();
+    const float* in = packed.base();
+    float* dst = out.mutable_base();
+
+    if (inner == 1) {
+      if (len <= kParallelGrain) {
+        parallel_for(outer, row_grain(len), [&](size_t begin, size_t end) {
+          for (size_t o = begin; o < end; o++) {
+            size_t index = 0;
+            const float value = reduce_row(r, in + o * len, len, index);
+            dst[o] = finish_row(r, value, index, len);
+          }
+        });
+        return;
+      }
+      const size_t blocks = (len + kParallelGrain - 1) / kParallelGrain;
+      std::vector<float> partial(outer * blocks);
+      std::vector<size_t> partial_index(outer * blocks);
+      parallel_for(outer * blocks, 1, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+          const size_t first = t % blocks * kParallelGrain;
+          size_t index = 0;
+          partial[t] = reduce_row(r, in + t / blocks * len + first, std::min(kParallelGrain, len - first), index);
+          partial_index[t] = first + index;
+        }
+      });
+      for (size_t o = 0; o < outer; o++) {
+        float value = partial[o * blocks];
+        size_t index = partial_index[o * blocks];
+        for (size_t b = 1; b < blocks; b++) {
+          combine_partial(r, value, index, partial[o * blocks + b], partial_index[o * blocks + b]);
+        }
+        dst[o] = finish_row(r, value, index, len);
+      }
+      return;
+    }
+
+    // Columns per task: long enough runs of each row to stream well, with
+    // the accumulators still in L1.
+    const size_t width = std::min<size_t>(inner, 2048);
+    const size_t column_blocks = (inner + width - 1) / width;
+    const bool arg = r == Reduction::ArgMax || r == Reduction::ArgMin;
+    parallel_for(outer * column_blocks, 1, [&](size_t begin, size_t end) {
+      thread_local std::vector<float> best;
+      for (size_t t = begin; t < end; t++) {
+        const size_t o = t / column_blocks, j0 = t % column_blocks * width, n = std::min(width, inner - j0);
+        const float* src = in + o * len * inner + j0;
+        float* acc = dst + o * inner + j0;
+        if (arg) {
+          best.assign(src, src + n);
+          std::fill(acc, acc + n, 0.0f);
+          for (size_t k = 1; k < len; k++) {
+            kernels::arg_update(r == Reduction::ArgMax, best.data(), acc, src + k * inner, static_cast<float>(k), n);
+          }
+          continue;
+        }
+        if (r == Reduction::L2Norm) {
+          std::fill(acc, acc + n, 0.0f);
+          for (size_t k = 0; k < len; k++) {
+            kernels::add_squares(acc, src + k * inner, n);
+          }
+          for (size_t j = 0; j < n; j++) {
+            acc[j] = std::sqrt(acc[j]);
+          }
+          continue;
+        }
+        const kernels::BinaryOp op = r == Reduction::Max   ? kernels::BinaryOp::Max
+                                     : r == Reduction::Min ? kernels::BinaryOp::Min
+                                                           : kernels::BinaryOp::Add;
+        std::copy(src, src + n, acc);
+        for (size_t k = 1; k < len; k++) {
+          kernels::binary(op, acc, src + k * inner, acc, n);
+        }
+        if (r == Reduction::Mean) {
+          kernels::binary_scalar(kernels::BinaryOp::Div, acc, static_cast<float>(len), acc, n, false);
+        }
+      }
+    });
+  }
+
+  // Offset of logical row-major index i.
+  int64_t offset_of(uint32_t i) const {
+    int64_t offset = 0;
+    for (size_t d = shape_.size(); d-- > 0;) {
+      offset += static_cast<int64_t>(i % shape_[d]) * strides_[d];
+      i /= shape_[d];
+    }
+    return offset;
+  }
+
+  // Offset of (channel, row, col), where channel runs over every dimension
+  // in front of the last two.
+  int64_t offset_of(uint32_t channel, uint32_t row, uint32_t col) const {
+    if (channel >= channels() || row >= rows() || col >= cols()) {
+      throw std::invalid_argument("Index out of range");
+    }
+
+    const size_t ndim = shape_.size();
+    if (ndim == 0) {
+      return 0;
+    }
+    if (ndim == 1) {
+      return col * strides_[0];
+    }
+
+    int64_t offset = row * strides_[ndim - 2] + col * strides_[ndim - 1];
+    for (size_t d = ndim - 2; d-- > 0;) {
+      offset += static_cast<int64_t>(channel % shape_[d]) * strides_[d];
+      channel /= shape_[d];
+    }
+    return offset;
+  }
+
+  ConstStridedMap matrix_map() const {
+    return ConstStridedMap(base(), rows(), cols(),
+                           Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(strides_[0], strides_[1]));
+  }
+
+  // True if no view shares this tensor's storage and the whole buffer, which
+  // holds exactly n elements, can be rewritten from scratch.
+  bool owns_buffer_of(size_t n) const {
+    return storage_.use_count() == 1 && offset_ == 0 && storage_->size() == n;
+  }
+
+  // detail::for_each_row with the first dimension split across the thread
+  // pool. Rows may be visited in any order.
+  template <size_t N, typename F>
+  static void parallel_for_each_row(const std::vector<uint32_t>& shape,
+                                    const std::array<const std::vector<int64_t>*, N>& strides,
+                                    const std::array<int64_t, N>& offsets, F&& f) {
+    const size_t n = detail::numel(shape);
+    if (shape.empty() || n <= kParallelGrain) {
+      detail::for_each_row<N>(shape, strides, offsets, f);
+      return;
+    }
+    const size_t inner = n / shape[0];
+    parallel_for(shape[0], row_grain(inner), [&](size_t begin, size_t end) {
+      std::vector<uint32_t> part = shape;
+      part[0] = static_cast<uint32_t>(end - begin);
+      std::array<int64_t, N> start = offsets;
+      for (size_t k = 0; k < N; k++) {
+        start[k] += static_cast<int64_t>(begin) * (*strides[k])[0];
+      }
+      detail::for_each_row<N>(part, strides, start, f);
+    });
+  }
+
+  // One row of a binary op. An operand with stride 0 along the row is a
+  // broadcast scalar and gets its own vectorized loop.
+  static void binary_row(kernels::BinaryOp op, const float* a, int64_t a_inc, const float* b, int64_t b_inc,
+                         float* out, int64_t out_inc, uint32_t n) {
+    if (out_inc == 1) {
+      if (a_inc == 1 && b_inc == 1) {
+        return kernels::binary(op, a, b, out, n);
+      }
+      if (a_inc == 1 && b_inc == 0) {
+        return kernels::binary_scalar(op, a, *b, out, n, false);
+      }
+      if (a_inc == 0 && b_inc == 1) {
+        return kernels::binary_scalar(op, b, *a, out, n, true);
+      }
+    }
+    kernels::binary_strided(op, a, a_inc, b, b_inc, out, out_inc, n);
+  }
+
+  // out = this op other, with both operands broadcast to out's shape through
+  // stride-0 views; nothing is tiled. Runs the SIMD kernel over whole
+  // contiguous buffers, or row by row otherwise, split across the thread pool
+  // either way.
+  void elementwise_into(const Tensor<float>& other, Tensor<float>& out, kernels::BinaryOp op) const {
+    float* dst = out.mutable_base();
+    const float* a = base();
+    const float* b = other.base();
+    if (shape_ == out.shape_ && other.shape_ == out.shape_ && is_contiguous() && other.is_contiguous() &&
+        out.is_contiguous()) {
+      parallel_for(out.size(), kParallelGrain, [&](size_t begin, size_t end) {
+        kernels::binary(op, a + begin, b + begin, dst + begin, end - begin);
+      });
+      return;
+    }
+
+    const Tensor<float> lhs = broadcast_to(out.shape_);
+    const Tensor<float> rhs = other.broadcast_to(out.shape_);
+    parallel_for_each_row<3>(out.shape_, {&lhs.strides_, &rhs.strides_, &out.strides_},
+                             {0, 0, 0}, [&](const auto& off, const auto& inc, uint32_t n) {
+      binary_row(op, a + off[0], inc[0], b + off[1], inc[1], dst + off[2], inc[2], n);
+    });
+  }
+
+  Tensor<float> elementwise(const Tensor<float>& other, kernels::BinaryOp op) const {
+    Tensor<float> result = empty(detail::broadcast_shape(shape_, other.shape_));
+    elementwise_into(other, result, op);
+    return result;
+  }
+
+  Tensor<float>& elementwise(const Tensor<float>& other, Tensor<float>& out, kernels::BinaryOp op) const {
+    std::vector<uint32_t> shape = detail::broadcast_shape(shape_, other.shape_);
+    if ((&out == this || &out == &other) &&
+        (out.shape_ != shape || !out.is_contiguous() || !out.owns_buffer_of(out.size()))) {
+      // Resizing out would drop an operand's elements before they are read.
+      out = elementwise(other, op);
+      return out;
+    }
+    out.resize_(shape);
+    elementwise_into(other, out, op);
+    return out;
+  }
+
+  // this = this op other, through this tensor's own layout, with other
+  // broadcast to this tensor's shape.
+  Tensor<float>& elementwise_(const Tensor<float>& other, kernels::BinaryOp op) {
+    if (other.shape_ != shape_ && detail::broadcast_shape(shape_, other.shape_) != shape_) {
+      throw std::invalid_argument("In-place operand must broadcast to the tensor's shape");
+    }
+    elementwise_into(other, *this, op);
+    return *this;
+  }
+
+  // this = this op e for a lazy expression of the same shape.
+  template <typename Op, typename E>
+  Tensor<float>& update_(const expr::Expr<E>& e, kernels::BinaryOp op) {
+    const std::vector<uint32_t>* shape = expr::shape_of(e.self());
+    if (shape != nullptr && *shape != shape_) {
+      throw std::invalid_argument("In-place operation requires same shape");
+    }
+    if (!is_contiguous()) {
+      return elementwise_(Tensor<float>(e), op);
+    }
+    float* out = mutable_base();
+    const expr::Binary<Op, expr::Ref, E> update(expr::Ref(out, &shape_), e.self());
+    parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+      kernels::evaluate(update, out, begin, end);
+    });
+    return *this;
+  }
+
+  // Leading (batch) dimensions of a matmul operand, i.e. all but the last two.
+  std::vector<uint32_t> batch_shape() const {
+    return std::vector<uint32_t>(shape_.begin(), shape_.end() - 2);
+  }
+
+  // Shape of this.matmul(other), whose batch dimensions broadcast.
+  std::vector<uint32_t> matmul_shape(const Tensor<float>& other) const {
+    if (ndim() < 2 || other.ndim() < 2) {
+      throw std::invalid_argument("Matrix multiplication requires 2D matrix");
+    }
+
+    if (cols() != other.rows()) {
+      throw std::invalid_argument("Matrix multiplication requires the number of columns of the first matrix to be equal to the number of rows of the second matrix");
+    }
+
+    std::vector<uint32_t> shape = detail::broadcast_shape(batch_shape(), other.batch_shape());
+    shape.push_back(rows());
+    shape.push_back(other.cols());
+    return shape;
+  }
+
+  // 2-D alias of matrix `channel` of a (batch..., rows, cols) tensor.
+  Tensor<float> matrix_at(uint32_t channel) const {
+    const size_t r = shape_.size() - 2;
+    int64_t offset = offset_;
+    for (size_t d = r; d-- > 0;) {
+      offset += static_cast<int64_t>(channel % shape_[d]) * strides_[d];
+      channel /= shape_[d];
+    }
+    return Tensor<float>({shape_[r], shape_[r + 1]}, {strides_[r], strides_[r + 1]}, offset, storage_);
+  }
+
+  // 2-D alias with the batch dimensions folded into the rows (dim 0) or the
+  // columns (dim 1), e.g. a contiguous (C, R, K) tensor as a (C * R, K)
+  // matrix. Returns false when the strides do not line up.
+  bool fold_batch(size_t dim, Tensor<float>& folded) const {
+    const size_t r = shape_.size() - 2;
+    uint32_t extent = shape_[r + dim];
+    int64_t next = strides_[r + dim] * shape_[r + dim];
+    for (size_t d = r; d-- > 0;) {
+      if (shape_[d] == 1) {
+        continue;
+      }
+      if (strides_[d] != next) {
+        return false;
+      }
+      next = strides_[d] * shape_[d];
+      extent *= shape_[d];
+    }
+
+    std::vector<uint32_t> shape = {shape_[r], shape_[r + 1]};
+    shape[dim] = extent;
+    folded = Tensor<float>(shape, {strides_[r], strides_[r + 1]}, offset_, storage_);
+    return true;
+  }
+
+  // this = beta * this + a * b for 2-D operands, read through their strides
+  // (see gemm.hh), so transposed views are multiplied without a copy.
+  void gemm_(const Tensor<float>& a, const Tensor<float>& b, float beta) {
+    float* out = mutable_base();
+    gemm::gemm_strided(a.rows(), b.cols(), a.cols(), 1.0f, a.base(), a.strides_[0], a.strides_[1], b.base(),
+                       b.strides_[0], b.strides_[1], beta, out, strides_[0], strides_[1]);
+  }
 
  public:
-  TensorType type() const { return type_; }
-  
-  explicit Tensor(const TensorType type, const std::vector<uint32_t>& shape) : type_(type) {
+  TensorType type() const {
+    if (shape_.empty()) {
+      return TensorType::Scalar;
+    }
+    return shape_.size() <= 2 ? TensorType::Matrix : TensorType::Tensor;
+  }
+
+  explicit Tensor(const TensorType type, const std::vector<uint32_t>& shape) {
     if (type == TensorType::Scalar) {
-      raw_data_ = ScalarData<float>(0);
-      raw_shape_ = {1, 1, 1};
+      shape_ = {};
     } else if (type == TensorType::Matrix) {
-      raw_data_ = MatrixData<float>(shape[0], shape[1]);
-      raw_shape_ = {1, shape[0], shape[1]};
+      if (shape.size() != 2) {
+        throw std::invalid_argument("Matrix requires a 2D shape");
+      }
+      shape_ = shape;
     } else if (type == TensorType::Tensor) {
-      raw_data_ = TensorData<float>(shape[0], shape[1], shape[2]);
-      raw_shape_ = shape;
+      if (shape.size() < 3) {
+        throw std::invalid_argument("Tensor requires at least a 3D shape");
+      }
+      shape_ = shape;
     } else {
       throw std::invalid_argument("Invalid tensor type");
     }
+    strides_ = detail::contiguous_strides(shape_);
+    storage_ = std::make_shared<Storage<float>>(detail::numel(shape_));
   }
 
-  explicit Tensor(const ScalarData<float>& data) : type_(TensorType::Scalar), raw_data_(data) {
-    raw_shape_ = {1, 1, 1};
+  explicit Tensor(const ScalarData<float>& data) : Tensor(TensorType::Scalar, {}) {
+    storage_->mutable_data()[0] = data;
   }
 
-  explicit Tensor(const std::vector<uint32_t>& data, bool row_vector = true) : type_(TensorType::Matrix) {
-    if (row_vector) {
-      raw_shape_ = {1, 1, static_cast<uint32_t>(data.size())};
-      raw_data_ = MatrixData<float>(1, data.size());
-    } else {
-      raw_shape_ = {1, static_cast<uint32_t>(data.size()), 1,};
-      raw_data_ = MatrixData<float>(data.size(), 1);
+  explicit Tensor(const std::vector<uint32_t>& data, bool row_vector = true)
+      : Tensor(TensorType::Matrix, row_vector ? std::vector<uint32_t>{1, static_cast<uint32_t>(data.size())}
+                                              : std::vector<uint32_t>{static_cast<uint32_t>(data.size()), 1}) {
+    std::copy(data.begin(), data.end(), storage_->mutable_data());
+  }
+
+  explicit Tensor(const MatrixData<float>& data)
+      : Tensor(TensorType::Matrix, {static_cast<uint32_t>(data.rows()), static_cast<uint32_t>(data.cols())}) {
+    std::copy(data.data(), data.data() + data.size(), storage_->mutable_data());
+  }
+
+  explicit Tensor(const TensorData<float>& data)
+      : Tensor(TensorType::Tensor, {static_cast<uint32_t>(data.dimension(0)), static_cast<uint32_t>(data.dimension(1)), static_cast<uint32_t>(data.dimension(2))}) {
+    std::copy(data.data(), data.data() + data.size(), storage_->mutable_data());
+  }
+
+  // Evaluates a lazy expression (see expr.hh) in one fused pass.
+  template <typename E>
+  Tensor(const expr::Expr<E>& e) {
+    const std::vector<uint32_t>* shape = expr::shape_of(e.self());
+    if (shape == nullptr) {
+      throw std::invalid_argument("Expression requires at least one tensor operand");
+    }
+    *this = empty(*shape);
+    float* out = mutable_base();
+    parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+      kernels::evaluate(e.self(), out, begin, end);
+    });
+  }
+
+  Tensor(const Tensor<float>& other)
+      : shape_(other.shape_), strides_(other.strides_), offset_(other.offset_),
+        storage_(std::make_shared<Storage<float>>(*other.storage_)) {}
+
+  Tensor(Tensor<float>&& other) noexcept = default;
+
+  Tensor<float>& operator=(const Tensor<float>& other) {
+    if (this != &other) {
+      *this = Tensor<float>(other);
+    }
+    return *this;
+  }
+
+  Tensor<float>& operator=(Tensor<float>&& other) noexcept = default;
+
+  // Evaluates e into this tensor's own buffer when nothing else can observe
+  // it (no views, same element count), so repeated assignments of the same
+  // shape do not allocate. Otherwise behaves like assigning Tensor<float>(e).
+  template <typename E>
+  Tensor<float>& operator=(const expr::Expr<E>& e) {
+    const std::vector<uint32_t>* shape = expr::shape_of(e.self());
+    if (shape == nullptr) {
+      throw std::invalid_argument("Expression requires at least one tensor operand");
+    }
+    if (placed_ && *shape == shape_) {
+      float* out = mutable_base();
+      parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+        kernels::evaluate(e.self(), out, begin, end);
+      });
+      return *this;
+    }
+    if (!owns_buffer_of(detail::numel(*shape))) {
+      return *this = Tensor<float>(e);
     }
+    if (shape != &shape_) {
+      shape_ = *shape;
+    }
+    strides_ = detail::contiguous_strides(shape_);
+    float* out = mutable_base();
+    parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+      kernels::evaluate(e.self(), out, begin, end);
+    });
+    return *this;
+  }
 
-    for (uint32_t i = 0; i < data.size(); i++) {
-      std::get<MatrixData<float>>(raw_data_)(i, 0) = data[i];
+  // Gives this tensor the given shape and a contiguous layout, keeping its
+  // buffer when it is the sole owner of one of the right size (or was placed
+  // with that shape) and allocating a zeroed one otherwise. Element values
+  // are unspecified afterwards.
+  Tensor<float>& resize_(const std::vector<uint32_t>& shape) {
+    if (placed_ && shape == shape_) {
+      return *this;
     }
+    placed_ = false;
+    if (!owns_buffer_of(detail::numel(shape))) {
+      *this = empty(shape);
+      return *this;
+    }
+    shape_ = shape;
+    strides_ = detail::contiguous_strides(shape_);
+    return *this;
+  }
+
+  Tensor<float>& resize_as_(const Tensor<float>& other) {
+    return resize_(other.shape_);
   }
 
-  explicit Tensor(const MatrixData<float>& data) : type_(TensorType::Matrix), raw_data_(data) {
-    raw_shape_ = {1, static_cast<uint32_t>(data.rows()), static_cast<uint32_t>(data.cols())};
+  // Borrowed view of the elements; no copy is made. Only contiguous tensors
+  // have a flat element range, so call contiguous() first on strided views.
+  Span<const float> data() const {
+    if (!is_contiguous()) {
+      throw std::invalid_argument("data() requires a contiguous tensor");
+    }
+    return Span<const float>(base(), size());
   }
 
-  explicit Tensor(const TensorData<float>& data) : type_(TensorType::Tensor), raw_data_(data) {
-    raw_shape_ = {static_cast<uint32_t>(data.dimension(0)), static_cast<uint32_t>(data.dimension(1)), static_cast<uint32_t>(data.dimension(2))};
+  Span<float> mutable_data() {
+    if (!is_contiguous()) {
+      throw std::invalid_argument("mutable_data() requires a contiguous tensor");
+    }
+    return Span<float>(mutable_base(), size());
   }
 
-  UnifiedData<float> data() const {
-    return raw_data_;
+  // Operand handle for building lazy expressions, e.g.
+  //   Tensor<float> y = x.lazy() * (1.0f - x.lazy());
+  // The expression refers to this tensor's storage until it is evaluated.
+  expr::Ref lazy() const {
+    if (!is_contiguous()) {
+      throw std::invalid_argument("lazy() requires a contiguous tensor");
+    }
+    return expr::Ref(base(), &shape_);
   }
 
-  void fill(float value) {
-    if (type_ == TensorType::Scalar) {
-      std::get<ScalarData<float>>(raw_data_) = value;
-    } else if (type_ == TensorType::Matrix) {
-      std::get<MatrixData<float>>(raw_data_).fill(value);
-    } else if (type_ == TensorType::Tensor) {
-      std::get<TensorData<float>>(raw_data_).setConstant(value);
-    } else {
-      throw std::invalid_argument("Invalid tensor type");
+  // A contiguous tensor of the given shape over storage holding exactly its
+  // elements. No copy is made.
+  static Tensor<float> wrap(std::shared_ptr<Storage<float>> storage, const std::vector<uint32_t>& shape) {
+    if (storage->size() != detail::numel(shape)) {
+      throw std::invalid_argument("Storage size does not match the shape");
+    }
+    return Tensor<float>(shape, detail::contiguous_strides(shape), 0, std::move(storage));
+  }
+
+  // True if dropping this tensor frees its buffer: it is contiguous, was not
+  // placed into another tensor and no view shares its storage.
+  bool sole_owner() const {
+    return !placed_ && is_contiguous() && owns_buffer_of(size());
+  }
+
+  // Drops the buffer, leaving an empty 1-d tensor.
+  Tensor<float>& release_() {
+    *this = empty({0});
+    return *this;
+  }
+
+  // True if both tensors currently read the same element buffer.
+  bool shares_storage(const Tensor<float>& other) const {
+    return storage_->shares_buffer_with(*other.storage_);
+  }
+
+  // True if both tensors are the same view of the same storage, so writing
+  // through one is seen by the other.
+  bool aliases(const Tensor<float>& other) const {
+    return storage_ == other.storage_ && offset_ == other.offset_ && shape_ == other.shape_ &&
+           strides_ == other.strides_;
+  }
+
+  // Turns this tensor into region, a contiguous view into another tensor's
+  // buffer, and keeps it there: until its shape changes, resize_() and
+  // expression assignment write into region instead of reallocating. This
+  // lets an op produce its output straight inside a consumer's buffer (see
+  // Concat). Copies of a placed tensor are ordinary tensors.
+  void place_(const Tensor<float>& region) {
+    if (!region.is_contiguous()) {
+      throw std::invalid_argument("place_ requires a contiguous region");
+    }
+    *this = Tensor<float>(region.shape_, region.strides_, region.offset_, region.storage_);
+    placed_ = true;
+  }
+
+  bool placed() const {
+    return placed_;
+  }
+
+  // this = src elementwise, through both layouts.
+  Tensor<float>& copy_(const Tensor<float>& src) {
+    if (src.shape_ != shape_) {
+      throw std::invalid_argument("copy_ requires same shape");
     }
+    detail::record_copy();
+    float* out = mutable_base();
+    const float* in = src.base();
+    parallel_for_each_row<2>(shape_, {&strides_, &src.strides_}, {0, 0},
+                             [&](const auto& off, const auto& inc, uint32_t n) {
+      if (inc[0] == 1 && inc[1] == 1) {
+        std::copy(in + off[1], in + off[1] + n, out + off[0]);
+        return;
+      }
+      for (uint32_t i = 0; i < n; i++) {
+        out[off[0] + i * inc[0]] = in[off[1] + i * inc[1]];
+      }
+    });
+    return *this;
+  }
+
+  void fill(float value) {
+    float* data = mutable_base();
+    parallel_for_each_row<1>(shape_, {&strides_}, {0}, [&](const auto& off, const auto& inc, uint32_t n) {
+      for (uint32_t i = 0; i < n; i++) {
+        data[off[0] + i * inc[0]] = value;
+      }
+    });
+  }
+
+  Tensor<float>& fill_(float value) {
+    fill(value);
+    return *this;
   }
 
   void fill(const std::vector<float>& values) {
@@ -106,55 +704,45 @@ private:
       throw std::invalid_argument("values size does not match tensor size");
     }
 
-    if (type_ == TensorType::Scalar) {
-      std::get<ScalarData<float>>(raw_data_) = values[0];
-    } else if (type_ == TensorType::Matrix) {
-      for (uint32_t i = 0; i < values.size(); i++) {
-        std::get<MatrixData<float>>(raw_data_).data()[i] = values[i];
+    float* data = mutable_base();
+    const float* src = values.data();
+    detail::for_each_row<1>(shape_, {&strides_}, {0}, [&](const auto& off, const auto& inc, uint32_t n) {
+      for (uint32_t i = 0; i < n; i++) {
+        data[off[0] + i * inc[0]] = *src++;
       }
-    } else if (type_ == TensorType::Tensor) {
-      for (uint32_t i = 0; i < values.size(); i++) {
-        std::get<TensorData<float>>(raw_data_).data()[i] = values[i];
-      }
-    } else {
-      throw std::invalid_argument("Invalid tensor type");
-    }
+    });
   }
 
   uint32_t size() const {
-    return raw_shape_[0] * raw_shape_[1] * raw_shape_[2];
+    return static_cast<uint32_t>(detail::numel(shape_));
   }
 
+  // Product of every dimension in front of rows and cols.
   uint32_t channels() const {
-    return raw_shape_[0];
+    uint32_t n = 1;
+    for (size_t d = 0; d + 2 < shape_.size(); d++) {
+      n *= shape_[d];
+    }
+    return n;
   }
 
   uint32_t rows() const {
-    return raw_shape_[1];
+    return shape_.size() >= 2 ? shape_[shape_.size() - 2] : 1;
   }
 
   uint32_t cols() const {
-      return raw_shape_[2];
+    return shape_.empty() ? 1 : shape_.back();
   }
 
   int ndim() const {
-    if (this->type() == TensorType::Scalar) {
-      return 0;
-    } else if (this->type() == TensorType::Matrix) {
-      return 2;
-    }
+    return static_cast<int>(shape_.size());
   }
 
   void show() const {
-    if (type_ == TensorType::Scalar) {
-      std::cout << std::get<ScalarData<float>>(raw_data_) << std::endl;
-    } else if (type_ == TensorType::Matrix) {
-      std::cout << std::get<MatrixData<float>>(raw_data_) << std::endl;
-    } else if (type_ == TensorType::Tensor) {
-      for(uint32_t c = 0; c < raw_shape_[0]; c++) {
-        std::cout << "Channel " << c << std::endl;
-        std::cout << std::get<TensorData<float>>(raw_data_).chip(c, 0) << std::endl;
-      }
+    if (type() == TensorType::Tensor) {
+      std::cout << *this;
+    } else {
+      std::cout << *this << std::endl;
     }
   }
 
@@ -163,145 +751,188 @@ private:
       return {1};
     }
 
-    if (this->type() == TensorType::Matrix) {
-      return {raw_shape_[1], raw_shape_[2]};
-    }
-
-    return raw_shape_;
+    return shape_;
   }
-    
-  void reshape(const std::vector<uint32_t>& new_shape) {
+
+  // Strides in elements, one per dimension of shape().
+  std::vector<int64_t> strides() const {
     if (this->type() == TensorType::Scalar) {
-      throw std::invalid_argument("Cannot reshape a scalar");
+      return {1};
     }
 
-    if (size() != std::accumulate(new_shape.begin(), new_shape.end(), 1, std::multiplies<uint32_t>())) {
-      throw std::invalid_argument("New shape must have the same number of elements");
+    return strides_;
+  }
+
+  bool is_contiguous() const {
+    return detail::is_contiguous(shape_, strides_);
+  }
+
+  // Packs the elements into a fresh row-major buffer.
+  Tensor<float> contiguous_copy() const {
+    Tensor<float> result = empty(shape_);
+    detail::record_copy();
+    float* out = result.mutable_base();
+    const float* in = base();
+    if (is_contiguous()) {
+      std::copy(in, in + size(), out);
+      return result;
     }
-    if (type_ == TensorType::Matrix) {
-      if (new_shape.size() == 2) {
-        using t = Eigen::Map<MatrixData<float>>;
-        uint32_t new_rows = new_shape[0];
-        uint32_t new_cols = new_shape[1];
-        t new_data(std::get<MatrixData<float>>(raw_data_).data(), new_rows, new_cols);
-        this->raw_data_ = new_data;
-        this->raw_shape_ = {1, new_rows, new_cols};
-        return;
-      } else if (new_shape.size() == 3) {
-        // type conversion to tensor
-        auto &matrix = std::get<MatrixData<float>>(raw_data_);
-        TensorData<float> new_data(new_shape[0], new_shape[1], new_shape[2]);
-        for (size_t i = 0; i < matrix.size(); i++) {
-          new_data.data()[i] = matrix.data()[i];
-        }
-        this->raw_data_ = new_data;
-        this->raw_shape_ = new_shape;
-        this->type_ = TensorType::Tensor;
-        return;
+    detail::for_each_row<1>(shape_, {&strides_}, {0}, [&](const auto& off, const auto& inc, uint32_t n) {
+      for (uint32_t i = 0; i < n; i++) {
+        *out++ = in[off[0] + i * inc[0]];
       }
+    });
+    return result;
+  }
 
-    } else if (type_ == TensorType::Tensor) {
-      if (new_shape.size() == 3) {
-        auto &tensor = std::get<TensorData<float>>(raw_data_);
-        raw_data_ = tensor.reshape(Eigen::array<Eigen::Index, 3>({new_shape[0], new_shape[1], new_shape[2]}));
-        this->raw_shape_ = new_shape;
-        return;
-      } else if (new_shape.size() == 2) {
-        // type conversion to matrix
-        auto &tensor = std::get<TensorData<float>>(raw_data_);
-        MatrixData<float> new_data(new_shape[0], new_shape[1]);
-        for (size_t i = 0; i < tensor.size(); i++) {
-          new_data.data()[i] = tensor.data()[i];
-        }
-        this->raw_data_ = new_data;
-        this->raw_shape_ = {1, new_shape[0], new_shape[1]};
-        this->type_ = TensorType::Matrix;
-        return;
-      }
+  // This tensor when already row-major, otherwise a packed copy.
+  Tensor<float> contiguous() const {
+    if (is_contiguous()) {
+      return Tensor<float>(shape_, strides_, offset_, storage_);
     }
-
-    throw std::invalid_argument("Invalid tensor type");
+    return contiguous_copy();
   }
 
-  Tensor<float> apply(const std::function<float(float)>& f) const {
-    if (type_ == TensorType::Scalar) {
-      Tensor<float> ret({1});
-      ret.at(0) = f(std::get<ScalarData<float>>(raw_data_));
-      return ret;
+  // Alias with a new shape of the same size. Requires a contiguous layout.
+  Tensor<float> view(const std::vector<uint32_t>& new_shape) const {
+    if (detail::numel(new_shape) != size()) {
+      throw std::invalid_argument("New shape must have the same number of elements");
+    }
+    if (!is_contiguous()) {
+      throw std::invalid_argument("view requires a contiguous tensor");
+    }
+    return Tensor<float>(new_shape, detail::contiguous_strides(new_shape), offset_, storage_);
+  }
 
-    } else if (type_ == TensorType::Matrix) {
-      auto& data = std::get<MatrixData<float>>(raw_data_);
-      Tensor<float> ret_data(*this);
-      for (uint32_t i = 0; i < size(); i++) {
-        ret_data.at(i) = f(data.data()[i]);
-      }
-      return ret_data;
+  // Alias of [start, end) along dim.
+  Tensor<float> slice(uint32_t dim, uint32_t start, uint32_t end) const {
+    if (dim >= shape_.size()) {
+      throw std::invalid_argument("Slice dimension out of range");
+    }
+    if (start > end || end > shape_[dim]) {
+      throw std::invalid_argument("Invalid slice range");
+    }
 
-    } else if (type_ == TensorType::Tensor) {
-      auto& data = std::get<TensorData<float>>(raw_data_);
-      Tensor<float> ret_data(*this);
-      for (size_t i = 0; i < data.size(); i++) {
-        ret_data.at(i) = f(data.data()[i]);
-      }
-      return ret_data;
+    std::vector<uint32_t> shape = shape_;
+    shape[dim] = end - start;
+    return Tensor<float>(shape, strides_, offset_ + start * strides_[dim], storage_);
+  }
 
+  // Alias of index offset along dim, with that dimension removed (like
+  // Eigen's chip).
+  Tensor<float> chip(uint32_t offset, uint32_t dim) const {
+    if (dim >= shape_.size()) {
+      throw std::invalid_argument("Chip dimension out of range");
     }
+    if (offset >= shape_[dim]) {
+      throw std::invalid_argument("Index out of range");
+    }
+
+    std::vector<uint32_t> shape = shape_;
+    std::vector<int64_t> strides = strides_;
+    shape.erase(shape.begin() + dim);
+    strides.erase(strides.begin() + dim);
+    return Tensor<float>(shape, std::move(strides), offset_ + offset * strides_[dim], storage_);
   }
 
-  void transpose() {
-    if (type_ == TensorType::Scalar) {
-      return;
+  // Alias with dimensions reordered: dimension i of the result is dims[i].
+  Tensor<float> permute(const std::vector<uint32_t>& dims) const {
+    if (dims.size() != shape_.size()) {
+      throw std::invalid_argument("permute requires one entry per dimension");
     }
 
-    if (type_ == TensorType::Matrix) {
-      if (raw_shape_[0] != 1) {
-        throw std::invalid_argument("Transpose only supports 2D matrix currently");
+    std::vector<uint32_t> shape(dims.size());
+    std::vector<int64_t> strides(dims.size());
+    std::vector<bool> seen(dims.size(), false);
+    for (size_t i = 0; i < dims.size(); i++) {
+      if (dims[i] >= dims.size() || seen[dims[i]]) {
+        throw std::invalid_argument("permute requires a permutation of the dimensions");
       }
+      seen[dims[i]] = true;
+      shape[i] = shape_[dims[i]];
+      strides[i] = strides_[dims[i]];
+    }
+    return Tensor<float>(shape, std::move(strides), offset_, storage_);
+  }
 
-      std::get<MatrixData<float>>(raw_data_).transposeInPlace();
-      raw_shape_ = {raw_shape_[0], raw_shape_[2], raw_shape_[1]};
-      return;
+  // O(1) when the layout is contiguous; otherwise the elements are packed
+  // first.
+  void reshape(const std::vector<uint32_t>& new_shape) {
+    if (this->type() == TensorType::Scalar) {
+      throw std::invalid_argument("Cannot reshape a scalar");
     }
 
-    throw std::invalid_argument("Invalid tensor type");
-  }
+    if (size() != detail::numel(new_shape)) {
+      throw std::invalid_argument("New shape must have the same number of elements");
+    }
 
-  Tensor<float> transposed() const {
-    if (type_ == TensorType::Scalar) {
-      return *this;
+    if (!is_contiguous()) {
+      *this = contiguous_copy();
     }
+    shape_ = new_shape;
+    strides_ = detail::contiguous_strides(new_shape);
+  }
 
-    if (type_ == TensorType::Matrix) {
-      if (raw_shape_[0] != 1) {
-        throw std::invalid_argument("Transpose only supports 2D matrix currently");
+  // f is called once per element; taking it as a template parameter lets the
+  // call inline into the loop (and vectorize, for simple lambdas).
+  template <typename F>
+  Tensor<float> apply(F f) const {
+    Tensor<float> result = empty(shape_);
+    float* out = result.mutable_base();
+    const float* in = base();
+    if (is_contiguous()) {
+      parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          out[i] = f(in[i]);
+        }
+      });
+      return result;
+    }
+    parallel_for_each_row<2>(shape_, {&strides_, &result.strides_}, {0, 0},
+                             [&](const auto& off, const auto& inc, uint32_t n) {
+      for (uint32_t i = 0; i < n; i++) {
+        out[off[1] + i * inc[1]] = f(in[off[0] + i * inc[0]]);
       }
+    });
+    return result;
+  }
 
-      Tensor<float> ret(*this);
-      ret.transpose();
-      return ret;
+  // Swaps the last two dimensions in place by swapping their strides.
+  void transpose() {
+    if (shape_.size() < 2) {
+      return;
     }
 
-    throw std::invalid_argument("Invalid tensor type");
+    const size_t r = shape_.size() - 2;
+    std::swap(shape_[r], shape_[r + 1]);
+    std::swap(strides_[r], strides_[r + 1]);
+  }
+
+  // Alias with the last two dimensions swapped.
+  Tensor<float> transposed() const {
+    Tensor<float> ret(shape_, strides_, offset_, storage_);
+    ret.transpose();
+    return ret;
   }
 
   std::vector<float> values() const {
-    if (type_ == TensorType::Scalar) {
-      return {std::get<ScalarData<float>>(raw_data_)};
-    } else if (type_ == TensorType::Matrix) {
-      return std::vector<float>(std::get<MatrixData<float>>(raw_data_).data(),
-                                std::get<MatrixData<float>>(raw_data_).data() + size());
-    } else if (type_ == TensorType::Tensor) {
-      return std::vector<float>(std::get<TensorData<float>>(raw_data_).data(),
-                                std::get<TensorData<float>>(raw_data_).data() + size());
-    }
+    std::vector<float> result(size());
+    float* out = result.data();
+    const float* in = base();
+    detail::for_each_row<1>(shape_, {&strides_}, {0}, [&](const auto& off, const auto& inc, uint32_t n) {
+      for (uint32_t i = 0; i < n; i++) {
+        *out++ = in[off[0] + i * inc[0]];
+      }
+    });
+    return result;
   }
 
   void flatten(bool row_vector = true) {
-    if (type_ == TensorType::Scalar) {
+    if (type() == TensorType::Scalar) {
       return;
     }
 
-    if (type_ == TensorType::Matrix) {
+    if (type() == TensorType::Matrix) {
       if (row_vector) {
         this->reshape({1, size()});
       } else {
@@ -311,17 +942,11 @@ private:
       return;
     }
 
-    if (type_ == TensorType::Tensor) {
-      if (row_vector) {
-        this->reshape({1, 1, size()});
-      } else {
-        this->reshape({1, size(), 1});
-      }
-
-      return;
+    if (row_vector) {
+      this->reshape({1, 1, size()});
+    } else {
+      this->reshape({1, size(), 1});
     }
-
-    throw std::invalid_argument("Invalid tensor type");
   }
 
   void padding(const std::vector<uint32_t>& pads,
@@ -345,221 +970,482 @@ private:
     if (pad_rows1 == 0 && pad_rows2 == 0 && pad_cols1 == 0 && pad_cols2 == 0) {
       return;
     }
-    
-    if (this->type_ == TensorType::Matrix) {
-      MatrixData<float> new_data(new_rows, new_cols);
-      new_data.setConstant(value);
 
-      for (uint32_t i = 0; i < rows(); i++) {
-        for (uint32_t j = 0; j < cols(); j++) {
-          new_data(i + pad_rows1, j + pad_cols1) = at(i, j);
+    if (shape_.size() < 2) {
+      return;
+    }
+
+    // padding for each channel
+    std::vector<uint32_t> new_shape = shape_;
+    new_shape[new_shape.size() - 2] = new_rows;
+    new_shape[new_shape.size() - 1] = new_cols;
+
+    Tensor<float> padded = empty(new_shape);
+    padded.fill(value);
+
+    const int64_t col_stride = strides_.back();
+    const uint32_t rows = this->rows();
+    const uint32_t cols = this->cols();
+    float* out = padded.mutable_base();
+    parallel_for(size_t(channels()) * rows, row_grain(cols), [&](size_t begin, size_t end) {
+      for (size_t r = begin; r < end; r++) {
+        const uint32_t c = static_cast<uint32_t>(r / rows);
+        const uint32_t i = static_cast<uint32_t>(r % rows);
+        const float* src = base() + offset_of(c, i, 0);
+        float* dst = out + padded.offset_of(c, i + pad_rows1, pad_cols1);
+        for (uint32_t j = 0; j < cols; j++) {
+          dst[j] = src[j * col_stride];
         }
       }
+    });
 
-      this->raw_data_ = new_data;
-      this->raw_shape_ = {1, new_rows, new_cols};
+    *this = std::move(padded);
+  }
 
-      return;
+  // What the non-const at() returns: reads go through the shared buffer, so
+  // only a write detaches the tensor from other copies of it. It stands for
+  // the element only within the expression that calls at(): it cannot be
+  // copied (nor passed to printf and the like), and only the temporary
+  // at() returns can be written through. auto v = t.at(i) still names the
+  // element rather than its value, so later writes show through v; write
+  // float v = t.at(i) to keep the value.
+  class Element {
+  public:
+    Element(const Element&) = delete;
+
+    operator float() const { return tensor_->base()[index_]; }
+
+    Element& operator=(float v) && {
+      tensor_->mutable_base()[index_] = v;
+      return *this;
     }
 
-    if (this->type_ == TensorType::Tensor) {
-      // padding for each channel
-      TensorData<float> new_data(channels(), new_rows, new_cols);
-      new_data.setConstant(value);
+    Element& operator=(const Element& other) && { return std::move(*this) = static_cast<float>(other); }
 
-      for (uint32_t c = 0; c < channels(); c++) {
-        for (uint32_t i = 0; i < rows(); i++) {
-          for (uint32_t j = 0; j < cols(); j++) {
-            new_data(c, i + pad_rows1, j + pad_cols1) = at(c, i, j);
-          }
-        }
-      }
+    Element& operator+=(float v) && { return std::move(*this) = *this + v; }
 
-      this->raw_data_ = new_data;
-      this->raw_shape_ = {channels(), new_rows, new_cols};
+    Element& operator-=(float v) && { return std::move(*this) = *this - v; }
 
-      return;
-    }
+    Element& operator*=(float v) && { return std::move(*this) = *this * v; }
 
+    Element& operator/=(float v) && { return std::move(*this) = *this / v; }
 
-  }
+  private:
+    friend class Tensor<float>;
 
-  float& at(uint32_t i) {
-    if (type_ == TensorType::Scalar) {
-      if (i == 0) {
-        return std::get<ScalarData<float>>(raw_data_);
-      } else {
-        throw std::invalid_argument("Index out of range");
-      }
-    }
+    Element(Tensor<float>* tensor, int64_t index) : tensor_(tensor), index_(index) {}
+
+    Tensor<float>* tensor_;
+    int64_t index_;  // from base()
+  };
 
+  Element at(uint32_t i) {
     if (i >= size()) {
       throw std::invalid_argument("Index out of range");
     }
 
-    if (type_ == TensorType::Matrix) {
-      return std::get<MatrixData<float>>(raw_data_).data()[i];
-    }
-    
-    if (type_ == TensorType::Tensor) {
-      return std::get<TensorData<float>>(raw_data_).data()[i];
-    }
-
-    throw std::invalid_argument("Invalid tensor type");
+    return Element(this, is_contiguous() ? i : offset_of(i));
   }
 
   float at(uint32_t i) const {
-    if (type_ == TensorType::Scalar) {
-      if (i == 0) {
-        return std::get<ScalarData<float>>(raw_data_);
-      } else {
-        throw std::invalid_argument("Index out of range");
-      }
-    }
-
     if (i >= size()) {
       throw std::invalid_argument("Index out of range");
     }
 
-    return std::get<MatrixData<float>>(raw_data_).data()[i];
+    return base()[is_contiguous() ? i : offset_of(i)];
   }
 
-  float& at(uint32_t row, uint32_t col) {
-    if (type_ == TensorType::Scalar) {
+  Element at(uint32_t row, uint32_t col) {
+    if (type() == TensorType::Scalar) {
       throw std::invalid_argument("Cannot access element of a scalar");
     }
 
-    if (row >= raw_shape_[1] || col >= raw_shape_[2]) {
-      throw std::invalid_argument("Index out of range");
-    }
-
-    return std::get<MatrixData<float>>(raw_data_)(row, col);
+    return Element(this, offset_of(0, row, col));
   }
 
   float at(uint32_t row, uint32_t col) const {
-    if (type_ == TensorType::Scalar) {
+    if (type() == TensorType::Scalar) {
       throw std::invalid_argument("Cannot access element of a scalar");
     }
 
-    if (row >= raw_shape_[1] || col >= raw_shape_[2]) {
-      throw std::invalid_argument("Index out of range");
+    return base()[offset_of(0, row, col)];
+  }
+
+  Element at(uint32_t channel, uint32_t row, uint32_t col) {
+    if (type() == TensorType::Scalar) {
+      throw std::invalid_argument("Cannot access element of a scalar");
     }
 
-    return std::get<MatrixData<float>>(raw_data_)(row, col);
+    return Element(this, offset_of(channel, row, col));
   }
 
-  float& at(uint32_t channel, uint32_t row, uint32_t col) {
-    if (type_ == TensorType::Scalar) {
+  float at(uint32_t channel, uint32_t row, uint32_t col) const {
+    if (type() == TensorType::Scalar) {
       throw std::invalid_argument("Cannot access element of a scalar");
     }
 
-    if (channel >= raw_shape_[0] || row >= raw_shape_[1] || col >= raw_shape_[2]) {
-      throw std::invalid_argument("Index out of range");
-    }
+    return base()[offset_of(channel, row, col)];
+  }
 
-    return std::get<TensorData<float>>(raw_data_)(channel, row, col);
+  // Elementwise arithmetic with NumPy broadcasting: shapes are aligned at
+  // the last dimension and sizes of 1 stretch to match, e.g. a {N, C}
+  // activation plus a {1, C} or {C} bias.
+  Tensor<float> mul(const Tensor<float>& other) const {
+    return elementwise(other, kernels::BinaryOp::Mul);
   }
 
-  float at(uint32_t channel, uint32_t row, uint32_t col) const {
-    if (type_ == TensorType::Scalar) {
-      throw std::invalid_argument("Cannot access element of a scalar");
+  Tensor<float> add(const Tensor<float>& other) const {
+    return elementwise(other, kernels::BinaryOp::Add);
+  }
+
+  Tensor<float> sub(const Tensor<float>& other) const {
+    return elementwise(other, kernels::BinaryOp::Sub);
+  }
+
+  Tensor<float> div(const Tensor<float>& other) const {
+    return elementwise(other, kernels::BinaryOp::Div);
+  }
+
+  // Same, written into out: out is resized to the result shape as by
+  // resize_, so a buffer of the right size is reused. out may be an operand.
+  Tensor<float>& mul(const Tensor<float>& other, Tensor<float>& out) const {
+    return elementwise(other, out, kernels::BinaryOp::Mul);
+  }
+
+  Tensor<float>& add(const Tensor<float>& other, Tensor<float>& out) const {
+    return elementwise(other, out, kernels::BinaryOp::Add);
+  }
+
+  Tensor<float>& sub(const Tensor<float>& other, Tensor<float>& out) const {
+    return elementwise(other, out, kernels::BinaryOp::Sub);
+  }
+
+  Tensor<float>& div(const Tensor<float>& other, Tensor<float>& out) const {
+    return elementwise(other, out, kernels::BinaryOp::Div);
+  }
+
+  // Read-only alias with the given shape, where broadcast dimensions get
+  // stride 0. Writing through it would hit the same elements repeatedly.
+  Tensor<float> broadcast_to(const std::vector<uint32_t>& shape) const {
+    if (shape.size() < shape_.size()) {
+      throw std::invalid_argument("Cannot broadcast to fewer dimensions");
     }
 
-    if (channel >= raw_shape_[0] || row >= raw_shape_[1] || col >= raw_shape_[2]) {
-      throw std::invalid_argument("Index out of range");
+    std::vector<int64_t> strides(shape.size(), 0);
+    const size_t lead = shape.size() - shape_.size();
+    for (size_t i = 0; i < shape_.size(); i++) {
+      if (shape_[i] == shape[lead + i]) {
+        strides[lead + i] = shape_[i] == 1 ? 0 : strides_[i];
+      } else if (shape_[i] != 1) {
+        throw std::invalid_argument("Shapes cannot be broadcast together");
+      }
     }
+    return Tensor<float>(shape, std::move(strides), offset_, storage_);
+  }
 
-    return std::get<TensorData<float>>(raw_data_)(channel, row, col);
+  bool same_shape(const Tensor<float>& other) const {
+    return shape_ == other.shape_;
   }
 
-  Tensor<float> mul(const Tensor<float>& other) const {
-    if (raw_shape_ != other.raw_shape_) {
-      throw std::invalid_argument("Hadamard product requires same shape");
+  // this += alpha * other summed over the dimensions along which this tensor
+  // broadcasts to other's shape: the gradient of a broadcast operand. Plain
+  // axpy_ when the shapes already match.
+  Tensor<float>& add_reduced_(const Tensor<float>& other, float alpha = 1.0f) {
+    if (shape_ == other.shape_) {
+      return alpha == 1.0f ? add_(other) : axpy_(alpha, other);
     }
 
-    if (type_ == TensorType::Scalar && other.type() == TensorType::Scalar) {
-      return Tensor<float>(std::get<ScalarData<float>>(raw_data_) * std::get<ScalarData<float>>(other.raw_data_));
+    const Tensor<float> acc = broadcast_to(other.shape_);
+    float* out = mutable_base();
+    const float* in = other.base();
+    const auto row = [&](const auto& off, const auto& inc, uint32_t n) {
+      float* dst = out + off[0];
+      const float* src = in + off[1];
+      if (inc[0] == 0) {
+        float total = 0.0f;
+        if (inc[1] == 1) {
+          total = kernels::sum(src, n);
+        } else {
+          for (uint32_t i = 0; i < n; i++) {
+            total += src[i * inc[1]];
+          }
+        }
+        *dst += alpha * total;
+      } else if (inc[0] == 1 && inc[1] == 1 && alpha == 1.0f) {
+        kernels::binary(kernels::BinaryOp::Add, dst, src, dst, n);
+      } else {
+        for (uint32_t i = 0; i < n; i++) {
+          dst[i * inc[0]] += alpha * src[i * inc[1]];
+        }
+      }
+    };
+    // Rows may only run in parallel when they never write the same element,
+    // i.e. when the split (first) dimension is not a broadcast one.
+    if (acc.strides_[0] != 0) {
+      parallel_for_each_row<2>(other.shape_, {&acc.strides_, &other.strides_}, {0, 0}, row);
+    } else {
+      detail::for_each_row<2>(other.shape_, {&acc.strides_, &other.strides_}, {0, 0}, row);
     }
+    return *this;
+  }
 
-    Tensor<float> result(raw_shape_);
-    
-    for (uint32_t i = 0; i < size(); i++) {
-      result.at(i) = at(i) * other.at(i);
-    }
+  // Sum of this tensor over broadcast dimensions, reducing it to shape.
+  Tensor<float> sum_to(const std::vector<uint32_t>& shape) const {
+    Tensor<float> result = empty(shape);
+    result.add_reduced_(*this);
+    return result;
+  }
 
+  // Operands may be strided (e.g. transposed()); Eigen reads them in place.
+  // Tensors with more than two dimensions are batches of matrices over their
+  // leading dimensions, which broadcast: (C, R, K) x (C, K, N) -> (C, R, N),
+  // and (C, R, K) x (K, N) multiplies every channel by the same matrix.
+  Tensor<float> matmul(const Tensor<float>& other) const {
+    Tensor<float> result = empty(matmul_shape(other));
+    result.addmm_(*this, other, 0.0f);
     return result;
   }
 
-  Tensor<float> add(const Tensor<float>& other) const {
-    if (raw_shape_ != other.raw_shape_) {
-      throw std::invalid_argument("Addition requires same shape");
+  Tensor<float>& matmul(const Tensor<float>& other, Tensor<float>& out) const {
+    const std::vector<uint32_t> shape = matmul_shape(other);
+    if (&out == this || &out == &other) {
+      out = matmul(other);
+      return out;
     }
+    out.resize_(shape);
+    return out.addmm_(*this, other, 0.0f);
+  }
 
-    if (type_ == TensorType::Scalar && other.type() == TensorType::Scalar) {
-      return Tensor<float>(std::get<ScalarData<float>>(raw_data_) + std::get<ScalarData<float>>(other.raw_data_));
-    }
+  // In-place arithmetic, written through this tensor's layout (so on a view
+  // they update the viewed elements). other may broadcast to this tensor's
+  // shape. They allocate nothing unless the buffer is still shared
+  // copy-on-write with another tensor.
+  Tensor<float>& add_(const Tensor<float>& other) {
+    return elementwise_(other, kernels::BinaryOp::Add);
+  }
 
-    Tensor<float> result(this->shape());
-    
-    for (uint32_t i = 0; i < size(); i++) {
-      result.at(i) = at(i) + other.at(i);
+  Tensor<float>& sub_(const Tensor<float>& other) {
+    return elementwise_(other, kernels::BinaryOp::Sub);
+  }
+
+  Tensor<float>& mul_(const Tensor<float>& other) {
+    return elementwise_(other, kernels::BinaryOp::Mul);
+  }
+
+  // Fused forms taking a lazy expression, e.g. grad.add_(x.lazy() * dy.lazy()).
+  template <typename E>
+  Tensor<float>& add_(const expr::Expr<E>& e) {
+    return update_<expr::Add>(e, kernels::BinaryOp::Add);
+  }
+
+  template <typename E>
+  Tensor<float>& sub_(const expr::Expr<E>& e) {
+    return update_<expr::Sub>(e, kernels::BinaryOp::Sub);
+  }
+
+  template <typename E>
+  Tensor<float>& mul_(const expr::Expr<E>& e) {
+    return update_<expr::Mul>(e, kernels::BinaryOp::Mul);
+  }
+
+  // this += alpha * x
+  Tensor<float>& axpy_(float alpha, const Tensor<float>& x) {
+    if (shape_ != x.shape_) {
+      throw std::invalid_argument("axpy requires same shape");
     }
 
-    return result;
+    if (x.is_contiguous()) {
+      return add_(alpha * x.lazy());
+    }
+    float* y = mutable_base();
+    const float* in = x.base();
+    parallel_for_each_row<2>(shape_, {&strides_, &x.strides_}, {0, 0},
+                             [&](const auto& off, const auto& inc, uint32_t n) {
+      for (uint32_t i = 0; i < n; i++) {
+        y[off[0] + i * inc[0]] += alpha * in[off[1] + i * inc[1]];
+      }
+    });
+    return *this;
   }
 
-  Tensor<float> sub(const Tensor<float>& other) const {
-    if (raw_shape_ != other.raw_shape_) {
-      throw std::invalid_argument("Subtraction requires same shape");
+  // this = beta * this + a.matmul(b), without a temporary for the product.
+  // this must not alias a or b; with beta = 0 its old contents are ignored.
+  // If this has fewer batch dimensions than the product (it broadcasts to the
+  // product's shape), the product is summed over the missing ones, which is
+  // the gradient of a matrix shared across the batch.
+  //
+  // Batches run one matrix per task when there are enough of them, and
+  // otherwise one after another with each product split into bands. When one
+  // operand is shared by the whole batch and the others' batch dimensions
+  // fold into their rows (or, for a summed product, their inner dimension),
+  // the batch becomes a single tall product, so the shared operand is packed
+  // once instead of once per matrix.
+  Tensor<float>& addmm_(const Tensor<float>& a, const Tensor<float>& b, float beta = 1.0f) {
+    const std::vector<uint32_t> shape = a.matmul_shape(b);
+    if (ndim() < 2 || rows() != a.rows() || cols() != b.cols()) {
+      throw std::invalid_argument("Matrix multiplication result has the wrong shape");
+    }
+    if (ndim() == 2 && shape.size() == 2) {
+      gemm_(a, b, beta);
+      return *this;
     }
 
-    Tensor<float> result(this->shape());
-    
-    for (uint32_t i = 0; i < size(); i++) {
-      result.at(i) = at(i) - other.at(i);
+    const std::vector<uint32_t> batch(shape.begin(), shape.end() - 2);
+    const std::vector<uint32_t> own = batch_shape();
+    if (own.size() > batch.size() || detail::broadcast_shape(own, batch) != batch) {
+      throw std::invalid_argument("Matrix multiplication result has the wrong shape");
+    }
+    const size_t count = detail::numel(batch);
+    const bool a_batched = detail::numel(a.batch_shape()) == count;
+    const bool b_batched = detail::numel(b.batch_shape()) == count;
+    mutable_base();  // detach once, before tasks write through aliases
+
+    Tensor<float> folded_out({}, {}, 0, nullptr), folded_a({}, {}, 0, nullptr), folded_b({}, {}, 0, nullptr);
+    if (detail::numel(own) == count) {
+      if (!b_batched && a_batched && fold_batch(0, folded_out) && a.fold_batch(0, folded_a)) {
+        folded_out.gemm_(folded_a, b.matrix_at(0), beta);
+        return *this;
+      }
+    } else if (detail::numel(own) == 1 && a_batched && b_batched && a.fold_batch(1, folded_a) &&
+               b.fold_batch(0, folded_b)) {
+      matrix_at(0).gemm_(folded_a, folded_b, beta);
+      return *this;
     }
 
-    return result;
-  }
+    const auto batched = [&](const Tensor<float>& t) {
+      std::vector<uint32_t> full = batch;
+      full.push_back(t.rows());
+      full.push_back(t.cols());
+      return t.broadcast_to(full);
+    };
+    const Tensor<float> lhs = batched(a), rhs = batched(b);
+    const Tensor<float> out = batched(*this);
+    if (detail::numel(own) != count) {
+      // Several products land on the same output matrix, so they run in turn.
+      if (beta != 1.0f) {
+        beta == 0.0f ? fill_(0.0f) : mul_(Tensor<float>(beta));
+      }
+      for (uint32_t i = 0; i < count; i++) {
+        out.matrix_at(i).gemm_(lhs.matrix_at(i), rhs.matrix_at(i), 1.0f);
+      }
+      return *this;
+    }
 
-  Tensor<float> div(const Tensor<float>& other) const {
-    if (raw_shape_ != other.raw_shape_) {
-      throw std::invalid_argument("Division requires same shape");
+    const auto multiply = [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const uint32_t c = static_cast<uint32_t>(i);
+        out.matrix_at(c).gemm_(lhs.matrix_at(c), rhs.matrix_at(c), beta);
+      }
+    };
+    if (count >= num_threads()) {
+      const size_t work = size_t(a.rows()) * a.cols() * b.cols();
+      parallel_for(count, row_grain(work), multiply);
+    } else {
+      multiply(0, count);
     }
+    return *this;
+  }
 
-    Tensor<float> result(this->shape());
-    
-    for (uint32_t i = 0; i < size(); i++) {
-      result.at(i) = at(i) / other.at(i);
+  // Sum of all elements. Partial sums are taken over fixed blocks of
+  // kParallelGrain elements, so the result does not depend on the thread count.
+  float sum() const {
+    const Tensor<float> packed = contiguous();
+    const float* in = packed.base();
+    const size_t n = size();
+    const size_t blocks = (n + kParallelGrain - 1) / kParallelGrain;
+    std::vector<float> partial(blocks);
+    parallel_for(blocks, 1, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const size_t first = i * kParallelGrain;
+        partial[i] = kernels::sum(in + first, std::min(kParallelGrain, n - first));
+      }
+    });
+    float total = 0.0f;
+    for (float p : partial) {
+      total += p;
     }
+    return total;
+  }
 
+  // Reduction r of dimension axis, which is dropped from the result (or kept
+  // with size 1 if keepdim). Arg reductions hold indices as floats.
+  //
+  // When axis is the innermost dimension every output reduces one
+  // contiguous row with the SIMD kernels; rows longer than kParallelGrain are
+  // cut into fixed blocks whose partial results are combined in order.
+  // Otherwise each output row of the inner dimensions is accumulated
+  // elementwise from the rows along axis. Outputs (and blocks) are split
+  // across the thread pool; the blocking never depends on the thread count,
+  // so neither does the result.
+  Tensor<float> reduce(Reduction r, uint32_t axis, bool keepdim = false) const {
+    Tensor<float> result = empty(reduced_shape(axis, keepdim));
+    reduce_into(r, axis, result);
     return result;
   }
 
-  Tensor<float> matmul(const Tensor<float>& other) const {
-    if (this->type() != TensorType::Matrix || other.type() != TensorType::Matrix) {
-      throw std::invalid_argument("Matrix multiplication requires 2D matrix");
+  // Same, written into out, which is resized as by resize_.
+  Tensor<float>& reduce(Reduction r, uint32_t axis, bool keepdim, Tensor<float>& out) const {
+    if (&out == this) {
+      out = reduce(r, axis, keepdim);
+      return out;
     }
+    out.resize_(reduced_shape(axis, keepdim));
+    reduce_into(r, axis, out);
+    return out;
+  }
 
-    if (this->cols() != other.rows()) {
-      throw std::invalid_argument("Matrix multiplication requires the number of columns of the first matrix to be equal to the number of rows of the second matrix");
-    }
+  Tensor<float> sum(uint32_t axis, bool keepdim = false) const {
+    return reduce(Reduction::Sum, axis, keepdim);
+  }
+
+  Tensor<float> mean(uint32_t axis, bool keepdim = false) const {
+    return reduce(Reduction::Mean, axis, keepdim);
+  }
 
-    MatrixData<float> result = std::get<MatrixData<float>>(raw_data_) * std::get<MatrixData<float>>(other.raw_data_);
-    return Tensor<float>(result);
+  Tensor<float> max(uint32_t axis, bool keepdim = false) const {
+    return reduce(Reduction::Max, axis, keepdim);
+  }
+
+  Tensor<float> min(uint32_t axis, bool keepdim = false) const {
+    return reduce(Reduction::Min, axis, keepdim);
+  }
+
+  Tensor<float> argmax(uint32_t axis, bool keepdim = false) const {
+    return reduce(Reduction::ArgMax, axis, keepdim);
+  }
+
+  Tensor<float> argmin(uint32_t axis, bool keepdim = false) const {
+    return reduce(Reduction::ArgMin, axis, keepdim);
+  }
+
+  Tensor<float> l2norm(uint32_t axis, bool keepdim = false) const {
+    return reduce(Reduction::L2Norm, axis, keepdim);
+  }
+
+  // Shape after reducing axis.
+  std::vector<uint32_t> reduced_shape(uint32_t axis, bool keepdim) const {
+    if (axis >= shape_.size()) {
+      throw std::invalid_argument("Reduction axis out of range");
+    }
+    std::vector<uint32_t> shape = shape_;
+    if (keepdim) {
+      shape[axis] = 1;
+    } else {
+      shape.erase(shape.begin() + axis);
+    }
+    return shape;
   }
 
   Tensor<float> inv() const {
-    if (this->type() != TensorType::Matrix) {
+    if (this->ndim() != 2) {
       throw std::invalid_argument("Matrix inversion requires 2D matrix");
     }
 
-    return Tensor<float>(std::get<MatrixData<float>>(raw_data_).inverse());
+    return Tensor<float>(MatrixData<float>(matrix_map().inverse()));
   }
 
   Tensor<float> square() const {
-    const auto sqrt_fn = [](float x) { return x * x; };
-    return this->apply(sqrt_fn);
+    return elementwise(*this, kernels::BinaryOp::Mul);
   }
 
   Tensor<float> pow(float exponent) const {
@@ -567,15 +1453,41 @@ private:
     return this->apply(pow_fn);
   }
 
+  // Vectorized elementary functions; see kernels_impl.hh for their error bounds.
+  Tensor<float> exp() const {
+    return Tensor<float>(expr::exp(contiguous().lazy()));
+  }
+
+  Tensor<float> log() const {
+    return Tensor<float>(expr::log(contiguous().lazy()));
+  }
+
+  Tensor<float> tanh() const {
+    return Tensor<float>(expr::tanh(contiguous().lazy()));
+  }
+
+  Tensor<float> sigmoid() const {
+    return Tensor<float>(expr::sigmoid(contiguous().lazy()));
+  }
+
+  // Prints through strided Eigen maps over the storage, one channel at a
+  // time, without materializing a copy.
   friend std::ostream& operator<<(std::ostream& os, const Tensor<float>& obj) {
     if (obj.type() == TensorType::Scalar) {
-      os << std::get<ScalarData<float>>(obj.data());
-    } else if (obj.type() == TensorType::Matrix) {
-      os << std::get<MatrixData<float>>(obj.data());
-    } else if (obj.type() == TensorType::Tensor) {
-      for(uint32_t c = 0; c < obj.shape()[0]; c++) {
+      os << obj.at(0);
+      return os;
+    }
+
+    const size_t ndim = obj.shape_.size();
+    const Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> stride(ndim >= 2 ? obj.strides_[ndim - 2] : 0,
+                                                               obj.strides_[ndim - 1]);
+    for (uint32_t c = 0; c < obj.channels(); c++) {
+      ConstStridedMap channel(obj.base() + (obj.size() == 0 ? 0 : obj.offset_of(c, 0, 0)), obj.rows(), obj.cols(), stride);
+      if (obj.type() == TensorType::Tensor) {
         os << "Channel " << c << std::endl;
-        os << std::get<TensorData<float>>(obj.data()).chip(c, 0) << std::endl;
+        os << channel << std::endl;
+      } else {
+        os << channel;
       }
     }
 
@@ -583,19 +1495,174 @@ private:
   }
 
   static Tensor<float> zeros_like(const Tensor<float>& other) {
-    if (other.type() == TensorType::Scalar) {
-      return Tensor<float>(0.0f);
+    return empty(other.shape_);
+  }
+
+};
+
+// A quantized tensor: uint8 values q with a scale and zero point standing for
+// the reals (q - zero_point) * scale (see quant.hh). Always contiguous; it
+// holds inference inputs and weights at a quarter of the float size.
+template <>
+class Tensor<uint8_t> {
+public:
+  Tensor(const std::vector<uint32_t>& shape, quant::Params params)
+      : shape_(shape), params_(check(params)), storage_(std::make_shared<Storage<uint8_t>>(detail::numel(shape))) {}
+
+  // Affine quantization over the range of x.
+  static Tensor<uint8_t> quantize(const Tensor<float>& x) {
+    const Tensor<float> c = x.contiguous();
+    return quantize(c, c.size() == 0 ? quant::Params() : quant::affine(c.data().data(), c.size()));
+  }
+
+  static Tensor<uint8_t> quantize(const Tensor<float>& x, quant::Params params) {
+    const Tensor<float> c = x.contiguous();
+    Tensor<uint8_t> q(c.shape_, params);
+    const float* in = c.data().data();
+    uint8_t* out = q.mutable_data().data();
+    parallel_for(q.size(), kParallelGrain, [&](size_t begin, size_t end) {
+      kernels::quantize(in + begin, 1.0f / params.scale, params.zero_point, out + begin, end - begin);
+    });
+    return q;
+  }
+
+  Tensor<float> dequantize() const {
+    Tensor<float> x = Tensor<float>::empty(shape_);
+    const uint8_t* in = storage_->data();
+    float* out = x.mutable_data().data();
+    parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+      kernels::dequantize(in + begin, params_.scale, params_.zero_point, out + begin, end - begin);
+    });
+    return x;
+  }
+
+  // Gives this tensor the given shape and params, keeping its buffer when it
+  // is the sole owner of one of the right size. Values are unspecified
+  // afterwards.
+  Tensor<uint8_t>& resize_(const std::vector<uint32_t>& shape, quant::Params params) {
+    params_ = check(params);
+    if (storage_.use_count() != 1 || storage_->size() != detail::numel(shape)) {
+      storage_ = std::make_shared<Storage<uint8_t>>(detail::numel(shape));
     }
+    shape_ = shape;
+    return *this;
+  }
+
+  const std::vector<uint32_t>& shape() const { return shape_; }
+
+  size_t ndim() const { return shape_.size(); }
+
+  size_t size() const { return storage_->size(); }
+
+  const quant::Params& params() const { return params_; }
+
+  float scale() const { return params_.scale; }
+
+  int32_t zero_point() const { return params_.zero_point; }
 
-    if (other.type() == TensorType::Matrix) {
-      return Tensor<float>(TensorType::Matrix, {other.rows(), other.cols()});
+  Span<const uint8_t> data() const { return Span<const uint8_t>(storage_->data(), size()); }
+
+  Span<uint8_t> mutable_data() { return Span<uint8_t>(storage_->mutable_data(), size()); }
+
+private:
+  std::vector<uint32_t> shape_;
+  quant::Params params_;
+  std::shared_ptr<Storage<uint8_t>> storage_;
+
+  static quant::Params check(quant::Params params) {
+    if (!(params.scale > 0.0f) || !std::isfinite(params.scale) || params.zero_point < 0 || params.zero_point > 255) {
+      throw std::invalid_argument("Quantization needs scale > 0 and a zero point in [0, 255]");
     }
+    return params;
+  }
+};
 
-    if (other.type() == TensorType::Tensor) {
-      return Tensor<float>(TensorType::Tensor, {other.channels(), other.rows(), other.cols()});
+// A tensor of 16-bit floats (T is bf16 or fp16), always contiguous. It only
+// stores values: encode() rounds a Tensor<float> into it and decode() widens
+// it back, both in SIMD kernels, so math stays in Tensor<float>. It holds
+// activations and gradients at half the float size (see Executor and
+// MixedPrecision in graph.hh).
+template <typename T>
+class Tensor {
+  static_assert(std::is_same<T, bf16>::value || std::is_same<T, fp16>::value,
+                "Tensor<T> is defined for float, bf16, fp16 and uint8_t");
+
+public:
+  Tensor() : Tensor(std::vector<uint32_t>{0}) {}
+
+  explicit Tensor(const std::vector<uint32_t>& shape)
+      : shape_(shape), storage_(std::make_shared<Storage<T>>(detail::numel(shape))) {}
+
+  // A tensor of the given shape over storage holding exactly its elements.
+  static Tensor<T> wrap(std::shared_ptr<Storage<T>> storage, const std::vector<uint32_t>& shape) {
+    if (storage->size() != detail::numel(shape)) {
+      throw std::invalid_argument("Storage size does not match the shape");
     }
+    return Tensor<T>(shape, std::move(storage));
+  }
+
+  static Tensor<T> encode(const Tensor<float>& x) {
+    Tensor<T> h;
+    h.encode_(x);
+    return h;
+  }
+
+  // Rounds x into this tensor, keeping the buffer when it is the sole owner
+  // of one of the right size.
+  Tensor<T>& encode_(const Tensor<float>& x) {
+    const Tensor<float> c = x.contiguous();
+    if (storage_.use_count() != 1 || storage_->size() != c.size()) {
+      storage_ = std::make_shared<Storage<T>>(c.size());
+    }
+    shape_ = c.shape_;
+    const float* in = c.data().data();
+    uint16_t* out = bits(storage_->mutable_data());
+    parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+      T::encode(in + begin, out + begin, end - begin);
+    });
+    return *this;
+  }
+
+  Tensor<float> decode() const {
+    Tensor<float> x = Tensor<float>::empty(shape_);
+    decode_into(x);
+    return x;
   }
 
+  // Widens the values into out, reusing its buffer when possible.
+  void decode_into(Tensor<float>& out) const {
+    out.resize_(shape_);
+    const uint16_t* in = bits(storage_->data());
+    float* o = out.mutable_data().data();
+    parallel_for(size(), kParallelGrain, [&](size_t begin, size_t end) {
+      T::decode(in + begin, o + begin, end - begin);
+    });
+  }
+
+  const std::vector<uint32_t>& shape() const { return shape_; }
+
+  size_t ndim() const { return shape_.size(); }
+
+  size_t size() const { return storage_->size(); }
+
+  size_t bytes() const { return size() * sizeof(T); }
+
+  float at(size_t i) const { return to_float(storage_->data()[i]); }
+
+  Span<const T> data() const { return Span<const T>(storage_->data(), size()); }
+
+  Span<T> mutable_data() { return Span<T>(storage_->mutable_data(), size()); }
+
+private:
+  std::vector<uint32_t> shape_;
+  std::shared_ptr<Storage<T>> storage_;
+
+  Tensor(const std::vector<uint32_t>& shape, std::shared_ptr<Storage<T>> storage)
+      : shape_(shape), storage_(std::move(storage)) {}
+
+  static const uint16_t* bits(const T* p) { return reinterpret_cast<const uint16_t*>(p); }
+
+  static uint16_t* bits(T* p) { return reinterpret_cast<uint16_t*>(p); }
 };
 
 }  // namespace upsilon
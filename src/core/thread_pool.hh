@@ -0,0 +1,252 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace upsilon {
+
+// Fixed set of worker threads that split index ranges for the tensor kernels.
+// The calling thread works alongside the workers, so a pool of size() == N
+// runs N chunks at once with N - 1 background threads.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads) : size_(std::max<size_t>(threads, 1)) {
+    for (size_t i = 1; i < size_; i++) {
+      workers_.emplace_back([this] { work(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  size_t size() const { return size_; }
+
+  // Calls f(begin, end) on disjoint chunks covering [0, n) and returns when
+  // all of them are done. Chunks hold at least grain indices, so small
+  // ranges run inline on the caller without waking anyone. Nested calls, and
+  // calls made while another thread is using the pool, also run inline.
+  // If f throws, chunks not yet started are skipped and the first exception
+  // is rethrown on the caller once every running chunk has returned.
+  template <typename F>
+  void parallel_for(size_t n, size_t grain, F&& f) {
+    grain = std::max<size_t>(grain, 1);
+    const size_t max_chunks = (n + grain - 1) / grain;
+    if (size_ == 1 || max_chunks <= 1 || in_pool()) {
+      if (n > 0) {
+        f(size_t(0), n);
+      }
+      return;
+    }
+
+    std::unique_lock<std::mutex> region(region_, std::try_to_lock);
+    if (!region.owns_lock()) {
+      f(size_t(0), n);
+      return;
+    }
+
+    // A few chunks per thread so uneven chunks balance out.
+    const size_t chunks = std::min(max_chunks, size_ * 4);
+    Job job;
+    job.n = n;
+    job.chunk = (n + chunks - 1) / chunks;
+    job.chunks = (n + job.chunk - 1) / job.chunk;
+    job.context = &f;
+    job.invoke = [](const void* context, size_t begin, size_t end) {
+      (*static_cast<std::remove_reference_t<F>*>(const_cast<void*>(context)))(begin, end);
+    };
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      generation_++;
+    }
+    wake_.notify_all();
+
+    {
+      InPool scope;
+      run_chunks(job);
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [&] { return job.finished == job.chunks && busy_ == 0; });
+      job_ = nullptr;
+    }
+    if (job.error) {
+      std::rethrow_exception(job.error);
+    }
+  }
+
+private:
+  struct Job {
+    size_t n = 0;
+    size_t chunk = 0;
+    size_t chunks = 0;
+    std::atomic<size_t> next{0};
+    size_t finished = 0;  // guarded by mutex_
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;  // the first exception thrown by f, guarded by mutex_
+    const void* context = nullptr;
+    void (*invoke)(const void*, size_t, size_t) = nullptr;
+  };
+
+  static bool& in_pool() {
+    thread_local bool flag = false;
+    return flag;
+  }
+
+  // Marks the thread as running chunks, so parallel_for calls made from them
+  // run inline, until the scope ends.
+  class InPool {
+  public:
+    InPool() : previous_(in_pool()) { in_pool() = true; }
+    InPool(const InPool&) = delete;
+    InPool& operator=(const InPool&) = delete;
+    ~InPool() { in_pool() = previous_; }
+
+  private:
+    bool previous_;
+  };
+
+  // Never throws: an exception from f is kept in the job for the caller, and
+  // the chunks claimed after it are counted as finished without running.
+  void run_chunks(Job& job) {
+    size_t done = 0;
+    std::exception_ptr error;
+    for (size_t c; (c = job.next.fetch_add(1, std::memory_order_relaxed)) < job.chunks; done++) {
+      if (job.failed.load(std::memory_order_relaxed)) {
+        continue;
+      }
+      const size_t begin = c * job.chunk;
+      try {
+        job.invoke(job.context, begin, std::min(begin + job.chunk, job.n));
+      } catch (...) {
+        error = std::current_exception();
+        job.failed.store(true, std::memory_order_relaxed);
+      }
+    }
+    if (done > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job.finished += done;
+      if (error && !job.error) {
+        job.error = std::move(error);
+      }
+    }
+  }
+
+  void work() {
+    InPool scope;
+    size_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [&] { return stop_ || (job_ != nullptr && generation_ != seen); });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      Job* job = job_;
+      busy_++;
+      lock.unlock();
+      run_chunks(*job);
+      lock.lock();
+      busy_--;
+      done_.notify_one();
+    }
+  }
+
+  const size_t size_;
+  std::vector<std::thread> workers_;
+  std::mutex region_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  Job* job_ = nullptr;
+  size_t generation_ = 0;
+  size_t busy_ = 0;
+  bool stop_ = false;
+};
+
+namespace detail {
+
+inline size_t default_num_threads() {
+  if (const char* env = std::getenv("UPSILON_NUM_THREADS")) {
+    const long n = std::strtol(env, nullptr, 10);
+    if (n > 0) {
+      return static_cast<size_t>(n);
+    }
+  }
+  return std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+}
+
+inline std::shared_ptr<ThreadPool>& global_pool() {
+  static std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>(default_num_threads());
+  return pool;
+}
+
+inline std::mutex& global_pool_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+}  // namespace detail
+
+// The process-wide pool used by tensor operations. Sized from
+// UPSILON_NUM_THREADS, or the number of hardware threads if that is unset.
+inline std::shared_ptr<ThreadPool> thread_pool() {
+  std::lock_guard<std::mutex> lock(detail::global_pool_mutex());
+  return detail::global_pool();
+}
+
+inline size_t num_threads() {
+  return thread_pool()->size();
+}
+
+// Replaces the process-wide pool. Operations already running keep the old
+// pool alive until they finish.
+inline void set_num_threads(size_t n) {
+  auto pool = std::make_shared<ThreadPool>(n);
+  std::lock_guard<std::mutex> lock(detail::global_pool_mutex());
+  detail::global_pool() = std::move(pool);
+}
+
+// Elements per task for cheap per-element work; smaller ranges are not worth
+// handing to another thread.
+constexpr size_t kParallelGrain = size_t(1) << 15;
+
+// Grain for a parallel_for over rows of n elements each: enough rows for
+// kParallelGrain elements per task, and at least one.
+inline size_t row_grain(size_t n) {
+  return std::max<size_t>(1, kParallelGrain / std::max<size_t>(n, 1));
+}
+
+// Splits [0, n) across the process-wide pool; see ThreadPool::parallel_for.
+template <typename F>
+void parallel_for(size_t n, size_t grain, F&& f) {
+  if (n <= grain) {
+    if (n > 0) {
+      f(size_t(0), n);
+    }
+    return;
+  }
+  thread_pool()->parallel_for(n, grain, std::forward<F>(f));
+}
+
+}  // namespace upsilon
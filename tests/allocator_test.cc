@@ -0,0 +1,163 @@
+#include "allocator.hh"
+#include "graph.hh"
+#include "tensor.hh"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+using namespace upsilon;
+
+static bool aligned(const void* p) {
+  return reinterpret_cast<uintptr_t>(p) % kBufferAlignment == 0;
+}
+
+TEST(AllocatorTest, SizeClasses) {
+  size_t previous = 0;
+  for (size_t bytes = 1; bytes < (size_t(1) << 26); bytes += bytes / 7 + 1) {
+    const size_t index = CachingAllocator::size_class(bytes);
+    const size_t rounded = CachingAllocator::class_size(index);
+    ASSERT_GE(rounded, bytes);
+    ASSERT_EQ(rounded % kBufferAlignment, 0u);
+    ASSERT_GE(index, previous);
+    if (bytes > 256) {
+      ASSERT_LE(rounded, bytes + bytes / 4) << bytes;
+    }
+    ASSERT_EQ(CachingAllocator::size_class(rounded), index);
+    previous = index;
+  }
+}
+
+TEST(AllocatorTest, BuffersAreAligned) {
+  for (uint32_t n : {1u, 3u, 17u, 1000u, 1u << 20}) {
+    Tensor<float> t(TensorType::Matrix, {1, n});
+    EXPECT_TRUE(aligned(t.data().data())) << n;
+    EXPECT_EQ(t.data()[n - 1], 0.0f);
+  }
+}
+
+TEST(AllocatorTest, CachesFreedBuffers) {
+  auto& allocator = CachingAllocator::instance();
+  allocator.reset_stats();
+  const uint64_t in_use = allocator.stats().bytes_in_use;
+
+  const float* first;
+  {
+    Tensor<float> t(TensorType::Matrix, {100, 100});
+    first = t.data().data();
+    EXPECT_GE(allocator.stats().bytes_in_use, in_use + 40000);
+  }
+  EXPECT_EQ(allocator.stats().bytes_in_use, in_use);
+  EXPECT_GE(allocator.stats().bytes_cached, 40000u);
+
+  Tensor<float> again(TensorType::Matrix, {100, 100});
+  EXPECT_EQ(again.data().data(), first);
+  const AllocatorStats stats = allocator.stats();
+  EXPECT_EQ(stats.allocations, 2u);
+  EXPECT_EQ(stats.cache_hits, 1u);
+  EXPECT_GE(stats.peak_bytes, in_use + 40000);
+  EXPECT_EQ(again.data()[1234], 0.0f);  // recycled buffers are cleared too
+}
+
+TEST(AllocatorTest, HugePages) {
+  set_huge_pages(true);
+  {
+    Tensor<float> big(TensorType::Matrix, {1024, 2048});
+    big.fill(1.0f);
+    EXPECT_TRUE(aligned(big.data().data()));
+    EXPECT_FLOAT_EQ(big.sum(), 1024.0f * 2048.0f);
+  }
+  set_huge_pages(false);
+}
+
+TEST(AllocatorTest, ScopeAndDefault) {
+  auto system = std::make_shared<SystemAllocator>();
+  auto& caching = CachingAllocator::instance();
+  caching.reset_stats();
+  {
+    AllocatorScope scope(system);
+    Tensor<float> t(TensorType::Matrix, {10, 10});
+  }
+  EXPECT_EQ(caching.stats().allocations, 0u);
+
+  set_default_allocator(system);
+  { Tensor<float> t(TensorType::Matrix, {10, 10}); }
+  EXPECT_EQ(caching.stats().allocations, 0u);
+  set_default_allocator(std::shared_ptr<Allocator>(&caching, [](Allocator*) {}));
+  { Tensor<float> t(TensorType::Matrix, {10, 10}); }
+  EXPECT_EQ(caching.stats().allocations, 1u);
+}
+
+TEST(ArenaTest, ResetReusesMemory) {
+  auto arena = std::make_shared<Arena>(1 << 16);
+  const float* first;
+  {
+    AllocatorScope scope(arena);
+    Tensor<float> a(TensorType::Matrix, {16, 16});
+    Tensor<float> b(TensorType::Matrix, {16, 16});
+    first = a.data().data();
+    EXPECT_TRUE(aligned(first));
+    EXPECT_TRUE(aligned(b.data().data()));
+    EXPECT_NE(first, b.data().data());
+  }
+  EXPECT_GT(arena->bytes_in_use(), 2048u);
+
+  arena->reset();
+  EXPECT_EQ(arena->bytes_in_use(), 0u);
+  AllocatorScope scope(arena);
+  Tensor<float> c(TensorType::Matrix, {16, 16});
+  EXPECT_EQ(c.data().data(), first);
+  EXPECT_EQ(arena->chunk_count(), 1u);
+}
+
+TEST(ArenaTest, LiveBuffersSurviveReset) {
+  auto arena = std::make_shared<Arena>(1 << 16);
+  Tensor<float> kept(0.0f);
+  {
+    AllocatorScope scope(arena);
+    kept = Tensor<float>(TensorType::Matrix, {32, 32});
+    kept.fill(3.0f);
+  }
+  arena->reset();
+  EXPECT_EQ(arena->chunk_count(), 0u);
+
+  AllocatorScope scope(arena);
+  Tensor<float> fresh(TensorType::Matrix, {32, 32});
+  fresh.fill(5.0f);
+  EXPECT_NE(fresh.data().data(), kept.data().data());
+  EXPECT_FLOAT_EQ(kept.sum(), 3.0f * 1024);
+
+  // Large requests get a chunk of their own.
+  Tensor<float> large(TensorType::Matrix, {256, 256});
+  EXPECT_TRUE(aligned(large.data().data()));
+  EXPECT_EQ(arena->chunk_count(), 2u);
+}
+
+TEST(ArenaTest, OutlivedByItsBuffers) {
+  Tensor<float> kept(0.0f);
+  {
+    auto arena = std::make_shared<Arena>();
+    AllocatorScope scope(arena);
+    kept = Tensor<float>(TensorType::Matrix, {8, 8});
+  }
+  kept.fill(2.0f);
+  EXPECT_FLOAT_EQ(kept.sum(), 128.0f);
+}
+
+TEST(ArenaTest, ExecutorStepsFromArena) {
+  auto x = std::make_shared<Variable>(Tensor<float>(TensorType::Matrix, {4, 8}));
+  auto w = std::make_shared<Variable>(Tensor<float>(TensorType::Matrix, {8, 3}));
+  x->output.fill(0.5f);
+  w->output.fill(0.25f);
+  auto y = std::make_shared<Tanh>(std::make_shared<MatMul>(x, w));
+
+  Executor executor(y);
+  auto arena = std::make_shared<Arena>();
+  executor.set_arena(arena);
+  for (int step = 0; step < 3; step++) {
+    executor.step();
+    EXPECT_FLOAT_EQ(y->output.at(2, 1), std::tanh(1.0f));
+    EXPECT_FLOAT_EQ(w->grad.at(0, 0), 4 * 0.5f * (1.0f - std::tanh(1.0f) * std::tanh(1.0f)));
+  }
+  EXPECT_LE(arena->chunk_count(), 1u);
+}
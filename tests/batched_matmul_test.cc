@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+// Operands repeat every kPeriod elements so that products stay small.
+static constexpr uint32_t kPeriod = 23;
+
+static void expect_matrix_near(const Tensor<float>& actual, const Tensor<float>& expected) {
+  ASSERT_EQ(actual.rows(), expected.rows());
+  ASSERT_EQ(actual.cols(), expected.cols());
+  for (uint32_t i = 0; i < expected.rows(); i++) {
+    for (uint32_t j = 0; j < expected.cols(); j++) {
+      EXPECT_NEAR(actual.at(i, j), expected.at(i, j), 1e-4f * std::max(1.0f, std::abs(expected.at(i, j))));
+    }
+  }
+}
+
+TEST(BatchedMatmulTest, MatchesChipLoop) {
+  const Tensor<float> a = ramp({5, 7, 4}, -1.f, 0.125f, kPeriod);
+  const Tensor<float> b = ramp({5, 4, 6}, 0.5f, -0.0625f, kPeriod);
+  const Tensor<float> c = a.matmul(b);
+  ASSERT_EQ(c.shape(), (std::vector<uint32_t>{5, 7, 6}));
+  for (uint32_t k = 0; k < 5; k++) {
+    expect_matrix_near(c.chip(k, 0), a.chip(k, 0).matmul(b.chip(k, 0)));
+  }
+
+  // Strided operands are read in place.
+  const Tensor<float> at = ramp({5, 4, 7}, 0.25f, 0.25f, kPeriod).transposed();
+  const Tensor<float> d = at.matmul(b);
+  for (uint32_t k = 0; k < 5; k++) {
+    expect_matrix_near(d.chip(k, 0), at.chip(k, 0).matmul(b.chip(k, 0)));
+  }
+}
+
+TEST(BatchedMatmulTest, BroadcastsBatchDimensions) {
+  const Tensor<float> a = ramp({2, 1, 3, 4}, -0.5f, 0.25f, kPeriod);
+  const Tensor<float> b = ramp({3, 4, 5}, 1.f, -0.125f, kPeriod);
+  const Tensor<float> c = a.matmul(b);
+  ASSERT_EQ(c.shape(), (std::vector<uint32_t>{2, 3, 3, 5}));
+  for (uint32_t i = 0; i < 2; i++) {
+    for (uint32_t j = 0; j < 3; j++) {
+      expect_matrix_near(c.chip(i, 0).chip(j, 0), a.chip(i, 0).chip(0, 0).matmul(b.chip(j, 0)));
+    }
+  }
+
+  // A matrix shared by every channel, on either side.
+  const Tensor<float> w = ramp({4, 5}, 0.1f, 0.2f, kPeriod);
+  const Tensor<float> x = ramp({6, 3, 4}, -1.f, 0.1f, kPeriod);
+  const Tensor<float> xw = x.matmul(w);
+  const Tensor<float> wx = w.transposed().matmul(x.transposed());
+  for (uint32_t k = 0; k < 6; k++) {
+    expect_matrix_near(xw.chip(k, 0), x.chip(k, 0).matmul(w));
+    expect_matrix_near(wx.chip(k, 0), w.transposed().matmul(x.chip(k, 0).transposed()));
+  }
+
+  EXPECT_THROW(ramp({2, 3, 4}, 0, 1, kPeriod).matmul(ramp({3, 4, 5}, 0, 1, kPeriod)), std::invalid_argument);
+  EXPECT_THROW(ramp({2, 3, 4}, 0, 1, kPeriod).matmul(ramp({2, 3, 5}, 0, 1, kPeriod)), std::invalid_argument);
+  EXPECT_THROW(ramp({2, 3, 4}, 0, 1, kPeriod).matmul(ramp({1, 4}, 0, 1, kPeriod).view({4})), std::invalid_argument);
+}
+
+TEST(BatchedMatmulTest, AddmmSumsOverMissingBatchDimensions) {
+  const Tensor<float> a = ramp({4, 6, 3}, -0.5f, 0.125f, kPeriod);
+  const Tensor<float> b = ramp({4, 6, 5}, 0.25f, 0.0625f, kPeriod);
+  Tensor<float> expected = ramp({3, 5}, 1.f, 0.5f, kPeriod);
+  Tensor<float> folded = expected, looped = expected;
+  for (uint32_t k = 0; k < 4; k++) {
+    expected.addmm_(a.chip(k, 0).transposed(), b.chip(k, 0));
+  }
+
+  // Contiguous operands fold into one (3, 24) x (24, 5) product; a
+  // non-foldable layout takes the per-matrix loop.
+  folded.addmm_(a.transposed(), b);
+  looped.addmm_(a.transposed(), b.permute({0, 2, 1}).contiguous().transposed());
+  expect_matrix_near(folded, expected);
+  expect_matrix_near(looped, expected);
+
+  Tensor<float> zeroed = ramp({3, 5}, 9.f, 0.f, kPeriod);
+  zeroed.addmm_(a.transposed(), b, 0.0f);
+  Tensor<float> sum = Tensor<float>::zeros_like(zeroed);
+  for (uint32_t k = 0; k < 4; k++) {
+    sum.addmm_(a.chip(k, 0).transposed(), b.chip(k, 0));
+  }
+  expect_matrix_near(zeroed, sum);
+}
+
+TEST(BatchedMatmulTest, OutputFormReusesBuffer) {
+  const Tensor<float> x = ramp({8, 16, 12}, -1.f, 0.05f, kPeriod);
+  const Tensor<float> w = ramp({12, 10}, 0.5f, -0.03f, kPeriod);
+  Tensor<float> out(0.0f);
+  x.matmul(w, out);
+
+  reset_storage_stats();
+  x.matmul(w, out);
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  expect_matrix_near(out.chip(7, 0), x.chip(7, 0).matmul(w));
+}
+
+TEST(BatchedMatmulTest, OpGradients) {
+  auto matmul = [](const auto& in) { return std::make_shared<MatMul>(in[0], in[1]); };
+  const float h = 1e-2f;
+  expect_gradients_match(matmul, {ramp({3, 4, 5}, -0.5f, 0.1f, kPeriod), ramp({3, 5, 2}, 0.25f, 0.05f, kPeriod)}, h);
+  expect_gradients_match(matmul, {ramp({3, 4, 5}, -0.5f, 0.1f, kPeriod), ramp({5, 2}, 0.25f, 0.05f, kPeriod)}, h);
+  expect_gradients_match(matmul, {ramp({4, 5}, -0.5f, 0.1f, kPeriod), ramp({2, 3, 5, 2}, 0.25f, 0.05f, kPeriod)}, h);
+}
+
+TEST(BatchedMatmulTest, StepDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(ramp({4, 8, 6}, -1.f, 0.02f, kPeriod));
+  auto w = std::make_shared<Variable>(ramp({6, 3}, -0.5f, 0.03f, kPeriod));
+  auto v = std::make_shared<Variable>(ramp({4, 3, 2}, 0.1f, 0.05f, kPeriod));
+  auto y = std::make_shared<Tanh>(std::make_shared<MatMul>(std::make_shared<MatMul>(x, w), v));
+
+  Executor executor(y);
+  executor.step();
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+TEST(BroadcastTest, Shapes) {
+  using V = std::vector<uint32_t>;
+  EXPECT_EQ(detail::broadcast_shape({4, 3}, {1, 3}), (V{4, 3}));
+  EXPECT_EQ(detail::broadcast_shape({4, 3}, {3}), (V{4, 3}));
+  EXPECT_EQ(detail::broadcast_shape({3, 1}, {1, 4}), (V{3, 4}));
+  EXPECT_EQ(detail::broadcast_shape({2, 3, 4}, {}), (V{2, 3, 4}));
+  EXPECT_EQ(detail::broadcast_shape({8, 1, 6, 1}, {7, 1, 5}), (V{8, 7, 6, 5}));
+  EXPECT_THROW(detail::broadcast_shape({4, 3}, {4}), std::invalid_argument);
+  EXPECT_THROW(ramp({2, 3}, 0, 1).add(ramp({3, 2}, 0, 1)), std::invalid_argument);
+}
+
+TEST(BroadcastTest, BroadcastToIsAView) {
+  Tensor<float> bias = ramp({1, 3}, 1.f, 1.f);
+  Tensor<float> wide = bias.broadcast_to({4, 3});
+  EXPECT_TRUE(wide.shares_storage(bias));
+  EXPECT_EQ(wide.strides(), (std::vector<int64_t>{0, 1}));
+  EXPECT_FLOAT_EQ(wide.at(3, 2), 3.f);
+  EXPECT_THROW(bias.broadcast_to({4, 2}), std::invalid_argument);
+}
+
+TEST(BroadcastTest, ElementwiseOps) {
+  const Tensor<float> x = ramp({2, 3, 4}, -1.f, 0.25f);
+  const Tensor<float> row = ramp({1, 4}, 1.f, 1.f);
+  const Tensor<float> channel = ramp({2, 1, 1}, 2.f, 1.f);
+  const Tensor<float> column = ramp({3, 1}, 0.5f, 0.5f);
+
+  reset_storage_stats();
+  const Tensor<float> sum = x.add(row);
+  const Tensor<float> scaled = x.mul(channel);
+  const Tensor<float> diff = column.sub(x);
+  const Tensor<float> ratio = row.div(column);
+  EXPECT_EQ(storage_stats().allocations, 4);  // the results only
+
+  ASSERT_EQ(ratio.shape(), (std::vector<uint32_t>{3, 4}));
+  for (uint32_t c = 0; c < 2; c++) {
+    for (uint32_t i = 0; i < 3; i++) {
+      for (uint32_t j = 0; j < 4; j++) {
+        const float v = x.at(c, i, j);
+        EXPECT_FLOAT_EQ(sum.at(c, i, j), v + row.at(0, j));
+        EXPECT_FLOAT_EQ(scaled.at(c, i, j), v * channel.at(c, 0, 0));
+        EXPECT_FLOAT_EQ(diff.at(c, i, j), column.at(i, 0) - v);
+      }
+    }
+  }
+  for (uint32_t i = 0; i < 3; i++) {
+    for (uint32_t j = 0; j < 4; j++) {
+      EXPECT_FLOAT_EQ(ratio.at(i, j), row.at(0, j) / column.at(i, 0));
+    }
+  }
+
+  // Scalars broadcast against anything.
+  const Tensor<float> shifted = x.sub(Tensor<float>(1.0f));
+  EXPECT_FLOAT_EQ(shifted.at(1, 2, 3), x.at(1, 2, 3) - 1.0f);
+}
+
+TEST(BroadcastTest, OutputAndInPlaceForms) {
+  const Tensor<float> x = ramp({64, 32}, 0.f, 0.5f);
+  const Tensor<float> bias = ramp({1, 32}, 1.f, 1.f);
+  const Tensor<float> ones = ramp({1, 32}, 1.f, 0.f).view({32});
+  Tensor<float> out(0.0f);
+  x.add(bias, out);
+
+  reset_storage_stats();
+  x.add(bias, out);
+  Tensor<float> y = x;
+  y.add_(bias);  // clones the buffer shared with x, once
+  y.mul_(ones);
+  EXPECT_EQ(storage_stats().allocations, 1);
+  EXPECT_EQ(out.values(), y.values());
+  EXPECT_THROW(Tensor<float>(bias).add_(x), std::invalid_argument);
+
+  // out may be an operand, even one that changes shape.
+  Tensor<float> b = bias;
+  x.add(b, b);
+  EXPECT_EQ(b.values(), out.values());
+}
+
+TEST(BroadcastTest, SumTo) {
+  const Tensor<float> x = ramp({2, 3, 4}, 0.f, 1.f);
+  const Tensor<float> rows = x.sum_to({1, 4});
+  const Tensor<float> channels = x.sum_to({2, 1, 1});
+  for (uint32_t j = 0; j < 4; j++) {
+    float expected = 0;
+    for (uint32_t c = 0; c < 2; c++) {
+      for (uint32_t i = 0; i < 3; i++) {
+        expected += x.at(c, i, j);
+      }
+    }
+    EXPECT_FLOAT_EQ(rows.at(0, j), expected);
+  }
+  EXPECT_FLOAT_EQ(channels.at(0, 0, 0), 66.f);
+  EXPECT_FLOAT_EQ(channels.at(1, 0, 0), 210.f);
+  EXPECT_FLOAT_EQ(x.sum_to({}).at(0), 276.f);
+}
+
+TEST(BroadcastTest, OpGradients) {
+  const Tensor<float> x = ramp({2, 3, 4}, 0.5f, 0.125f);
+  const Tensor<float> row = ramp({1, 4}, 1.f, 0.5f);
+  const Tensor<float> channel = ramp({2, 1, 1}, 1.5f, 0.5f);
+
+  const float h = 1e-2f;
+  expect_gradients_match([](const auto& in) { return std::make_shared<Add>(in[0], in[1]); }, {x, row}, h);
+  expect_gradients_match([](const auto& in) { return std::make_shared<Sub>(in[0], in[1]); }, {row, x}, h);
+  expect_gradients_match([](const auto& in) { return std::make_shared<Mul>(in[0], in[1]); }, {x, channel}, h);
+  expect_gradients_match([](const auto& in) { return std::make_shared<Div>(in[0], in[1]); }, {x, row}, h);
+  expect_gradients_match([](const auto& in) { return std::make_shared<Div>(in[0], in[1]); }, {channel, x}, h);
+}
+
+TEST(BroadcastTest, BiasAddStepDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(ramp({16, 8}, -1.f, 0.01f));
+  auto w = std::make_shared<Variable>(ramp({8, 4}, -0.5f, 0.03f));
+  auto bias = std::make_shared<Variable>(ramp({1, 4}, 0.1f, 0.1f));
+  auto y = std::make_shared<Tanh>(std::make_shared<Add>(std::make_shared<MatMul>(x, w), bias));
+
+  Executor executor(y);
+  executor.step();
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+
+  // d(sum y)/d(bias) is the column sum of 1 - y^2.
+  const Tensor<float> expected = Tensor<float>(1.0f - y->output.lazy() * y->output.lazy()).sum_to({1, 4});
+  for (uint32_t j = 0; j < 4; j++) {
+    EXPECT_FLOAT_EQ(bias->grad.at(0, j), expected.at(0, j));
+  }
+}
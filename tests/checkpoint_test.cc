@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+// layers x (MatMul, Tanh or Sigmoid), with a skip connection every fourth
+// layer so some inputs reach across segments.
+static Net make_mlp(int layers, uint32_t batch = 8, uint32_t width = 16) {
+  Net net;
+  net.x = std::make_shared<Variable>(random({batch, width}, -1.0f, 1.0f));
+  std::shared_ptr<Op> h = net.x, skip = net.x;
+  for (int l = 0; l < layers; l++) {
+    net.weights.push_back(std::make_shared<Variable>(random({width, width}, -0.5f, 0.5f, 2 + l)));
+    const auto z = std::make_shared<MatMul>(h, net.weights.back());
+    h = l % 2 == 0 ? std::shared_ptr<Op>(std::make_shared<Tanh>(z)) : std::make_shared<Sigmoid>(z);
+    if (l % 4 == 3) {
+      h = std::make_shared<Add>(h, skip);
+      skip = h;
+    }
+    net.layers.push_back(h);
+  }
+  net.loss = squared_sum(h);
+  return net;
+}
+
+TEST(CheckpointTest, MarkedSegments) {
+  Net reference = make_mlp(12);
+  Executor plain(reference.loss);
+  plain.step();
+
+  Net net = make_mlp(12);
+  Executor executor(net.loss);
+  const std::vector<std::shared_ptr<Op>> marked = {net.layers[3], net.layers[7]};
+  executor.set_checkpoints(marked);
+  EXPECT_EQ(executor.checkpoints(), marked);
+  for (int i = 0; i < 2; i++) {
+    executor.step();
+    EXPECT_EQ(net.loss->output.values(), reference.loss->output.values());
+    EXPECT_EQ(grads(net), grads(reference));
+  }
+  // Every MatMul, activation and the Mul and inner Sum are dropped except the
+  // two checkpoints; the skip connections are checkpoints or the input.
+  const size_t intermediates = executor.graph().size() - 1 - net.weights.size() - 1;
+  EXPECT_EQ(executor.recomputed(), intermediates - marked.size());
+
+  executor.set_checkpoints({});
+  EXPECT_TRUE(executor.checkpoints().empty());
+  executor.step();
+  EXPECT_EQ(executor.recomputed(), 0u);
+  EXPECT_EQ(grads(net), grads(reference));
+
+  EXPECT_THROW(executor.set_checkpoints({std::make_shared<Tanh>(net.x)}), std::invalid_argument);
+}
+
+TEST(CheckpointTest, BudgetHeuristic) {
+  Net reference = make_mlp(32);
+  Executor plain(reference.loss);
+  plain.step();
+
+  Net net = make_mlp(32);
+  Executor executor(net.loss);
+  const std::vector<std::shared_ptr<Op>> chosen = executor.checkpoint_by_budget();
+  // About sqrt(N) of the 74 droppable outputs, all at the skip connections:
+  // inside a block the skip reads past every op.
+  EXPECT_GE(chosen.size(), 6u);
+  EXPECT_LE(chosen.size(), 10u);
+  for (const auto& op : chosen) {
+    EXPECT_NE(dynamic_cast<Add*>(op.get()), nullptr);
+  }
+  executor.step();
+  EXPECT_EQ(grads(net), grads(reference));
+
+  // A budget covering everything still cuts the graph about every sqrt(N)
+  // ops, at the same skip connections.
+  const std::vector<std::shared_ptr<Op>> capped = executor.checkpoint_by_budget(size_t(1) << 30);
+  EXPECT_GE(capped.size(), 6u);
+  EXPECT_LE(capped.size(), 10u);
+  for (const auto& op : capped) {
+    EXPECT_NE(dynamic_cast<Add*>(op.get()), nullptr);
+  }
+  executor.step();
+  EXPECT_EQ(grads(net), grads(reference));
+}
+
+// A chain far deeper than the call stack allows one frame per op.
+TEST(CheckpointTest, DeepChain) {
+  const int depth = 100000;
+  auto make = [] {
+    Net net;
+    net.x = std::make_shared<Variable>(random({2, 4}, -1.0f, 1.0f));
+    std::shared_ptr<Op> h = net.x;
+    for (int i = 0; i < depth; i++) {
+      h = std::make_shared<Tanh>(h);
+    }
+    net.loss = squared_sum(h);
+    return net;
+  };
+  Net reference = make();
+  Executor plain(reference.loss);
+  plain.step();
+
+  Net net = make();
+  Executor executor(net.loss);
+  const size_t chosen = executor.checkpoint_by_budget(SIZE_MAX).size();
+  EXPECT_GE(chosen, 300u);
+  EXPECT_LE(chosen, 320u);
+  executor.step();
+  EXPECT_EQ(executor.recomputed(), depth + 2 - chosen);
+  EXPECT_EQ(grads(net), grads(reference));
+}
+
+TEST(CheckpointTest, LowersPeakMemory) {
+  // Bytes the executor holds at the peak of a step, beyond the inputs and
+  // weights.
+  auto peak = [](bool checkpointing) {
+    Net net = make_mlp(64, 1024, 128);
+    auto& allocator = CachingAllocator::instance();
+    const uint64_t weights = allocator.stats().bytes_in_use;
+    Executor executor(net.loss);
+    if (checkpointing) {
+      executor.checkpoint_by_budget();
+    }
+    executor.step();
+    allocator.reset_stats();
+    executor.step();
+    return allocator.stats().peak_bytes - weights;
+  };
+  const uint64_t full = peak(false), checkpointed = peak(true);
+  EXPECT_LT(checkpointed * 3, full);
+}
+
+TEST(CheckpointTest, WithHalfActivations) {
+  Net reference = make_mlp(12);
+  Executor plain(reference.loss);
+  plain.set_activation_precision(Precision::BF16);
+  plain.step();
+
+  Net net = make_mlp(12);
+  Executor executor(net.loss);
+  executor.set_activation_precision(Precision::BF16);
+  executor.set_checkpoints({net.layers[5]});
+  executor.step();
+  EXPECT_GT(executor.recomputed(), 0u);
+  // Recomputed activations are not rounded, so they differ in the last bits.
+  const auto expected = grads(reference), actual = grads(net);
+  for (size_t w = 0; w < expected.size(); w++) {
+    for (size_t i = 0; i < expected[w].size(); i++) {
+      ASSERT_NEAR(actual[w][i], expected[w][i], 0.02f * (1.0f + std::abs(expected[w][i]))) << w << ", " << i;
+    }
+  }
+}
+
+TEST(CheckpointTest, RejectsMemoryPlan) {
+  Net net = make_mlp(4);
+  Executor executor(net.loss);
+  executor.set_checkpoints({net.layers[1]});
+  EXPECT_THROW(executor.plan_memory(), std::logic_error);
+  executor.set_checkpoints({});
+  executor.plan_memory();
+  EXPECT_THROW(executor.set_checkpoints({net.layers[1]}), std::logic_error);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+TEST(SliceTest, ForwardIsAView) {
+  auto x = std::make_shared<Variable>(ramp({2, 3, 4}, 0.0f, 1.0f));
+  auto s = std::make_shared<Slice>(x, 2, 1, 3);
+  reset_storage_stats();
+  s->forward();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_TRUE(s->output.shares_storage(x->output));
+  ASSERT_EQ(s->output.shape(), (std::vector<uint32_t>{2, 3, 2}));
+  EXPECT_EQ(s->output.values(), (std::vector<float>{1, 2, 5, 6, 9, 10, 13, 14, 17, 18, 21, 22}));
+}
+
+TEST(SliceTest, BackwardAddsIntoRange) {
+  auto x = std::make_shared<Variable>(ramp({3, 2, 2}, 0.0f, 1.0f));
+  auto s = std::make_shared<Slice>(x, 0, 1, 2);
+  s->forward();
+  x->grad = Tensor<float>::zeros_like(x->output).fill_(1.0f);
+  s->grad = ramp(s->output.shape(), 10.0f, 1.0f);
+  reset_storage_stats();
+  s->backward();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(x->grad.values(), (std::vector<float>{1, 1, 1, 1, 11, 12, 13, 14, 1, 1, 1, 1}));
+  EXPECT_THROW(Slice(x, 0, 2, 4).forward(), std::invalid_argument);
+}
+
+TEST(SliceTest, StridedSliceFeedsElementwiseOps) {
+  auto x = std::make_shared<Variable>(ramp({2, 2, 4}, -8.0f, 1.0f));
+  auto s = std::make_shared<Slice>(x, 2, 1, 3);
+  auto y = std::make_shared<Mul>(std::make_shared<ReLU>(s), s);
+  Executor executor(y);
+  executor.step();
+  EXPECT_EQ(y->output.values(), (std::vector<float>{0, 0, 0, 0, 1, 4, 25, 36}));
+  // d(relu(s) * s) / ds = 2s where s > 0.
+  EXPECT_EQ(x->grad.values(), (std::vector<float>{0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 4, 0, 0, 10, 12, 0}));
+}
+
+TEST(ConcatTest, ForwardJoinsAlongAxis) {
+  auto a = std::make_shared<Variable>(ramp({1, 2, 3}, 0.0f, 1.0f));
+  auto b = std::make_shared<Variable>(ramp({2, 2, 3}, 100.0f, 1.0f));
+  auto c = std::make_shared<Concat>(std::vector<std::shared_ptr<Op>>{a, b}, 0);
+  c->forward();
+  ASSERT_EQ(c->output.shape(), (std::vector<uint32_t>{3, 2, 3}));
+  EXPECT_EQ(c->output.values(), (std::vector<float>{0, 1, 2, 3, 4, 5, 100, 101, 102, 103, 104, 105, 106, 107,
+                                                    108, 109, 110, 111}));
+
+  auto m = std::make_shared<Variable>(ramp({2, 1}, 0.0f, 1.0f));
+  auto n = std::make_shared<Variable>(ramp({2, 2}, 10.0f, 1.0f));
+  auto d = std::make_shared<Concat>(std::vector<std::shared_ptr<Op>>{m, n}, 1);
+  d->forward();
+  ASSERT_EQ(d->output.shape(), (std::vector<uint32_t>{2, 3}));
+  EXPECT_EQ(d->output.values(), (std::vector<float>{0, 10, 11, 1, 12, 13}));
+}
+
+TEST(ConcatTest, RejectsMismatchedInputs) {
+  auto a = std::make_shared<Variable>(ramp({1, 2, 3}, 0.0f, 1.0f));
+  auto b = std::make_shared<Variable>(ramp({1, 3, 3}, 0.0f, 1.0f));
+  EXPECT_THROW(Concat({a, b}, 0).forward(), std::invalid_argument);
+  EXPECT_NO_THROW(Concat({a, b}, 1).forward());
+  EXPECT_THROW(Concat({a, b}, 3).forward(), std::invalid_argument);
+  EXPECT_THROW(Concat({}, 0), std::invalid_argument);
+}
+
+TEST(ConcatTest, BackwardScattersGradient) {
+  auto a = std::make_shared<Variable>(ramp({2, 2, 2}, 0.0f, 1.0f));
+  auto b = std::make_shared<Variable>(ramp({2, 2, 1}, 0.0f, 1.0f));
+  auto c = std::make_shared<Concat>(std::vector<std::shared_ptr<Op>>{a, b}, 2);
+  auto y = std::make_shared<Mul>(c, std::make_shared<Variable>(ramp({2, 2, 3}, 1.0f, 1.0f)));
+  Executor executor(y);
+  executor.step();
+  EXPECT_EQ(a->grad.values(), (std::vector<float>{1, 2, 4, 5, 7, 8, 10, 11}));
+  EXPECT_EQ(b->grad.values(), (std::vector<float>{3, 6, 9, 12}));
+}
+
+TEST(ConcatTest, ProducersWriteIntoOutput) {
+  auto x = std::make_shared<Variable>(ramp({2, 4, 4}, -16.0f, 1.0f));
+  auto w = std::make_shared<Variable>(ramp({3, 4, 4}, -20.0f, 1.0f));
+  auto a = std::make_shared<Tanh>(x);
+  auto b = std::make_shared<Mul>(w, w);
+  auto c = std::make_shared<Concat>(std::vector<std::shared_ptr<Op>>{a, b}, 0);
+  auto y = std::make_shared<Sigmoid>(c);
+
+  Executor executor(y);
+  executor.step();
+  const std::vector<float> first = y->output.values();
+  EXPECT_TRUE(a->output.placed());
+  EXPECT_TRUE(b->output.placed());
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_TRUE(a->output.shares_storage(c->output));
+  EXPECT_TRUE(b->output.shares_storage(c->output));
+  EXPECT_EQ(y->output.values(), first);
+
+  // New values flow through the placed producers.
+  x->output.fill(0.0f);
+  executor.forward();
+  EXPECT_EQ(c->output.values()[0], 0.0f);
+  EXPECT_EQ(c->output.values()[32], 400.0f);
+}
+
+TEST(ConcatTest, StridedPartsAreCopied) {
+  auto x = std::make_shared<Variable>(ramp({2, 2, 2}, 0.0f, 1.0f));
+  auto a = std::make_shared<Tanh>(x);
+  auto c = std::make_shared<Concat>(std::vector<std::shared_ptr<Op>>{a, x}, 1);
+  Executor executor(c);
+  executor.forward();
+  EXPECT_FALSE(a->output.placed());
+  x->output.fill(0.0f);
+  executor.forward();
+  EXPECT_EQ(c->output.values(), std::vector<float>(16, 0.0f));
+}
@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+// Inputs repeat every kPeriod elements, which no tested plane size divides,
+// so neighbouring rows and channels differ. Within a period they step by
+// kStride, so neighbouring pixels are not in order either.
+static constexpr uint32_t kPeriod = 31;
+static constexpr uint32_t kStride = 7;
+
+// Direct convolution of image n, straight from the definition.
+static float reference(const Tensor<float>& x, const Tensor<float>& w, const Conv2DOptions& o, uint32_t n,
+                       uint32_t oc, uint32_t oi, uint32_t oj) {
+  const bool batched = x.ndim() == 4;
+  const std::vector<uint32_t> xs = x.shape(), ws = w.shape();
+  const uint32_t channels = xs[xs.size() - 3], rows = xs[xs.size() - 2], cols = xs[xs.size() - 1];
+  const uint32_t group_channels = channels / o.groups, group = oc / (ws[0] / o.groups);
+  double sum = 0;
+  for (uint32_t c = 0; c < group_channels; c++) {
+    for (uint32_t ki = 0; ki < ws[2]; ki++) {
+      for (uint32_t kj = 0; kj < ws[3]; kj++) {
+        const int64_t i = int64_t(oi) * o.stride_h + int64_t(ki) * o.dilation_h - o.pad_h;
+        const int64_t j = int64_t(oj) * o.stride_w + int64_t(kj) * o.dilation_w - o.pad_w;
+        if (i < 0 || j < 0 || i >= rows || j >= cols) {
+          continue;
+        }
+        const uint32_t ic = group * group_channels + c;
+        const uint32_t index = ((n * channels + ic) * rows + uint32_t(i)) * cols + uint32_t(j);
+        sum += double(x.at(batched ? index : index - n * channels * rows * cols)) *
+               w.at(((oc * group_channels + c) * ws[2] + ki) * ws[3] + kj);
+      }
+    }
+  }
+  return static_cast<float>(sum);
+}
+
+static void check_forward(const std::vector<uint32_t>& input, const std::vector<uint32_t>& weight,
+                          const Conv2DOptions& o) {
+  auto x = std::make_shared<Variable>(ramp(input, -1.0f, 0.0625f, kPeriod, kStride));
+  auto w = std::make_shared<Variable>(ramp(weight, -0.5f, 0.03125f, kPeriod, kStride));
+  auto y = std::make_shared<Conv2D>(x, w, o);
+  y->forward();
+
+  const std::vector<uint32_t> shape = y->output.shape();
+  const size_t d = shape.size() - 3;
+  const uint32_t batch = input.size() == 4 ? input[0] : 1;
+  ASSERT_EQ(shape[d], weight[0]);
+  for (uint32_t n = 0; n < batch; n++) {
+    for (uint32_t oc = 0; oc < shape[d]; oc++) {
+      for (uint32_t i = 0; i < shape[d + 1]; i++) {
+        for (uint32_t j = 0; j < shape[d + 2]; j++) {
+          const uint32_t index = ((n * shape[d] + oc) * shape[d + 1] + i) * shape[d + 2] + j;
+          const float expected = reference(x->output, w->output, o, n, oc, i, j);
+          ASSERT_NEAR(y->output.at(index), expected, 1e-4f * std::max(1.0f, std::abs(expected)))
+              << "n=" << n << " oc=" << oc << " at " << i << "," << j;
+        }
+      }
+    }
+  }
+}
+
+TEST(Conv2DTest, ForwardMatchesDirectConvolution) {
+  check_forward({3, 8, 9}, {4, 3, 3, 3}, {});
+  check_forward({3, 8, 9}, {4, 3, 3, 3}, {1, 1, 1, 1, 1, 1, 1});
+  check_forward({2, 3, 11, 10}, {5, 3, 3, 2}, {2, 3, 1, 2, 1, 1, 1});
+  check_forward({2, 4, 12, 12}, {6, 4, 3, 3}, {1, 1, 2, 2, 2, 2, 1});   // dilated
+  check_forward({2, 6, 7, 7}, {4, 3, 3, 3}, {1, 1, 1, 1, 1, 1, 2});     // grouped
+  check_forward({6, 9, 9}, {6, 1, 3, 3}, {2, 2, 1, 1, 1, 1, 6});        // depthwise
+  check_forward({2, 5, 6, 7}, {3, 5, 1, 1}, {});                        // pointwise, read in place
+  check_forward({3, 7, 7}, {8, 3, 7, 7}, {2, 2, 3, 3, 1, 1, 1});        // ResNet stem
+}
+
+static Conv2DOptions with(ConvAlgorithm algorithm, uint32_t pad, uint32_t groups = 1) {
+  Conv2DOptions o;
+  o.pad_h = o.pad_w = pad;
+  o.groups = groups;
+  o.algorithm = algorithm;
+  return o;
+}
+
+TEST(Conv2DTest, WinogradMatchesDirectConvolution) {
+  for_each_isa([] {
+    for (ConvAlgorithm a : {ConvAlgorithm::Winograd2x2, ConvAlgorithm::Winograd4x4}) {
+      SCOPED_TRACE(algorithm_name(a));
+      check_forward({5, 8, 8}, {7, 5, 3, 3}, with(a, 0));
+      check_forward({3, 13, 10}, {4, 3, 3, 3}, with(a, 1));   // ragged edge tiles
+      check_forward({2, 4, 7, 9}, {3, 4, 3, 3}, with(a, 2));
+      check_forward({6, 3, 3}, {20, 6, 3, 3}, with(a, 1));    // one tile
+      check_forward({4, 11, 11}, {6, 2, 3, 3}, with(a, 1, 2));
+      check_forward({24, 17, 17}, {33, 24, 3, 3}, with(a, 1));  // wider than a vector of tiles
+      check_forward({7, 3, 17, 15}, {4, 3, 3, 3}, with(a, 1));  // several GEMM chunks of images
+    }
+  });
+}
+
+TEST(Conv2DTest, DirectMatchesDirectConvolution) {
+  const ConvAlgorithm direct = ConvAlgorithm::Direct;
+  for_each_isa([&] {
+    check_forward({4, 9, 40}, {4, 1, 3, 3}, with(direct, 1, 4));
+    check_forward({2, 3, 10, 37}, {6, 1, 3, 3}, with(direct, 0, 3));  // channel multiplier 2
+    check_forward({3, 12, 12}, {3, 1, 5, 5}, with(direct, 2, 3));
+    check_forward({3, 12, 33}, {3, 1, 3, 3}, {2, 2, 1, 1, 1, 1, 3, direct});
+    check_forward({3, 12, 33}, {3, 1, 3, 3}, {1, 1, 2, 2, 2, 2, 3, direct});
+    check_forward({2, 5, 5}, {2, 1, 3, 3}, with(direct, 4, 2));  // mostly padding
+  });
+}
+
+TEST(Conv2DTest, SelectsKernelByShape) {
+  auto pick = [](uint32_t channels, uint32_t size, const std::vector<uint32_t>& weight, Conv2DOptions o,
+                 uint32_t batch = 1) { return conv::geometry(channels, size, size, weight, o, batch).algorithm; };
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  EXPECT_EQ(pick(64, 56, {64, 64, 3, 3}, same), ConvAlgorithm::Winograd4x4);
+  EXPECT_EQ(pick(128, 28, {128, 128, 3, 3}, same), ConvAlgorithm::Winograd2x2);
+  EXPECT_EQ(pick(256, 14, {256, 256, 3, 3}, same), ConvAlgorithm::Im2col);
+  EXPECT_EQ(pick(256, 14, {256, 256, 3, 3}, same, 8), ConvAlgorithm::Winograd4x4);
+  EXPECT_EQ(pick(3, 224, {64, 3, 3, 3}, same), ConvAlgorithm::Im2col);
+  EXPECT_EQ(pick(64, 56, {256, 64, 1, 1}, {}), ConvAlgorithm::Im2col);
+  Conv2DOptions strided = same;
+  strided.stride_h = strided.stride_w = 2;
+  EXPECT_EQ(pick(64, 56, {128, 64, 3, 3}, strided), ConvAlgorithm::Im2col);
+  Conv2DOptions depthwise = strided;
+  depthwise.groups = 32;
+  EXPECT_EQ(pick(32, 112, {32, 1, 3, 3}, depthwise), ConvAlgorithm::Direct);
+
+  EXPECT_THROW(conv::geometry(8, 9, 9, {8, 8, 3, 3}, with(ConvAlgorithm::Direct, 1)), std::invalid_argument);
+  EXPECT_THROW(conv::geometry(8, 9, 9, {8, 8, 5, 5}, with(ConvAlgorithm::Winograd4x4, 1)), std::invalid_argument);
+  EXPECT_THROW(conv::geometry(8, 9, 9, {8, 8, 3, 3}, {2, 2, 1, 1, 1, 1, 1, ConvAlgorithm::Winograd2x2}),
+               std::invalid_argument);
+}
+
+TEST(Conv2DTest, RejectsBadShapes) {
+  auto x = std::make_shared<Variable>(ramp({4, 5, 5}, 0.0f, 1.0f, kPeriod, kStride));
+  EXPECT_THROW(Conv2D(x, std::make_shared<Variable>(ramp({2, 3, 3, 3}, 0, 1, kPeriod, kStride))).forward(),
+               std::invalid_argument);
+  EXPECT_THROW(Conv2D(x, std::make_shared<Variable>(ramp({2, 4, 7, 7}, 0, 1, kPeriod, kStride))).forward(),
+               std::invalid_argument);
+  Conv2DOptions grouped;
+  grouped.groups = 3;
+  EXPECT_THROW(Conv2D(x, std::make_shared<Variable>(ramp({3, 1, 3, 3}, 0, 1, kPeriod, kStride)), grouped).forward(),
+               std::invalid_argument);
+}
+
+static void check_gradients(const std::vector<uint32_t>& input, const std::vector<uint32_t>& weight,
+                            const Conv2DOptions& o) {
+  const Tensor<float> x = ramp(input, -1.0f, 0.0625f, kPeriod, kStride);
+  const Tensor<float> w = ramp(weight, -0.5f, 0.03125f, kPeriod, kStride);
+  expect_gradients_match([&](const auto& in) { return std::make_shared<Conv2D>(in[0], in[1], o); }, {x, w}, 1e-2f);
+}
+
+TEST(Conv2DTest, Gradients) {
+  check_gradients({2, 5, 6}, {3, 2, 3, 3}, {1, 1, 1, 1, 1, 1, 1});
+  check_gradients({2, 2, 7, 6}, {2, 2, 2, 3}, {2, 1, 0, 2, 1, 1, 1});
+  check_gradients({4, 7, 7}, {4, 2, 3, 3}, {2, 2, 2, 1, 2, 1, 2});
+  check_gradients({3, 4, 5}, {2, 3, 1, 1}, {});
+  // Depthwise layers run direct, Winograd layers train through im2col.
+  check_gradients({3, 6, 5}, {6, 1, 3, 3}, {1, 1, 1, 1, 1, 1, 3, ConvAlgorithm::Direct});
+  check_gradients({2, 7, 6}, {2, 1, 3, 2}, {2, 1, 1, 0, 1, 2, 2, ConvAlgorithm::Direct});
+  check_gradients({2, 5, 5}, {3, 2, 3, 3}, {1, 1, 1, 1, 1, 1, 1, ConvAlgorithm::Winograd4x4});
+}
+
+// backward() called by hand, outside an Executor, checks the grad buffers it
+// writes through instead of running past them.
+TEST(Conv2DTest, BackwardByHand) {
+  auto make = [] {
+    auto x = std::make_shared<Variable>(ramp({2, 6, 6}, -1.0f, 0.0625f, kPeriod, kStride));
+    auto w = std::make_shared<Variable>(ramp({3, 2, 3, 3}, -0.5f, 0.03125f, kPeriod, kStride));
+    return std::make_shared<Conv2D>(x, w);
+  };
+  auto c = make();
+  c->forward();
+  EXPECT_THROW(c->backward(), std::invalid_argument);
+  c->grad.resize_as_(c->output).fill_(1.0f);
+  EXPECT_THROW(c->backward(), std::invalid_argument);
+  for (const auto& input : c->inputs) {
+    input->grad.resize_as_(input->output).fill_(0.0f);
+  }
+  c->backward();
+
+  auto reference = make();
+  Executor(reference).step();
+  for (size_t i = 0; i < 2; i++) {
+    EXPECT_EQ(c->inputs[i]->grad.values(), reference->inputs[i]->grad.values()) << "input " << i;
+  }
+}
+
+TEST(Conv2DTest, StepDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(ramp({2, 3, 16, 16}, -1.0f, 0.05f, kPeriod, kStride));
+  auto w1 = std::make_shared<Variable>(ramp({8, 3, 3, 3}, -0.2f, 0.01f, kPeriod, kStride));
+  auto w2 = std::make_shared<Variable>(ramp({4, 8, 1, 1}, -0.2f, 0.02f, kPeriod, kStride));
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  auto h = std::make_shared<ReLU>(std::make_shared<Conv2D>(x, w1, same));
+  auto y = std::make_shared<Tanh>(std::make_shared<Conv2D>(h, w2));
+
+  Executor executor(y);
+  executor.step();
+  const std::vector<float> first = w1->grad.values();
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_EQ(w1->grad.values(), first);
+  EXPECT_EQ(y->output.shape(), (std::vector<uint32_t>{2, 4, 16, 16}));
+}
+
+TEST(Conv2DTest, WinogradAndDirectStepsDoNotAllocate) {
+  auto x = std::make_shared<Variable>(ramp({16, 12, 12}, -1.0f, 0.05f, kPeriod, kStride));
+  auto w1 = std::make_shared<Variable>(ramp({16, 16, 3, 3}, -0.1f, 0.005f, kPeriod, kStride));
+  auto w2 = std::make_shared<Variable>(ramp({16, 1, 3, 3}, -0.2f, 0.02f, kPeriod, kStride));
+  Conv2DOptions dw;
+  dw.pad_h = dw.pad_w = 1;
+  dw.groups = 16;
+  auto h = std::make_shared<Conv2D>(x, w1, with(ConvAlgorithm::Auto, 1));
+  auto y = std::make_shared<Tanh>(std::make_shared<Conv2D>(h, w2, dw));
+
+  Executor executor(y);
+  executor.step();
+  const std::vector<float> first = w1->grad.values();
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_EQ(w1->grad.values(), first);
+}
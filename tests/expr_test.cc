@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+TEST(ExprTest, FusedChainMatchesEager) {
+  Tensor<float> a = ramp({3, 7, 11}, -2.f, 0.01f);
+  Tensor<float> b = ramp({3, 7, 11}, 1.f, 0.02f);
+  Tensor<float> c = ramp({3, 7, 11}, 0.5f, -0.003f);
+
+  reset_storage_stats();
+  Tensor<float> fused = a.lazy() + b.lazy() * (1.0f - c.lazy() * c.lazy()) / b.lazy();
+  EXPECT_EQ(storage_stats().allocations, 1);
+
+  Tensor<float> eager = a.add(b.mul(c.mul(c).apply([](float x) { return 1.0f - x; })).div(b));
+  ASSERT_EQ(fused.shape(), eager.shape());
+  for (uint32_t i = 0; i < fused.size(); ++i) {
+    EXPECT_FLOAT_EQ(fused.at(i), eager.at(i));
+  }
+}
+
+TEST(ExprTest, ElementFunctions) {
+  Tensor<float> x = ramp({4, 9}, -1.f, 0.1f);
+  Tensor<float> relu = max(x.lazy(), 0.0f);
+  Tensor<float> clip = min(max(x.lazy(), -0.5f), 0.5f);
+  Tensor<float> step = greater(x.lazy(), 0.0f);
+  Tensor<float> neg = -x.lazy();
+  for (uint32_t i = 0; i < x.size(); ++i) {
+    const float v = x.at(i);
+    EXPECT_EQ(relu.at(i), std::max(v, 0.0f));
+    EXPECT_EQ(clip.at(i), std::min(std::max(v, -0.5f), 0.5f));
+    EXPECT_EQ(step.at(i), v > 0 ? 1.0f : 0.0f);
+    EXPECT_EQ(neg.at(i), -v);
+  }
+}
+
+TEST(ExprTest, AssignToOperand) {
+  Tensor<float> x = ramp({5, 5}, 0.f, 1.f);
+  x = x.lazy() * x.lazy() + 1.0f;
+  for (uint32_t i = 0; i < x.size(); ++i) {
+    EXPECT_EQ(x.at(i), float(i) * i + 1);
+  }
+}
+
+TEST(ExprTest, Errors) {
+  Tensor<float> a(TensorType::Matrix, {2, 3});
+  Tensor<float> b(TensorType::Matrix, {3, 2});
+  EXPECT_THROW(Tensor<float>(a.lazy() + b.lazy()), std::invalid_argument);
+  EXPECT_THROW(a.transposed().lazy(), std::invalid_argument);
+}
+
+// Central finite differences against the fused backward formulas.
+TEST(ExprTest, BackwardMatchesFiniteDifferences) {
+  auto x = std::make_shared<Variable>(ramp({2, 3}, -0.7f, 0.3f));
+  auto y = std::make_shared<Variable>(ramp({2, 3}, 0.5f, 0.25f));
+  auto z = std::make_shared<Sigmoid>(std::make_shared<Div>(
+      std::make_shared<Tanh>(std::make_shared<Mul>(x, y)),
+      std::make_shared<Add>(std::make_shared<ReLU>(std::make_shared<Sub>(y, x)), y)));
+
+  Executor executor(z);
+  executor.step();
+  const std::vector<float> dx = x->grad.values();
+  const std::vector<float> dy = y->grad.values();
+
+  auto total = [&] {
+    executor.forward();
+    float sum = 0;
+    for (float v : z->output.values()) {
+      sum += v;
+    }
+    return sum;
+  };
+
+  const float h = 1e-3f;
+  for (auto [var, expected] : {std::make_pair(x, dx), std::make_pair(y, dy)}) {
+    for (uint32_t i = 0; i < var->output.size(); ++i) {
+      const float v = var->output.at(i);
+      var->output.at(i) = v + h;
+      const float up = total();
+      var->output.at(i) = v - h;
+      const float down = total();
+      var->output.at(i) = v;
+      EXPECT_NEAR(expected[i], (up - down) / (2 * h), 2e-3f) << i;
+    }
+  }
+}
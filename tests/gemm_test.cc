@@ -0,0 +1,170 @@
+#include "gemm.hh"
+#include "tensor.hh"
+#include "test_util.hh"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace upsilon;
+
+static std::vector<float> values(size_t n, float start, float step) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) {
+    v[i] = start + step * static_cast<float>(i % 29);
+  }
+  return v;
+}
+
+// c = alpha * op(a) * op(b) + beta * c, in double.
+static std::vector<float> reference(bool ta, bool tb, size_t m, size_t n, size_t k, float alpha,
+                                    const std::vector<float>& a, size_t lda, const std::vector<float>& b, size_t ldb,
+                                    float beta, std::vector<float> c, size_t ldc) {
+  for (size_t i = 0; i < m; i++) {
+    for (size_t j = 0; j < n; j++) {
+      double sum = 0;
+      for (size_t p = 0; p < k; p++) {
+        sum += static_cast<double>(ta ? a[p * lda + i] : a[i * lda + p]) * (tb ? b[j * ldb + p] : b[p * ldb + j]);
+      }
+      c[i * ldc + j] = static_cast<float>(alpha * sum + (beta == 0.0f ? 0.0 : beta * c[i * ldc + j]));
+    }
+  }
+  return c;
+}
+
+// Which kernels check() runs: sgemm's choice, or the packed or unpacked path.
+enum class Path { Auto, Packed, Direct };
+
+static void check(size_t m, size_t n, size_t k, bool ta, bool tb, float alpha, float beta, Path path = Path::Auto,
+                  size_t c_pad = 2) {
+  const size_t lda = (ta ? m : k) + 3, ldb = (tb ? k : n) + 1, ldc = n + c_pad;
+  const std::vector<float> a = values((ta ? k : m) * lda, -1.0f, 0.0625f);
+  const std::vector<float> b = values((tb ? n : k) * ldb, 0.5f, -0.03125f);
+  std::vector<float> c = values(m * ldc, 2.0f, 0.25f);
+  const std::vector<float> expected = reference(ta, tb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+  const int64_t a_rs = ta ? 1 : lda, a_cs = ta ? lda : 1, b_rs = tb ? 1 : ldb, b_cs = tb ? ldb : 1;
+  if (path == Path::Packed) {
+    gemm::detail::run(gemm::config(), m, n, k, alpha, a.data(), a_rs, a_cs, b.data(), b_rs, b_cs, beta, c.data(), ldc);
+  } else if (path == Path::Direct) {
+    gemm::detail::run_direct(m, n, k, alpha, a.data(), a_rs, a_cs, b.data(), b_rs, b_cs, beta, c.data(), ldc);
+  } else {
+    gemm::sgemm(ta ? gemm::Trans::Yes : gemm::Trans::No, tb ? gemm::Trans::Yes : gemm::Trans::No, m, n, k, alpha,
+                a.data(), lda, b.data(), ldb, beta, c.data(), ldc);
+  }
+  for (size_t i = 0; i < m; i++) {
+    for (size_t j = 0; j < n; j++) {
+      const float e = expected[i * ldc + j];
+      ASSERT_NEAR(c[i * ldc + j], e, 1e-4f * std::max(1.0f, std::abs(e)) * std::sqrt(float(k) + 1))
+          << m << "x" << n << "x" << k << " ta=" << ta << " tb=" << tb << " at " << i << "," << j;
+    }
+    for (size_t j = n; j < ldc; j++) {
+      ASSERT_EQ(c[i * ldc + j], expected[i * ldc + j]) << "padding written";
+    }
+  }
+}
+
+static void check_shapes(Path path) {
+  for (size_t m : {1, 5, 17, 70}) {
+    for (size_t n : {1, 7, 33, 100}) {
+      for (size_t k : {1, 9, 300}) {
+        for (int t = 0; t < 4; t++) {
+          check(m, n, k, t & 1, t & 2, 1.0f, 0.0f, path);
+        }
+      }
+    }
+  }
+  check(37, 29, 41, false, true, -0.5f, 1.0f, path);
+  check(37, 29, 41, true, false, 2.0f, 0.25f, path);
+}
+
+TEST(GemmTest, MatchesReferenceForEveryTileAndIsa) {
+  const gemm::Config saved = gemm::config();
+  for_each_isa([] {
+    for (gemm::Config config : gemm::tiles()) {
+      // Small blocks so that every loop of the nest takes several trips.
+      config.mc = config.mr * 2;
+      config.kc = 64;
+      config.nc = config.nr * 2;
+      gemm::set_config(config);
+      SCOPED_TRACE(std::to_string(config.mr) + "x" + std::to_string(config.nr));
+      check_shapes(Path::Packed);
+    }
+  });
+  gemm::set_config(saved);
+  check_shapes(Path::Auto);
+}
+
+TEST(GemmTest, DirectMatchesReferenceForEveryIsa) {
+  for_each_isa([] {
+    check_shapes(Path::Direct);
+    // Row-form tails read past the row up to the end of b, then pad.
+    check(6, 17, 40, false, false, 1.0f, 0.5f, Path::Direct, 0);
+    check(3, 31, 2, false, true, -1.0f, 0.0f, Path::Direct);
+    // a^T times a vector, turned into a row vector times a.
+    check(70, 1, 300, true, false, 0.5f, 1.0f, Path::Direct, 0);
+  });
+}
+
+TEST(GemmTest, LargeProductAcrossBlocks) {
+  check(300, 2100, 700, false, false, 1.0f, 0.0f);
+  check(260, 130, 520, true, true, 1.0f, 1.0f);
+}
+
+TEST(GemmTest, StridedOutputAndEdgeCases) {
+  // A transposed output is computed as b^T a^T.
+  const Tensor<float> a = Tensor<float>(MatrixData<float>::Random(19, 23));
+  const Tensor<float> b = Tensor<float>(MatrixData<float>::Random(23, 11));
+  const Tensor<float> expected = a.matmul(b);
+  Tensor<float> out = Tensor<float>(TensorType::Matrix, {11, 19});
+  Tensor<float> view = out.transposed();
+  view.addmm_(a, b, 0.0f);
+  for (uint32_t i = 0; i < 19; i++) {
+    for (uint32_t j = 0; j < 11; j++) {
+      EXPECT_NEAR(view.at(i, j), expected.at(i, j), 1e-5f);
+    }
+  }
+
+  // k = 0 only scales c.
+  std::vector<float> c = {1.0f, 2.0f, 3.0f, 4.0f};
+  gemm::sgemm(gemm::Trans::No, gemm::Trans::No, 2, 2, 0, 1.0f, nullptr, 0, nullptr, 2, 0.5f, c.data(), 2);
+  EXPECT_EQ(c, (std::vector<float>{0.5f, 1.0f, 1.5f, 2.0f}));
+}
+
+TEST(GemmTest, ConfigCacheRoundTrip) {
+  const std::string saved = gemm::cache_path();
+  const std::string path = temp_path("upsilon_gemm_test/tiles");
+  std::remove(path.c_str());
+  setenv("UPSILON_GEMM_CACHE", path.c_str(), 1);
+  EXPECT_EQ(gemm::cache_path(), path);
+
+  const kernels::Isa isa = kernels::active_isa();
+  gemm::Config config = gemm::tiles().back();
+  config.kc = 96;
+  gemm::save_config(kernels::Isa::Scalar, gemm::Config{4, 4, 64, 128, 256});
+  gemm::save_config(isa, config);
+  config.mc = config.mr * 3;
+  gemm::save_config(isa, config);  // replaces the line for isa
+
+  gemm::Config loaded;
+  ASSERT_TRUE(gemm::load_config(isa, loaded));
+  EXPECT_TRUE(loaded == config);
+  ASSERT_TRUE(gemm::load_config(kernels::Isa::Scalar, loaded));
+  EXPECT_EQ(loaded.nc, 256u);
+  setenv("UPSILON_GEMM_CACHE", saved.c_str(), 1);
+
+  EXPECT_THROW(gemm::set_config(gemm::Config{3, 5, 8, 8, 8}), std::invalid_argument);
+}
+
+TEST(GemmTest, AutotunePicksACompiledTile) {
+  const gemm::Config tuned = gemm::autotune();
+  bool found = false;
+  for (const gemm::Config& tile : gemm::tiles()) {
+    found = found || (tile.mr == tuned.mr && tile.nr == tuned.nr);
+  }
+  EXPECT_TRUE(found);
+  EXPECT_GT(tuned.mc, 0u);
+  EXPECT_GT(tuned.kc, 0u);
+  EXPECT_GT(tuned.nc, 0u);
+}
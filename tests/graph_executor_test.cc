@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <gtest/gtest.h>
+#include "graph.hh"
+
+using namespace upsilon;
+
+TEST(GraphTest, TopologicalOrder) {
+  auto a = std::make_shared<Variable>(Tensor<float>(3.0f));
+  auto b = std::make_shared<Variable>(Tensor<float>(2.0f));
+  auto mul_ab = std::make_shared<Mul>(a, b);
+  auto add_a_ab = std::make_shared<Add>(a, mul_ab);
+
+  Graph graph(add_a_ab);
+  const auto& order = graph.order();
+  ASSERT_EQ(order.size(), 4);
+
+  auto position = [&](const std::shared_ptr<Op>& op) {
+    return std::find(order.begin(), order.end(), op) - order.begin();
+  };
+  EXPECT_LT(position(a), position(mul_ab));
+  EXPECT_LT(position(b), position(mul_ab));
+  EXPECT_LT(position(mul_ab), position(add_a_ab));
+  EXPECT_EQ(order.back(), add_a_ab);
+}
+
+TEST(ExecutorTest, ForwardBackward) {
+  auto a = std::make_shared<Variable>(Tensor<float>(3.0f));
+  auto b = std::make_shared<Variable>(Tensor<float>(2.0f));
+  auto mul_ab = std::make_shared<Mul>(a, b);
+  auto add_a_ab = std::make_shared<Add>(a, mul_ab);
+
+  Executor executor(add_a_ab);
+  executor.forward();
+  EXPECT_FLOAT_EQ(add_a_ab->output.at(0), 9.0f);  // 3 + 3 * 2
+
+  executor.backward();
+  EXPECT_FLOAT_EQ(add_a_ab->grad.at(0), 1.0f);
+  EXPECT_FLOAT_EQ(a->grad.at(0), 3.0f);  // 1 + b
+  EXPECT_FLOAT_EQ(b->grad.at(0), 3.0f);  // a
+
+  // Gradients are reset between steps rather than accumulated across them.
+  executor.step();
+  EXPECT_FLOAT_EQ(a->grad.at(0), 3.0f);
+  EXPECT_FLOAT_EQ(b->grad.at(0), 3.0f);
+}
+
+TEST(ExecutorTest, DeepChain) {
+  const size_t depth = 10000;
+  auto x = std::make_shared<Variable>(Tensor<float>(1.0f));
+  std::shared_ptr<Op> y = x;
+  for (size_t i = 0; i < depth; ++i) {
+    y = std::make_shared<Add>(y, x);
+  }
+
+  Executor executor(y);
+  ASSERT_EQ(executor.graph().size(), depth + 1);
+
+  Timing forward = executor.forward();
+  Timing backward = executor.backward();
+  EXPECT_EQ(forward.ops, depth + 1);
+  EXPECT_EQ(backward.ops, depth + 1);
+
+  EXPECT_FLOAT_EQ(y->output.at(0), depth + 1.0f);
+  EXPECT_FLOAT_EQ(x->grad.at(0), depth + 1.0f);
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include "graph_io.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+// A small classifier touching most op types: conv, pools, concat, slice,
+// reductions, elementwise ops, matmul and the fused loss.
+struct Model {
+  std::shared_ptr<Variable> x, labels, w1, w2, bias;
+  std::shared_ptr<Op> logits, loss;
+
+  Model() {
+    x = std::make_shared<Variable>(random({2, 3, 8, 8}, -1.0f, 1.0f));
+    labels = std::make_shared<Variable>(Tensor<float>(std::vector<uint32_t>{1, 4}));
+    w1 = std::make_shared<Variable>(random({6, 3, 3, 3}, -0.5f, 0.5f, 2));
+    w2 = std::make_shared<Variable>(random({12, 5}, -0.5f, 0.5f, 3));
+    bias = std::make_shared<Variable>(random({1, 5}, -0.1f, 0.1f, 4));
+    Conv2DOptions same;
+    same.pad_h = same.pad_w = 1;
+    Pool2DOptions pool;
+    pool.kernel_h = pool.kernel_w = 3;
+    pool.stride_h = pool.stride_w = 2;
+    auto h = std::make_shared<Tanh>(std::make_shared<Conv2D>(x, w1, same));
+    auto both = std::make_shared<Concat>(
+        std::vector<std::shared_ptr<Op>>{std::make_shared<MaxPool2D>(h, pool), std::make_shared<AvgPool2D>(h, pool)}, 1);
+    auto features = std::make_shared<Mean>(std::make_shared<Max>(both, 3), 2);   // (2, 12)
+    auto scaled = std::make_shared<Mul>(features, std::make_shared<Sigmoid>(features));
+    logits = std::make_shared<Add>(std::make_shared<MatMul>(scaled, w2), bias);
+    loss = std::make_shared<SoftmaxCrossEntropy>(logits, labels);
+  }
+};
+
+TEST(GraphIoTest, RoundTrip) {
+  Model model;
+  auto top = std::make_shared<Slice>(std::make_shared<Softmax>(model.logits), 1, 0, 3);
+  Graph graph({model.loss, top});
+  const std::string path = temp_path("model.graph");
+  save_graph(graph, path, "model.ups", {{"x", model.x}, {"labels", model.labels}});
+
+  LoadedGraph loaded = load_graph(path);
+  ASSERT_EQ(loaded.graph.size(), graph.size());
+  ASSERT_EQ(loaded.graph.outputs().size(), 2);
+  ASSERT_EQ(loaded.inputs.size(), 2);
+  EXPECT_EQ(loaded.inputs.at("x")->output.shape(), model.x->output.shape());
+  loaded.inputs.at("x")->output = Tensor<float>(model.x->output);
+  loaded.inputs.at("labels")->output = Tensor<float>(model.labels->output);
+
+  Executor reference(graph);
+  reference.step();
+  Executor executor(loaded.graph);
+  executor.step();
+  for (size_t i = 0; i < 2; i++) {
+    EXPECT_EQ(loaded.graph.outputs()[i]->output.values(), graph.outputs()[i]->output.values());
+  }
+  // Same order, so gradients can be matched op by op.
+  for (size_t i = 0; i < graph.size(); i++) {
+    EXPECT_EQ(loaded.graph.order()[i]->grad.values(), graph.order()[i]->grad.values()) << "op " << i;
+  }
+}
+
+TEST(GraphIoTest, Errors) {
+  Model model;
+  const std::string path = temp_path("errors.graph");
+  EXPECT_THROW(save_graph(Graph(model.loss), path, "errors.ups", {{"y", std::make_shared<Variable>(Tensor<float>(1.0f))}}),
+               std::invalid_argument);
+  auto quantized = std::make_shared<QuantizedMatMul>(model.x, random({8, 4}, -1.0f, 1.0f));
+  EXPECT_THROW(save_graph(Graph(quantized), path, "errors.ups"), std::invalid_argument);
+  EXPECT_THROW(load_graph(temp_path("missing.graph")), std::runtime_error);
+
+  save_graph(Graph(model.loss), path, "errors.ups", {{"x", model.x}, {"labels", model.labels}});
+  std::ifstream in(path, std::ios::binary);
+  const std::string good((std::istreambuf_iterator<char>(in)), {});
+  auto corrupt = [&](size_t at, char value) {
+    std::string bytes = good;
+    bytes[at] = value;
+    std::ofstream(path, std::ios::binary) << bytes;
+  };
+  corrupt(0, 'X');
+  EXPECT_THROW(load_graph(path), std::runtime_error);
+  corrupt(8, 9);  // version
+  EXPECT_THROW(load_graph(path), std::runtime_error);
+  std::ofstream(path, std::ios::binary) << good.substr(0, good.size() - 2);
+  EXPECT_THROW(load_graph(path), std::runtime_error);
+  std::ofstream(path, std::ios::binary) << good;
+  EXPECT_NO_THROW(load_graph(path));
+}
+
+struct Record {
+  OpType type;
+  size_t type_at, inputs_at, attrs_at;  // byte offsets of those fields
+};
+
+// Walks the op records of a valid graph file.
+static std::vector<Record> records(const std::string& bytes) {
+  io::Cursor in(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+  in.take(12);
+  const uint32_t count = in.get<uint32_t>();
+  in.take(4);
+  io::get_string(in);
+  std::vector<Record> result;
+  for (uint32_t i = 0; i < count; i++) {
+    Record r;
+    r.type_at = bytes.size() - in.remaining();
+    r.type = static_cast<OpType>(in.get<uint32_t>());
+    io::get_string(in);
+    r.inputs_at = bytes.size() - in.remaining();
+    in.take(4 * size_t(in.get<uint32_t>()));
+    r.attrs_at = bytes.size() - in.remaining();
+    in.take(4 * size_t(in.get<uint32_t>()));
+    result.push_back(r);
+  }
+  return result;
+}
+
+TEST(GraphIoTest, RejectsCorruptCounts) {
+  Model model;
+  const std::string path = temp_path("counts.graph");
+  save_graph(Graph(model.loss), path, "counts.ups", {{"x", model.x}, {"labels", model.labels}});
+  std::ifstream in(path, std::ios::binary);
+  const std::string good((std::istreambuf_iterator<char>(in)), {});
+  const std::vector<Record> ops = records(good);
+  auto find = [&](OpType type) {
+    return *std::find_if(ops.begin(), ops.end(), [&](const Record& r) { return r.type == type; });
+  };
+  // Every corruption is reported as a runtime_error, without first trying
+  // to allocate what the corrupt value asks for.
+  auto expect_rejected = [&](size_t at, uint32_t value) {
+    std::string bytes = good;
+    std::string encoded;
+    io::put<uint32_t>(encoded, value);
+    bytes.replace(at, 4, encoded);
+    std::ofstream(path, std::ios::binary) << bytes;
+    EXPECT_THROW(load_graph(path), std::runtime_error) << "at " << at << " = " << value;
+  };
+  expect_rejected(12, 0xffffffffu);  // op count
+  expect_rejected(16, 0x7fffffffu);  // output count
+  expect_rejected(ops[3].inputs_at, 0xfffffff0u);
+  expect_rejected(ops[3].attrs_at, 0xfffffff0u);
+
+  const Record input = find(OpType::Input);
+  expect_rejected(input.attrs_at + 4, 1u << 31);  // numel overflows
+  expect_rejected(input.attrs_at + 8, 1u << 31);
+  expect_rejected(find(OpType::Tanh).type_at, static_cast<uint32_t>(OpType::Variable));
+  expect_rejected(find(OpType::Tanh).type_at, static_cast<uint32_t>(OpType::Input));
+  expect_rejected(find(OpType::Conv2D).attrs_at + 4 + 7 * 4, 5);  // algorithm
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+// layers x (MatMul, then ReLU, Tanh or Sigmoid), with a residual Add every
+// third layer.
+static std::shared_ptr<Op> mlp(const std::shared_ptr<Variable>& x, int layers, uint32_t width) {
+  std::shared_ptr<Op> h = x;
+  for (int l = 0; l < layers; l++) {
+    auto w = std::make_shared<Variable>(random({width, width}, -0.3f, 0.3f, 2 + l));
+    const auto z = std::make_shared<MatMul>(h, w);
+    std::shared_ptr<Op> a;
+    if (l % 3 == 0) {
+      a = std::make_shared<ReLU>(z);
+    } else if (l % 3 == 1) {
+      a = std::make_shared<Tanh>(z);
+    } else {
+      a = std::make_shared<Add>(std::make_shared<Sigmoid>(z), h);
+    }
+    h = a;
+  }
+  return h;
+}
+
+TEST(InferenceTest, NoGradScope) {
+  EXPECT_TRUE(grad_enabled());
+  {
+    NoGradScope outer;
+    EXPECT_FALSE(grad_enabled());
+    {
+      NoGradScope inner;
+      EXPECT_FALSE(grad_enabled());
+    }
+    EXPECT_FALSE(grad_enabled());
+  }
+  EXPECT_TRUE(grad_enabled());
+
+  auto x = std::make_shared<Variable>(random({4, 8}, -1.0f, 1.0f));
+  reset_storage_stats();
+  NoGradScope no_grad;
+  auto y = std::make_shared<Tanh>(std::make_shared<MatMul>(x, x));
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(y->grad.size(), 0u);
+  EXPECT_EQ(x->grad.size(), 1u);  // built before the scope
+}
+
+TEST(InferenceTest, MatchesTrainingForward) {
+  auto x = std::make_shared<Variable>(random({16, 32}, -1.0f, 1.0f));
+  std::shared_ptr<Op> reference = mlp(x, 9, 32);
+  Executor plain(reference);
+  plain.forward();
+
+  NoGradScope no_grad;
+  auto y = mlp(x, 9, 32);
+  Executor executor(y);
+  for (int i = 0; i < 2; i++) {
+    executor.forward();
+    EXPECT_EQ(y->output.values(), reference->output.values());
+  }
+  // Only the Variables and the output keep their values.
+  for (const auto& op : executor.graph().order()) {
+    if (op != y && dynamic_cast<Variable*>(op.get()) == nullptr) {
+      EXPECT_EQ(op->output.size(), 0u);
+    }
+    EXPECT_EQ(op->grad.size(), op.get() == x.get() ? 1u : 0u);
+  }
+  EXPECT_THROW(executor.backward(), std::logic_error);
+}
+
+TEST(InferenceTest, OverwritesInputs) {
+  auto x = std::make_shared<Variable>(random({4, 4}, -1.0f, 1.0f));
+  auto y = std::make_shared<Sigmoid>(std::make_shared<ReLU>(std::make_shared<MatMul>(x, x)));
+  // y is read twice, so Tanh may not overwrite it.
+  auto out = std::make_shared<Add>(std::make_shared<Tanh>(y), y);
+  Executor plain(out);
+  plain.forward();
+  const std::vector<float> expected = out->output.values();
+
+  NoGradScope no_grad;
+  Executor executor(out);
+  executor.forward();
+  reset_storage_stats();
+  executor.forward();
+  EXPECT_EQ(out->output.values(), expected);
+  // Only MatMul and Tanh allocate again: ReLU and Sigmoid reuse MatMul's
+  // buffer, and the graph output keeps its own.
+  EXPECT_EQ(storage_stats().allocations, 2);
+  EXPECT_EQ(storage_stats().copies, 0);
+
+  // Variables are never overwritten.
+  const std::vector<float> before = x->output.values();
+  Executor(std::make_shared<Sigmoid>(std::make_shared<ReLU>(x))).forward();
+  EXPECT_EQ(x->output.values(), before);
+}
+
+TEST(InferenceTest, ServingMemory) {
+  // Bytes held at the peak of a forward pass, beyond inputs and weights.
+  auto peak = [](bool inference) {
+    auto x = std::make_shared<Variable>(random({256, 128}, -1.0f, 1.0f));
+    std::unique_ptr<NoGradScope> no_grad;
+    if (inference) {
+      no_grad = std::make_unique<NoGradScope>();
+    }
+    std::shared_ptr<Op> y = mlp(x, 30, 128);
+    Executor executor(y);
+    auto& allocator = CachingAllocator::instance();
+    allocator.reset_stats();
+    const uint64_t before = allocator.stats().bytes_in_use;
+    executor.forward();
+    return allocator.stats().peak_bytes - before;
+  };
+  const uint64_t activation = 256 * 128 * sizeof(float);
+  const uint64_t kept = peak(false), serving = peak(true);
+  EXPECT_GE(kept, 40 * activation);
+  // An Add reads its two inputs into a third buffer; nothing else is live.
+  EXPECT_LE(serving, 4 * activation);
+}
@@ -0,0 +1,66 @@
+#include "kernels.hh"
+#include "tensor.hh"
+#include "test_util.hh"
+
+#include <gtest/gtest.h>
+
+using namespace upsilon;
+
+TEST(KernelsTest, BinaryMatchesScalarOnEveryIsa) {
+  // Odd length so the unrolled body, the single-vector loop and the tail all run.
+  const size_t n = 1000 + 13;
+  std::vector<float> a(n), b(n), out(n);
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = 0.5f * i - 100.f;
+    b[i] = 1.f + 0.25f * (i % 17);
+  }
+
+  for_each_isa([&] {
+    for (auto op : {kernels::BinaryOp::Add, kernels::BinaryOp::Sub, kernels::BinaryOp::Mul, kernels::BinaryOp::Div,
+                    kernels::BinaryOp::Max, kernels::BinaryOp::Min}) {
+      kernels::binary(op, a.data(), b.data(), out.data(), n);
+      for (size_t i = 0; i < n; ++i) {
+        float expected = 0;
+        kernels::binary_strided(op, &a[i], 1, &b[i], 1, &expected, 1, 1);
+        ASSERT_FLOAT_EQ(out[i], expected) << "at " << i;
+      }
+    }
+  });
+}
+
+TEST(KernelsTest, InPlace) {
+  std::vector<float> a(37, 2.f), b(37, 3.f);
+  kernels::binary(kernels::BinaryOp::Mul, a.data(), b.data(), a.data(), a.size());
+  for (float x : a) {
+    EXPECT_EQ(x, 6.f);
+  }
+}
+
+TEST(KernelsTest, TensorDispatch) {
+  Tensor<float> x(TensorType::Tensor, {3, 5, 7});
+  Tensor<float> y(TensorType::Tensor, {3, 5, 7});
+  std::vector<float> xs(x.size()), ys(y.size());
+  for (size_t i = 0; i < xs.size(); ++i) {
+    xs[i] = float(i);
+    ys[i] = float(i % 5 + 1);
+  }
+  x.fill(xs);
+  y.fill(ys);
+
+  Tensor<float> sum = x.add(y);
+  Tensor<float> diff = x.sub(y);
+  Tensor<float> prod = x.mul(y);
+  Tensor<float> quot = x.div(y);
+  Tensor<float> sq = x.square();
+  for (uint32_t i = 0; i < x.size(); ++i) {
+    EXPECT_FLOAT_EQ(sum.at(i), xs[i] + ys[i]);
+    EXPECT_FLOAT_EQ(diff.at(i), xs[i] - ys[i]);
+    EXPECT_FLOAT_EQ(prod.at(i), xs[i] * ys[i]);
+    EXPECT_FLOAT_EQ(quot.at(i), xs[i] / ys[i]);
+    EXPECT_FLOAT_EQ(sq.at(i), xs[i] * xs[i]);
+  }
+
+  // Strided rows with a unit inner stride still go through the kernel.
+  Tensor<float> sliced = x.slice(2, 1, 6).add(y.slice(2, 1, 6));
+  EXPECT_FLOAT_EQ(sliced.at(2, 4, 4), x.at(2, 4, 5) + y.at(2, 4, 5));
+}
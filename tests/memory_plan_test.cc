@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+// A small conv net followed by a residual MLP, so tensors of many sizes
+// have overlapping lifetimes.
+static Net make_net() {
+  Net net;
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  net.x = std::make_shared<Variable>(random({2, 3, 8, 8}, -1.0f, 1.0f));
+  for (uint32_t i = 0; i < 5; i++) {
+    const std::vector<uint32_t> shape = i == 0 ? std::vector<uint32_t>{4, 3, 3, 3}
+                                      : i == 1 ? std::vector<uint32_t>{4, 4, 3, 3}
+                                               : std::vector<uint32_t>{4, 4};
+    net.weights.push_back(std::make_shared<Variable>(random(shape, -0.5f, 0.5f, 2 + i)));
+  }
+  std::shared_ptr<Op> h = std::make_shared<ReLU>(std::make_shared<Conv2D>(net.x, net.weights[0], same));
+  h = std::make_shared<Tanh>(std::make_shared<Conv2D>(h, net.weights[1], same));
+  h = std::make_shared<Mean>(std::make_shared<Mean>(std::make_shared<MaxPool2D>(h, Pool2DOptions{}), 3), 2);
+  for (uint32_t i = 2; i < 5; i++) {
+    h = std::make_shared<Add>(h, std::make_shared<Sigmoid>(std::make_shared<MatMul>(h, net.weights[i])));
+  }
+  net.loss = squared_sum(h);
+  return net;
+}
+
+TEST(MemoryPlanTest, MatchesUnplanned) {
+  Net reference = make_net();
+  Executor plain(reference.loss);
+  plain.step();
+
+  Net net = make_net();
+  Executor executor(net.loss);
+  const MemoryPlan& plan = executor.plan_memory();
+  EXPECT_TRUE(plan.training);
+  EXPECT_GT(plan.blocks.size(), 0u);
+  EXPECT_LT(plan.peak_bytes(), plan.naive_bytes());
+  EXPECT_EQ(grads(net), grads(reference));
+
+  // Later steps run in the slab and give the same results.
+  for (int i = 0; i < 2; i++) {
+    executor.step();
+    EXPECT_EQ(net.loss->output.values(), reference.loss->output.values());
+    EXPECT_EQ(grads(net), grads(reference));
+  }
+  const auto& order = executor.graph().order();
+  for (const MemoryPlan::Block& block : plan.blocks) {
+    EXPECT_TRUE((block.grad ? order[block.op]->grad : order[block.op]->output).placed()) << "op " << block.op;
+  }
+  EXPECT_THROW(executor.set_activation_precision(Precision::BF16), std::logic_error);
+}
+
+TEST(MemoryPlanTest, LiveBlocksDoNotOverlap) {
+  Net net = make_net();
+  Executor executor(net.loss);
+  for (bool training : {true, false}) {
+    const MemoryPlan& plan = executor.plan_memory(training);
+    size_t naive = 0;
+    for (const MemoryPlan::Block& a : plan.blocks) {
+      naive += a.size;
+      EXPECT_EQ(a.offset % plan::kAlignFloats, 0u);
+      EXPECT_LE(a.offset + a.size, plan.slab_floats);
+      EXPECT_LE(a.first, a.last);
+      for (const MemoryPlan::Block& b : plan.blocks) {
+        if (&a == &b || a.last < b.first || b.last < a.first) {
+          continue;
+        }
+        EXPECT_TRUE(a.offset + a.size <= b.offset || b.offset + b.size <= a.offset)
+            << "ops " << a.op << " and " << b.op;
+      }
+    }
+    EXPECT_EQ(naive, plan.naive_floats);
+  }
+}
+
+TEST(MemoryPlanTest, ForwardOnly) {
+  Net reference = make_net();
+  Executor plain(reference.loss);
+  plain.forward();
+
+  Net net = make_net();
+  Executor executor(net.loss);
+  const MemoryPlan& plan = executor.plan_memory(false);
+  EXPECT_FALSE(plan.training);
+  for (const MemoryPlan::Block& block : plan.blocks) {
+    EXPECT_FALSE(block.grad);
+  }
+  EXPECT_LT(plan.peak_bytes(), plan.naive_bytes());
+  executor.forward();
+  EXPECT_EQ(net.loss->output.values(), reference.loss->output.values());
+  EXPECT_THROW(executor.backward(), std::logic_error);
+}
+
+TEST(MemoryPlanTest, RejectsHalfActivations) {
+  Net net = make_net();
+  Executor executor(net.loss);
+  executor.set_activation_precision(Precision::FP16);
+  EXPECT_THROW(executor.plan_memory(), std::logic_error);
+}
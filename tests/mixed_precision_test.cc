@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include "mixed_precision.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+static Tensor<float> matrix(uint32_t rows, uint32_t cols, float value) {
+  Tensor<float> t(TensorType::Matrix, {rows, cols});
+  t.fill_(value);
+  return t;
+}
+
+TEST(MixedPrecisionTest, HalfConversions) {
+  EXPECT_EQ(to_float(to_half<fp16>(65504.0f)), 65504.0f);
+  EXPECT_EQ(to_float(to_half<fp16>(65520.0f)), INFINITY);       // rounds past the largest half
+  EXPECT_EQ(to_float(to_half<fp16>(-1e6f)), -INFINITY);
+  EXPECT_EQ(to_float(to_half<fp16>(std::ldexp(1.0f, -24))), std::ldexp(1.0f, -24));  // smallest subnormal
+  EXPECT_EQ(to_float(to_half<fp16>(1e-8f)), 0.0f);
+  EXPECT_EQ(to_float(to_half<fp16>(1.0f + std::ldexp(1.0f, -11))), 1.0f);  // tie to even
+  EXPECT_TRUE(std::isnan(to_float(to_half<fp16>(NAN))));
+  EXPECT_NEAR(to_float(to_half<bf16>(-3.0e38f)) / -3.0e38f, 1.0f, std::ldexp(1.0f, -8));  // float's range
+  EXPECT_EQ(to_float(to_half<bf16>(1.0f + std::ldexp(1.0f, -8))), 1.0f);
+  EXPECT_EQ(to_float(to_half<bf16>(1.0f + 3 * std::ldexp(1.0f, -8))), 1.0f + std::ldexp(1.0f, -6));
+  EXPECT_TRUE(std::isnan(to_float(to_half<bf16>(NAN))));
+
+  const Tensor<float> x = random({3, 5, 37}, -100.0f, 100.0f);
+  const Tensor<fp16> h = Tensor<fp16>::encode(x.permute({2, 0, 1}));
+  const Tensor<bf16> b = Tensor<bf16>::encode(x);
+  EXPECT_EQ(h.shape(), (std::vector<uint32_t>{37, 3, 5}));
+  EXPECT_EQ(b.bytes(), x.size() * 2);
+  const Tensor<float> back = b.decode();
+  ASSERT_EQ(back.shape(), x.shape());
+  for (uint32_t i = 0; i < x.size(); i++) {
+    ASSERT_LE(std::abs(back.at(i) - x.at(i)), std::abs(x.at(i)) * std::ldexp(1.0f, -8));
+  }
+  EXPECT_EQ(h.decode().at(1), to_float(to_half<fp16>(x.at(37))));
+}
+
+// Weight gradients of a two-layer classifier, with activations kept in the
+// given precision.
+static std::vector<std::vector<float>> mlp_grads(Precision precision, size_t& saved) {
+  auto x = std::make_shared<Variable>(random({8, 16}, -1.0f, 1.0f));
+  auto labels = std::make_shared<Variable>(Tensor<float>(std::vector<uint32_t>{0, 1, 2, 3, 4, 0, 1, 2}));
+  auto w1 = std::make_shared<Variable>(random({16, 32}, -0.5f, 0.5f, 2));
+  auto w2 = std::make_shared<Variable>(random({32, 5}, -0.5f, 0.5f, 3));
+  auto h = std::make_shared<MatMul>(x, w1);
+  auto loss = std::make_shared<SoftmaxCrossEntropy>(std::make_shared<MatMul>(std::make_shared<ReLU>(h), w2), labels);
+  Executor executor(loss);
+  executor.set_activation_precision(precision);
+  for (int step = 0; step < 2; step++) {
+    executor.forward();
+    saved = executor.saved_bytes();
+    EXPECT_EQ(h->output.size(), precision == Precision::FP32 ? 8 * 32 : 0);
+    executor.backward();
+    EXPECT_EQ(executor.saved_bytes(), 0);
+  }
+  return {w1->grad.values(), w2->grad.values(), x->grad.values()};
+}
+
+TEST(MixedPrecisionTest, ExecutorSavesHalfActivations) {
+  size_t saved = 0;
+  const auto reference = mlp_grads(Precision::FP32, saved);
+  EXPECT_EQ(saved, 0);
+  for (Precision precision : {Precision::BF16, Precision::FP16}) {
+    const auto grads = mlp_grads(precision, saved);
+    EXPECT_EQ(saved, (8 * 32 + 8 * 32 + 8 * 5) * 2);
+    for (size_t g = 0; g < grads.size(); g++) {
+      ASSERT_EQ(grads[g].size(), reference[g].size());
+      float scale = 0.0f;
+      for (float v : reference[g]) {
+        scale = std::max(scale, std::abs(v));
+      }
+      for (size_t i = 0; i < grads[g].size(); i++) {
+        ASSERT_NEAR(grads[g][i], reference[g][i], 0.02f * scale) << g << " at " << i;
+      }
+    }
+  }
+}
+
+TEST(MixedPrecisionTest, LossScaling) {
+  // d(sum y)/dw is the column sum of x: 2 per step, 131072 once scaled by
+  // 65536, which overflows fp16.
+  auto x = std::make_shared<Variable>(matrix(2, 3, 1.0f));
+  auto w = std::make_shared<Variable>(matrix(3, 1, 1.0f));
+  Executor executor(std::make_shared<MatMul>(x, w));
+  LossScaling scaling;
+  scaling.interval = 2;
+  MixedPrecision trainer(executor, {w}, Precision::FP16, scaling);
+  EXPECT_FALSE(trainer.step(0.25f));
+  EXPECT_FALSE(trainer.step(0.25f));  // 65536 still rounds to infinity
+  EXPECT_EQ(trainer.loss_scale(), 16384.0f);
+  EXPECT_EQ(trainer.master(0).at(0), 1.0f);
+  EXPECT_TRUE(trainer.step(0.25f));
+  EXPECT_EQ(trainer.master(0).at(0), 0.5f);
+  EXPECT_EQ(w->output.at(0), 0.5f);
+  EXPECT_TRUE(trainer.step(0.25f));
+  EXPECT_EQ(trainer.loss_scale(), 32768.0f);  // grown after two clean steps
+  EXPECT_EQ(trainer.skipped(), 2);
+
+  // A gradient of 2e-8 is below the smallest fp16 subnormal: it only
+  // reaches the master weights when scaled.
+  for (float initial : {1.0f, 1024.0f}) {
+    x->output = matrix(2, 3, 1e-8f);
+    w->output = matrix(3, 1, 0.0f);
+    LossScaling fixed;
+    fixed.initial = initial;
+    MixedPrecision tiny(executor, {w}, Precision::FP16, fixed);
+    EXPECT_TRUE(tiny.step(1.0f));
+    if (initial == 1.0f) {
+      EXPECT_EQ(tiny.master(0).at(0), 0.0f);
+    } else {
+      EXPECT_NEAR(tiny.master(0).at(0), -2e-8f, 1e-10f);
+    }
+  }
+  EXPECT_THROW(MixedPrecision(executor, {w}, Precision::FP32), std::invalid_argument);
+}
+
+TEST(MixedPrecisionTest, Trains) {
+  for (Precision precision : {Precision::BF16, Precision::FP16}) {
+    // Class c is the input column with the largest value.
+    Tensor<float> data = random({32, 4}, 0.0f, 1.0f, 5);
+    std::vector<uint32_t> classes(32);
+    for (uint32_t r = 0; r < 32; r++) {
+      for (uint32_t c = 0; c < 4; c++) {
+        classes[r] = data.at(r, c) > data.at(r, classes[r]) ? c : classes[r];
+      }
+    }
+    auto x = std::make_shared<Variable>(std::move(data));
+    auto labels = std::make_shared<Variable>(Tensor<float>(classes));
+    auto w1 = std::make_shared<Variable>(random({4, 16}, -0.5f, 0.5f, 6));
+    auto w2 = std::make_shared<Variable>(random({16, 4}, -0.5f, 0.5f, 7));
+    auto loss = std::make_shared<SoftmaxCrossEntropy>(
+        std::make_shared<MatMul>(std::make_shared<ReLU>(std::make_shared<MatMul>(x, w1)), w2), labels);
+    Executor executor(loss);
+    MixedPrecision trainer(executor, {w1, w2}, precision);
+    float first = 0.0f, last = 0.0f;
+    for (int step = 0; step < 200; step++) {
+      ASSERT_TRUE(trainer.step(0.5f));
+      (step == 0 ? first : last) = loss->output.at(0);
+    }
+    EXPECT_LT(last, first * 0.5f);
+    // The working weights are the masters rounded to 16 bits.
+    const float ulp = std::ldexp(1.0f, precision == Precision::BF16 ? -8 : -11);
+    for (uint32_t i = 0; i < w1->output.size(); i++) {
+      const float m = trainer.master(0).at(i);
+      ASSERT_LE(std::abs(w1->output.at(i) - m), std::abs(m) * ulp);
+    }
+  }
+}
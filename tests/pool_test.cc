@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+// Distinct values in shuffled order, so every window has a single maximum.
+static Tensor<float> shuffled(const std::vector<uint32_t>& shape, uint32_t seed = 1) {
+  Tensor<float> t(TensorType::Tensor, shape);
+  std::vector<float> values(t.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = -1.0f + 0.01f * static_cast<float>(i);
+  }
+  std::shuffle(values.begin(), values.end(), std::mt19937(seed));
+  t.fill(values);
+  return t;
+}
+
+// Max (or mean of the non-pad inputs) of one window, from the definition.
+static float reference(const Tensor<float>& x, const Pool2DOptions& o, bool max, size_t p, uint32_t oi,
+                       uint32_t oj) {
+  const std::vector<uint32_t> xs = x.shape();
+  const uint32_t rows = xs[xs.size() - 2], cols = xs[xs.size() - 1];
+  const uint32_t sh = o.stride_h ? o.stride_h : o.kernel_h, sw = o.stride_w ? o.stride_w : o.kernel_w;
+  float best = -std::numeric_limits<float>::infinity();
+  double sum = 0;
+  int count = 0;
+  for (uint32_t ki = 0; ki < o.kernel_h; ki++) {
+    for (uint32_t kj = 0; kj < o.kernel_w; kj++) {
+      const int64_t i = int64_t(oi) * sh + ki - o.pad_h, j = int64_t(oj) * sw + kj - o.pad_w;
+      if (i < 0 || j < 0 || i >= rows || j >= cols) {
+        continue;
+      }
+      const float v = x.at(static_cast<uint32_t>((p * rows + i) * cols + j));
+      best = std::max(best, v);
+      sum += v;
+      count++;
+    }
+  }
+  return max ? best : static_cast<float>(sum / count);
+}
+
+static Pool2DOptions window(uint32_t kernel, uint32_t stride, uint32_t pad) {
+  Pool2DOptions o;
+  o.kernel_h = o.kernel_w = kernel;
+  o.stride_h = o.stride_w = stride;
+  o.pad_h = o.pad_w = pad;
+  return o;
+}
+
+template <typename P>
+static void check_forward(const std::vector<uint32_t>& input, const Pool2DOptions& o, bool max) {
+  auto x = std::make_shared<Variable>(shuffled(input));
+  auto y = std::make_shared<P>(x, o);
+  y->forward();
+  const std::vector<uint32_t> shape = y->output.shape();
+  ASSERT_EQ(shape.size(), input.size());
+  const uint32_t out_rows = shape[shape.size() - 2], out_cols = shape[shape.size() - 1];
+  for (size_t p = 0; p < y->output.size() / (out_rows * out_cols); p++) {
+    for (uint32_t i = 0; i < out_rows; i++) {
+      for (uint32_t j = 0; j < out_cols; j++) {
+        ASSERT_NEAR(y->output.at(static_cast<uint32_t>((p * out_rows + i) * out_cols + j)),
+                    reference(x->output, o, max, p, i, j), 1e-5f)
+            << "plane " << p << " at " << i << "," << j;
+      }
+    }
+  }
+}
+
+TEST(PoolTest, ForwardMatchesDefinition) {
+  for_each_isa([] {
+    for (bool max : {true, false}) {
+      auto check = max ? check_forward<MaxPool2D> : check_forward<AvgPool2D>;
+      check({3, 8, 10}, {}, max);
+      check({3, 9, 11}, window(2, 2, 0), max);            // odd sizes drop the last row and column
+      check({2, 3, 13, 12}, window(3, 2, 1), max);        // ResNet stem
+      check({2, 20, 37}, window(3, 1, 1), max);           // stride 1 reduces shifted rows
+      check({2, 6, 40}, window(5, 1, 2), max);
+      check({2, 4, 5, 33}, {2, 3, 1, 0, 0, 1}, max);      // unequal window and stride
+      check({1, 3, 3}, window(3, 1, 0), max);
+    }
+  });
+}
+
+template <typename P>
+static void check_gradients(const std::vector<uint32_t>& input, const Pool2DOptions& o) {
+  // Inputs are 0.01 apart, so a smaller step never changes which one is the
+  // maximum.
+  expect_gradients_match([&](const auto& in) { return std::make_shared<P>(in[0], o); }, {shuffled(input, 7)}, 1e-3f);
+}
+
+TEST(PoolTest, Gradients) {
+  check_gradients<MaxPool2D>({2, 6, 7}, {});
+  check_gradients<MaxPool2D>({2, 7, 7}, window(3, 2, 1));
+  check_gradients<MaxPool2D>({1, 2, 6, 9}, window(3, 1, 1));
+  check_gradients<AvgPool2D>({2, 6, 7}, {});
+  check_gradients<AvgPool2D>({2, 7, 7}, window(3, 2, 1));
+  check_gradients<AvgPool2D>({1, 2, 6, 9}, window(3, 1, 1));
+}
+
+TEST(PoolTest, MaxGradientGoesToFirstMaximum) {
+  Tensor<float> t(TensorType::Tensor, {1, 2, 4});
+  t.fill({1, 5, 5, 2, 5, 0, 3, 3});
+  auto x = std::make_shared<Variable>(std::move(t));
+  auto y = std::make_shared<MaxPool2D>(x);
+  y->forward();
+  EXPECT_EQ(y->output.values(), (std::vector<float>{5, 5}));
+  x->grad = Tensor<float>::zeros_like(x->output);
+  y->grad = Tensor<float>::zeros_like(y->output).fill_(1.0f);
+  y->backward();
+  EXPECT_EQ(x->grad.values(), (std::vector<float>{0, 1, 1, 0, 0, 0, 0, 0}));
+}
+
+TEST(PoolTest, GlobalAverage) {
+  auto x = std::make_shared<Variable>(shuffled({2, 3, 5, 7}));
+  auto y = std::make_shared<GlobalAvgPool>(x);
+  y->forward();
+  ASSERT_EQ(y->output.shape(), (std::vector<uint32_t>{2, 3, 1, 1}));
+  const std::vector<float> in = x->output.values();
+  for (uint32_t p = 0; p < 6; p++) {
+    double sum = 0;
+    for (uint32_t i = 0; i < 35; i++) {
+      sum += in[p * 35 + i];
+    }
+    EXPECT_NEAR(y->output.at(p), sum / 35, 1e-5);
+  }
+
+  x->grad = Tensor<float>::zeros_like(x->output);
+  y->grad = shuffled(y->output.shape());
+  y->backward();
+  for (uint32_t i = 0; i < x->grad.size(); i++) {
+    ASSERT_FLOAT_EQ(x->grad.at(i), y->grad.at(i / 35) / 35);
+  }
+
+  auto deep = std::make_shared<GlobalAvgPool>(std::make_shared<Variable>(shuffled({2, 2, 2, 3, 3})));
+  EXPECT_THROW(deep->forward(), std::invalid_argument);
+}
+
+TEST(PoolTest, RejectsBadOptions) {
+  EXPECT_THROW(pool::geometry({4, 4}, {}), std::invalid_argument);
+  EXPECT_THROW(pool::geometry({1, 4, 4}, window(0, 1, 0)), std::invalid_argument);
+  EXPECT_THROW(pool::geometry({1, 4, 4}, window(2, 1, 2)), std::invalid_argument);
+  EXPECT_THROW(pool::geometry({1, 2, 2}, window(5, 1, 1)), std::invalid_argument);
+  const pool::Geometry g = pool::geometry({2, 3, 112, 112}, window(3, 2, 1));
+  EXPECT_EQ(g.planes, 6u);
+  EXPECT_EQ(g.out_rows, 56u);
+  EXPECT_EQ(g.out_cols, 56u);
+}
+
+TEST(PoolTest, BackwardByHandNeedsSizedGrads) {
+  const std::shared_ptr<Op> ops[] = {
+      std::make_shared<MaxPool2D>(std::make_shared<Variable>(shuffled({2, 6, 6})), window(2, 2, 0)),
+      std::make_shared<AvgPool2D>(std::make_shared<Variable>(shuffled({2, 6, 6})), window(3, 1, 1)),
+      std::make_shared<GlobalAvgPool>(std::make_shared<Variable>(shuffled({2, 6, 6})))};
+  for (const auto& op : ops) {
+    op->forward();
+    op->grad.resize_as_(op->output).fill_(1.0f);
+    EXPECT_THROW(op->backward(), std::invalid_argument);
+    Tensor<float>& dx = op->inputs[0]->grad;
+    dx.resize_as_(op->inputs[0]->output).fill_(0.0f);
+    op->backward();
+    EXPECT_NEAR(dx.sum(), static_cast<float>(op->output.size()), 1e-4f);
+  }
+}
+
+TEST(PoolTest, StepDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(shuffled({2, 4, 16, 16}));
+  auto h = std::make_shared<MaxPool2D>(x, window(3, 2, 1));
+  auto a = std::make_shared<AvgPool2D>(std::make_shared<Tanh>(h));
+  auto y = std::make_shared<GlobalAvgPool>(a);
+
+  Executor executor(y);
+  executor.step();
+  const std::vector<float> first = x->grad.values();
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_EQ(x->grad.values(), first);
+  EXPECT_EQ(y->output.shape(), (std::vector<uint32_t>{2, 4, 1, 1}));
+}
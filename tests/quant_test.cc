@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "ptq.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+TEST(QuantTest, ParamsCoverRange) {
+  const quant::Params p = quant::affine(-1.0f, 3.0f);
+  EXPECT_FLOAT_EQ(p.scale, 4.0f / 255.0f);
+  EXPECT_EQ(p.zero_point, 64);
+  EXPECT_EQ(quant::affine(2.0f, 5.0f).zero_point, 0);    // widened to include zero
+  EXPECT_EQ(quant::affine(-5.0f, -2.0f).zero_point, 255);
+  EXPECT_EQ(quant::symmetric(2.54f).zero_point, 128);
+  EXPECT_FLOAT_EQ(quant::symmetric(2.54f).scale, 0.02f);
+  EXPECT_THROW(quant::affine(0.0f, INFINITY), std::invalid_argument);
+  EXPECT_THROW(Tensor<uint8_t>({2}, {0.0f, 0}), std::invalid_argument);
+  EXPECT_THROW(Tensor<uint8_t>({2}, {1.0f, 256}), std::invalid_argument);
+}
+
+TEST(QuantTest, RoundTrip) {
+  const Tensor<float> x = random({3, 7, 33}, -2.0f, 5.0f);
+  // Every ISA must match the scalar path, which for_each_isa runs first.
+  std::vector<uint8_t> reference;
+  int32_t zero_point = 0;
+  for_each_isa([&] {
+    const Tensor<uint8_t> q = Tensor<uint8_t>::quantize(x);
+    ASSERT_EQ(q.shape(), x.shape());
+    if (reference.empty()) {
+      reference.assign(q.data().begin(), q.data().end());
+      zero_point = q.params().zero_point;
+    }
+    EXPECT_EQ(q.params().zero_point, zero_point);
+    ASSERT_TRUE(std::equal(q.data().begin(), q.data().end(), reference.begin()));
+    const Tensor<float> y = q.dequantize();
+    for (uint32_t i = 0; i < x.size(); i++) {
+      ASSERT_LE(std::abs(y.at(i) - x.at(i)), q.scale() * 0.5f + 1e-6f) << "at " << i;
+    }
+  });
+
+  // Zero is exact and values out of range saturate.
+  Tensor<float> z(TensorType::Matrix, {1, 3});
+  z.fill({0.0f, -100.0f, 100.0f});
+  const Tensor<uint8_t> q = Tensor<uint8_t>::quantize(z, quant::affine(-1.0f, 1.0f));
+  EXPECT_EQ(q.dequantize().at(0), 0.0f);
+  EXPECT_EQ(q.data()[1], 0);
+  EXPECT_EQ(q.data()[2], 255);
+}
+
+TEST(QuantTest, GemmIsExact) {
+  const size_t m = 37, k = 45, n = 53, lda = quant::padded_depth(k) + 4;
+  std::mt19937 rng(3);
+  std::vector<uint8_t> a(m * lda), b(k * n);
+  for (uint8_t& v : a) {
+    v = static_cast<uint8_t>(rng());
+  }
+  for (uint8_t& v : b) {
+    v = static_cast<uint8_t>(1 + rng() % 255);
+  }
+  const quant::Params ap{0.5f, 17}, bp{0.25f, 128}, cp{64.0f, 100};
+  EXPECT_THROW(quant::pack(b.data(), n, 1, k, n, ap), std::invalid_argument);
+  const quant::PackedMatrix packed = quant::pack(b.data(), n, 1, k, n, bp);
+
+  std::vector<int64_t> expected(m * n);
+  for (size_t i = 0; i < m; i++) {
+    for (size_t j = 0; j < n; j++) {
+      for (size_t p = 0; p < k; p++) {
+        expected[i * n + j] += (int64_t(a[i * lda + p]) - ap.zero_point) * (int64_t(b[p * n + j]) - 128);
+      }
+    }
+  }
+
+  for_each_isa([&] {
+    std::vector<float> c(m * n);
+    std::vector<uint8_t> q(m * n);
+    quant::Output out;
+    out.c = c.data();
+    out.rs = n;
+    quant::qgemm(m, a.data(), lda, ap, packed, out);
+    // Transposed requantized output.
+    quant::Output out_q;
+    out_q.q = q.data();
+    out_q.rs = 1;
+    out_q.cs = m;
+    out_q.requant = cp;
+    quant::qgemm(m, a.data(), lda, ap, packed, out_q);
+    for (size_t i = 0; i < m; i++) {
+      for (size_t j = 0; j < n; j++) {
+        const float real = 0.125f * static_cast<float>(expected[i * n + j]);
+        ASSERT_EQ(c[i * n + j], real) << i << "," << j;
+        const float r = std::clamp(std::nearbyint(real / cp.scale + cp.zero_point), 0.0f, 255.0f);
+        ASSERT_EQ(q[j * m + i], static_cast<uint8_t>(r)) << i << "," << j;
+      }
+    }
+  });
+}
+
+TEST(QuantTest, MatMulMatchesFloat) {
+  const Tensor<float> x = random({2, 9, 70}, -1.0f, 1.0f, 5);
+  const Tensor<float> w = random({70, 40}, -0.5f, 0.5f, 6);
+  auto q = std::make_shared<QuantizedMatMul>(std::make_shared<Variable>(Tensor<float>(x)), w);
+  q->forward();
+  ASSERT_EQ(q->output.shape(), (std::vector<uint32_t>{2, 9, 40}));
+  float worst = 0.0f;
+  for (uint32_t r = 0; r < 18; r++) {
+    for (uint32_t j = 0; j < 40; j++) {
+      float expected = 0.0f;
+      for (uint32_t p = 0; p < 70; p++) {
+        expected += x.at(r * 70 + p) * w.at(p, j);
+      }
+      worst = std::max(worst, std::abs(q->output.at(r * 40 + j) - expected));
+    }
+  }
+  // Each product is off by at most half a step of either operand.
+  EXPECT_LT(worst, 0.05f);
+  const QuantizedMatMul large(q, random({256, 96}, -1.0f, 1.0f));
+  EXPECT_LT(large.weight().bytes() * 3.8, 256 * 96 * sizeof(float));
+  EXPECT_THROW(q->backward(), std::logic_error);
+  EXPECT_THROW(QuantizedMatMul(q, random({2, 3, 4}, 0, 1)), std::invalid_argument);
+}
+
+// Relative error of the quantized graph against the float one, after
+// calibrating on two inputs.
+static float calibrated_error(std::shared_ptr<Variable> x, std::shared_ptr<Op> y, size_t expected_ops,
+                              const std::vector<Tensor<float>>& batches) {
+  Executor executor(y);
+  std::vector<std::vector<float>> reference;
+  Quantizer quantizer(executor.graph());
+  EXPECT_EQ(quantizer.size(), expected_ops);
+  for (const Tensor<float>& batch : batches) {
+    x->output = batch;
+    executor.forward();
+    reference.push_back(y->output.values());
+    quantizer.observe();
+  }
+  EXPECT_EQ(quantizer.apply(), expected_ops);
+  size_t quantized = 0;
+  for (const auto& op : executor.graph().order()) {
+    quantized += dynamic_cast<QuantizedOp*>(op.get()) != nullptr;
+  }
+  EXPECT_EQ(quantized, expected_ops);
+
+  float error = 0.0f, scale = 0.0f;
+  for (size_t b = 0; b < batches.size(); b++) {
+    x->output = batches[b];
+    executor.forward();
+    const std::vector<float> out = executor.graph().outputs()[0]->output.values();
+    for (size_t i = 0; i < out.size(); i++) {
+      error = std::max(error, std::abs(out[i] - reference[b][i]));
+      scale = std::max(scale, std::abs(reference[b][i]));
+    }
+  }
+  return error / scale;
+}
+
+TEST(QuantTest, CalibratedMlp) {
+  auto x = std::make_shared<Variable>(random({16, 64}, -1.0f, 1.0f));
+  auto w1 = std::make_shared<Variable>(random({64, 48}, -0.3f, 0.3f, 2));
+  auto w2 = std::make_shared<Variable>(random({48, 10}, -0.3f, 0.3f, 3));
+  auto y = std::make_shared<MatMul>(std::make_shared<ReLU>(std::make_shared<MatMul>(x, w1)), w2);
+  EXPECT_LT(calibrated_error(x, y, 2, {random({16, 64}, -1.0f, 1.0f, 7), random({16, 64}, -1.0f, 1.0f, 8)}), 0.03f);
+}
+
+TEST(QuantTest, CalibratedConvNet) {
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  Conv2DOptions grouped;
+  grouped.stride_h = grouped.stride_w = 2;
+  grouped.groups = 2;
+  auto x = std::make_shared<Variable>(random({2, 3, 12, 11}, -1.0f, 1.0f));
+  auto w1 = std::make_shared<Variable>(random({8, 3, 3, 3}, -0.4f, 0.4f, 2));
+  auto w2 = std::make_shared<Variable>(random({6, 4, 3, 3}, -0.4f, 0.4f, 3));
+  auto h = std::make_shared<ReLU>(std::make_shared<Conv2D>(x, w1, same));
+  auto y = std::make_shared<Conv2D>(h, w2, grouped);
+  EXPECT_LT(calibrated_error(x, y, 2, {random({2, 3, 12, 11}, -1.0f, 1.0f, 7), random({2, 3, 12, 11}, -1.0f, 1.0f, 8)}),
+            0.03f);
+}
+
+TEST(QuantTest, ForwardDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(random({1, 4, 10, 10}, -1.0f, 1.0f));
+  Conv2DOptions same;
+  same.pad_h = same.pad_w = 1;
+  auto c = std::make_shared<QuantizedConv2D>(x, random({8, 4, 3, 3}, -1.0f, 1.0f), same);
+  auto y = std::make_shared<QuantizedMatMul>(c, random({10, 5}, -1.0f, 1.0f));
+  Executor executor(y);
+  executor.forward();
+  const std::vector<float> first = y->output.values();
+  reset_storage_stats();
+  executor.forward();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_EQ(y->output.values(), first);
+}
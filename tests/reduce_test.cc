@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+static Tensor<float> values(const std::vector<uint32_t>& shape, float scale = 0.25f) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> v(t.size());
+  for (size_t i = 0; i < v.size(); ++i) {
+    v[i] = scale * static_cast<float>(static_cast<int>((i * 37) % 101) - 50);
+  }
+  t.fill(v);
+  return t;
+}
+
+// Reduction r of dimension axis, element by element.
+static std::vector<double> reference(const Tensor<float>& x, Reduction r, uint32_t axis) {
+  const std::vector<uint32_t> shape = x.shape();
+  size_t outer = 1, inner = 1;
+  for (size_t d = 0; d < axis; d++) {
+    outer *= shape[d];
+  }
+  for (size_t d = axis + 1; d < shape.size(); d++) {
+    inner *= shape[d];
+  }
+  const size_t len = shape[axis];
+  const std::vector<float> in = x.values();
+  std::vector<double> out;
+  for (size_t o = 0; o < outer; o++) {
+    for (size_t j = 0; j < inner; j++) {
+      double acc = 0, best = in[o * len * inner + j];
+      size_t index = 0;
+      for (size_t k = 0; k < len; k++) {
+        const double v = in[(o * len + k) * inner + j];
+        acc += r == Reduction::L2Norm ? v * v : v;
+        if (r == Reduction::Max || r == Reduction::ArgMax ? v > best : v < best) {
+          best = v;
+          index = k;
+        }
+      }
+      switch (r) {
+        case Reduction::Sum:
+          out.push_back(acc);
+          break;
+        case Reduction::Mean:
+          out.push_back(acc / len);
+          break;
+        case Reduction::L2Norm:
+          out.push_back(std::sqrt(acc));
+          break;
+        case Reduction::ArgMax:
+        case Reduction::ArgMin:
+          out.push_back(static_cast<double>(index));
+          break;
+        default:
+          out.push_back(best);
+          break;
+      }
+    }
+  }
+  return out;
+}
+
+static const Reduction kAll[] = {Reduction::Sum,    Reduction::Mean,   Reduction::Max,   Reduction::Min,
+                                 Reduction::ArgMax, Reduction::ArgMin, Reduction::L2Norm};
+
+static void check(const Tensor<float>& x, double tolerance) {
+  const uint32_t ndim = static_cast<uint32_t>(x.ndim());
+  for (Reduction r : kAll) {
+    for (uint32_t axis = 0; axis < ndim; axis++) {
+      const Tensor<float> y = x.reduce(r, axis);
+      ASSERT_EQ(y.shape(), x.reduced_shape(axis, false));
+      const std::vector<double> expected = reference(x, r, axis);
+      const std::vector<float> got = y.values();
+      ASSERT_EQ(got.size(), expected.size());
+      for (size_t i = 0; i < got.size(); i++) {
+        ASSERT_NEAR(got[i], expected[i], tolerance * std::max(1.0, std::abs(expected[i])))
+            << "reduction " << static_cast<int>(r) << " axis " << axis << " at " << i;
+      }
+    }
+  }
+}
+
+TEST(ReduceTest, EveryAxisMatchesReference) {
+  for_each_isa([] {
+    check(values({3, 4, 5}), 1e-5);
+    check(values({2, 3, 37, 19}), 1e-5);
+    check(values({7, 129}), 1e-5);
+    check(values({70, 1, 600}), 1e-5);
+  });
+}
+
+TEST(ReduceTest, LongRowsAreSplitIntoBlocks) {
+  for_each_isa([] {
+    // Tolerances cover float rounding of sums with heavy cancellation.
+    check(values({1, 2, 100003}, 0.01f), 1e-3);
+    check(values({2, 70001, 3}, 0.01f), 1e-3);
+  });
+}
+
+TEST(ReduceTest, KeepdimAndShapes) {
+  const Tensor<float> x = values({2, 3, 4});
+  EXPECT_EQ(x.sum(1, true).shape(), (std::vector<uint32_t>{2, 1, 4}));
+  EXPECT_EQ(x.sum(1).shape(), (std::vector<uint32_t>{2, 4}));
+  EXPECT_EQ(x.sum(2).sum(1).sum(0).type(), TensorType::Scalar);
+  EXPECT_NEAR(x.sum(2).sum(1).sum(0).at(0), x.sum(), 1e-4);
+  EXPECT_THROW(x.sum(3), std::invalid_argument);
+
+  // Strided inputs are packed first.
+  const Tensor<float> t = x.permute({2, 0, 1});
+  EXPECT_EQ(t.max(0).values(), x.max(2).values());
+}
+
+TEST(ReduceTest, ArgReductionsPickFirstExtreme) {
+  Tensor<float> t(TensorType::Tensor, {1, 4, 3});
+  t.fill({1, 9, 0, 5, 9, 0, 5, 2, 0, 3, 9, 0});
+  EXPECT_EQ(t.argmax(2).values(), (std::vector<float>{1, 1, 0, 1}));
+  EXPECT_EQ(t.argmax(1).values(), (std::vector<float>{1, 0, 0}));
+  EXPECT_EQ(t.argmin(1).values(), (std::vector<float>{0, 2, 0}));
+
+  Tensor<float> long_row(TensorType::Tensor, {1, 1, 100000});
+  long_row.fill(1.0f);
+  long_row.at(40000) = 2.0f;
+  long_row.at(90000) = 2.0f;
+  EXPECT_EQ(long_row.argmax(2).at(0), 40000.0f);
+}
+
+TEST(ReduceTest, ResultDoesNotDependOnThreadCount) {
+  const Tensor<float> x = values({3, 200000}, 0.001f);
+  const size_t threads = num_threads();
+  set_num_threads(1);
+  const std::vector<float> one = x.sum(1).values();
+  const std::vector<float> column = x.l2norm(0).values();
+  set_num_threads(threads);
+  EXPECT_EQ(x.sum(1).values(), one);
+  EXPECT_EQ(x.l2norm(0).values(), column);
+}
+
+template <typename P>
+static void check_gradients(const std::vector<uint32_t>& shape, uint32_t axis, bool keepdim) {
+  SCOPED_TRACE("axis " + std::to_string(axis));
+  // Inputs differ by at least 0.1 within a row, so the step never moves an
+  // extreme.
+  expect_gradients_match([&](const auto& in) { return std::make_shared<P>(in[0], axis, keepdim); },
+                         {values(shape, 0.1f)}, 1e-2f);
+}
+
+TEST(ReduceTest, Gradients) {
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    for (bool keepdim : {false, true}) {
+      check_gradients<Sum>({2, 3, 4}, axis, keepdim);
+      check_gradients<Mean>({2, 3, 4}, axis, keepdim);
+      check_gradients<Max>({2, 3, 4}, axis, keepdim);
+      check_gradients<Min>({2, 3, 4}, axis, keepdim);
+      check_gradients<L2Norm>({2, 3, 4}, axis, keepdim);
+    }
+  }
+}
+
+TEST(ReduceTest, BackwardByHandNeedsSizedGrads) {
+  auto x = std::make_shared<Variable>(values({2, 3, 4}));
+  auto sum = std::make_shared<Sum>(x, 1);
+  sum->forward();
+  sum->grad.resize_as_(sum->output).fill_(1.0f);
+  EXPECT_THROW(sum->backward(), std::invalid_argument);
+
+  // Max and Min write their gradient in place and must fail the same way.
+  const std::shared_ptr<Op> ops[] = {std::make_shared<Max>(x, 1), std::make_shared<Min>(x, 2)};
+  for (const auto& op : ops) {
+    op->forward();
+    op->grad.resize_as_(op->output).fill_(1.0f);
+    x->grad = Tensor<float>(0.0f);
+    EXPECT_THROW(op->backward(), std::invalid_argument);
+    x->grad.resize_as_(x->output).fill_(0.0f);
+    op->backward();
+    EXPECT_FLOAT_EQ(x->grad.sum(), static_cast<float>(op->output.size()));
+  }
+}
+
+TEST(ReduceTest, ArgMaxOpPassesNoGradient) {
+  auto x = std::make_shared<Variable>(values({2, 3, 4}));
+  auto y = std::make_shared<Add>(std::make_shared<ArgMax>(x, 1), std::make_shared<Sum>(x, 1));
+  Executor executor(y);
+  executor.step();
+  EXPECT_EQ(y->inputs[0]->output.values(), x->output.argmax(1).values());
+  EXPECT_EQ(x->grad.values(), std::vector<float>(24, 1.0f));
+}
+
+TEST(ReduceTest, StepDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(values({4, 16, 32}));
+  auto a = std::make_shared<Max>(std::make_shared<Tanh>(x), 1, true);
+  auto b = std::make_shared<Mean>(x, 1, true);
+  auto c = std::make_shared<L2Norm>(std::make_shared<Add>(a, b), 2);
+  auto y = std::make_shared<Sum>(c, 0);
+
+  Executor executor(y);
+  executor.step();
+  const std::vector<float> first = x->grad.values();
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_EQ(x->grad.values(), first);
+}
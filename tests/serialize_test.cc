@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "serialize.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+static std::string read_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+static void write_file(const std::string& path, const std::string& bytes) {
+  std::ofstream(path, std::ios::binary) << bytes;
+}
+
+TEST(SerializeTest, RoundTrip) {
+  const Tensor<float> a = ramp({3, 5, 7}, 0.0f, 0.5f);
+  const Tensor<float> b = ramp({6, 4}, -3.0f, 0.5f);
+  const Tensor<float> scalar(2.5f);
+  const std::string path = temp_path("round_trip.ups");
+  {
+    TensorWriter writer;
+    writer.add("a", a);
+    writer.add("b.t", b.transposed());  // written contiguously
+    writer.add("scalar", scalar);
+    writer.add("half", Tensor<fp16>::encode(b));
+    writer.add("brain", Tensor<bf16>::encode(a));
+    EXPECT_THROW(writer.add("a", b), std::invalid_argument);
+    writer.write(path);
+  }
+
+  const TensorFile file(path);
+  EXPECT_EQ(file.names(), (std::vector<std::string>{"a", "b.t", "scalar", "half", "brain"}));
+  EXPECT_EQ(file.dtype("half"), DType::FP16);
+  EXPECT_EQ(file.shape("b.t"), (std::vector<uint32_t>{4, 6}));
+  EXPECT_EQ(file.get("a").values(), a.values());
+  EXPECT_EQ(file.get("b.t").values(), b.transposed().contiguous().values());
+  EXPECT_EQ(file.get("scalar").shape(), scalar.shape());
+  EXPECT_EQ(file.get("scalar").at(0), 2.5f);
+  EXPECT_EQ(file.get("half").values(), b.values());  // halves of 0.5 steps are exact
+  EXPECT_EQ(file.get<bf16>("brain").decode().values(), a.values());
+  EXPECT_THROW(file.get<fp16>("brain"), std::invalid_argument);
+  EXPECT_THROW(file.get("missing"), std::invalid_argument);
+  EXPECT_FALSE(file.contains("missing"));
+}
+
+TEST(SerializeTest, LoadAliasesMappedFile) {
+  const std::string path = temp_path("alias.ups");
+  TensorWriter writer;
+  writer.add("x", ramp({64, 33}, 0.0f, 0.5f));
+  writer.add("y", ramp({1, 5}, 1.0f, 0.5f));
+  writer.write(path);
+
+  reset_storage_stats();
+  Tensor<float> x = [&] {
+    const TensorFile file(path);
+    Tensor<float> y = file.get("y");
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(y.data().data()) % kBufferAlignment, 0);
+    return file.get("x");
+  }();
+  // No buffer was allocated or copied, and the tensor outlives the file.
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_EQ(x.at(63, 32), 0.5f * (64 * 33 - 1));
+
+  // Writes land in private pages, never in the file.
+  const std::string before = read_file(path);
+  x.mutable_data()[0] = 42.0f;
+  EXPECT_EQ(x.at(0), 42.0f);
+  EXPECT_EQ(read_file(path), before);
+  EXPECT_EQ(TensorFile(path).get("x").at(0), 0.0f);
+}
+
+TEST(SerializeTest, RejectsBadFiles) {
+  const std::string path = temp_path("bad.ups");
+  TensorWriter writer;
+  writer.add("w", ramp({4, 4}, 0.0f, 0.5f));
+  writer.write(path);
+  const std::string good = read_file(path);
+
+  EXPECT_THROW(TensorFile(temp_path("does_not_exist.ups")), std::runtime_error);
+
+  std::string bytes = good;
+  bytes[0] = 'X';
+  write_file(path, bytes);
+  EXPECT_THROW(TensorFile{path}, std::runtime_error);
+
+  bytes = good;
+  bytes[8] = 2;  // version
+  write_file(path, bytes);
+  EXPECT_THROW(TensorFile{path}, std::runtime_error);
+
+  write_file(path, good.substr(0, good.size() - 4));  // data cut short
+  EXPECT_THROW(TensorFile{path}, std::runtime_error);
+
+  write_file(path, good.substr(0, 40));  // index cut short
+  EXPECT_THROW(TensorFile{path}, std::runtime_error);
+
+  write_file(path, good);
+  EXPECT_EQ(TensorFile(path).get("w").values(), ramp({4, 4}, 0.0f, 0.5f).values());
+  std::remove(path.c_str());
+}
+
+// A hand-written file with one index entry "w" of the given shape and byte
+// count, and the header's entry count.
+static std::string crafted(const std::vector<uint32_t>& shape, uint64_t bytes, uint32_t count = 1) {
+  std::string index;
+  io::put<uint32_t>(index, 1);
+  index += "w";
+  io::put<uint32_t>(index, static_cast<uint32_t>(DType::F32));
+  io::put<uint32_t>(index, shape.size());
+  for (uint32_t d : shape) {
+    io::put<uint32_t>(index, d);
+  }
+  io::put<uint64_t>(index, io::align_up(io::kHeaderBytes + index.size() + 16));
+  io::put<uint64_t>(index, bytes);
+  std::string file(io::kMagic, sizeof(io::kMagic));
+  io::put<uint32_t>(file, io::kVersion);
+  io::put<uint32_t>(file, count);
+  io::put<uint64_t>(file, index.size());
+  io::put<uint64_t>(file, 0);
+  file += index;
+  file.resize(io::align_up(file.size()) + kBufferAlignment, '\0');
+  return file;
+}
+
+TEST(SerializeTest, RejectsOverflowingIndex) {
+  const std::string path = temp_path("overflow.ups");
+  write_file(path, crafted({2, 2}, 16));
+  EXPECT_EQ(TensorFile(path).shape("w"), (std::vector<uint32_t>{2, 2}));
+
+  // 2^22 * 2^21 * 2^21 floats wrap around to 0 bytes.
+  write_file(path, crafted({1u << 22, 1u << 21, 1u << 21}, 0));
+  EXPECT_THROW(TensorFile{path}, std::runtime_error);
+  // Counts that do not fit in the index are rejected before allocating.
+  write_file(path, crafted({2, 2}, 16, 0xffffffffu));
+  EXPECT_THROW(TensorFile{path}, std::runtime_error);
+  std::string file = crafted({2, 2}, 16);
+  file[io::kHeaderBytes + 9] = '\xff';  // ndim
+  file[io::kHeaderBytes + 12] = '\x7f';
+  write_file(path, file);
+  EXPECT_THROW(TensorFile{path}, std::runtime_error);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "graph.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+static Tensor<float> logits(const std::vector<uint32_t>& shape, float scale = 0.37f, float shift = 0.0f) {
+  Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> v(t.size());
+  for (size_t i = 0; i < v.size(); ++i) {
+    v[i] = shift + scale * static_cast<float>(static_cast<int>((i * 29) % 23) - 11);
+  }
+  t.fill(v);
+  return t;
+}
+
+static double reference_lse(const float* x, size_t n) {
+  double m = x[0];
+  for (size_t i = 0; i < n; i++) {
+    m = std::max(m, double(x[i]));
+  }
+  double s = 0;
+  for (size_t i = 0; i < n; i++) {
+    s += std::exp(double(x[i]) - m);
+  }
+  return m + std::log(s);
+}
+
+TEST(SoftmaxTest, LogSumExpIsStable) {
+  for_each_isa([] {
+    for (size_t n : {1, 3, 16, 63, 64, 65, 1000}) {
+      for (float shift : {0.0f, 1000.0f, -1000.0f}) {
+        std::vector<float> x(n);
+        for (size_t i = 0; i < n; i++) {
+          // Rising, so the running max moves through the whole row.
+          x[i] = shift + 0.05f * static_cast<float>(i) + 0.3f * static_cast<float>((i * 7) % 5);
+        }
+        const double expected = reference_lse(x.data(), n);
+        ASSERT_NEAR(kernels::logsumexp(x.data(), n), expected, 1e-5 * std::max(1.0, std::abs(expected)))
+            << "n=" << n << " shift=" << shift;
+      }
+    }
+  });
+}
+
+TEST(SoftmaxTest, ForwardMatchesReference) {
+  for_each_isa([] {
+    for (float shift : {0.0f, 500.0f}) {
+      auto x = std::make_shared<Variable>(logits({3, 4, 37}, 0.37f, shift));
+      auto y = std::make_shared<Softmax>(x);
+      auto z = std::make_shared<LogSoftmax>(x);
+      y->forward();
+      z->forward();
+      ASSERT_EQ(y->output.shape(), x->output.shape());
+      const std::vector<float> in = x->output.values(), p = y->output.values(), lp = z->output.values();
+      for (size_t r = 0; r < 12; r++) {
+        const double lse = reference_lse(in.data() + r * 37, 37);
+        double total = 0;
+        for (size_t i = 0; i < 37; i++) {
+          const double expected = in[r * 37 + i] - lse;
+          ASSERT_NEAR(lp[r * 37 + i], expected, 1e-4);
+          // x - lse loses the low bits of large logits, relative to p.
+          ASSERT_NEAR(p[r * 37 + i], std::exp(expected), 1e-4 * std::exp(expected) + 1e-7);
+          total += p[r * 37 + i];
+        }
+        ASSERT_NEAR(total, 1.0, 1e-4);
+      }
+    }
+  });
+}
+
+TEST(SoftmaxTest, CrossEntropyMatchesReference) {
+  for (float shift : {0.0f, 1e4f}) {
+    auto x = std::make_shared<Variable>(logits({5, 11}, 2.5f, shift));
+    auto labels = std::make_shared<Variable>(Tensor<float>(std::vector<uint32_t>{0, 10, 3, 3, 7}));
+    auto loss = std::make_shared<SoftmaxCrossEntropy>(x, labels);
+    loss->forward();
+    ASSERT_EQ(loss->output.type(), TensorType::Scalar);
+    const std::vector<float> in = x->output.values();
+    const uint32_t label[] = {0, 10, 3, 3, 7};
+    double expected = 0;
+    for (size_t r = 0; r < 5; r++) {
+      expected += reference_lse(in.data() + r * 11, 11) - in[r * 11 + label[r]];
+    }
+    EXPECT_TRUE(std::isfinite(loss->output.at(0)));
+    EXPECT_NEAR(loss->output.at(0), expected / 5, 1e-3);
+  }
+}
+
+TEST(SoftmaxTest, CrossEntropyRejectsBadLabels) {
+  auto x = std::make_shared<Variable>(logits({2, 3}));
+  auto out_of_range = std::make_shared<Variable>(Tensor<float>(std::vector<uint32_t>{0, 3}));
+  EXPECT_THROW(SoftmaxCrossEntropy(x, out_of_range).forward(), std::invalid_argument);
+  auto too_many = std::make_shared<Variable>(Tensor<float>(std::vector<uint32_t>{0, 1, 2}));
+  EXPECT_THROW(SoftmaxCrossEntropy(x, too_many).forward(), std::invalid_argument);
+  Tensor<float> fractional(std::vector<uint32_t>{0, 1});
+  fractional.at(1) = 0.5f;
+  EXPECT_THROW(SoftmaxCrossEntropy(x, std::make_shared<Variable>(std::move(fractional))).forward(),
+               std::invalid_argument);
+}
+
+TEST(SoftmaxTest, Gradients) {
+  const float h = 1e-2f;
+  const double tol = 1e-2;
+  expect_gradients_match([](const auto& in) { return std::make_shared<Softmax>(in[0]); }, {logits({2, 3, 5})}, h, tol);
+  expect_gradients_match([](const auto& in) { return std::make_shared<LogSoftmax>(in[0]); }, {logits({2, 3, 5})}, h,
+                         tol);
+  expect_gradients_match(
+      [](const auto& in) {
+        auto labels = std::make_shared<Variable>(Tensor<float>(std::vector<uint32_t>{2, 0, 4, 1}));
+        return std::make_shared<SoftmaxCrossEntropy>(in[0], labels);
+      },
+      {logits({4, 5})}, h, tol);
+}
+
+TEST(SoftmaxTest, BackwardByHandNeedsSizedGrads) {
+  auto x = std::make_shared<Variable>(logits({4, 5}));
+  auto labels = std::make_shared<Variable>(ramp({1, 4}, 0.0f, 1.0f));
+  const std::shared_ptr<Op> ops[] = {std::make_shared<Softmax>(x), std::make_shared<LogSoftmax>(x),
+                                     std::make_shared<SoftmaxCrossEntropy>(x, labels)};
+  for (const auto& op : ops) {
+    op->forward();
+    op->grad.resize_as_(op->output).fill_(1.0f);
+    x->grad = Tensor<float>(0.0f);
+    EXPECT_THROW(op->backward(), std::invalid_argument);
+    // Every row of the gradient sums to zero for a uniform upstream gradient.
+    x->grad.resize_as_(x->output).fill_(0.0f);
+    op->backward();
+    EXPECT_NEAR(x->grad.sum(), 0.0f, 1e-5f);
+  }
+}
+
+TEST(SoftmaxTest, StepDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(logits({64, 100}));
+  auto w = std::make_shared<Variable>(logits({100, 100}, 0.01f));
+  auto labels = std::make_shared<Variable>(Tensor<float>(std::vector<uint32_t>(64, 7)));
+  auto h = std::make_shared<LogSoftmax>(std::make_shared<MatMul>(x, w));
+  auto y = std::make_shared<SoftmaxCrossEntropy>(std::make_shared<Softmax>(h), labels);
+
+  Executor executor(y);
+  executor.step();
+  const std::vector<float> first = w->grad.values();
+  reset_storage_stats();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_EQ(w->grad.values(), first);
+}
@@ -0,0 +1,119 @@
+#include "graph.hh"
+#include "tensor.hh"
+
+#include <gtest/gtest.h>
+
+using namespace upsilon;
+
+static Tensor<float> matrix(uint32_t rows, uint32_t cols, float start) {
+  Tensor<float> t(TensorType::Matrix, {rows, cols});
+  for (uint32_t i = 0; i < t.size(); i++) {
+    t.at(i) = start + i;
+  }
+  return t;
+}
+
+TEST(TensorInplaceTest, ArithmeticMatchesOutOfPlace) {
+  const Tensor<float> a = matrix(3, 4, 1.0f);
+  const Tensor<float> b = matrix(3, 4, 0.5f);
+
+  Tensor<float> x = a;
+  x.add_(b);
+  EXPECT_EQ(x.values(), a.add(b).values());
+  x = a;
+  x.sub_(b);
+  EXPECT_EQ(x.values(), a.sub(b).values());
+  x = a;
+  x.mul_(b);
+  EXPECT_EQ(x.values(), a.mul(b).values());
+  x = a;
+  x.axpy_(2.0f, b);
+  EXPECT_EQ(x.values(), a.add(b).add(b).values());
+  x.fill_(7.0f);
+  EXPECT_EQ(x.values(), std::vector<float>(12, 7.0f));
+
+  // The source of the copy is untouched.
+  EXPECT_FLOAT_EQ(a.at(0), 1.0f);
+  EXPECT_THROW(x.add_(matrix(4, 3, 0.0f)), std::invalid_argument);
+}
+
+TEST(TensorInplaceTest, WritesThroughViews) {
+  Tensor<float> a = matrix(4, 4, 0.0f);
+  Tensor<float> column = a.slice(1, 1, 2);
+  column.add_(Tensor<float>::zeros_like(column).fill_(100.0f));
+  EXPECT_FLOAT_EQ(a.at(0, 1), 101.0f);
+  EXPECT_FLOAT_EQ(a.at(3, 1), 113.0f);
+  EXPECT_FLOAT_EQ(a.at(3, 2), 14.0f);
+
+  Tensor<float> t = a.transposed();
+  t.axpy_(-1.0f, a.transposed());
+  EXPECT_EQ(a.values(), std::vector<float>(16, 0.0f));
+}
+
+TEST(TensorInplaceTest, ExpressionUpdate) {
+  const Tensor<float> a = matrix(2, 3, 1.0f);
+  const Tensor<float> b = matrix(2, 3, 2.0f);
+  Tensor<float> x = Tensor<float>::zeros_like(a);
+
+  reset_storage_stats();
+  x.add_(a.lazy() * b.lazy());
+  x.sub_(a.lazy());
+  EXPECT_EQ(storage_stats().allocations, 0);
+  for (uint32_t i = 0; i < x.size(); i++) {
+    EXPECT_FLOAT_EQ(x.at(i), a.at(i) * b.at(i) - a.at(i));
+  }
+}
+
+TEST(TensorInplaceTest, ExpressionAssignmentReusesBuffer) {
+  const Tensor<float> a = matrix(2, 3, 1.0f);
+  Tensor<float> x = Tensor<float>::zeros_like(a);
+
+  reset_storage_stats();
+  x = a.lazy() * 2.0f;
+  x = x.lazy() + a.lazy();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_FLOAT_EQ(x.at(1, 2), 18.0f);
+
+  // A view of x must not see the assignment.
+  Tensor<float> view = x.view({3, 2});
+  x = a.lazy() + 0.0f;
+  EXPECT_FLOAT_EQ(view.at(2, 1), 18.0f);
+  EXPECT_FLOAT_EQ(x.at(1, 2), 6.0f);
+}
+
+TEST(TensorInplaceTest, Addmm) {
+  const Tensor<float> a = matrix(2, 3, 1.0f);
+  const Tensor<float> b = matrix(3, 2, -2.0f);
+  Tensor<float> c = matrix(2, 2, 0.0f);
+  const Tensor<float> product = a.matmul(b);
+
+  c.addmm_(a, b);
+  for (uint32_t i = 0; i < c.size(); i++) {
+    EXPECT_FLOAT_EQ(c.at(i), i + product.at(i));
+  }
+  c.addmm_(b.transposed(), a.transposed(), 0.0f);
+  EXPECT_EQ(c.values(), product.transposed().contiguous().values());
+  EXPECT_THROW(c.addmm_(b, a), std::invalid_argument);
+}
+
+TEST(TensorInplaceTest, TrainingStepDoesNotAllocate) {
+  auto x = std::make_shared<Variable>(matrix(8, 16, -60.0f).div(matrix(8, 16, 100.0f)));
+  auto w1 = std::make_shared<Variable>(matrix(16, 32, -200.0f).div(matrix(16, 32, 1000.0f)));
+  auto b1 = std::make_shared<Variable>(matrix(8, 32, 0.0f));
+  auto w2 = std::make_shared<Variable>(matrix(32, 4, -50.0f).div(matrix(32, 4, 500.0f)));
+  auto h = std::make_shared<Tanh>(std::make_shared<Add>(std::make_shared<MatMul>(x, w1), b1));
+  auto y = std::make_shared<Sigmoid>(std::make_shared<MatMul>(h, w2));
+
+  Executor executor(y);
+  executor.step();
+  const std::vector<float> first = w1->grad.values();
+
+  reset_storage_stats();
+  executor.step();
+  executor.step();
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+
+  // Gradients are recomputed, not accumulated across steps.
+  EXPECT_EQ(w1->grad.values(), first);
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <type_traits>
+#include "graph.hh"
+
+using namespace upsilon;
+
+TEST(TensorStorageTest, CopyIsSharedUntilWritten) {
+  Tensor<float> a(TensorType::Matrix, {64, 64});
+  a.fill(1.f);
+
+  reset_storage_stats();
+  Tensor<float> b(a);
+  Tensor<float> c = b;
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_TRUE(a.shares_storage(b));
+  EXPECT_TRUE(a.shares_storage(c));
+
+  b.at(0, 0) = 2.f;
+  EXPECT_EQ(storage_stats().copies, 1);
+  EXPECT_FALSE(a.shares_storage(b));
+  EXPECT_TRUE(a.shares_storage(c));
+  EXPECT_EQ(a.at(0, 0), 1.f);
+  EXPECT_EQ(b.at(0, 0), 2.f);
+  EXPECT_EQ(c.at(0, 0), 1.f);
+
+  // The last holder of a buffer writes without cloning it.
+  c.fill(3.f);
+  a.fill(4.f);
+  EXPECT_EQ(storage_stats().copies, 2);
+}
+
+TEST(TensorStorageTest, ViewsFollowTheirOwnerOnDetach) {
+  Tensor<float> a(TensorType::Tensor, {2, 3, 4});
+  Tensor<float> b(a);
+  Tensor<float> channel = b.chip(1, 0);
+
+  channel.fill(5.f);
+  EXPECT_EQ(b.at(1, 2, 3), 5.f);
+  EXPECT_EQ(a.at(1, 2, 3), 0.f);
+
+  b.at(1, 0, 0) = 6.f;
+  EXPECT_EQ(channel.at(0, 0), 6.f);
+}
+
+TEST(TensorStorageTest, ReadingDoesNotCopy) {
+  Tensor<float> a(TensorType::Tensor, {4, 32, 32});
+  a.fill(1.f);
+
+  reset_storage_stats();
+  Span<const float> data = a.data();
+  float sum = 0;
+  for (float x : data) {
+    sum += x;
+  }
+  std::ostringstream os;
+  os << a << a.transposed();
+
+  EXPECT_EQ(sum, 4 * 32 * 32);
+  EXPECT_EQ(storage_stats().allocations, 0);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_THROW(a.transposed().data(), std::invalid_argument);
+}
+
+TEST(TensorStorageTest, ReadingThroughAtDoesNotCopy) {
+  Tensor<float> a(TensorType::Matrix, {64, 64});
+  a.fill(1.f);
+  Tensor<float> b(a);
+
+  reset_storage_stats();
+  float sum = 0;
+  for (uint32_t i = 0; i < 64; i++) {
+    sum += b.at(i, i) + b.at(i);
+  }
+  const float x = b.at(0, 0);
+  EXPECT_EQ(sum, 128.f);
+  EXPECT_EQ(x, 1.f);
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_TRUE(a.shares_storage(b));
+
+  b.at(1, 1) += 2.f;  // the first write detaches b
+  EXPECT_EQ(storage_stats().copies, 1);
+  EXPECT_FALSE(a.shares_storage(b));
+  EXPECT_EQ(b.at(1, 1), 3.f);
+  EXPECT_EQ(a.at(1, 1), 1.f);
+}
+
+// A value read through at() is a float, not a handle on the element.
+TEST(TensorStorageTest, ReadThenMutateThroughAt) {
+  static_assert(!std::is_copy_constructible<Tensor<float>::Element>::value, "at() must not be copied out");
+  Tensor<float> a(TensorType::Tensor, {2, 3, 4});
+  a.fill(1.f);
+  Tensor<float> b(a);
+
+  const float x = b.at(5), y = b.at(1, 2), z = b.at(1, 2, 3);
+  b.at(5) = 2.f;
+  b.at(1, 2) *= 3.f;
+  b.at(1, 2, 3) = b.at(5);
+  EXPECT_EQ(x, 1.f);
+  EXPECT_EQ(y, 1.f);
+  EXPECT_EQ(z, 1.f);
+  EXPECT_EQ(b.at(5), 2.f);
+  EXPECT_EQ(b.at(1, 2), 3.f);
+  EXPECT_EQ(b.at(1, 2, 3), 2.f);
+  EXPECT_EQ(a.at(5), 1.f);
+  EXPECT_EQ(a.at(1, 2), 1.f);
+  EXPECT_EQ(a.at(1, 2, 3), 1.f);
+}
+
+TEST(TensorStorageTest, ForwardPassDoesNoRedundantCopies) {
+  Tensor<float> x0(TensorType::Matrix, {256, 256});
+  Tensor<float> y0(TensorType::Matrix, {256, 256});
+  x0.fill(0.5f);
+  y0.fill(2.f);
+
+  auto x = std::make_shared<Variable>(std::move(x0));
+  auto y = std::make_shared<Variable>(std::move(y0));
+  auto z = std::make_shared<Tanh>(std::make_shared<Add>(std::make_shared<Mul>(x, y), x));
+  reset_storage_stats();
+
+  Executor executor(z);
+  executor.forward();
+  EXPECT_EQ(storage_stats().allocations, 3);  // one output each for Mul, Add, Tanh
+  EXPECT_EQ(storage_stats().copies, 0);
+
+  executor.backward();
+  EXPECT_EQ(storage_stats().copies, 0);
+  EXPECT_FLOAT_EQ(z->output.at(0), std::tanh(1.5f));
+}
+
+TEST(TensorStorageTest, EmptyTensorsHoldNoBuffer) {
+  reset_storage_stats();
+  Tensor<float> a(TensorType::Matrix, {0, 4});
+  Tensor<float> b = Tensor<float>(TensorType::Matrix, {2, 2}).release_();
+  EXPECT_EQ(storage_stats().allocations, 1);
+  EXPECT_EQ(a.size(), 0u);
+  EXPECT_FALSE(a.shares_storage(b));
+  b.resize_({3, 3}).fill_(1.0f);
+  EXPECT_FLOAT_EQ(b.at(2, 2), 1.0f);
+}
@@ -0,0 +1,131 @@
+#include "tensor.hh"
+#include "test_util.hh"
+
+#include <gtest/gtest.h>
+
+using namespace upsilon;
+
+TEST(TensorViewTest, ViewAliasesStorage) {
+  Tensor<float> t = ramp({2, 3, 4}, 0.f, 1.f);
+  Tensor<float> v = t.view({6, 4});
+  EXPECT_EQ(v.type(), TensorType::Matrix);
+  EXPECT_EQ(v.at(5, 3), 23.f);
+
+  v.at(5, 3) = -1.f;
+  EXPECT_EQ(t.at(1, 2, 3), -1.f);
+}
+
+TEST(TensorViewTest, CopyDoesNotAlias) {
+  Tensor<float> t = ramp({2, 3, 4}, 0.f, 1.f);
+  Tensor<float> copy(t);
+  copy.at(0) = 100.f;
+  EXPECT_EQ(t.at(0), 0.f);
+}
+
+TEST(TensorViewTest, Slice) {
+  Tensor<float> t = ramp({2, 3, 4}, 0.f, 1.f);
+  Tensor<float> s = t.slice(2, 1, 3);
+  ASSERT_EQ(s.shape(), (std::vector<uint32_t>{2, 3, 2}));
+  EXPECT_FALSE(s.is_contiguous());
+  for (uint32_t c = 0; c < 2; ++c) {
+    for (uint32_t r = 0; r < 3; ++r) {
+      for (uint32_t k = 0; k < 2; ++k) {
+        EXPECT_EQ(s.at(c, r, k), t.at(c, r, k + 1));
+      }
+    }
+  }
+
+  s.fill(7.f);
+  EXPECT_EQ(t.at(1, 2, 1), 7.f);
+  EXPECT_EQ(t.at(1, 2, 0), 23.f - 3);
+}
+
+TEST(TensorViewTest, Chip) {
+  Tensor<float> t = ramp({2, 3, 4}, 0.f, 1.f);
+  Tensor<float> channel = t.chip(1, 0);
+  ASSERT_EQ(channel.shape(), (std::vector<uint32_t>{3, 4}));
+  EXPECT_EQ(channel.at(2, 3), 23.f);
+
+  Tensor<float> column = t.chip(2, 2);
+  ASSERT_EQ(column.shape(), (std::vector<uint32_t>{2, 3}));
+  EXPECT_EQ(column.at(1, 1), t.at(1, 1, 2));
+}
+
+TEST(TensorViewTest, Permute) {
+  Tensor<float> t = ramp({2, 3, 4}, 0.f, 1.f);
+  Tensor<float> p = t.permute({2, 0, 1});
+  ASSERT_EQ(p.shape(), (std::vector<uint32_t>{4, 2, 3}));
+  for (uint32_t c = 0; c < 2; ++c) {
+    for (uint32_t r = 0; r < 3; ++r) {
+      for (uint32_t k = 0; k < 4; ++k) {
+        EXPECT_EQ(p.at(k, c, r), t.at(c, r, k));
+      }
+    }
+  }
+
+  EXPECT_THROW(t.permute({0, 0, 1}), std::invalid_argument);
+}
+
+TEST(TensorViewTest, TransposeIsStrided) {
+  Tensor<float> m(TensorType::Matrix, {2, 3});
+  m.fill({1, 2, 3, 4, 5, 6});
+
+  Tensor<float> mt = m.transposed();
+  EXPECT_FALSE(mt.is_contiguous());
+  EXPECT_EQ(mt.shape(), (std::vector<uint32_t>{3, 2}));
+  EXPECT_EQ(mt.values(), (std::vector<float>{1, 4, 2, 5, 3, 6}));
+
+  // Eigen reads the strided operand in place.
+  Tensor<float> gram = m.matmul(mt);
+  EXPECT_EQ(gram.values(), (std::vector<float>{14, 32, 32, 77}));
+
+  // reshape() of a non-contiguous tensor packs it first.
+  mt.reshape({6});
+  EXPECT_TRUE(mt.is_contiguous());
+  EXPECT_EQ(mt.values(), (std::vector<float>{1, 4, 2, 5, 3, 6}));
+}
+
+TEST(TensorViewTest, ElementwiseOnViews) {
+  Tensor<float> t = ramp({2, 3, 4}, 0.f, 1.f);
+  Tensor<float> a = t.chip(0, 0);
+  Tensor<float> b = t.chip(1, 0);
+  Tensor<float> sum = a.add(b);
+  for (uint32_t i = 0; i < sum.size(); ++i) {
+    EXPECT_EQ(sum.at(i), 2.f * i + 12.f);
+  }
+
+  Tensor<float> diff = a.transposed().sub(b.transposed());
+  for (uint32_t i = 0; i < diff.size(); ++i) {
+    EXPECT_EQ(diff.at(i), -12.f);
+  }
+}
+
+TEST(TensorViewTest, ReshapeIsInPlace) {
+  Tensor<float> t = ramp({2, 3, 4}, 0.f, 1.f);
+  Tensor<float> v = t.view({24});
+  t.reshape({4, 6});
+  EXPECT_EQ(t.type(), TensorType::Matrix);
+  t.at(3, 5) = 42.f;
+  EXPECT_EQ(v.at(23), 42.f);
+}
+
+TEST(TensorViewTest, PlacedTensorWritesIntoRegion) {
+  Tensor<float> big = ramp({3, 2, 2}, 0.f, 1.f);
+  Tensor<float> part = ramp({1, 2, 2}, 100.f, 1.f);
+  Tensor<float> region = big.slice(0, 1, 2);
+  region.copy_(part);
+  EXPECT_EQ(big.at(1, 1, 1), 103.f);
+
+  part.place_(region);
+  EXPECT_TRUE(part.placed());
+  part = part.lazy() * 2.0f;
+  EXPECT_EQ(big.at(1, 0, 0), 200.f);
+  part.resize_({1, 2, 2}).fill(-1.f);
+  EXPECT_EQ(big.at(1, 1, 1), -1.f);
+
+  // A new shape leaves the region alone.
+  part.resize_({2, 2, 2}).fill(5.f);
+  EXPECT_FALSE(part.placed());
+  EXPECT_EQ(big.at(1, 1, 1), -1.f);
+  EXPECT_THROW(part.place_(big.slice(2, 0, 1)), std::invalid_argument);
+}
@@ -7,6 +7,7 @@ def generate_test(name, src):
         includes = ["//src/core"],
         deps = [
             "//src/core:core",
+            "//tests:test_util",
             "@com_google_googletest//:gtest_main",
         ],
     )
@@ -0,0 +1,142 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "graph.hh"
+
+// Helpers shared by the tests. 2-D shapes give matrices, others tensors.
+
+// Values drawn uniformly from [lo, hi), the same for the same seed.
+inline upsilon::Tensor<float> random(const std::vector<uint32_t>& shape, float lo, float hi, uint32_t seed = 1) {
+  using upsilon::TensorType;
+  upsilon::Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> dist(lo, hi);
+  std::vector<float> values(t.size());
+  for (float& v : values) {
+    v = dist(rng);
+  }
+  t.fill(values);
+  return t;
+}
+
+// start + step * i for element i, or start + step * (i * stride % period)
+// when a period is given to keep the values of large tensors in range. A
+// stride coprime to the period visits the same values in scrambled order.
+inline upsilon::Tensor<float> ramp(const std::vector<uint32_t>& shape, float start, float step, uint32_t period = 0,
+                                   uint32_t stride = 1) {
+  using upsilon::TensorType;
+  upsilon::Tensor<float> t(shape.size() == 2 ? TensorType::Matrix : TensorType::Tensor, shape);
+  std::vector<float> values(t.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = start + step * static_cast<float>(period == 0 ? i : i * stride % period);
+  }
+  t.fill(values);
+  return t;
+}
+
+// Runs f once per instruction set the machine supports, scalar first.
+template <typename F>
+void for_each_isa(F&& f) {
+  namespace kernels = upsilon::kernels;
+  const kernels::Isa widest = kernels::supported_isa();
+  for (int isa = 0; isa <= static_cast<int>(widest); isa++) {
+    kernels::set_isa(static_cast<kernels::Isa>(isa));
+    SCOPED_TRACE(kernels::isa_name(kernels::active_isa()));
+    f();
+  }
+  kernels::set_isa(widest);
+}
+
+// Checks the gradients Executor::step() gives each input against central
+// differences with step h, within tol relative to the numeric gradient.
+// make_op builds the op under test on one Variable per input. The loss is
+// sum(op * r) for a fixed r that differs between neighbouring outputs, so
+// that gradients which sum to zero over a row still get checked.
+using OpFactory = std::function<std::shared_ptr<upsilon::Op>(const std::vector<std::shared_ptr<upsilon::Op>>&)>;
+
+inline void expect_gradients_match(const OpFactory& make_op, const std::vector<upsilon::Tensor<float>>& inputs,
+                                   float h, double tol = 2e-2) {
+  using namespace upsilon;
+  Tensor<float> r(0.0f);
+  auto make = [&](const std::vector<Tensor<float>>& values, std::vector<std::shared_ptr<Op>>* leaves) {
+    leaves->clear();
+    for (const Tensor<float>& v : values) {
+      leaves->push_back(std::make_shared<Variable>(Tensor<float>(v)));
+    }
+    std::shared_ptr<Op> op = make_op(*leaves);
+    Executor(op).forward();
+    if (!r.same_shape(op->output)) {
+      r = Tensor<float>::zeros_like(op->output);
+      std::vector<float> weights(r.size());
+      for (size_t i = 0; i < weights.size(); i++) {
+        weights[i] = 0.5f + 0.25f * static_cast<float>(i % 5);
+      }
+      r.fill(weights);
+    }
+    return std::make_shared<Mul>(op, std::make_shared<Variable>(Tensor<float>(r)));
+  };
+  auto loss = [&](const std::vector<Tensor<float>>& values) {
+    std::vector<std::shared_ptr<Op>> leaves;
+    auto z = make(values, &leaves);
+    Executor(z).forward();
+    return static_cast<double>(z->output.sum());
+  };
+
+  std::vector<std::shared_ptr<Op>> leaves;
+  Executor executor(make(inputs, &leaves));
+  executor.step();
+  for (size_t k = 0; k < inputs.size(); k++) {
+    const Tensor<float>& grad = leaves[k]->grad;
+    ASSERT_TRUE(grad.same_shape(inputs[k])) << "input " << k;
+    for (uint32_t i = 0; i < inputs[k].size(); i++) {
+      std::vector<Tensor<float>> plus = inputs, minus = inputs;
+      plus[k].at(i) += h;
+      minus[k].at(i) -= h;
+      const double numeric = (loss(plus) - loss(minus)) / (2 * h);
+      ASSERT_NEAR(grad.at(i), numeric, tol * std::max(1.0, std::abs(numeric))) << "input " << k << " at " << i;
+    }
+  }
+}
+
+// A small network under test: its input, its weights and a scalar loss.
+struct Net {
+  std::shared_ptr<upsilon::Variable> x;
+  std::vector<std::shared_ptr<upsilon::Variable>> weights;
+  std::vector<std::shared_ptr<upsilon::Op>> layers;  // activation of each layer, if recorded
+  std::shared_ptr<upsilon::Op> loss;
+};
+
+// sum(h * h) over a 2-D activation h, as a scalar loss for Net.
+inline std::shared_ptr<upsilon::Op> squared_sum(const std::shared_ptr<upsilon::Op>& h) {
+  using namespace upsilon;
+  return std::make_shared<Sum>(std::make_shared<Sum>(std::make_shared<Mul>(h, h), 1), 0);
+}
+
+// Gradients of every weight of net, then of its input.
+inline std::vector<std::vector<float>> grads(const Net& net) {
+  std::vector<std::vector<float>> result;
+  for (const auto& w : net.weights) {
+    result.push_back(w->grad.values());
+  }
+  result.push_back(net.x->grad.values());
+  return result;
+}
+
+inline std::string temp_path(const std::string& name) {
+  return testing::TempDir() + "/" + name;
+}
+
+// Points the tile cache that the first large GEMM writes (see
+// gemm::cache_path()) into the test's scratch directory instead of the
+// user's home, before any test runs.
+inline const bool gemm_cache_in_temp_dir = [] {
+  setenv("UPSILON_GEMM_CACHE", temp_path("gemm_tiles").c_str(), 1);
+  return true;
+}();
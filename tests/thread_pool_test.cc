@@ -0,0 +1,151 @@
+#include "thread_pool.hh"
+#include "tensor.hh"
+#include "test_util.hh"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace upsilon;
+
+TEST(ThreadPoolTest, CoversRangeExactlyOnce) {
+  ThreadPool pool(4);
+  for (size_t n : {0u, 1u, 7u, 1000u, 100003u}) {
+    std::vector<std::atomic<int>> hits(n);
+    pool.parallel_for(n, 64, [&](size_t begin, size_t end) {
+      ASSERT_LE(begin, end);
+      for (size_t i = begin; i < end; i++) {
+        hits[i]++;
+      }
+    });
+    for (size_t i = 0; i < n; i++) {
+      ASSERT_EQ(hits[i].load(), 1) << "n=" << n << " at " << i;
+    }
+  }
+}
+
+TEST(ThreadPoolTest, SmallRangesRunInline) {
+  ThreadPool pool(4);
+  size_t calls = 0;
+  pool.parallel_for(100, 100, [&](size_t begin, size_t end) {
+    EXPECT_EQ(begin, 0u);
+    EXPECT_EQ(end, 100u);
+    calls++;
+  });
+  EXPECT_EQ(calls, 1u);
+}
+
+TEST(ThreadPoolTest, NestedCallsComplete) {
+  ThreadPool pool(3);
+  std::atomic<size_t> total{0};
+  pool.parallel_for(16, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      pool.parallel_for(100, 1, [&](size_t b, size_t e) { total += e - b; });
+    }
+  });
+  EXPECT_EQ(total.load(), 1600u);
+}
+
+TEST(ThreadPoolTest, ExceptionsReachTheCaller) {
+  ThreadPool pool(4);
+  EXPECT_THROW(pool.parallel_for(1000, 1,
+                                 [&](size_t begin, size_t) {
+                                   if (begin == 0) {
+                                     throw std::runtime_error("chunk");
+                                   }
+                                 }),
+               std::runtime_error);
+
+  // Thrown on a worker while the caller is still inside its own chunk.
+  const std::thread::id caller = std::this_thread::get_id();
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  std::atomic<bool> thrown{false};
+  EXPECT_THROW(pool.parallel_for(1000, 1,
+                                 [&](size_t, size_t) {
+                                   if (std::this_thread::get_id() != caller) {
+                                     thrown = true;
+                                     throw std::runtime_error("worker");
+                                   }
+                                   while (!thrown && std::chrono::steady_clock::now() < deadline) {
+                                     std::this_thread::yield();
+                                   }
+                                 }),
+               std::runtime_error);
+
+  // The pool still splits work afterwards instead of running it inline.
+  std::atomic<size_t> calls{0};
+  pool.parallel_for(1000, 1, [&](size_t, size_t) { calls++; });
+  EXPECT_GT(calls.load(), 1u);
+}
+
+TEST(ThreadPoolTest, SetNumThreads) {
+  set_num_threads(3);
+  EXPECT_EQ(num_threads(), 3u);
+  set_num_threads(0);
+  EXPECT_EQ(num_threads(), 1u);
+}
+
+TEST(ThreadPoolTest, TensorOpsMatchSingleThreaded) {
+  Tensor<float> a(TensorType::Tensor, {4, 130, 190});
+  Tensor<float> b(TensorType::Tensor, {4, 130, 190});
+  for (uint32_t i = 0; i < a.size(); i++) {
+    a.at(i) = 0.001f * (i % 997) - 0.4f;
+    b.at(i) = 1.0f + 0.01f * (i % 13);
+  }
+  Tensor<float> m(TensorType::Matrix, {300, 200});
+  Tensor<float> w(TensorType::Matrix, {200, 250});
+  m.fill(0.5f);
+  for (uint32_t i = 0; i < w.size(); i++) {
+    w.at(i) = 0.01f * (i % 31);
+  }
+
+  auto run = [&] {
+    std::vector<Tensor<float>> results;
+    results.push_back(a.add(b));
+    results.push_back(a.transposed().mul(b.transposed()));
+    results.push_back(Tensor<float>(a.lazy() * b.lazy() + 1.0f));
+    results.push_back(a.apply([](float x) { return 2.0f * x; }));
+    Tensor<float> padded = a;
+    padded.padding({1, 2, 3, 4}, -1.0f);
+    results.push_back(padded);
+    results.push_back(m.matmul(w));
+    results.push_back(m.slice(0, 0, 2).matmul(w));
+    results.push_back(Tensor<float>(a.sum()));
+    return results;
+  };
+
+  set_num_threads(1);
+  const auto expected = run();
+  set_num_threads(4);
+  const auto actual = run();
+  set_num_threads(1);
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t r = 0; r < expected.size(); r++) {
+    ASSERT_EQ(expected[r].shape(), actual[r].shape());
+    // Eigen may block a matmul band differently from the whole product.
+    const auto e = expected[r].values();
+    const auto v = actual[r].values();
+    for (size_t i = 0; i < e.size(); i++) {
+      ASSERT_NEAR(e[i], v[i], 1e-5f * std::abs(e[i])) << "result " << r << " at " << i;
+    }
+  }
+}
+
+TEST(ThreadPoolTest, SumMatchesSerialSum) {
+  Tensor<float> a(TensorType::Matrix, {1, 100001});
+  double expected = 0;
+  for (uint32_t i = 0; i < a.size(); i++) {
+    a.at(i) = static_cast<float>(i % 7);
+    expected += i % 7;
+  }
+  set_num_threads(4);
+  EXPECT_FLOAT_EQ(a.sum(), static_cast<float>(expected));
+  EXPECT_FLOAT_EQ(a.transposed().sum(), static_cast<float>(expected));
+  set_num_threads(1);
+}
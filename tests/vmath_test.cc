@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include "op.hh"
+#include "test_util.hh"
+
+using namespace upsilon;
+
+static int64_t ulp_distance(float a, float b) {
+  if (std::isnan(a) && std::isnan(b)) {
+    return 0;
+  }
+  if (a == b) {
+    return 0;
+  }
+  auto ordered = [](float f) {
+    int32_t i;
+    std::memcpy(&i, &f, sizeof(i));
+    return i < 0 ? int64_t(INT32_MIN) - i : int64_t(i);
+  };
+  return std::llabs(ordered(a) - ordered(b));
+}
+
+// Every 1021st float in [lo, hi], evaluated on every available ISA.
+template <typename Make, typename Reference>
+static void check_ulp(float lo, float hi, Make make, Reference reference, int64_t max_ulp) {
+  std::vector<float> xs;
+  for (uint32_t bits = 0; bits < 0x7f800000u; bits += 1021) {
+    for (uint32_t sign : {0u, 0x80000000u}) {
+      const uint32_t b = bits | sign;
+      float x;
+      std::memcpy(&x, &b, sizeof(x));
+      if (x >= lo && x <= hi) {
+        xs.push_back(x);
+      }
+    }
+  }
+  std::vector<float> out(xs.size());
+  const std::vector<uint32_t> shape{static_cast<uint32_t>(xs.size())};
+
+  for_each_isa([&] {
+    kernels::evaluate(make(expr::Ref(xs.data(), &shape)), out.data(), xs.size());
+    for (size_t i = 0; i < xs.size(); ++i) {
+      const float expected = static_cast<float>(reference(static_cast<double>(xs[i])));
+      ASSERT_LE(ulp_distance(out[i], expected), max_ulp)
+          << "x=" << xs[i] << " got " << out[i] << " expected " << expected;
+    }
+  });
+}
+
+TEST(VMathTest, ExpUlp) {
+  check_ulp(-87.3365f, 88.7228f, [](auto x) { return expr::exp(x); }, [](double x) { return std::exp(x); }, 1);
+}
+
+TEST(VMathTest, LogUlp) {
+  check_ulp(0.0f, std::numeric_limits<float>::max(), [](auto x) { return expr::log(x); },
+            [](double x) { return std::log(x); }, 1);
+}
+
+TEST(VMathTest, TanhUlp) {
+  check_ulp(-9.0f, 9.0f, [](auto x) { return expr::tanh(x); }, [](double x) { return std::tanh(x); }, 1);
+}
+
+TEST(VMathTest, SigmoidUlp) {
+  check_ulp(-87.0f, 87.0f, [](auto x) { return expr::sigmoid(x); },
+            [](double x) { return 1.0 / (1.0 + std::exp(-x)); }, 2);
+}
+
+TEST(VMathTest, SpecialValues) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  Tensor<float> x(TensorType::Matrix, {1, 8});
+  x.fill({-inf, -200.f, -0.f, 0.f, 1e-40f, 200.f, inf, nan});
+
+  const std::vector<float> e = x.exp().values();
+  EXPECT_EQ(e[0], 0.f);
+  EXPECT_EQ(e[1], 0.f);
+  EXPECT_EQ(e[2], 1.f);
+  EXPECT_EQ(e[5], inf);
+  EXPECT_EQ(e[6], inf);
+  EXPECT_TRUE(std::isnan(e[7]));
+
+  const std::vector<float> l = x.log().values();
+  EXPECT_TRUE(std::isnan(l[0]));
+  EXPECT_EQ(l[3], -inf);
+  EXPECT_NEAR(l[4], std::log(1e-40), 1e-4);
+  EXPECT_EQ(l[6], inf);
+  EXPECT_TRUE(std::isnan(l[7]));
+
+  const std::vector<float> t = x.tanh().values();
+  EXPECT_EQ(t[0], -1.f);
+  EXPECT_EQ(t[1], -1.f);
+  EXPECT_TRUE(std::signbit(t[2]));
+  EXPECT_EQ(t[5], 1.f);
+  EXPECT_TRUE(std::isnan(t[7]));
+
+  const std::vector<float> s = x.sigmoid().values();
+  EXPECT_EQ(s[0], 0.f);
+  EXPECT_EQ(s[3], 0.5f);
+  EXPECT_EQ(s[6], 1.f);
+}
+
+TEST(VMathTest, ApplyInlinesAnyCallable) {
+  Tensor<float> x(TensorType::Tensor, {2, 3, 4});
+  x.fill(3.f);
+  const float offset = 0.5f;
+  Tensor<float> a = x.apply([offset](float v) { return v * v + offset; });
+  Tensor<float> b = x.transposed().apply(std::function<float(float)>([](float v) { return -v; }));
+  Tensor<float> p = x.pow(3.f);
+  for (uint32_t i = 0; i < x.size(); ++i) {
+    EXPECT_EQ(a.at(i), 9.5f);
+    EXPECT_EQ(b.at(i), -3.f);
+    EXPECT_EQ(p.at(i), 27.f);
+  }
+}
+
+TEST(VMathTest, ActivationOps) {
+  Tensor<float> values(TensorType::Matrix, {1, 5});
+  values.fill({-2.f, -0.5f, 0.f, 0.5f, 2.f});
+  auto x = std::make_shared<Variable>(std::move(values));
+  auto tanh = std::make_shared<Tanh>(x);
+  auto sigmoid = std::make_shared<Sigmoid>(x);
+  auto relu = std::make_shared<ReLU>(x);
+  tanh->forward();
+  sigmoid->forward();
+  relu->forward();
+  for (uint32_t i = 0; i < 5; ++i) {
+    const float v = x->output.at(i);
+    EXPECT_FLOAT_EQ(tanh->output.at(i), std::tanh(v));
+    EXPECT_FLOAT_EQ(sigmoid->output.at(i), 1.f / (1.f + std::exp(-v)));
+    EXPECT_EQ(relu->output.at(i), std::max(v, 0.f));
+  }
+}